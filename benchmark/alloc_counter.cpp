@@ -0,0 +1,46 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "alloc_counter.h"
+
+#include <stddef.h>
+
+#include <atomic>
+
+// glibc内部分配函数，用于包装malloc统计分配次数，Qt容器与operator new最终都会调用到这里
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+static std::atomic<quint64> allocations(0);
+
+extern "C" void *malloc(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+/*
+ * 获取进程启动以来堆内存分配次数(malloc/calloc/realloc)
+ *
+ * @return quint64: 分配次数
+ */
+quint64 allocationCount()
+{
+    return allocations.load(std::memory_order_relaxed);
+}
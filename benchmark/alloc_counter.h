@@ -0,0 +1,18 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_DBUS_PROXY_BENCHMARK_ALLOC_COUNTER_H
+#define LINGLONG_DBUS_PROXY_BENCHMARK_ALLOC_COUNTER_H
+
+#include <QtGlobal>
+
+/*
+ * 获取进程启动以来堆内存分配次数(malloc/calloc/realloc)
+ *
+ * @return quint64: 分配次数
+ */
+quint64 allocationCount();
+#endif
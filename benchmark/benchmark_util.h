@@ -0,0 +1,184 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_DBUS_PROXY_BENCHMARK_BENCHMARK_UTIL_H
+#define LINGLONG_DBUS_PROXY_BENCHMARK_BENCHMARK_UTIL_H
+
+#include <dbus/dbus.h>
+
+#include <QByteArray>
+#include <QString>
+#include <QtEndian>
+
+#include "message/dbus_message.h"
+
+/*
+ * 使用libdbus生成一条method call报文
+ *
+ * @param serial: 报文序列号
+ * @param dest: 报文目标地址
+ * @param path: 报文路径
+ * @param iface: 报文interface
+ * @param member: 报文方法名
+ * @param bodySize: 报文body中字节数组的长度，0表示无body
+ *
+ * @return QByteArray: 报文字节数组
+ */
+inline QByteArray marshalMethodCall(quint32 serial, const char *dest, const char *path, const char *iface,
+                                    const char *member, int bodySize = 0)
+{
+    DBusMessage *msg = dbus_message_new_method_call(dest, path, iface, member);
+    if (bodySize > 0) {
+        QByteArray body(bodySize, 'x');
+        const char *data = body.constData();
+        dbus_message_append_args(msg, DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE, &data, bodySize, DBUS_TYPE_INVALID);
+    }
+    dbus_message_set_serial(msg, serial);
+    char *buffer = nullptr;
+    int len = 0;
+    dbus_message_marshal(msg, &buffer, &len);
+    QByteArray ret(buffer, len);
+    dbus_free(buffer);
+    dbus_message_unref(msg);
+    return ret;
+}
+
+/*
+ * 使用libdbus生成一条signal报文
+ *
+ * @param serial: 报文序列号
+ * @param path: 报文路径
+ * @param iface: 报文interface
+ * @param member: 信号名
+ *
+ * @return QByteArray: 报文字节数组
+ */
+inline QByteArray marshalSignal(quint32 serial, const char *path, const char *iface, const char *member)
+{
+    DBusMessage *msg = dbus_message_new_signal(path, iface, member);
+    const char *arg = "org.deepin.demo";
+    dbus_message_append_args(msg, DBUS_TYPE_STRING, &arg, DBUS_TYPE_INVALID);
+    dbus_message_set_serial(msg, serial);
+    char *buffer = nullptr;
+    int len = 0;
+    dbus_message_marshal(msg, &buffer, &len);
+    QByteArray ret(buffer, len);
+    dbus_free(buffer);
+    dbus_message_unref(msg);
+    return ret;
+}
+
+/*
+ * 生成count条连续的method call报文，模拟一次读取到的突发数据
+ *
+ * @param count: 报文条数
+ *
+ * @return QByteArray: 报文字节数组
+ */
+inline QByteArray methodCallBurst(int count)
+{
+    QByteArray burst;
+    for (int i = 0; i < count; i++) {
+        burst.append(marshalMethodCall(static_cast<quint32>(i + 1), "com.deepin.linglong.AppManager",
+                                       "/com/deepin/linglong/PackageManager", "com.deepin.linglong.PackageManager",
+                                       "Status"));
+    }
+    return burst;
+}
+/*
+ * 旧版本的字节数组转整形实现，每个整数都需要先mid出一个QByteArray，作为对比基准
+ *
+ * @param arr: 报文字节数组
+ * @param isBigEndian: 是否为大端序
+ *
+ * @return int: 转化结果
+ */
+inline int legacyByteAraryToInt(const QByteArray &arr, bool isBigEndian)
+{
+    if (arr.size() < 4) {
+        return -1;
+    }
+    int ret = 0;
+    if (isBigEndian) {
+        ret = (arr.at(0) << 24) & 0xFF000000;
+        ret |= (arr.at(1) << 16) & 0x00FF0000;
+        ret |= arr.at(2) << 8 & 0x0000FF00;
+        ret |= arr.at(3) & 0x000000FF;
+    } else {
+        ret = arr.at(0) & 0x000000FF;
+        ret |= (arr.at(1) << 8) & 0x0000FF00;
+        ret |= (arr.at(2) << 16) & 0x00FF0000;
+        ret |= (arr.at(3) << 24) & 0xFF000000;
+    }
+    return ret;
+}
+
+/*
+ * 将报文中指定位置的UINT32由小端序转换为大端序
+ *
+ * @param msg: 报文
+ * @param pos: UINT32位置
+ *
+ * @return quint32: 转换前的值
+ */
+inline quint32 swapUInt32(QByteArray *msg, quint32 pos)
+{
+    const quint32 value = qFromLittleEndian<quint32>(msg->constData() + pos);
+    qToBigEndian<quint32>(value, msg->data() + pos);
+    return value;
+}
+
+/*
+ * 将libdbus生成的小端序报文转换为大端序，body只支持由s和ay组成的签名
+ *
+ * @param msg: 小端序报文
+ *
+ * @return QByteArray: 大端序报文
+ */
+inline QByteArray toBigEndianMsg(const QByteArray &msg)
+{
+    QByteArray ret = msg;
+    ret[0] = 'B';
+    swapUInt32(&ret, 4);
+    swapUInt32(&ret, 8);
+    const quint32 arrayLen = swapUInt32(&ret, 12);
+    const quint32 endOffset = 16 + arrayLen;
+    QByteArray signature;
+    quint32 offset = 16;
+    while (offset < endOffset) {
+        offset = alignBy8(offset);
+        const char code = ret[offset];
+        const char type = ret[offset + 2];
+        offset += 4;
+        if (type == 's' || type == 'o') {
+            offset = alignBy4(offset);
+            offset += swapUInt32(&ret, offset) + 5;
+        } else if (type == 'u') {
+            offset = alignBy4(offset);
+            swapUInt32(&ret, offset);
+            offset += 4;
+        } else {
+            const quint32 len = static_cast<uchar>(ret[offset]);
+            if (code == (char)DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_SIGNATURE) {
+                signature = ret.mid(static_cast<int>(offset) + 1, static_cast<int>(len));
+            }
+            offset += len + 2;
+        }
+    }
+    // body中的字符串和字节数组长度
+    offset = alignBy8(endOffset);
+    for (int i = 0; i < signature.size(); i++) {
+        offset = alignBy4(offset);
+        offset += swapUInt32(&ret, offset) + 4;
+        if (signature[i] == 's') {
+            offset += 1;
+        } else {
+            i++;
+        }
+    }
+    return ret;
+}
+#endif
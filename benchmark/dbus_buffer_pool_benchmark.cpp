@@ -0,0 +1,161 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "alloc_counter.h"
+#include "benchmark_util.h"
+#include "message/dbus_buffer_pool.h"
+#include "message/dbus_frame_reader.h"
+#include "message/dbus_header_view.h"
+#include "proxy/dbus_output_queue.h"
+
+// 多个连接轮流收到一批消息时，按代理的转发步骤读取、切分、解析报文头并合并发送的内存分配次数与空闲连接占用的接收缓冲区
+namespace {
+
+// 连接数
+const int kSessions = 256;
+// 每个连接每轮收到的消息数
+const int kBurst = 64;
+// 代理读取box客户端时解析的报文头字段
+const quint32 kFilterFields = headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_DESTINATION)
+    | headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_PATH)
+    | headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_INTERFACE);
+
+/*
+ * 模拟dbus-daemon，在独立线程中读取所有连接转发的数据
+ */
+class Sink
+{
+public:
+    Sink()
+    {
+        socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+        reader = std::thread([this]() {
+            char buf[64 * 1024];
+            while (::read(fds[1], buf, sizeof(buf)) > 0) {
+            }
+        });
+    }
+
+    ~Sink()
+    {
+        ::shutdown(fds[0], SHUT_WR);
+        reader.join();
+        ::close(fds[0]);
+        ::close(fds[1]);
+    }
+
+    int writeFd() const { return fds[0]; }
+
+private:
+    int fds[2];
+    std::thread reader;
+};
+
+// 一个连接：box客户端写入端、代理读取的socket、消息重组器与发往dbus-daemon的发送队列
+struct Session {
+    explicit Session(int sinkFd)
+    {
+        int pair[2];
+        socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+        clientFd = pair[0];
+        boxSocket.setSocketDescriptor(pair[1]);
+        daemonSocket.setSocketDescriptor(::dup(sinkFd));
+        queue.reset(new DBusOutputQueue(&daemonSocket, 4 * 1024 * 1024, 1024 * 1024));
+        reader.startBinaryMode();
+    }
+
+    ~Session()
+    {
+        queue.reset();
+        ::close(clientFd);
+    }
+
+    int clientFd;
+    DBusSocket boxSocket;
+    DBusSocket daemonSocket;
+    QScopedPointer<DBusOutputQueue> queue;
+    DBusFrameReader reader;
+};
+
+/*
+ * 按代理的转发步骤处理一个连接的可读数据
+ *
+ * @param session: 连接
+ * @param pooled: 是否在分发结束后归还接收缓冲区
+ */
+void dispatch(Session *session, bool pooled)
+{
+    DBusFrame frame;
+    while (session->boxSocket.bytesAvailable() > 0) {
+        session->reader.readFrom(&session->boxSocket);
+        while (session->reader.nextFrame(&frame)) {
+            DBusHeaderView header;
+            header.parsePartial(frame.data, frame.size, frame.messageSize, kFilterFields);
+            benchmark::DoNotOptimize(header.destination());
+            session->queue->enqueue(frame.data, frame.size);
+        }
+        session->queue->flush();
+    }
+    if (pooled) {
+        session->reader.releaseBuffer();
+    }
+}
+
+} // namespace
+
+// 参数：是否使用共享缓冲池
+static void BM_SessionDispatchAllocs(benchmark::State &state)
+{
+    const bool pooled = state.range(0) != 0;
+    QByteArray burst;
+    for (int i = 0; i < kBurst; i++) {
+        burst.append(marshalMethodCall(static_cast<quint32>(i + 1), "org.deepin.linglong.demo",
+                                       "/org/deepin/linglong/demo", "org.deepin.linglong.demo", "Ping", 128));
+    }
+    Sink sink;
+    QSharedPointer<DBusBufferPool> pool(new DBusBufferPool(64 * 1024, 256));
+    std::vector<std::unique_ptr<Session>> sessions;
+    for (int i = 0; i < kSessions; i++) {
+        sessions.emplace_back(new Session(sink.writeFd()));
+        if (pooled) {
+            sessions.back()->reader.setBufferPool(pool);
+        }
+    }
+    // 第一轮之后各连接的缓冲区与发送批次都已分配，只统计稳定状态
+    quint64 allocations = 0;
+    bool warm = false;
+    for (auto _ : state) {
+        const quint64 before = allocationCount();
+        for (const std::unique_ptr<Session> &session : sessions) {
+            ::write(session->clientFd, burst.constData(), static_cast<size_t>(burst.size()));
+            dispatch(session.get(), pooled);
+        }
+        if (warm) {
+            allocations += allocationCount() - before;
+        }
+        warm = true;
+    }
+    // 每轮分发结束后连接都处于空闲状态，统计仍被占用的接收缓冲区
+    qint64 retained = 0;
+    for (const std::unique_ptr<Session> &session : sessions) {
+        retained += session->reader.capacity();
+    }
+    const double messages = static_cast<double>(qMax<qint64>(state.iterations() - 1, 1)) * kSessions * kBurst;
+    state.counters["allocs/msg"] = static_cast<double>(allocations) / messages;
+    state.counters["idleKiB"] = static_cast<double>(retained) / 1024;
+    state.counters["poolChunks"] = pool->metrics().lentChunks + pool->metrics().freeChunks;
+    state.SetItemsProcessed(state.iterations() * kSessions * kBurst);
+}
+BENCHMARK(BM_SessionDispatchAllocs)->Arg(0)->Arg(1)->ArgName("pooled")->Unit(benchmark::kMillisecond);
@@ -0,0 +1,101 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+
+#include "benchmark_util.h"
+#include "message/dbus_frame_reader.h"
+
+// box客户端发送大消息（如传输图片、文件内容）时，转发首字节的延迟与重组缓冲区占用的内存
+namespace {
+
+// 每次从socket读取的数据量
+const int kSocketReadSize = 64 * 1024;
+// 与代理使用的直通阈值一致
+const quint32 kCutThroughThreshold = 1024 * 1024;
+
+// 单个数组的长度上限为64MiB，大消息的body拆成多个字节数组
+const int kChunkArraySize = 32 * 1024 * 1024;
+
+/*
+ * 获取指定大小的method call报文，同一大小只生成一次
+ *
+ * @param megabytes: body大小，MiB
+ *
+ * @return const QByteArray &: 报文字节数组
+ */
+const QByteArray &largeMessage(int megabytes)
+{
+    static QByteArray cache[101];
+    QByteArray &ret = cache[megabytes];
+    if (!ret.isEmpty()) {
+        return ret;
+    }
+    DBusMessage *msg =
+        dbus_message_new_method_call("com.deepin.linglong.AppManager", "/com/deepin/linglong/PackageManager",
+                                     "com.deepin.linglong.PackageManager", "Import");
+    const QByteArray chunk(kChunkArraySize, 'x');
+    const char *data = chunk.constData();
+    for (int remain = megabytes * 1024 * 1024; remain > 0; remain -= kChunkArraySize) {
+        const int size = qMin(remain, kChunkArraySize);
+        dbus_message_append_args(msg, DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE, &data, size, DBUS_TYPE_INVALID);
+    }
+    dbus_message_set_serial(msg, 1);
+    char *buffer = nullptr;
+    int len = 0;
+    dbus_message_marshal(msg, &buffer, &len);
+    ret = QByteArray(buffer, len);
+    dbus_free(buffer);
+    dbus_message_unref(msg);
+    return ret;
+}
+
+} // namespace
+
+// 参数：整条消息存储转发(0)/报文头到达后直通转发(1)，body大小MiB
+static void BM_LargeMessageForward(benchmark::State &state)
+{
+    const bool cutThrough = state.range(0) != 0;
+    const QByteArray &msg = largeMessage(static_cast<int>(state.range(1)));
+    double firstByteTotal = 0;
+    int peakCapacity = 0;
+    quint64 forwarded = 0;
+    for (auto _ : state) {
+        DBusFrameReader reader;
+        reader.setCutThroughThreshold(cutThrough ? kCutThroughThreshold : 0);
+        reader.append("BEGIN\r\n", 7);
+        DBusFrame frame;
+        reader.nextFrame(&frame);
+        bool firstByte = false;
+        const auto start = std::chrono::steady_clock::now();
+        for (int offset = 0; offset < msg.size(); offset += kSocketReadSize) {
+            reader.append(msg.constData() + offset, qMin(kSocketReadSize, msg.size() - offset));
+            while (reader.nextFrame(&frame)) {
+                if (!firstByte) {
+                    firstByte = true;
+                    firstByteTotal +=
+                        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                }
+                forwarded += frame.size;
+                benchmark::DoNotOptimize(frame.data);
+            }
+            peakCapacity = qMax(peakCapacity, reader.capacity());
+        }
+    }
+    if (forwarded != static_cast<quint64>(state.iterations()) * static_cast<quint64>(msg.size())) {
+        state.SkipWithError("forwarded size mismatch");
+        return;
+    }
+    state.counters["first_byte_us"] = firstByteTotal * 1e6 / static_cast<double>(state.iterations());
+    state.counters["peak_buffer_KiB"] = peakCapacity / 1024.0;
+    state.SetBytesProcessed(state.iterations() * msg.size());
+}
+BENCHMARK(BM_LargeMessageForward)
+    ->ArgsProduct({{0, 1}, {1, 10, 100}})
+    ->ArgNames({"cut_through", "MiB"})
+    ->Unit(benchmark::kMillisecond);
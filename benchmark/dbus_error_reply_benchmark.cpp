@@ -0,0 +1,128 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "alloc_counter.h"
+#include "benchmark_util.h"
+#include "filter/dbus_filter.h"
+#include "message/dbus_error_reply.h"
+#include "message/dbus_frame_reader.h"
+#include "message/dbus_header_view.h"
+
+// 沙箱应用反复调用被拒绝的接口时的处理开销：切分、解析、过滤并回复AccessDenied
+namespace {
+
+const char *const kDeniedName = "com.deepin.linglong.AppManager";
+const char *const kDeniedPath = "/com/deepin/linglong/PackageManager";
+const char *const kDeniedInterface = "com.deepin.linglong.PackageManager";
+const char *const kBoxClientAddr = ":1.585";
+const char *const kErrorName = "org.freedesktop.DBus.Error.AccessDenied";
+const char *const kErrorMsg = "org.freedesktop.DBus.Error.AccessDenied, please config permission first!";
+
+/*
+ * 旧版本createFakeReplyMsg的实现，经libdbus反序列化请求、创建错误消息再序列化，作为对比基准
+ *
+ * @param byteMsg: 请求报文
+ * @param serial: 回复报文序列号
+ *
+ * @return QByteArray: 回复报文
+ */
+QByteArray legacyCreateFakeReplyMsg(const QByteArray &byteMsg, quint32 serial)
+{
+    DBusError dbErr;
+    dbus_error_init(&dbErr);
+    DBusMessage *receiveMsg = dbus_message_demarshal(byteMsg.constData(), byteMsg.size(), &dbErr);
+    if (!receiveMsg) {
+        dbus_error_free(&dbErr);
+        return QByteArray();
+    }
+    const std::string name = QString(kErrorName).toStdString();
+    const std::string msg = QString(kErrorMsg).toStdString();
+    DBusMessage *reply = dbus_message_new_error(receiveMsg, name.c_str(), msg.c_str());
+    const std::string destination = QString(kBoxClientAddr).toStdString();
+    dbus_message_set_destination(reply, destination.c_str());
+    dbus_message_set_serial(reply, serial);
+    char *replyAsc = nullptr;
+    int len = 0;
+    dbus_message_marshal(reply, &replyAsc, &len);
+    QByteArray data(replyAsc, len);
+    dbus_free(replyAsc);
+    dbus_message_unref(receiveMsg);
+    dbus_message_unref(reply);
+    return data;
+}
+
+} // namespace
+
+// 单条请求生成回复，0为旧实现，1为预编码模板
+static void BM_ErrorReplySingle(benchmark::State &state)
+{
+    const bool native = state.range(0) != 0;
+    const QByteArray msg = marshalMethodCall(7, kDeniedName, kDeniedPath, kDeniedInterface, "Status", 64);
+    DBusHeaderView header;
+    header.parse(msg.constData(), static_cast<quint32>(msg.size()));
+    QByteArray out;
+    out.reserve(512);
+    const quint64 before = allocationCount();
+    for (auto _ : state) {
+        if (native) {
+            out.resize(0);
+            accessDeniedReply().appendTo(header, header.serial + 1, QLatin1String(kBoxClientAddr), &out);
+            benchmark::DoNotOptimize(out.constData());
+        } else {
+            benchmark::DoNotOptimize(legacyCreateFakeReplyMsg(msg, header.serial + 1));
+        }
+    }
+    state.counters["allocs/msg"] =
+        benchmark::Counter(static_cast<double>(allocationCount() - before), benchmark::Counter::kAvgIterations);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ErrorReplySingle)->Arg(0)->Arg(1);
+
+// 一次读取到count条被拒绝的请求，逐条切分、解析、过滤并回复，0为旧实现，1为预编码模板
+static void BM_DenyBurst(benchmark::State &state)
+{
+    const bool native = state.range(0) != 0;
+    const int count = static_cast<int>(state.range(1));
+    const QByteArray burst = methodCallBurst(count);
+    DbusFilter filter;
+    filter.addNameFilter(kDeniedName);
+    filter.addPathFilter(kDeniedPath);
+    filter.addInterfaceFilter(kDeniedInterface);
+    DBusFrameReader reader;
+    reader.append("BEGIN\r\n", 7);
+    DBusFrame frame;
+    reader.nextFrame(&frame);
+    QByteArray out;
+    out.reserve(512);
+    qint64 replyBytes = 0;
+    const quint64 before = allocationCount();
+    for (auto _ : state) {
+        reader.append(burst.constData(), burst.size());
+        while (reader.nextFrame(&frame)) {
+            DBusHeaderView header;
+            header.parse(frame.data, frame.size, filter.requiredHeaderFields());
+            if (!filter.isMessageMatch(header.destination(), header.path(), header.interface())) {
+                continue;
+            }
+            if (native) {
+                out.resize(0);
+                accessDeniedReply().appendTo(header, header.serial + 1, QLatin1String(kBoxClientAddr), &out);
+                replyBytes += out.size();
+            } else {
+                replyBytes += legacyCreateFakeReplyMsg(frame.toByteArray(), header.serial + 1).size();
+            }
+        }
+    }
+    benchmark::DoNotOptimize(replyBytes);
+    state.counters["allocs/msg"] = benchmark::Counter(static_cast<double>(allocationCount() - before)
+                                                          / static_cast<double>(count),
+                                                      benchmark::Counter::kAvgIterations);
+    state.SetItemsProcessed(state.iterations() * count);
+    state.SetBytesProcessed(state.iterations() * burst.size());
+}
+BENCHMARK(BM_DenyBurst)->Args({0, 1000})->Args({1, 1000});
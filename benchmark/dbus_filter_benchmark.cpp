@@ -0,0 +1,120 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <QRegExp>
+
+#include "filter/dbus_rule_matcher.h"
+
+// 规则数增长时单个字段的匹配开销：逐条规则构造QRegExp查找与编译后的匹配器
+namespace {
+
+/*
+ * 生成规则列表，一半为精确规则，一半为以*结尾的正则规则
+ *
+ * @param count: 规则数
+ *
+ * @return QStringList: 规则列表
+ */
+QStringList makeRules(int count)
+{
+    QStringList ret;
+    for (int i = 0; i < count; i++) {
+        if (i % 2 == 0) {
+            ret.append(QString("com.vendor%1.Service").arg(i));
+        } else {
+            ret.append(QString("com.vendor%1.App.*").arg(i));
+        }
+    }
+    return ret;
+}
+
+/*
+ * 生成输入名称，交替为命中精确规则、命中正则规则与不命中
+ *
+ * @param count: 规则数
+ *
+ * @return QStringList: 输入名称
+ */
+QStringList makeNames(int count)
+{
+    QStringList ret;
+    for (int i = 0; i < 64; i++) {
+        const int rule = (i * 7919) % count;
+        switch (i % 3) {
+        case 0:
+            ret.append(QString("com.vendor%1.Service").arg(rule & ~1));
+            break;
+        case 1:
+            ret.append(QString("com.vendor%1.App.Window").arg(rule | 1));
+            break;
+        default:
+            ret.append(QString("org.other%1.Service").arg(rule));
+            break;
+        }
+    }
+    return ret;
+}
+
+// 原有实现：每次匹配遍历规则列表，为每条正则规则构造QRegExp
+bool isMatchLegacy(const QString &data, const QStringList &rules)
+{
+    for (const QString &item : rules) {
+        if (item == data || (DBusRuleMatcher::isPattern(item) && data.contains(QRegExp(item)))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+// 参数：规则数
+static void BM_FilterLegacy(benchmark::State &state)
+{
+    const QStringList rules = makeRules(static_cast<int>(state.range(0)));
+    const QStringList names = makeNames(rules.size());
+    int index = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(isMatchLegacy(names[index], rules));
+        index = (index + 1) % names.size();
+    }
+}
+BENCHMARK(BM_FilterLegacy)->Arg(10)->Arg(1000)->ArgName("rules");
+
+// 参数：规则数
+static void BM_FilterCompiled(benchmark::State &state)
+{
+    const QStringList rules = makeRules(static_cast<int>(state.range(0)));
+    const QStringList names = makeNames(rules.size());
+    QVector<QByteArray> latin;
+    for (const QString &name : names) {
+        latin.append(name.toLatin1());
+    }
+    const DBusRuleMatcher matcher(rules);
+    int index = 0;
+    for (auto _ : state) {
+        const QByteArray &name = latin[index];
+        benchmark::DoNotOptimize(matcher.isMatch(QLatin1String(name.constData(), name.size())));
+        index = (index + 1) % latin.size();
+    }
+    const DBusRuleMatcherMetrics metrics = matcher.metrics();
+    state.counters["dfa_states"] = metrics.dfaStates;
+    state.counters["byte_classes"] = metrics.byteClasses;
+}
+BENCHMARK(BM_FilterCompiled)->Arg(10)->Arg(1000)->Arg(50000)->ArgName("rules");
+
+// 参数：规则数
+static void BM_FilterCompile(benchmark::State &state)
+{
+    const QStringList rules = makeRules(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        DBusRuleMatcher matcher(rules);
+        benchmark::DoNotOptimize(matcher.metrics().dfaStates);
+    }
+}
+BENCHMARK(BM_FilterCompile)->Arg(10)->Arg(1000)->Arg(50000)->ArgName("rules")->Unit(benchmark::kMillisecond);
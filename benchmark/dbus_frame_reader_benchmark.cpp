@@ -0,0 +1,105 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <QList>
+
+#include "benchmark_util.h"
+#include "message/dbus_frame_reader.h"
+#include "message/dbus_message.h"
+
+// 每次从socket读取的数据量
+static const int kSocketReadSize = 64 * 1024;
+
+// 旧版本splitDBusMsg的实现，每切出一条消息拷贝一次剩余数据，作为对比基准
+static void legacySplitDBusMsg(const QByteArray &buffer, QList<QByteArray> &out)
+{
+    bool bigEndian = buffer[0] == 'B';
+    QByteArray tmp = buffer;
+    while (true) {
+        auto bodyLen = legacyByteAraryToInt(tmp.mid(4, 4), bigEndian);
+        int arrayLen = legacyByteAraryToInt(tmp.mid(12, 4), bigEndian);
+        int headerLen = alignBy8(12 + 4 + arrayLen);
+        out.push_back(tmp.left(bodyLen + headerLen));
+        if (bodyLen + headerLen >= tmp.size()) {
+            break;
+        }
+        tmp = tmp.mid(bodyLen + headerLen);
+    }
+}
+
+static void BM_LegacySplitBurst(benchmark::State &state)
+{
+    const QByteArray burst = methodCallBurst(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        QList<QByteArray> out;
+        legacySplitDBusMsg(burst, out);
+        benchmark::DoNotOptimize(out.size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * burst.size());
+}
+BENCHMARK(BM_LegacySplitBurst)->Arg(1000);
+
+static void BM_FrameReaderBurst(benchmark::State &state)
+{
+    const QByteArray burst = methodCallBurst(static_cast<int>(state.range(0)));
+    DBusFrameReader reader;
+    reader.append("BEGIN\r\n", 7);
+    DBusFrame frame;
+    reader.nextFrame(&frame);
+    for (auto _ : state) {
+        reader.append(burst.constData(), burst.size());
+        int count = 0;
+        while (reader.nextFrame(&frame)) {
+            count++;
+        }
+        benchmark::DoNotOptimize(count);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * burst.size());
+}
+BENCHMARK(BM_FrameReaderBurst)->Arg(1000);
+
+static void BM_LegacySplitLargeMessage(benchmark::State &state)
+{
+    // 旧实现要求整条消息已在一次读取中到达
+    const QByteArray msg = marshalMethodCall(1, "org.freedesktop.portal.Desktop", "/org/freedesktop/portal/desktop",
+                                             "org.freedesktop.portal.FileChooser", "SaveFile",
+                                             static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        QList<QByteArray> out;
+        legacySplitDBusMsg(msg, out);
+        benchmark::DoNotOptimize(out.size());
+    }
+    state.SetBytesProcessed(state.iterations() * msg.size());
+}
+BENCHMARK(BM_LegacySplitLargeMessage)->Arg(64 * 1024 * 1024)->Unit(benchmark::kMillisecond);
+
+static void BM_FrameReaderLargeMessage(benchmark::State &state)
+{
+    // 大消息按socket读取粒度分块到达
+    const QByteArray msg = marshalMethodCall(1, "org.freedesktop.portal.Desktop", "/org/freedesktop/portal/desktop",
+                                             "org.freedesktop.portal.FileChooser", "SaveFile",
+                                             static_cast<int>(state.range(0)));
+    DBusFrameReader reader;
+    reader.append("BEGIN\r\n", 7);
+    DBusFrame frame;
+    reader.nextFrame(&frame);
+    for (auto _ : state) {
+        int count = 0;
+        for (int offset = 0; offset < msg.size(); offset += kSocketReadSize) {
+            reader.append(msg.constData() + offset, qMin(kSocketReadSize, msg.size() - offset));
+            while (reader.nextFrame(&frame)) {
+                count++;
+            }
+        }
+        benchmark::DoNotOptimize(count);
+    }
+    state.SetBytesProcessed(state.iterations() * msg.size());
+}
+BENCHMARK(BM_FrameReaderLargeMessage)->Arg(64 * 1024 * 1024)->Unit(benchmark::kMillisecond);
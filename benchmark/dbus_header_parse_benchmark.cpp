@@ -0,0 +1,209 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <QList>
+
+#include "alloc_counter.h"
+#include "benchmark_util.h"
+#include "filter/dbus_filter.h"
+#include "message/dbus_header_view.h"
+#include "message/dbus_message.h"
+
+// 模拟会话总线上典型的消息组成，比较完整解析与按需解析报文头的开销
+namespace {
+
+enum TrafficMix {
+    // 应用发往dbus-daemon：以方法调用为主，少量返回值和信号
+    ClientToDaemon,
+    // dbus-daemon发往应用：返回值、广播信号为主，带sender字段
+    DaemonToClient
+};
+
+QByteArray marshal(DBusMessage *msg, quint32 serial)
+{
+    dbus_message_set_serial(msg, serial);
+    char *buffer = nullptr;
+    int len = 0;
+    dbus_message_marshal(msg, &buffer, &len);
+    QByteArray ret(buffer, len);
+    dbus_free(buffer);
+    dbus_message_unref(msg);
+    return ret;
+}
+
+QByteArray methodReturn(quint32 serial, const char *sender, const char *dest)
+{
+    DBusMessage *msg = dbus_message_new(DBUS_MESSAGE_TYPE_METHOD_RETURN);
+    dbus_message_set_reply_serial(msg, serial + 1000);
+    dbus_message_set_sender(msg, sender);
+    dbus_message_set_destination(msg, dest);
+    const char *arg = "org.deepin.demo";
+    dbus_message_append_args(msg, DBUS_TYPE_STRING, &arg, DBUS_TYPE_INVALID);
+    return marshal(msg, serial);
+}
+
+QByteArray errorReply(quint32 serial, const char *sender, const char *dest)
+{
+    DBusMessage *msg = dbus_message_new(DBUS_MESSAGE_TYPE_ERROR);
+    dbus_message_set_error_name(msg, "org.freedesktop.DBus.Error.UnknownMethod");
+    dbus_message_set_reply_serial(msg, serial + 1000);
+    dbus_message_set_sender(msg, sender);
+    dbus_message_set_destination(msg, dest);
+    return marshal(msg, serial);
+}
+
+QByteArray broadcastSignal(quint32 serial, const char *sender, const char *path, const char *iface,
+                           const char *member)
+{
+    DBusMessage *msg = dbus_message_new_signal(path, iface, member);
+    dbus_message_set_sender(msg, sender);
+    const char *arg = "org.deepin.demo";
+    dbus_message_append_args(msg, DBUS_TYPE_STRING, &arg, DBUS_TYPE_INVALID);
+    return marshal(msg, serial);
+}
+
+/*
+ * 生成100条消息组成的流量样本
+ *
+ * @param mix: 流量类型
+ *
+ * @return QList<QByteArray>: 消息列表
+ */
+QList<QByteArray> trafficMix(TrafficMix mix)
+{
+    QList<QByteArray> msgs;
+    quint32 serial = 1;
+    for (int i = 0; i < 100; i++, serial++) {
+        const int slot = i % 20;
+        if (mix == ClientToDaemon) {
+            // 70%方法调用 15%返回值 10%信号 5%错误
+            if (slot < 14) {
+                msgs.append(marshalMethodCall(serial, "org.freedesktop.portal.Desktop",
+                                              "/org/freedesktop/portal/desktop", "org.freedesktop.portal.Settings",
+                                              "Read", slot < 2 ? 4096 : 64));
+            } else if (slot < 17) {
+                msgs.append(methodReturn(serial, ":1.42", ":1.7"));
+            } else if (slot < 19) {
+                msgs.append(broadcastSignal(serial, ":1.42", "/com/deepin/linglong/PackageManager",
+                                            "com.deepin.linglong.PackageManager", "TaskChanged"));
+            } else {
+                msgs.append(errorReply(serial, ":1.42", ":1.7"));
+            }
+        } else {
+            // 50%返回值 40%信号 5%方法调用 5%错误
+            if (slot < 10) {
+                msgs.append(methodReturn(serial, ":1.7", ":1.42"));
+            } else if (slot < 18) {
+                msgs.append(broadcastSignal(serial, ":1.7", "/org/freedesktop/DBus/Properties",
+                                            "org.freedesktop.DBus.Properties", "PropertiesChanged"));
+            } else if (slot < 19) {
+                msgs.append(marshalMethodCall(serial, ":1.42", "/org/freedesktop/DBus",
+                                              "org.freedesktop.DBus.Peer", "Ping"));
+            } else {
+                msgs.append(errorReply(serial, ":1.7", ":1.42"));
+            }
+        }
+    }
+    return msgs;
+}
+
+// 典型的沙箱过滤规则
+void setupFilter(DbusFilter *filter)
+{
+    filter->addNameFilter("org.freedesktop.portal.*");
+    filter->addNameFilter("com.deepin.linglong.AppManager");
+    filter->addPathFilter("/org/freedesktop/portal/desktop");
+    filter->addPathFilter("/com/deepin/linglong/*");
+    filter->addInterfaceFilter("org.freedesktop.portal.*");
+}
+
+/*
+ * 按指定字段掩码解析流量样本
+ *
+ * @param state: benchmark状态
+ * @param fields: 需要解码的字段掩码
+ */
+void parseMix(benchmark::State &state, quint32 fields)
+{
+    const QList<QByteArray> msgs = trafficMix(static_cast<TrafficMix>(state.range(0)));
+    qint64 bytes = 0;
+    for (const QByteArray &msg : msgs) {
+        bytes += msg.size();
+    }
+    const quint64 before = allocationCount();
+    for (auto _ : state) {
+        for (const QByteArray &msg : msgs) {
+            DBusHeaderView header;
+            benchmark::DoNotOptimize(header.parse(msg.constData(), static_cast<quint32>(msg.size()), fields));
+        }
+    }
+    state.counters["allocs/msg"] = benchmark::Counter(static_cast<double>(allocationCount() - before)
+                                                          / static_cast<double>(msgs.size()),
+                                                      benchmark::Counter::kAvgIterations);
+    state.SetItemsProcessed(state.iterations() * msgs.size());
+    state.SetBytesProcessed(state.iterations() * bytes);
+}
+
+} // namespace
+
+// 解码全部报文头字段
+static void BM_MixParseAllFields(benchmark::State &state)
+{
+    parseMix(state, DBUS_HEADER_FIELDS_ALL);
+}
+BENCHMARK(BM_MixParseAllFields)->Arg(ClientToDaemon)->Arg(DaemonToClient);
+
+// 只解码过滤规则需要的字段
+static void BM_MixParseFilterFields(benchmark::State &state)
+{
+    DbusFilter filter;
+    setupFilter(&filter);
+    parseMix(state, filter.requiredHeaderFields());
+}
+BENCHMARK(BM_MixParseFilterFields)->Arg(ClientToDaemon)->Arg(DaemonToClient);
+
+// 过滤规则为空，只解析固定头部
+static void BM_MixParseNoFields(benchmark::State &state)
+{
+    DbusFilter filter;
+    parseMix(state, filter.requiredHeaderFields());
+}
+BENCHMARK(BM_MixParseNoFields)->Arg(ClientToDaemon)->Arg(DaemonToClient);
+
+// 按需解析并匹配规则，对应代理转发热路径
+static void BM_MixParseAndFilter(benchmark::State &state)
+{
+    const QList<QByteArray> msgs = trafficMix(static_cast<TrafficMix>(state.range(0)));
+    DbusFilter filter;
+    setupFilter(&filter);
+    const quint32 fields = filter.requiredHeaderFields();
+    for (auto _ : state) {
+        for (const QByteArray &msg : msgs) {
+            DBusHeaderView header;
+            header.parse(msg.constData(), static_cast<quint32>(msg.size()), fields);
+            benchmark::DoNotOptimize(
+                filter.isMessageMatch(header.destination(), header.path(), header.interface()));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * msgs.size());
+}
+BENCHMARK(BM_MixParseAndFilter)->Arg(ClientToDaemon)->Arg(DaemonToClient);
+
+// 旧的QString报文头解析，作为对比基准
+static void BM_MixParseHeaderLegacy(benchmark::State &state)
+{
+    const QList<QByteArray> msgs = trafficMix(static_cast<TrafficMix>(state.range(0)));
+    for (auto _ : state) {
+        for (const QByteArray &msg : msgs) {
+            Header header;
+            benchmark::DoNotOptimize(parseHeader(msg, &header));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * msgs.size());
+}
+BENCHMARK(BM_MixParseHeaderLegacy)->Arg(ClientToDaemon)->Arg(DaemonToClient);
@@ -0,0 +1,100 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "alloc_counter.h"
+#include "benchmark_util.h"
+#include "filter/dbus_filter.h"
+#include "message/dbus_header_view.h"
+#include "message/dbus_message.h"
+
+static QByteArray typicalMethodCall()
+{
+    return marshalMethodCall(7, "com.deepin.linglong.AppManager", "/com/deepin/linglong/PackageManager",
+                             "com.deepin.linglong.PackageManager", "Status", 64);
+}
+
+static void BM_ParseHeader(benchmark::State &state)
+{
+    const QByteArray msg = typicalMethodCall();
+    const quint64 before = allocationCount();
+    for (auto _ : state) {
+        Header header;
+        benchmark::DoNotOptimize(parseHeader(msg, &header));
+    }
+    state.counters["allocs/msg"] =
+        benchmark::Counter(static_cast<double>(allocationCount() - before), benchmark::Counter::kAvgIterations);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ParseHeader);
+
+static void BM_ParseDBusMsg(benchmark::State &state)
+{
+    const QByteArray msg = typicalMethodCall();
+    const quint64 before = allocationCount();
+    for (auto _ : state) {
+        Header header;
+        benchmark::DoNotOptimize(parseDBusMsg(msg, &header));
+    }
+    state.counters["allocs/msg"] =
+        benchmark::Counter(static_cast<double>(allocationCount() - before), benchmark::Counter::kAvgIterations);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ParseDBusMsg);
+
+static void BM_HeaderViewParse(benchmark::State &state)
+{
+    const QByteArray msg = typicalMethodCall();
+    const quint64 before = allocationCount();
+    for (auto _ : state) {
+        DBusHeaderView header;
+        benchmark::DoNotOptimize(header.parse(msg.constData(), static_cast<quint32>(msg.size())));
+    }
+    state.counters["allocs/msg"] =
+        benchmark::Counter(static_cast<double>(allocationCount() - before), benchmark::Counter::kAvgIterations);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_HeaderViewParse);
+
+// 解析并匹配精确规则，对应代理转发热路径
+static void BM_HeaderViewFilter(benchmark::State &state)
+{
+    const QByteArray msg = typicalMethodCall();
+    DbusFilter filter;
+    filter.addNameFilter("org.freedesktop.portal.Desktop");
+    filter.addPathFilter("/org/freedesktop/portal/desktop");
+    filter.addInterfaceFilter("org.freedesktop.portal.FileChooser");
+    const quint64 before = allocationCount();
+    for (auto _ : state) {
+        DBusHeaderView header;
+        header.parse(msg.constData(), static_cast<quint32>(msg.size()));
+        benchmark::DoNotOptimize(filter.isMessageMatch(header.destination(), header.path(), header.interface()));
+    }
+    state.counters["allocs/msg"] =
+        benchmark::Counter(static_cast<double>(allocationCount() - before), benchmark::Counter::kAvgIterations);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_HeaderViewFilter);
+
+static void BM_ParseHeaderFilter(benchmark::State &state)
+{
+    const QByteArray msg = typicalMethodCall();
+    DbusFilter filter;
+    filter.addNameFilter("org.freedesktop.portal.Desktop");
+    filter.addPathFilter("/org/freedesktop/portal/desktop");
+    filter.addInterfaceFilter("org.freedesktop.portal.FileChooser");
+    const quint64 before = allocationCount();
+    for (auto _ : state) {
+        Header header;
+        parseHeader(msg, &header);
+        benchmark::DoNotOptimize(filter.isMessageMatch(header.destination, header.path, header.interface));
+    }
+    state.counters["allocs/msg"] =
+        benchmark::Counter(static_cast<double>(allocationCount() - before), benchmark::Counter::kAvgIterations);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ParseHeaderFilter);
@@ -0,0 +1,95 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "filter/dbus_name_trie.h"
+#include "filter/dbus_rule_matcher.h"
+
+// 沙箱常用的子树规则：按段匹配的前缀树与按正则在任意位置查找的匹配器
+namespace {
+
+/*
+ * 生成子树规则，形如/com/vendorN/App/*
+ *
+ * @param count: 规则数
+ *
+ * @return QStringList: 规则列表
+ */
+QStringList makeRules(int count)
+{
+    QStringList ret;
+    for (int i = 0; i < count; i++) {
+        ret.append(QString("/com/vendor%1/App/*").arg(i));
+    }
+    return ret;
+}
+
+/*
+ * 生成输入路径，交替为命中子树与不命中
+ *
+ * @param count: 规则数
+ *
+ * @return QVector<QByteArray>: 输入路径
+ */
+QVector<QByteArray> makePaths(int count)
+{
+    QVector<QByteArray> ret;
+    for (int i = 0; i < 64; i++) {
+        const int rule = (i * 7919) % count;
+        if (i % 2 == 0) {
+            ret.append(QString("/com/vendor%1/App/Window/%2").arg(rule).arg(i).toLatin1());
+        } else {
+            ret.append(QString("/com/vendor%1/Settings").arg(rule).toLatin1());
+        }
+    }
+    return ret;
+}
+
+} // namespace
+
+// 参数：规则数
+static void BM_NameTrie(benchmark::State &state)
+{
+    const QStringList rules = makeRules(static_cast<int>(state.range(0)));
+    const QVector<QByteArray> paths = makePaths(rules.size());
+    const DBusNameTrie trie(rules, '/');
+    int index = 0;
+    for (auto _ : state) {
+        const QByteArray &path = paths[index];
+        benchmark::DoNotOptimize(trie.isMatch(QLatin1String(path.constData(), path.size())));
+        index = (index + 1) % paths.size();
+    }
+    state.counters["nodes"] = trie.metrics().nodes;
+}
+BENCHMARK(BM_NameTrie)->Arg(10)->Arg(1000)->Arg(50000)->ArgName("rules");
+
+// 参数：规则数
+static void BM_NameTrieRuleMatcher(benchmark::State &state)
+{
+    const QStringList rules = makeRules(static_cast<int>(state.range(0)));
+    const QVector<QByteArray> paths = makePaths(rules.size());
+    const DBusRuleMatcher matcher(rules);
+    int index = 0;
+    for (auto _ : state) {
+        const QByteArray &path = paths[index];
+        benchmark::DoNotOptimize(matcher.isMatch(QLatin1String(path.constData(), path.size())));
+        index = (index + 1) % paths.size();
+    }
+    state.counters["dfa_states"] = matcher.metrics().dfaStates;
+}
+BENCHMARK(BM_NameTrieRuleMatcher)->Arg(10)->Arg(1000)->Arg(50000)->ArgName("rules");
+
+// 参数：规则数
+static void BM_NameTrieCompile(benchmark::State &state)
+{
+    const QStringList rules = makeRules(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        DBusNameTrie trie(rules, '/');
+        benchmark::DoNotOptimize(trie.metrics().nodes);
+    }
+}
+BENCHMARK(BM_NameTrieCompile)->Arg(10)->Arg(1000)->Arg(50000)->ArgName("rules")->Unit(benchmark::kMillisecond);
@@ -0,0 +1,140 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <thread>
+
+#include "benchmark_util.h"
+#include "message/dbus_frame_reader.h"
+#include "proxy/dbus_output_queue.h"
+
+// dbus-daemon一次推送大量属性变化信号时，代理转发给box客户端的系统调用次数与吞吐
+namespace {
+
+const int kSignalCount = 10000;
+// 每次从socket读取的数据量
+const int kSocketReadSize = 64 * 1024;
+
+/*
+ * 生成count条连续的小信号，与dbus-daemon转发的PropertiesChanged信号大小相当
+ *
+ * @param count: 信号条数
+ *
+ * @return QByteArray: 报文字节数组
+ */
+QByteArray signalBurst(int count)
+{
+    QByteArray burst;
+    for (int i = 0; i < count; i++) {
+        burst.append(marshalSignal(static_cast<quint32>(i + 1), "/org/freedesktop/DBus/Properties",
+                                   "org.freedesktop.DBus.Properties", "PropertiesChanged"));
+    }
+    return burst;
+}
+
+/*
+ * 模拟持续读取的box客户端，在独立线程中读取socketpair另一端的所有数据
+ */
+class SocketDrain
+{
+public:
+    SocketDrain()
+    {
+        socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+        reader = std::thread([this]() {
+            char buf[64 * 1024];
+            while (::read(fds[1], buf, sizeof(buf)) > 0) {
+            }
+        });
+    }
+
+    ~SocketDrain()
+    {
+        ::shutdown(fds[0], SHUT_WR);
+        reader.join();
+        ::close(fds[0]);
+        ::close(fds[1]);
+    }
+
+    int writeFd() const { return fds[0]; }
+
+private:
+    int fds[2];
+    std::thread reader;
+};
+
+} // namespace
+
+// 旧实现：每条消息一次write系统调用
+static void BM_SignalBurstWritePerFrame(benchmark::State &state)
+{
+    const QByteArray burst = signalBurst(kSignalCount);
+    SocketDrain drain;
+    DBusFrameReader reader;
+    reader.append("BEGIN\r\n", 7);
+    DBusFrame frame;
+    reader.nextFrame(&frame);
+    quint64 calls = 0;
+    for (auto _ : state) {
+        for (int offset = 0; offset < burst.size(); offset += kSocketReadSize) {
+            reader.append(burst.constData() + offset, qMin(kSocketReadSize, burst.size() - offset));
+            while (reader.nextFrame(&frame)) {
+                quint32 written = 0;
+                while (written < frame.size) {
+                    const ssize_t ret = ::write(drain.writeFd(), frame.data + written, frame.size - written);
+                    calls++;
+                    if (ret > 0) {
+                        written += static_cast<quint32>(ret);
+                    }
+                }
+            }
+        }
+    }
+    state.counters["syscalls/msg"] = static_cast<double>(calls) / (state.iterations() * kSignalCount);
+    state.SetItemsProcessed(state.iterations() * kSignalCount);
+    state.SetBytesProcessed(state.iterations() * burst.size());
+}
+BENCHMARK(BM_SignalBurstWritePerFrame)->Unit(benchmark::kMillisecond);
+
+// 发送队列：每次读取切分出的消息以iovec合并，一次sendmsg发送，内核未接收的部分由socket发送缓冲区发送
+static void BM_SignalBurstGathered(benchmark::State &state)
+{
+    const QByteArray burst = signalBurst(kSignalCount);
+    SocketDrain drain;
+    // socket持有复制的描述符，释放顺序与SocketDrain无关
+    DBusSocket socket;
+    socket.setSocketDescriptor(::dup(drain.writeFd()));
+    DBusOutputQueue queue(&socket, 4 * 1024 * 1024, 1024 * 1024);
+    // socket发送缓冲区每次写入socket后发出一次bytesWritten
+    quint64 bufferedWrites = 0;
+    QObject::connect(&socket, &DBusSocket::bytesWritten, [&bufferedWrites](qint64) { bufferedWrites++; });
+    DBusFrameReader reader;
+    reader.append("BEGIN\r\n", 7);
+    DBusFrame frame;
+    reader.nextFrame(&frame);
+    for (auto _ : state) {
+        for (int offset = 0; offset < burst.size(); offset += kSocketReadSize) {
+            reader.append(burst.constData() + offset, qMin(kSocketReadSize, burst.size() - offset));
+            while (reader.nextFrame(&frame)) {
+                queue.enqueue(frame.data, frame.size);
+            }
+            queue.flush();
+            while (socket.bytesToWrite() > 0) {
+                socket.waitForBytesWritten(1000);
+            }
+        }
+    }
+    const DBusOutputQueueMetrics metrics = queue.metrics();
+    state.counters["syscalls/msg"] =
+        static_cast<double>(metrics.sendCalls + bufferedWrites) / (state.iterations() * kSignalCount);
+    state.SetItemsProcessed(state.iterations() * kSignalCount);
+    state.SetBytesProcessed(state.iterations() * burst.size());
+}
+BENCHMARK(BM_SignalBurstGathered)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,175 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <dbus/dbus.h>
+
+#include "filter/dbus_filter.h"
+#include "filter/dbus_policy.h"
+#include "message/dbus_header_view.h"
+
+// 规则数增长时一条消息的判定开销：原有的name、path、interface三个名单与编译成判定树的策略规则
+namespace {
+
+// 预先生成并解析的消息，报文头视图指向data
+struct Messages {
+    QVector<QByteArray> data;
+    QVector<DBusHeaderView> headers;
+};
+
+/*
+ * 使用libdbus生成方法调用
+ *
+ * @param messages: 输出消息
+ * @param index: 服务编号
+ * @param interface: interface，%1替换为服务编号
+ * @param member: 方法名
+ * @param arg0: 字符串类型的第一个参数，为nullptr时不添加参数
+ */
+void appendCall(Messages *messages, int index, const char *interface, const char *member, const char *arg0)
+{
+    const QByteArray destination = QString("com.vendor%1.Service").arg(index).toLatin1();
+    const QByteArray path = QString("/com/vendor%1/Object").arg(index).toLatin1();
+    const QByteArray ifce = QString(interface).arg(index).toLatin1();
+    DBusMessage *msg =
+        dbus_message_new_method_call(destination.constData(), path.constData(), ifce.constData(), member);
+    if (arg0) {
+        dbus_message_append_args(msg, DBUS_TYPE_STRING, &arg0, DBUS_TYPE_INVALID);
+    }
+    dbus_message_set_serial(msg, 1);
+    char *buffer = nullptr;
+    int len = 0;
+    dbus_message_marshal(msg, &buffer, &len);
+    messages->data.append(QByteArray(buffer, len));
+    dbus_free(buffer);
+    dbus_message_unref(msg);
+}
+
+/*
+ * 生成消息，交替为属性读取、普通调用、带参数的portal调用与不命中任何规则的调用
+ *
+ * @param count: 规则数
+ *
+ * @return Messages: 消息
+ */
+Messages makeMessages(int count)
+{
+    Messages ret;
+    const int services = qMax(count / 4, 1);
+    for (int i = 0; i < 64; i++) {
+        const int index = (i * 7919) % services;
+        switch (i % 4) {
+        case 0:
+            appendCall(&ret, index, "com.vendor%1.Iface", "Get", nullptr);
+            break;
+        case 1:
+            appendCall(&ret, index, "com.vendor%1.Iface", "Update", nullptr);
+            break;
+        case 2:
+            appendCall(&ret, index, "com.vendor%1.Portal", "Open", "org.host.Files");
+            break;
+        default:
+            appendCall(&ret, index, "org.other%1.Iface", "Get", nullptr);
+            break;
+        }
+    }
+    ret.headers.resize(ret.data.size());
+    for (int i = 0; i < ret.data.size(); i++) {
+        ret.headers[i].parse(ret.data.at(i).constData(), static_cast<quint32>(ret.data.at(i).size()));
+    }
+    return ret;
+}
+
+/*
+ * 生成策略规则，每个服务四条：放行属性读取、其余调用申请授权、拒绝portal路径、丢弃指定参数的portal调用
+ *
+ * @param count: 规则数
+ *
+ * @return QStringList: 规则列表
+ */
+QStringList makeRules(int count)
+{
+    QStringList ret;
+    for (int i = 0; ret.size() < count; i++) {
+        ret.append(QString("interface='com.vendor%1.Iface',member='Get',action='allow'").arg(i));
+        ret.append(QString("destination='com.vendor%1.Service',interface='com.vendor%1.Iface',action='ask'").arg(i));
+        ret.append(QString("interface='com.vendor%1.Portal',member='Open',arg0namespace='org.host',action='drop'")
+                       .arg(i));
+        ret.append(QString("interface='com.vendor%1.Portal',path_namespace='/com/vendor%1',action='deny'").arg(i));
+    }
+    return ret;
+}
+
+} // namespace
+
+// 参数：每个名单的规则数
+static void BM_PolicyLegacyFilter(benchmark::State &state)
+{
+    const int count = static_cast<int>(state.range(0));
+    const Messages messages = makeMessages(count);
+    DbusFilter filter;
+    for (int i = 0; i < count; i++) {
+        filter.addNameFilter(QString("com.vendor%1.Service").arg(i));
+        filter.addPathFilter(QString("/com/vendor%1/*").arg(i));
+        filter.addInterfaceFilter(QString("com.vendor%1.*").arg(i));
+    }
+    filter.compile();
+    int index = 0;
+    for (auto _ : state) {
+        const DBusHeaderView &header = messages.headers[index];
+        benchmark::DoNotOptimize(filter.isMessageMatch(header.destination(), header.path(), header.interface()));
+        index = (index + 1) % messages.headers.size();
+    }
+}
+BENCHMARK(BM_PolicyLegacyFilter)->Arg(10)->Arg(1000)->ArgName("rules");
+
+// 参数：策略规则数
+static void BM_PolicyTree(benchmark::State &state)
+{
+    const int count = static_cast<int>(state.range(0));
+    const Messages messages = makeMessages(count);
+    QVector<DBusPolicyRule> rules;
+    for (const QString &text : makeRules(count)) {
+        DBusPolicyRule rule;
+        DBusPolicyRule::parse(text, &rule);
+        rules.append(rule);
+    }
+    const DBusPolicy policy(rules);
+    int index = 0;
+    for (auto _ : state) {
+        DBusPolicyVerdict verdict;
+        benchmark::DoNotOptimize(policy.evaluate(messages.headers[index], &verdict));
+        index = (index + 1) % messages.headers.size();
+    }
+    const DBusPolicyMetrics metrics = policy.metrics();
+    state.counters["branches"] = metrics.branches;
+    state.counters["leaf_rules"] = metrics.leafRules;
+}
+BENCHMARK(BM_PolicyTree)->Arg(10)->Arg(1000)->Arg(50000)->ArgName("rules");
+
+// 参数：策略规则数，名单中的规则数相同，没有匹配的策略规则时再匹配名单
+static void BM_PolicyFilterEvaluate(benchmark::State &state)
+{
+    const int count = static_cast<int>(state.range(0));
+    const Messages messages = makeMessages(count);
+    DbusFilter filter;
+    for (const QString &text : makeRules(count)) {
+        filter.addRule(text);
+    }
+    for (int i = 0; i < count; i++) {
+        filter.addNameFilter(QString("com.vendor%1.Service").arg(i));
+        filter.addPathFilter(QString("/com/vendor%1/*").arg(i));
+        filter.addInterfaceFilter(QString("com.vendor%1.*").arg(i));
+    }
+    filter.compile();
+    int index = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(filter.evaluate(messages.headers[index]).action);
+        index = (index + 1) % messages.headers.size();
+    }
+}
+BENCHMARK(BM_PolicyFilterEvaluate)->Arg(10)->Arg(1000)->ArgName("rules");
@@ -0,0 +1,349 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QLocalSocket>
+#include <QMap>
+#include <QTimer>
+#include <QtAlgorithms>
+
+#include "benchmark_util.h"
+#include "message/dbus_frame_reader.h"
+#include "proxy/dbus_output_queue.h"
+#include "proxy/dbus_reactor.h"
+#include "proxy/dbus_socket.h"
+
+// box客户端逐条发送method call并等待dbus-daemon原样返回时，代理两种分发方式的吞吐与往返延迟
+namespace {
+
+// 每个客户端每次迭代发送的消息数
+const int kMessagesPerClient = 2000;
+// 代理每次可读通知的读取预算，与DbusProxy一致
+const qint64 kReadBudget = 1024 * 1024;
+// 事件循环最长等待时间，毫秒
+const int kWaitTimeout = 10;
+
+// 单调时钟，纳秒
+qint64 nowNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<qint64>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// 基准测试没有main函数创建的QCoreApplication，QSocketNotifier需要事件循环
+void ensureApplication()
+{
+    static int argc = 1;
+    static char name[] = "dbus-proxy-benchmark";
+    static char *argv[] = {name, nullptr};
+    if (!QCoreApplication::instance()) {
+        new QCoreApplication(argc, argv);
+    }
+}
+
+/*
+ * 把数据写完，阻塞描述符
+ *
+ * @param fd: 描述符
+ * @param data: 数据地址
+ * @param size: 数据长度
+ */
+void writeAll(int fd, const char *data, qint64 size)
+{
+    qint64 offset = 0;
+    while (offset < size) {
+        const ssize_t ret = ::write(fd, data + offset, static_cast<size_t>(size - offset));
+        if (ret <= 0) {
+            return;
+        }
+        offset += ret;
+    }
+}
+
+/*
+ * 代理两侧的socket对：box[0]为客户端，box[1]为代理的box侧；daemon[0]为代理的dbus-daemon侧，daemon[1]为回显端
+ */
+struct ConnectionFds {
+    int box[2];
+    int daemon[2];
+};
+
+// 用一个线程模拟dbus-daemon，把收到的数据原样写回
+class EchoDaemon
+{
+public:
+    explicit EchoDaemon(const std::vector<ConnectionFds> &fds)
+        : running(true)
+    {
+        for (const ConnectionFds &item : fds) {
+            peers.push_back(item.daemon[1]);
+        }
+        worker = std::thread([this]() { run(); });
+    }
+
+    ~EchoDaemon()
+    {
+        running = false;
+        worker.join();
+    }
+
+private:
+    void run()
+    {
+        std::vector<pollfd> items;
+        for (int fd : peers) {
+            items.push_back({fd, POLLIN, 0});
+        }
+        char buf[64 * 1024];
+        while (running) {
+            if (::poll(items.data(), items.size(), kWaitTimeout) <= 0) {
+                continue;
+            }
+            for (const pollfd &item : items) {
+                if (item.revents & POLLIN) {
+                    const ssize_t ret = ::read(item.fd, buf, sizeof(buf));
+                    if (ret > 0) {
+                        writeAll(item.fd, buf, ret);
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<int> peers;
+    std::atomic<bool> running;
+    std::thread worker;
+};
+
+/*
+ * box客户端：逐条发送消息，收到完整回显后记录往返延迟
+ *
+ * @param fd: 客户端描述符
+ * @param msg: 消息
+ * @param latencies: 输出每条消息的往返延迟，纳秒
+ * @param done: 完成后加1
+ */
+void runClient(int fd, const QByteArray &msg, std::vector<qint64> *latencies, std::atomic<int> *done)
+{
+    QByteArray buf(msg.size(), '\0');
+    for (int i = 0; i < kMessagesPerClient; i++) {
+        const qint64 start = nowNs();
+        writeAll(fd, msg.constData(), msg.size());
+        qint64 received = 0;
+        while (received < msg.size()) {
+            const ssize_t ret = ::read(fd, buf.data() + received, static_cast<size_t>(msg.size() - received));
+            if (ret <= 0) {
+                done->fetch_add(1);
+                return;
+            }
+            received += ret;
+        }
+        latencies->push_back(nowNs() - start);
+    }
+    done->fetch_add(1);
+}
+
+// 基于QLocalSocket信号槽的转发：readyRead信号、查找对端、QIODevice读缓冲区
+class QtRelay
+{
+public:
+    explicit QtRelay(const std::vector<ConnectionFds> &fds)
+    {
+        for (const ConnectionFds &item : fds) {
+            QLocalSocket *box = new QLocalSocket();
+            QLocalSocket *daemon = new QLocalSocket();
+            box->setSocketDescriptor(item.box[1]);
+            daemon->setSocketDescriptor(item.daemon[0]);
+            relations.insert(box, daemon);
+            relations.insert(daemon, box);
+            for (QLocalSocket *socket : {box, daemon}) {
+                QSharedPointer<DBusFrameReader> reader(new DBusFrameReader());
+                reader->startBinaryMode();
+                readers.insert(socket, reader);
+                QObject::connect(socket, &QLocalSocket::readyRead, [this, socket]() { forward(socket); });
+            }
+        }
+    }
+
+    ~QtRelay() { qDeleteAll(relations.keys()); }
+
+    void poll() { QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents); }
+
+private:
+    void forward(QLocalSocket *from)
+    {
+        QLocalSocket *to = relations.value(from);
+        QSharedPointer<DBusFrameReader> reader = readers.value(from);
+        DBusFrame frame;
+        while (from->bytesAvailable() > 0) {
+            reader->readFrom(from);
+            while (reader->nextFrame(&frame)) {
+                to->write(frame.data, frame.size);
+            }
+        }
+    }
+
+    QMap<QLocalSocket *, QLocalSocket *> relations;
+    QMap<QLocalSocket *, QSharedPointer<DBusFrameReader>> readers;
+};
+
+// 一个连接在reactor中的会话：socket可读时直接调用，读入重组器后合并发送
+class ReactorSession : public DBusSocketListener
+{
+public:
+    ReactorSession(DBusReactor *reactor, const ConnectionFds &fds)
+        : boxQueue(&box, 4 * 1024 * 1024, 1024 * 1024)
+        , daemonQueue(&daemon, 4 * 1024 * 1024, 1024 * 1024)
+    {
+        for (DBusSocket *socket : {&box, &daemon}) {
+            socket->setReactor(reactor);
+            socket->setListener(this);
+        }
+        box.setSocketDescriptor(fds.box[1]);
+        daemon.setSocketDescriptor(fds.daemon[0]);
+        boxReader.startBinaryMode();
+        daemonReader.startBinaryMode();
+    }
+
+    bool socketReadable(DBusSocket *socket) override
+    {
+        const bool fromBox = socket == &box;
+        DBusFrameReader &reader = fromBox ? boxReader : daemonReader;
+        DBusOutputQueue &queue = fromBox ? daemonQueue : boxQueue;
+        qint64 budget = kReadBudget;
+        DBusFrame frame;
+        while (budget > 0 && socket->bytesAvailable() > 0) {
+            budget -= qMax<qint64>(reader.readFrom(socket), 1);
+            while (reader.nextFrame(&frame)) {
+                queue.enqueue(frame.data, frame.size);
+            }
+            queue.flush();
+        }
+        return budget <= 0;
+    }
+
+private:
+    DBusSocket box;
+    DBusSocket daemon;
+    DBusOutputQueue boxQueue;
+    DBusOutputQueue daemonQueue;
+    DBusFrameReader boxReader;
+    DBusFrameReader daemonReader;
+};
+
+class ReactorRelay
+{
+public:
+    explicit ReactorRelay(const std::vector<ConnectionFds> &fds)
+    {
+        for (const ConnectionFds &item : fds) {
+            sessions.push_back(std::unique_ptr<ReactorSession>(new ReactorSession(&reactor, item)));
+        }
+    }
+
+    void poll() { reactor.poll(kWaitTimeout); }
+
+private:
+    // 会话中的socket在reactor之前释放
+    DBusReactor reactor;
+    std::vector<std::unique_ptr<ReactorSession>> sessions;
+};
+
+/*
+ * 创建所有连接的socket对，代理一侧的描述符由relay接管
+ *
+ * @param count: 连接数
+ *
+ * @return std::vector<ConnectionFds>: 各连接的描述符
+ */
+std::vector<ConnectionFds> createConnections(int count)
+{
+    std::vector<ConnectionFds> ret(static_cast<size_t>(count));
+    for (ConnectionFds &item : ret) {
+        socketpair(AF_UNIX, SOCK_STREAM, 0, item.box);
+        socketpair(AF_UNIX, SOCK_STREAM, 0, item.daemon);
+    }
+    return ret;
+}
+
+template<class Relay>
+void runRelay(benchmark::State &state)
+{
+    ensureApplication();
+    const int connections = static_cast<int>(state.range(1));
+    const QByteArray msg = marshalMethodCall(1, "org.deepin.linglong.demo", "/org/deepin/linglong/demo",
+                                             "org.deepin.linglong.demo", "Ping", 64);
+    std::vector<ConnectionFds> fds = createConnections(connections);
+    // QLocalSocket等待事件时需要定时唤醒检查客户端是否完成
+    QTimer wakeup;
+    wakeup.start(kWaitTimeout);
+    std::vector<qint64> all;
+    {
+        Relay relay(fds);
+        EchoDaemon daemon(fds);
+        for (auto _ : state) {
+            std::vector<std::vector<qint64>> latencies(static_cast<size_t>(connections));
+            std::vector<std::thread> clients;
+            std::atomic<int> done(0);
+            for (int i = 0; i < connections; i++) {
+                latencies[i].reserve(kMessagesPerClient);
+                clients.emplace_back(runClient, fds[i].box[0], std::cref(msg), &latencies[i], &done);
+            }
+            while (done.load() < connections) {
+                relay.poll();
+            }
+            for (std::thread &client : clients) {
+                client.join();
+            }
+            for (const std::vector<qint64> &item : latencies) {
+                all.insert(all.end(), item.begin(), item.end());
+            }
+        }
+    }
+    for (const ConnectionFds &item : fds) {
+        ::close(item.box[0]);
+        ::close(item.daemon[1]);
+    }
+    std::sort(all.begin(), all.end());
+    if (!all.empty()) {
+        state.counters["p50_us"] = all[all.size() / 2] / 1e3;
+        state.counters["p99_us"] = all[all.size() * 99 / 100] / 1e3;
+    }
+    // items_per_second即每秒完成往返的消息数
+    state.SetItemsProcessed(static_cast<int64_t>(all.size()));
+}
+
+} // namespace
+
+// 参数：分发方式 QLocalSocket信号槽(0)/reactor(1)，连接数
+static void BM_ProxyRelayRoundTrip(benchmark::State &state)
+{
+    if (state.range(0) == 0) {
+        runRelay<QtRelay>(state);
+    } else {
+        runRelay<ReactorRelay>(state);
+    }
+}
+BENCHMARK(BM_ProxyRelayRoundTrip)
+    ->ArgsProduct({{0, 1}, {1, 16}})
+    ->ArgNames({"reactor", "conns"})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
@@ -0,0 +1,174 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QEventLoop>
+#include <QMap>
+
+#include "benchmark_util.h"
+#include "echo_bus.h"
+#include "proxy/dbus_proxy.h"
+#include "proxy/dbus_proxy_session.h"
+
+// 大量空闲连接存在时，单个活跃连接经过完整DbusProxy往返的延迟，以及由socket查找所属连接的开销
+namespace {
+
+// 活跃客户端每次迭代的往返次数
+const int kRoundTrips = 200;
+// 模拟dbus-daemon的线程数
+const int kDaemonThreads = 2;
+// 处理断开事件的等待时间，毫秒
+const int kWaitTimeout = 10;
+
+/*
+ * 每个会话占用客户端、box客户端、代理客户端与dbus-daemon侧4个描述符，提高进程的描述符上限
+ *
+ * @param sessions: 会话数
+ *
+ * @return bool: true:上限足够 false:无法提高到所需数量
+ */
+bool ensureFdLimit(int sessions)
+{
+    const rlim_t required = static_cast<rlim_t>(sessions) * 4 + 64;
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+        return false;
+    }
+    if (limit.rlim_cur >= required) {
+        return true;
+    }
+    if (limit.rlim_max < required) {
+        return false;
+    }
+    limit.rlim_cur = required;
+    return setrlimit(RLIMIT_NOFILE, &limit) == 0;
+}
+
+} // namespace
+
+// 参数：会话数，其中一个客户端做往返，其余连接认证后保持空闲
+static void BM_ProxySessionRoundTrip(benchmark::State &state)
+{
+    ensureApplication();
+    const int sessionCount = static_cast<int>(state.range(0));
+    if (!ensureFdLimit(sessionCount)) {
+        state.SkipWithError("RLIMIT_NOFILE too low");
+        return;
+    }
+    const QString prefix = QDir::tempPath() + QString("/dbus-proxy-session-%1-%2").arg(getpid()).arg(sessionCount);
+    const QByteArray msg = marshalMethodCall(1, "org.deepin.linglong.demo", "/org/deepin/linglong/demo",
+                                             "org.deepin.linglong.demo", "Ping", 64);
+    qint64 roundTrips = 0;
+    {
+        EchoBus bus(prefix + "-bus", kDaemonThreads, sessionCount);
+        DbusProxy proxy;
+        proxy.saveDbusDaemonPath(prefix + "-bus");
+        proxy.setReactorEnabled(true);
+        if (!proxy.startListenBoxClient(prefix + "-proxy")) {
+            state.SkipWithError("listen failed");
+            return;
+        }
+        // 连接与认证在后台线程中依次完成，当前线程处理新连接
+        std::vector<int> fds;
+        runInBackground([&fds, &prefix, sessionCount]() {
+            for (int i = 0; i < sessionCount; i++) {
+                const int fd = connectTo(prefix + "-proxy");
+                if (fd >= 0) {
+                    authenticate(fd);
+                    fds.push_back(fd);
+                }
+            }
+        });
+        if (proxy.sessionCount() != sessionCount) {
+            state.SkipWithError("not all sessions established");
+        }
+        const int active = fds.empty() ? -1 : fds.back();
+        for (auto _ : state) {
+            runClients({active}, [&msg](int fd) {
+                QByteArray buf(msg.size(), '\0');
+                for (int i = 0; i < kRoundTrips; i++) {
+                    if (!writeAll(fd, msg.constData(), msg.size()) || !readAll(fd, buf.data(), buf.size())) {
+                        return;
+                    }
+                }
+            });
+            roundTrips += kRoundTrips;
+        }
+        for (int fd : fds) {
+            ::close(fd);
+        }
+        QCoreApplication::processEvents(QEventLoop::AllEvents, kWaitTimeout);
+    }
+    state.SetItemsProcessed(roundTrips);
+}
+BENCHMARK(BM_ProxySessionRoundTrip)
+    ->Arg(1)
+    ->Arg(1000)
+    ->ArgName("sessions")
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+
+// 参数：会话数；原实现由代理客户端查找box客户端时遍历全部连接关系
+static void BM_SessionLookupByScan(benchmark::State &state)
+{
+    const int sessionCount = static_cast<int>(state.range(0));
+    QMap<DBusSocket *, DBusSocket *> relations;
+    std::vector<DBusSocket *> sockets;
+    for (int i = 0; i < sessionCount; i++) {
+        DBusSocket *box = new DBusSocket();
+        DBusSocket *daemon = new DBusSocket();
+        relations.insert(box, daemon);
+        sockets.push_back(daemon);
+    }
+    size_t next = 0;
+    for (auto _ : state) {
+        DBusSocket *target = sockets[next++ % sockets.size()];
+        DBusSocket *found = nullptr;
+        for (auto it = relations.begin(); it != relations.end(); ++it) {
+            if (it.value() == target) {
+                found = it.key();
+                break;
+            }
+        }
+        benchmark::DoNotOptimize(found);
+    }
+    for (auto it = relations.begin(); it != relations.end(); ++it) {
+        delete it.key();
+        delete it.value();
+    }
+}
+BENCHMARK(BM_SessionLookupByScan)->Arg(1)->Arg(1000)->ArgName("sessions");
+
+// 参数：会话数；socket的读取者即所属会话，查找与连接数无关
+static void BM_SessionLookupBySocket(benchmark::State &state)
+{
+    const int sessionCount = static_cast<int>(state.range(0));
+    DbusProxy proxy;
+    std::vector<DBusProxySession *> sessions;
+    std::vector<DBusSocket *> sockets;
+    for (int i = 0; i < sessionCount; i++) {
+        DBusSocket *daemon = new DBusSocket();
+        sessions.push_back(new DBusProxySession(&proxy, new DBusSocket(), daemon, 1024, 512));
+        sockets.push_back(daemon);
+    }
+    size_t next = 0;
+    for (auto _ : state) {
+        DBusProxySession *session = DBusProxySession::fromSocket(sockets[next++ % sockets.size()]);
+        benchmark::DoNotOptimize(session->boxSocket());
+    }
+    for (DBusProxySession *session : sessions) {
+        delete session;
+    }
+}
+BENCHMARK(BM_SessionLookupBySocket)->Arg(1)->Arg(1000)->ArgName("sessions");
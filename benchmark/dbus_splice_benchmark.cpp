@@ -0,0 +1,203 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <thread>
+
+#include <QtEndian>
+
+#include "message/dbus_frame_reader.h"
+#include "proxy/dbus_splice_relay.h"
+
+// dbus-daemon向box客户端发送大消息时，代理转发线程每GB数据消耗的CPU时间
+namespace {
+
+// 每次迭代转发的消息body大小
+const quint32 kBodySize = 64 * 1024 * 1024;
+// 与代理使用的socket读缓冲区、直通阈值一致
+const int kSocketReadSize = 1024 * 1024;
+const quint32 kCutThroughThreshold = 1024 * 1024;
+// splice转发时代理限制Qt每次读入的数据量
+const int kSpliceReadSize = 4096;
+
+/*
+ * 生成只有固定头部的小端method call
+ *
+ * @param bodySize: body长度
+ *
+ * @return QByteArray: 报文字节数组
+ */
+QByteArray largeMessage(quint32 bodySize)
+{
+    QByteArray msg(16, '\0');
+    msg[0] = 'l';
+    msg[1] = 1;
+    msg[3] = 1;
+    qToLittleEndian<quint32>(bodySize, reinterpret_cast<uchar *>(msg.data() + 4));
+    qToLittleEndian<quint32>(1, reinterpret_cast<uchar *>(msg.data() + 8));
+    msg.append(QByteArray(static_cast<int>(bodySize), 'x'));
+    return msg;
+}
+
+// 当前线程已消耗的CPU时间，秒
+double threadCpuTime()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+// 等待描述符可读或可写
+void waitFd(int fd, short events)
+{
+    pollfd item = {fd, events, 0};
+    ::poll(&item, 1, 1000);
+}
+
+/*
+ * dbus-daemon与box客户端两端：source[0]由写线程写入消息，dest[1]由读线程持续读取，
+ * 代理在当前线程从source[1]读取并写入dest[0]
+ */
+class RelayPeers
+{
+public:
+    RelayPeers()
+    {
+        socketpair(AF_UNIX, SOCK_STREAM, 0, source);
+        socketpair(AF_UNIX, SOCK_STREAM, 0, dest);
+        // 代理一端与Qt socket一样为非阻塞
+        ::fcntl(source[1], F_SETFL, O_NONBLOCK);
+        ::fcntl(dest[0], F_SETFL, O_NONBLOCK);
+        drain = std::thread([this]() {
+            char buf[64 * 1024];
+            while (::read(dest[1], buf, sizeof(buf)) > 0) {
+            }
+        });
+    }
+
+    ~RelayPeers()
+    {
+        ::shutdown(dest[0], SHUT_WR);
+        drain.join();
+        for (int fd : {source[0], source[1], dest[0], dest[1]}) {
+            ::close(fd);
+        }
+    }
+
+    // 在独立线程中写入一条消息
+    std::thread send(const QByteArray &msg)
+    {
+        const int fd = source[0];
+        return std::thread([fd, &msg]() {
+            qint64 offset = 0;
+            while (offset < msg.size()) {
+                const ssize_t ret =
+                    ::write(fd, msg.constData() + offset, static_cast<size_t>(msg.size() - offset));
+                if (ret <= 0) {
+                    return;
+                }
+                offset += ret;
+            }
+        });
+    }
+
+    int source[2];
+    int dest[2];
+
+private:
+    std::thread drain;
+};
+
+/*
+ * 把一段数据写完，目标写不下时等待
+ *
+ * @param fd: 目标描述符
+ * @param data: 数据地址
+ * @param size: 数据长度
+ */
+void writeAll(int fd, const char *data, quint32 size)
+{
+    quint32 offset = 0;
+    while (offset < size) {
+        const ssize_t ret = ::write(fd, data + offset, size - offset);
+        if (ret > 0) {
+            offset += static_cast<quint32>(ret);
+        } else {
+            waitFd(fd, POLLOUT);
+        }
+    }
+}
+
+} // namespace
+
+// 参数：拷贝转发(0)/splice转发(1)
+static void BM_DaemonToClientRelay(benchmark::State &state)
+{
+    const bool splice = state.range(0) != 0;
+    const QByteArray msg = largeMessage(kBodySize);
+    RelayPeers peers;
+    DBusSpliceRelay relay;
+    // Qt socket读缓冲区
+    QByteArray socketBuffer(kSocketReadSize, '\0');
+    double cpu = 0;
+    quint64 lostBytes = 0;
+    for (auto _ : state) {
+        std::thread sender = peers.send(msg);
+        const double start = threadCpuTime();
+        DBusFrameReader reader;
+        reader.startBinaryMode();
+        reader.setCutThroughThreshold(kCutThroughThreshold);
+        DBusFrame frame;
+        quint64 forwarded = 0;
+        // 报文头总是读入用户态过滤，splice时其余body尽量留在内核中
+        const int readSize = splice ? kSpliceReadSize : kSocketReadSize;
+        while (forwarded < static_cast<quint64>(msg.size())) {
+            const ssize_t ret = ::read(peers.source[1], socketBuffer.data(), static_cast<size_t>(readSize));
+            if (ret > 0) {
+                reader.append(socketBuffer.constData(), static_cast<int>(ret));
+            } else if (reader.streamRemaining() == 0) {
+                waitFd(peers.source[1], POLLIN);
+            }
+            while (reader.nextFrame(&frame)) {
+                writeAll(peers.dest[0], frame.data, frame.size);
+                forwarded += frame.size;
+            }
+            if (splice && reader.streamRemaining() > 0) {
+                QByteArray spill;
+                qint64 lost = 0;
+                const qint64 moved =
+                    relay.relay(peers.source[1], peers.dest[0], reader.streamRemaining(), &spill, &lost);
+                lostBytes += static_cast<quint64>(lost);
+                reader.skipStream(static_cast<quint32>(moved));
+                writeAll(peers.dest[0], spill.constData(), static_cast<quint32>(spill.size()));
+                forwarded += static_cast<quint64>(moved);
+                if (moved == 0) {
+                    waitFd(peers.source[1], POLLIN);
+                }
+            }
+        }
+        cpu += threadCpuTime() - start;
+        sender.join();
+    }
+    if (lostBytes > 0) {
+        state.SkipWithError("splice pipe drain failed");
+        return;
+    }
+    const double gigabytes = static_cast<double>(state.iterations()) * msg.size() / (1024.0 * 1024 * 1024);
+    state.counters["cpu_ms_per_GB"] = cpu * 1e3 / gigabytes;
+    const DBusSpliceMetrics metrics = relay.metrics();
+    state.counters["spill_ratio"] =
+        splice ? static_cast<double>(metrics.copiedBytes) / (metrics.splicedBytes + metrics.copiedBytes + 1) : 1;
+    state.SetBytesProcessed(state.iterations() * msg.size());
+}
+BENCHMARK(BM_DaemonToClientRelay)->Arg(0)->Arg(1)->ArgName("splice")->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,283 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <QCoreApplication>
+
+#include "benchmark_util.h"
+#include "message/dbus_frame_reader.h"
+#include "proxy/dbus_output_queue.h"
+#include "proxy/dbus_reactor.h"
+#include "proxy/dbus_socket.h"
+#include "syscall_counter.h"
+
+// 客户端以固定窗口连续发送method call、dbus-daemon原样返回时，reactor两种后端每条消息的系统调用次数与CPU时间
+namespace {
+
+// 每个客户端每次迭代发送的消息数
+const int kMessagesPerClient = 4000;
+// 客户端发送一个窗口的消息后再等待全部回显
+const int kWindow = 16;
+// 代理每次可读通知的读取预算，与DbusProxy一致
+const qint64 kReadBudget = 1024 * 1024;
+// 事件循环最长等待时间，毫秒
+const int kWaitTimeout = 10;
+
+// 基准测试没有main函数创建的QCoreApplication
+void ensureApplication()
+{
+    static int argc = 1;
+    static char name[] = "dbus-proxy-benchmark";
+    static char *argv[] = {name, nullptr};
+    if (!QCoreApplication::instance()) {
+        new QCoreApplication(argc, argv);
+    }
+}
+
+// 当前线程消耗的CPU时间，用户态加内核态，微秒
+qint64 threadCpuUs()
+{
+    rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return static_cast<qint64>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 + usage.ru_utime.tv_usec
+        + usage.ru_stime.tv_usec;
+}
+
+/*
+ * 把数据写完，阻塞描述符
+ *
+ * @param fd: 描述符
+ * @param data: 数据地址
+ * @param size: 数据长度
+ *
+ * @return bool: true:成功 false:失败
+ */
+bool writeAll(int fd, const char *data, qint64 size)
+{
+    qint64 offset = 0;
+    while (offset < size) {
+        const ssize_t ret = ::write(fd, data + offset, static_cast<size_t>(size - offset));
+        if (ret <= 0) {
+            return false;
+        }
+        offset += ret;
+    }
+    return true;
+}
+
+/*
+ * 代理两侧的socket对：box[0]为客户端，box[1]为代理的box侧；daemon[0]为代理的dbus-daemon侧，daemon[1]为回显端
+ */
+struct ConnectionFds {
+    int box[2];
+    int daemon[2];
+};
+
+// 用一个线程模拟dbus-daemon，把收到的数据原样写回
+class EchoDaemon
+{
+public:
+    explicit EchoDaemon(const std::vector<ConnectionFds> &fds)
+        : running(true)
+    {
+        for (const ConnectionFds &item : fds) {
+            peers.push_back(item.daemon[1]);
+        }
+        worker = std::thread([this]() { run(); });
+    }
+
+    ~EchoDaemon()
+    {
+        running = false;
+        worker.join();
+    }
+
+private:
+    void run()
+    {
+        std::vector<pollfd> items;
+        for (int fd : peers) {
+            items.push_back({fd, POLLIN, 0});
+        }
+        char buf[64 * 1024];
+        while (running) {
+            if (::poll(items.data(), items.size(), kWaitTimeout) <= 0) {
+                continue;
+            }
+            for (const pollfd &item : items) {
+                if (item.revents & POLLIN) {
+                    const ssize_t ret = ::read(item.fd, buf, sizeof(buf));
+                    if (ret > 0) {
+                        writeAll(item.fd, buf, ret);
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<int> peers;
+    std::atomic<bool> running;
+    std::thread worker;
+};
+
+/*
+ * box客户端：每次写入一个窗口的消息，读完全部回显后再写下一个窗口
+ *
+ * @param fd: 客户端描述符
+ * @param msg: 消息
+ * @param done: 完成后加1
+ */
+void runClient(int fd, const QByteArray &msg, std::atomic<int> *done)
+{
+    QByteArray window;
+    for (int i = 0; i < kWindow; i++) {
+        window.append(msg);
+    }
+    QByteArray buf(window.size(), '\0');
+    for (int i = 0; i < kMessagesPerClient / kWindow; i++) {
+        if (!writeAll(fd, window.constData(), window.size())) {
+            break;
+        }
+        qint64 received = 0;
+        while (received < window.size()) {
+            const ssize_t ret = ::read(fd, buf.data() + received, static_cast<size_t>(window.size() - received));
+            if (ret <= 0) {
+                done->fetch_add(1);
+                return;
+            }
+            received += ret;
+        }
+    }
+    done->fetch_add(1);
+}
+
+// 一个连接在reactor中的会话，与DbusProxy的转发路径一致：读入重组器后合并发送
+class RelaySession : public DBusSocketListener
+{
+public:
+    RelaySession(DBusReactor *reactor, const ConnectionFds &fds)
+        : boxQueue(&box, 4 * 1024 * 1024, 1024 * 1024)
+        , daemonQueue(&daemon, 4 * 1024 * 1024, 1024 * 1024)
+    {
+        for (DBusSocket *socket : {&box, &daemon}) {
+            socket->setReactor(reactor);
+            socket->setListener(this);
+        }
+        box.setSocketDescriptor(fds.box[1]);
+        daemon.setSocketDescriptor(fds.daemon[0]);
+        boxReader.startBinaryMode();
+        daemonReader.startBinaryMode();
+    }
+
+    bool socketReadable(DBusSocket *socket) override
+    {
+        const bool fromBox = socket == &box;
+        DBusFrameReader &reader = fromBox ? boxReader : daemonReader;
+        DBusOutputQueue &queue = fromBox ? daemonQueue : boxQueue;
+        qint64 budget = kReadBudget;
+        DBusFrame frame;
+        while (budget > 0 && socket->bytesAvailable() > 0) {
+            budget -= qMax<qint64>(reader.readFrom(socket), 1);
+            while (reader.nextFrame(&frame)) {
+                queue.enqueue(frame.data, frame.size);
+            }
+            queue.flush();
+        }
+        return budget <= 0;
+    }
+
+private:
+    DBusSocket box;
+    DBusSocket daemon;
+    DBusOutputQueue boxQueue;
+    DBusOutputQueue daemonQueue;
+    DBusFrameReader boxReader;
+    DBusFrameReader daemonReader;
+};
+
+} // namespace
+
+// 参数：后端 epoll(0)/io_uring(1)，连接数
+// syscalls_per_msg为代理线程的socket收发调用加上epoll_wait或io_uring_enter调用，由包装函数与reactor计数得到
+static void BM_ProxyRelayBackend(benchmark::State &state)
+{
+    ensureApplication();
+    const DBusReactor::Backend preferred = state.range(0) == 0 ? DBusReactor::Epoll : DBusReactor::IoUring;
+    const int connections = static_cast<int>(state.range(1));
+    const QByteArray msg = marshalMethodCall(1, "org.deepin.linglong.demo", "/org/deepin/linglong/demo",
+                                             "org.deepin.linglong.demo", "Ping", 64);
+    std::vector<ConnectionFds> fds(static_cast<size_t>(connections));
+    for (ConnectionFds &item : fds) {
+        socketpair(AF_UNIX, SOCK_STREAM, 0, item.box);
+        socketpair(AF_UNIX, SOCK_STREAM, 0, item.daemon);
+    }
+    quint64 syscalls = 0;
+    qint64 cpuUs = 0;
+    qint64 messages = 0;
+    {
+        // 会话中的socket在reactor之前释放
+        DBusReactor reactor(preferred);
+        if (reactor.backend() != preferred) {
+            for (const ConnectionFds &item : fds) {
+                for (int fd : {item.box[0], item.box[1], item.daemon[0], item.daemon[1]}) {
+                    ::close(fd);
+                }
+            }
+            state.SkipWithError("io_uring is not available");
+            return;
+        }
+        std::vector<std::unique_ptr<RelaySession>> sessions;
+        for (const ConnectionFds &item : fds) {
+            sessions.push_back(std::unique_ptr<RelaySession>(new RelaySession(&reactor, item)));
+        }
+        EchoDaemon daemon(fds);
+        for (auto _ : state) {
+            std::vector<std::thread> clients;
+            std::atomic<int> done(0);
+            const quint64 socketBefore = socketSyscallCount();
+            const quint64 reactorBefore = reactor.metrics().syscalls;
+            const qint64 cpuBefore = threadCpuUs();
+            for (int i = 0; i < connections; i++) {
+                clients.emplace_back(runClient, fds[i].box[0], std::cref(msg), &done);
+            }
+            while (done.load() < connections) {
+                reactor.poll(kWaitTimeout);
+            }
+            cpuUs += threadCpuUs() - cpuBefore;
+            syscalls += socketSyscallCount() - socketBefore + reactor.metrics().syscalls - reactorBefore;
+            for (std::thread &client : clients) {
+                client.join();
+            }
+            // 每条消息经过代理两次：客户端到daemon与回显
+            messages += static_cast<qint64>(connections) * kMessagesPerClient * 2;
+        }
+    }
+    for (const ConnectionFds &item : fds) {
+        ::close(item.box[0]);
+        ::close(item.daemon[1]);
+    }
+    if (messages > 0) {
+        state.counters["syscalls_per_msg"] = static_cast<double>(syscalls) / messages;
+        state.counters["cpu_us_per_msg"] = static_cast<double>(cpuUs) / messages;
+    }
+    state.SetItemsProcessed(messages);
+}
+BENCHMARK(BM_ProxyRelayBackend)
+    ->ArgsProduct({{0, 1}, {1, 16}})
+    ->ArgNames({"uring", "conns"})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
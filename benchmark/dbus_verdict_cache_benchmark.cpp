@@ -0,0 +1,130 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "benchmark_util.h"
+#include "filter/dbus_filter.h"
+#include "filter/dbus_verdict_cache.h"
+#include "message/dbus_header_view.h"
+
+// 回放沙箱应用的典型消息序列：解析报文头后匹配过滤规则，对比每条消息重新匹配与按报文头字段缓存判定结果
+namespace {
+
+// 回放序列长度
+const int kTraceSize = 4096;
+
+// 一种调用及其在序列中的权重
+struct TraceCall {
+    int weight;
+    const char *dest;
+    const char *path;
+    const char *iface;
+    const char *member;
+};
+
+// 轮询属性、输入法按键与门户设置读取占大多数，少量一次性调用
+const TraceCall kTraceCalls[] = {
+    {30, "org.freedesktop.NetworkManager", "/org/freedesktop/NetworkManager", "org.freedesktop.DBus.Properties",
+     "Get"},
+    {25, "org.fcitx.Fcitx5", "/org/freedesktop/portal/inputcontext/1", "org.fcitx.Fcitx.InputContext1",
+     "ProcessKeyEvent"},
+    {15, "org.freedesktop.portal.Desktop", "/org/freedesktop/portal/desktop", "org.freedesktop.portal.Settings",
+     "Read"},
+    {10, "com.deepin.daemon.Appearance", "/com/deepin/daemon/Appearance", "org.freedesktop.DBus.Properties",
+     "GetAll"},
+    {5, "org.freedesktop.Notifications", "/org/freedesktop/Notifications", "org.freedesktop.Notifications",
+     "Notify"},
+    {5, "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus", "AddMatch"},
+    {5, "com.deepin.linglong.AppManager", "/com/deepin/linglong/PackageManager",
+     "com.deepin.linglong.PackageManager", "Status"},
+};
+
+/*
+ * 生成回放序列，每100条中有5条发给不同唯一名称的一次性调用
+ *
+ * @return QVector<QByteArray>: 报文序列
+ */
+QVector<QByteArray> makeTrace()
+{
+    int totalWeight = 0;
+    for (const TraceCall &call : kTraceCalls) {
+        totalWeight += call.weight;
+    }
+    QVector<QByteArray> ret;
+    quint32 seed = 1;
+    for (int i = 0; i < kTraceSize; i++) {
+        seed = seed * 1103515245 + 12345;
+        const int pick = static_cast<int>((seed >> 16) % 100);
+        if (pick < 5) {
+            const QByteArray dest = QString(":1.%1").arg(i).toLatin1();
+            ret.append(marshalMethodCall(static_cast<quint32>(i + 1), dest.constData(), "/",
+                                         "org.freedesktop.DBus.Peer", "Ping"));
+            continue;
+        }
+        int choice = static_cast<int>((seed >> 8) % static_cast<quint32>(totalWeight));
+        for (const TraceCall &call : kTraceCalls) {
+            if (choice < call.weight) {
+                ret.append(
+                    marshalMethodCall(static_cast<quint32>(i + 1), call.dest, call.path, call.iface, call.member));
+                break;
+            }
+            choice -= call.weight;
+        }
+    }
+    return ret;
+}
+
+// 与沙箱默认配置规模相近的规则
+void addRules(DbusFilter *filter)
+{
+    for (int i = 0; i < 10; i++) {
+        filter->addNameFilter(QString("com.vendor%1.*").arg(i));
+        filter->addPathFilter(QString("/com/vendor%1/*").arg(i));
+        filter->addInterfaceFilter(QString("com.vendor%1.Service").arg(i));
+    }
+    filter->addNameFilter("com.deepin.linglong.*");
+    filter->addNameFilter("org.freedesktop.portal.Desktop*");
+    filter->addPathFilter("/com/deepin/linglong/*");
+    filter->addPathFilter("/org/freedesktop/portal/desktop");
+    filter->addInterfaceFilter("com.deepin.linglong.PackageManager");
+    filter->addInterfaceFilter("org.freedesktop.portal.Settings");
+}
+
+} // namespace
+
+// 参数：缓存容量，0为不缓存，每条消息重新匹配
+static void BM_VerdictReplay(benchmark::State &state)
+{
+    const QVector<QByteArray> trace = makeTrace();
+    DbusFilter filter;
+    addRules(&filter);
+    DBusVerdictCache cache(static_cast<int>(state.range(0)));
+    const quint32 fields =
+        filter.requiredHeaderFields() | headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_MEMBER);
+    int index = 0;
+    for (auto _ : state) {
+        const QByteArray &msg = trace[index];
+        DBusHeaderView header;
+        header.parsePartial(msg.constData(), static_cast<quint32>(msg.size()), static_cast<quint32>(msg.size()),
+                            fields);
+        cache.setGeneration(filter.generation());
+        const DBusVerdictKey key(header.destination(), header.path(), header.interface(), header.member());
+        int verdict = 0;
+        if (!cache.lookup(key, &verdict)) {
+            verdict = filter.isMessageMatch(header.destination(), header.path(), header.interface()) ? 1 : 0;
+            cache.insert(key, verdict);
+        }
+        benchmark::DoNotOptimize(verdict);
+        index = (index + 1) % trace.size();
+    }
+    const DBusVerdictCacheMetrics metrics = cache.metrics();
+    const quint64 lookups = metrics.hits + metrics.misses;
+    state.counters["hit_rate"] = lookups > 0 ? static_cast<double>(metrics.hits) / static_cast<double>(lookups) : 0;
+    state.counters["evictions"] = static_cast<double>(metrics.evictions);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VerdictReplay)->Arg(0)->Arg(64)->Arg(1024)->ArgName("capacity");
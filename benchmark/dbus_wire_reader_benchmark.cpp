@@ -0,0 +1,88 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <QList>
+
+#include "benchmark_util.h"
+#include "message/dbus_header_view.h"
+#include "message/dbus_wire_reader.h"
+
+// 对比按字节序特化的报文读取与旧的逐个整数判断字节序的实现，分别覆盖小端序与大端序报文
+namespace {
+
+/*
+ * 生成指定字节序的报文样本
+ *
+ * @param bigEndian: 是否为大端序
+ *
+ * @return QList<QByteArray>: 报文列表
+ */
+QList<QByteArray> sampleMessages(bool bigEndian)
+{
+    QList<QByteArray> msgs;
+    msgs.append(marshalMethodCall(1, "com.deepin.linglong.AppManager", "/com/deepin/linglong/PackageManager",
+                                  "com.deepin.linglong.PackageManager", "Status", 64));
+    msgs.append(marshalMethodCall(2, "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus",
+                                  "Hello"));
+    msgs.append(marshalSignal(3, "/org/freedesktop/DBus/Properties", "org.freedesktop.DBus.Properties",
+                              "PropertiesChanged"));
+    if (bigEndian) {
+        for (QByteArray &msg : msgs) {
+            msg = toBigEndianMsg(msg);
+        }
+    }
+    return msgs;
+}
+
+} // namespace
+
+// 旧实现：每个整数mid出一个QByteArray再按字节序拼接
+static void BM_LegacyReadFixedHeader(benchmark::State &state)
+{
+    const bool bigEndian = state.range(0) != 0;
+    const QList<QByteArray> msgs = sampleMessages(bigEndian);
+    for (auto _ : state) {
+        for (const QByteArray &msg : msgs) {
+            benchmark::DoNotOptimize(legacyByteAraryToInt(msg.mid(4, 4), bigEndian));
+            benchmark::DoNotOptimize(legacyByteAraryToInt(msg.mid(8, 4), bigEndian));
+            benchmark::DoNotOptimize(legacyByteAraryToInt(msg.mid(12, 4), bigEndian));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * msgs.size());
+}
+BENCHMARK(BM_LegacyReadFixedHeader)->Arg(0)->Arg(1);
+
+template<DBusByteOrder Order>
+static void BM_WireReaderFixedHeader(benchmark::State &state)
+{
+    const QList<QByteArray> msgs = sampleMessages(Order == DBusByteOrder::BigEndian);
+    for (auto _ : state) {
+        for (const QByteArray &msg : msgs) {
+            benchmark::DoNotOptimize(DBusWireReader<Order>::readUInt32(msg.constData() + 4));
+            benchmark::DoNotOptimize(DBusWireReader<Order>::readUInt32(msg.constData() + 8));
+            benchmark::DoNotOptimize(DBusWireReader<Order>::readUInt32(msg.constData() + 12));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * msgs.size());
+}
+BENCHMARK_TEMPLATE(BM_WireReaderFixedHeader, DBusByteOrder::LittleEndian);
+BENCHMARK_TEMPLATE(BM_WireReaderFixedHeader, DBusByteOrder::BigEndian);
+
+// 完整解析报文头，0为小端序，1为大端序
+static void BM_HeaderViewParseByteOrder(benchmark::State &state)
+{
+    const QList<QByteArray> msgs = sampleMessages(state.range(0) != 0);
+    for (auto _ : state) {
+        for (const QByteArray &msg : msgs) {
+            DBusHeaderView header;
+            benchmark::DoNotOptimize(header.parse(msg.constData(), static_cast<quint32>(msg.size())));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * msgs.size());
+}
+BENCHMARK(BM_HeaderViewParseByteOrder)->Arg(0)->Arg(1);
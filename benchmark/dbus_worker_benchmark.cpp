@@ -0,0 +1,103 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <unistd.h>
+
+#include <vector>
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QEventLoop>
+#include <QThread>
+
+#include "benchmark_util.h"
+#include "echo_bus.h"
+#include "proxy/dbus_proxy.h"
+
+// 多个box客户端同时经过完整的DbusProxy转发时，工作线程数对总吞吐的影响
+namespace {
+
+// 同时连接的客户端数
+const int kClients = 64;
+// 每个客户端每次迭代发送的消息数
+const int kMessagesPerClient = 1000;
+// 客户端发送一个窗口的消息后再等待全部回显
+const int kWindow = 16;
+// 模拟dbus-daemon的线程数，不成为瓶颈
+const int kDaemonThreads = 4;
+// 处理断开事件的等待时间，毫秒
+const int kWaitTimeout = 10;
+
+/*
+ * 客户端每次写入一个窗口的消息，读完全部回显后再写下一个窗口
+ *
+ * @param fd: 客户端描述符
+ * @param window: 一个窗口的消息
+ */
+void runWindows(int fd, const QByteArray &window)
+{
+    QByteArray buf(window.size(), '\0');
+    for (int i = 0; i < kMessagesPerClient / kWindow; i++) {
+        if (!writeAll(fd, window.constData(), window.size()) || !readAll(fd, buf.data(), buf.size())) {
+            return;
+        }
+    }
+}
+
+} // namespace
+
+// 参数：工作线程数，1表示所有连接在监听线程中处理
+static void BM_ProxyWorkerScaling(benchmark::State &state)
+{
+    ensureApplication();
+    const int workerCount = static_cast<int>(state.range(0));
+    const QString prefix = QDir::tempPath() + QString("/dbus-proxy-worker-%1-%2").arg(getpid()).arg(workerCount);
+    const QByteArray msg = marshalMethodCall(1, "org.deepin.linglong.demo", "/org/deepin/linglong/demo",
+                                             "org.deepin.linglong.demo", "Ping", 64);
+    QByteArray window;
+    for (int i = 0; i < kWindow; i++) {
+        window.append(msg);
+    }
+    qint64 messages = 0;
+    {
+        EchoBus bus(prefix + "-bus", kDaemonThreads, kClients);
+        DbusProxy proxy;
+        proxy.saveDbusDaemonPath(prefix + "-bus");
+        proxy.setReactorEnabled(true);
+        proxy.setWorkerCount(workerCount);
+        if (!proxy.startListenBoxClient(prefix + "-proxy")) {
+            state.SkipWithError("listen failed");
+            return;
+        }
+        std::vector<int> fds;
+        for (int i = 0; i < kClients; i++) {
+            fds.push_back(connectTo(prefix + "-proxy"));
+        }
+        runClients(fds, authenticate);
+        for (auto _ : state) {
+            runClients(fds, [&window](int fd) { runWindows(fd, window); });
+            // 每条消息经过代理两次：客户端到dbus-daemon与回显
+            messages += static_cast<qint64>(kClients) * kMessagesPerClient * 2;
+        }
+        for (int fd : fds) {
+            ::close(fd);
+        }
+        // 处理断开事件，释放连接后再停止dbus-daemon
+        QCoreApplication::processEvents(QEventLoop::AllEvents, kWaitTimeout);
+    }
+    state.counters["cpus"] = QThread::idealThreadCount();
+    state.SetItemsProcessed(messages);
+}
+BENCHMARK(BM_ProxyWorkerScaling)
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->Arg(8)
+    ->ArgName("workers")
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
@@ -0,0 +1,224 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "echo_bus.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QEventLoop>
+
+// 事件循环与poll最长等待时间，毫秒
+static const int kWaitTimeout = 10;
+
+// 转发路径上的调试日志会掩盖转发开销，只保留警告以上级别
+static void quietMessageHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg)
+{
+    Q_UNUSED(context);
+    if (type != QtDebugMsg && type != QtInfoMsg) {
+        fprintf(stderr, "%s\n", msg.toLocal8Bit().constData());
+    }
+}
+
+void ensureApplication()
+{
+    static int argc = 1;
+    static char name[] = "dbus-proxy-benchmark";
+    static char *argv[] = {name, nullptr};
+    if (!QCoreApplication::instance()) {
+        new QCoreApplication(argc, argv);
+        qInstallMessageHandler(quietMessageHandler);
+    }
+}
+
+bool writeAll(int fd, const char *data, qint64 size)
+{
+    qint64 offset = 0;
+    while (offset < size) {
+        const ssize_t ret = ::write(fd, data + offset, static_cast<size_t>(size - offset));
+        if (ret <= 0) {
+            return false;
+        }
+        offset += ret;
+    }
+    return true;
+}
+
+bool readAll(int fd, char *data, qint64 size)
+{
+    qint64 offset = 0;
+    while (offset < size) {
+        const ssize_t ret = ::read(fd, data + offset, static_cast<size_t>(size - offset));
+        if (ret <= 0) {
+            return false;
+        }
+        offset += ret;
+    }
+    return true;
+}
+
+int connectTo(const QString &path)
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.toLocal8Bit().constData(), sizeof(addr.sun_path) - 1);
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void authenticate(int fd)
+{
+    const char auth[] = "\0AUTH EXTERNAL 30\r\n";
+    writeAll(fd, auth, sizeof(auth) - 1);
+    char c = 0;
+    while (c != '\n' && ::read(fd, &c, 1) == 1) {
+    }
+    const char begin[] = "BEGIN\r\n";
+    writeAll(fd, begin, sizeof(begin) - 1);
+}
+
+void runClients(const std::vector<int> &fds, const std::function<void(int)> &task)
+{
+    std::atomic<int> done(0);
+    std::vector<std::thread> clients;
+    for (int fd : fds) {
+        clients.emplace_back([&task, &done, fd]() {
+            task(fd);
+            done.fetch_add(1);
+        });
+    }
+    while (done.load() < static_cast<int>(fds.size())) {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, kWaitTimeout);
+    }
+    for (std::thread &client : clients) {
+        client.join();
+    }
+}
+
+void runInBackground(const std::function<void()> &task)
+{
+    std::atomic<bool> done(false);
+    std::thread worker([&task, &done]() {
+        task();
+        done = true;
+    });
+    while (!done.load()) {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, kWaitTimeout);
+    }
+    worker.join();
+}
+
+struct EchoBus::Peer {
+    int fd;
+    bool binary;
+    QByteArray line;
+};
+
+EchoBus::EchoBus(const QString &path, int threads, int backlog)
+    : running(true)
+{
+    ::unlink(path.toLocal8Bit().constData());
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.toLocal8Bit().constData(), sizeof(addr.sun_path) - 1);
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    listen(listenFd, backlog);
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back([this]() { run(); });
+    }
+}
+
+EchoBus::~EchoBus()
+{
+    running = false;
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    ::close(listenFd);
+}
+
+/*
+ * 处理认证阶段的数据
+ *
+ * @param fd: 连接描述符
+ * @param binary: 输入输出，是否已收到BEGIN
+ * @param pending: 尚未组成完整一行的数据
+ * @param data: 收到的数据
+ * @param size: 数据长度
+ */
+static void handleAuth(int fd, bool *binary, QByteArray *pending, const char *data, int size)
+{
+    pending->append(data, size);
+    int end = 0;
+    while (!*binary && (end = pending->indexOf('\n')) >= 0) {
+        const QByteArray line = pending->left(end + 1);
+        pending->remove(0, end + 1);
+        if (line.contains("AUTH")) {
+            const char reply[] = "OK 0123456789abcdef0123456789abcdef\r\n";
+            writeAll(fd, reply, sizeof(reply) - 1);
+        } else if (line.startsWith("BEGIN")) {
+            *binary = true;
+        }
+    }
+    if (*binary && !pending->isEmpty()) {
+        writeAll(fd, pending->constData(), pending->size());
+        pending->clear();
+    }
+}
+
+void EchoBus::run()
+{
+    std::vector<Peer> peers;
+    std::vector<pollfd> items;
+    char buf[64 * 1024];
+    while (running) {
+        items.clear();
+        items.push_back({listenFd, POLLIN, 0});
+        for (const Peer &peer : peers) {
+            items.push_back({peer.fd, POLLIN, 0});
+        }
+        if (::poll(items.data(), items.size(), kWaitTimeout) <= 0) {
+            continue;
+        }
+        if (items[0].revents & POLLIN) {
+            const int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd >= 0) {
+                peers.push_back({fd, false, QByteArray()});
+            }
+        }
+        for (size_t i = 1; i < items.size(); i++) {
+            if (!(items[i].revents & (POLLIN | POLLHUP))) {
+                continue;
+            }
+            Peer &peer = peers[i - 1];
+            const ssize_t ret = ::read(peer.fd, buf, sizeof(buf));
+            if (ret <= 0) {
+                continue;
+            }
+            if (peer.binary) {
+                writeAll(peer.fd, buf, ret);
+            } else {
+                handleAuth(peer.fd, &peer.binary, &peer.line, buf, static_cast<int>(ret));
+            }
+        }
+    }
+    for (const Peer &peer : peers) {
+        ::close(peer.fd);
+    }
+}
@@ -0,0 +1,102 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_DBUS_PROXY_BENCHMARK_ECHO_BUS_H
+#define LINGLONG_DBUS_PROXY_BENCHMARK_ECHO_BUS_H
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include <QString>
+
+// 经过完整DbusProxy转发的基准测试共用的模拟dbus-daemon与客户端工具
+
+// 基准测试没有main函数创建的QCoreApplication，监听与事件循环都需要；同时只保留警告以上级别的日志
+void ensureApplication();
+
+/*
+ * 把数据写完，阻塞描述符
+ *
+ * @param fd: 描述符
+ * @param data: 数据地址
+ * @param size: 数据长度
+ *
+ * @return bool: true:成功 false:失败
+ */
+bool writeAll(int fd, const char *data, qint64 size);
+
+/*
+ * 读满指定长度，阻塞描述符
+ *
+ * @param fd: 描述符
+ * @param data: 输出地址
+ * @param size: 读取长度
+ *
+ * @return bool: true:成功 false:连接断开
+ */
+bool readAll(int fd, char *data, qint64 size);
+
+/*
+ * 连接unix socket
+ *
+ * @param path: 地址
+ *
+ * @return int: 描述符，失败返回-1
+ */
+int connectTo(const QString &path);
+
+/*
+ * 客户端认证：发送AUTH，等待dbus-daemon经代理返回OK后发送BEGIN
+ *
+ * @param fd: 客户端描述符
+ */
+void authenticate(int fd);
+
+/*
+ * 每个客户端在独立线程中执行task，同时驱动当前线程的事件循环直到全部完成
+ *
+ * @param fds: 客户端描述符
+ * @param task: 客户端任务
+ */
+void runClients(const std::vector<int> &fds, const std::function<void(int)> &task);
+
+/*
+ * 在一个线程中依次执行task，同时驱动当前线程的事件循环直到完成，用于大量客户端的连接与认证
+ *
+ * @param task: 任务
+ */
+void runInBackground(const std::function<void()> &task);
+
+/*
+ * 模拟dbus-daemon：认证阶段对AUTH回复OK，BEGIN之后把收到的数据原样写回
+ * 多个线程在同一个非阻塞监听socket上接受连接，各自处理接受到的连接
+ */
+class EchoBus
+{
+public:
+    /*
+     * 监听并启动处理线程
+     *
+     * @param path: 监听地址
+     * @param threads: 处理线程数
+     * @param backlog: 监听队列长度
+     */
+    EchoBus(const QString &path, int threads, int backlog);
+    ~EchoBus();
+
+private:
+    // 一个dbus-daemon侧的连接
+    struct Peer;
+
+    void run();
+
+    int listenFd;
+    std::atomic<bool> running;
+    std::vector<std::thread> workers;
+};
+#endif
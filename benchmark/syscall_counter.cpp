@@ -0,0 +1,44 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "syscall_counter.h"
+
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+
+// 包装代理使用的socket收发函数统计调用次数，直接发起系统调用，不经过glibc的实现
+static std::atomic<quint64> socketCalls(0);
+
+extern "C" ssize_t recvmsg(int fd, struct msghdr *msg, int flags)
+{
+    socketCalls.fetch_add(1, std::memory_order_relaxed);
+    return ::syscall(SYS_recvmsg, fd, msg, flags);
+}
+
+extern "C" ssize_t sendmsg(int fd, const struct msghdr *msg, int flags)
+{
+    socketCalls.fetch_add(1, std::memory_order_relaxed);
+    return ::syscall(SYS_sendmsg, fd, msg, flags);
+}
+
+extern "C" ssize_t recv(int fd, void *buf, size_t size, int flags)
+{
+    socketCalls.fetch_add(1, std::memory_order_relaxed);
+    return ::syscall(SYS_recvfrom, fd, buf, size, flags, nullptr, nullptr);
+}
+
+/*
+ * 获取进程启动以来socket收发系统调用次数(recvmsg/sendmsg/recv)
+ *
+ * @return quint64: 调用次数
+ */
+quint64 socketSyscallCount()
+{
+    return socketCalls.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,19 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_DBUS_PROXY_BENCHMARK_SYSCALL_COUNTER_H
+#define LINGLONG_DBUS_PROXY_BENCHMARK_SYSCALL_COUNTER_H
+
+#include <QtGlobal>
+
+/*
+ * 获取进程启动以来socket收发系统调用次数(recvmsg/sendmsg/recv)
+ * 基准测试中的客户端与回显线程使用read/write，不计入
+ *
+ * @return quint64: 调用次数
+ */
+quint64 socketSyscallCount();
+#endif
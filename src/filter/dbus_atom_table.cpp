@@ -0,0 +1,234 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "dbus_atom_table.h"
+
+#include <string.h>
+
+#include <QHash>
+#include <QMutexLocker>
+
+// 常量可能按引用使用，需要定义
+const int DBusAtomTable::kEmptyAtom;
+const int DBusAtomTable::kNoAtom;
+
+// 进程内原子表的默认内存上限
+static const qint64 kAtomTableLimit = 8 * 1024 * 1024;
+// 每个原子除文本外的估计开销：表项、哈希槽与QByteArray头
+static const int kEntryOverhead = 64;
+
+/*
+ * 获取进程内共用的原子表
+ *
+ * @return DBusAtomTable*: 原子表
+ */
+DBusAtomTable *DBusAtomTable::instance()
+{
+    static DBusAtomTable table(kAtomTableLimit);
+    return &table;
+}
+
+/*
+ * 创建原子表，一般使用instance()
+ *
+ * @param limit: 内存上限，字节
+ */
+DBusAtomTable::DBusAtomTable(qint64 limit)
+    : maxBytes(limit)
+    , usedBytes(0)
+    , atomCount(0)
+    , rejectedCount(0)
+{
+    for (Shard &shard : shards) {
+        rehash(&shard, 16);
+    }
+}
+
+// 在分片中查找，返回表项下标或-1，调用方持有分片锁
+int DBusAtomTable::findEntry(const Shard &shard, const char *data, int size, uint hash)
+{
+    int slot = static_cast<int>(hash >> kShardBits) & shard.slotMask;
+    for (int entry = shard.buckets[slot]; entry >= 0; entry = shard.buckets[slot]) {
+        const Entry &item = shard.entries[entry];
+        if (item.hash == hash && item.text.size() == size
+            && memcmp(item.text.constData(), data, static_cast<size_t>(size)) == 0) {
+            return entry;
+        }
+        slot = (slot + 1) & shard.slotMask;
+    }
+    return -1;
+}
+
+// 从哈希表中删除表项，后续槽位前移，调用方持有分片锁
+void DBusAtomTable::removeEntry(Shard *shard, int entry)
+{
+    const int mask = shard->slotMask;
+    int hole = static_cast<int>(shard->entries[entry].hash >> kShardBits) & mask;
+    while (shard->buckets[hole] != entry) {
+        hole = (hole + 1) & mask;
+    }
+    shard->buckets[hole] = -1;
+    // 线性探测删除后，把探测链上可以前移的项移到空出的槽，保证查找不会提前遇到空槽
+    for (int slot = (hole + 1) & mask; shard->buckets[slot] >= 0; slot = (slot + 1) & mask) {
+        const int home = static_cast<int>(shard->entries[shard->buckets[slot]].hash >> kShardBits) & mask;
+        const bool movable = hole <= slot ? (home <= hole || home > slot) : (home <= hole && home > slot);
+        if (movable) {
+            shard->buckets[hole] = shard->buckets[slot];
+            shard->buckets[slot] = -1;
+            hole = slot;
+        }
+    }
+}
+
+// 扩容分片的哈希表，调用方持有分片锁
+void DBusAtomTable::rehash(Shard *shard, int slotCount)
+{
+    shard->buckets.fill(-1, slotCount);
+    shard->slotMask = slotCount - 1;
+    for (int i = 0; i < shard->entries.size(); i++) {
+        if (shard->entries[i].refs == 0) {
+            continue;
+        }
+        int slot = static_cast<int>(shard->entries[i].hash >> kShardBits) & shard->slotMask;
+        while (shard->buckets[slot] >= 0) {
+            slot = (slot + 1) & shard->slotMask;
+        }
+        shard->buckets[slot] = i;
+    }
+}
+
+/*
+ * 查找字符串对应的原子，不增加引用
+ *
+ * @param data: 字符串视图
+ *
+ * @return int: 原子，不存在时返回kNoAtom
+ */
+int DBusAtomTable::find(QLatin1String data) const
+{
+    if (data.size() == 0) {
+        return kEmptyAtom;
+    }
+    const uint hash = qHashBits(data.data(), static_cast<size_t>(data.size()));
+    const int index = static_cast<int>(hash & (kShardCount - 1));
+    const Shard &shard = shards[index];
+    QMutexLocker locker(&shard.lock);
+    const int entry = findEntry(shard, data.data(), data.size(), hash);
+    return entry < 0 ? kNoAtom : ((entry << kShardBits) | index) + 1;
+}
+
+/*
+ * 获取字符串对应的原子并增加一次引用，不存在时创建
+ *
+ * @param data: 字符串视图
+ *
+ * @return int: 原子，超过内存上限时返回kNoAtom
+ */
+int DBusAtomTable::intern(QLatin1String data)
+{
+    if (data.size() == 0) {
+        return kEmptyAtom;
+    }
+    const uint hash = qHashBits(data.data(), static_cast<size_t>(data.size()));
+    const int index = static_cast<int>(hash & (kShardCount - 1));
+    Shard &shard = shards[index];
+    QMutexLocker locker(&shard.lock);
+    int entry = findEntry(shard, data.data(), data.size(), hash);
+    if (entry >= 0) {
+        shard.entries[entry].refs++;
+        return ((entry << kShardBits) | index) + 1;
+    }
+    const qint64 cost = data.size() + kEntryOverhead;
+    if (usedBytes.fetchAndAddRelaxed(cost) + cost > maxBytes) {
+        usedBytes.fetchAndAddRelaxed(-cost);
+        rejectedCount.fetchAndAddRelaxed(1);
+        return kNoAtom;
+    }
+    Entry item = {QByteArray(data.data(), data.size()), hash, 1};
+    if (shard.freeEntries.isEmpty()) {
+        shard.entries.append(item);
+        entry = shard.entries.size() - 1;
+    } else {
+        entry = shard.freeEntries.takeLast();
+        shard.entries[entry] = item;
+    }
+    atomCount.fetchAndAddRelaxed(1);
+    // 负载超过一半时扩容，扩容时已包含新表项
+    if ((shard.entries.size() - shard.freeEntries.size()) * 2 > shard.buckets.size()) {
+        rehash(&shard, shard.buckets.size() * 2);
+    } else {
+        int slot = static_cast<int>(hash >> kShardBits) & shard.slotMask;
+        while (shard.buckets[slot] >= 0) {
+            slot = (slot + 1) & shard.slotMask;
+        }
+        shard.buckets[slot] = entry;
+    }
+    return ((entry << kShardBits) | index) + 1;
+}
+
+/*
+ * 释放一次引用，引用计数归零时删除原子
+ *
+ * @param atom: intern返回的原子
+ */
+void DBusAtomTable::release(int atom)
+{
+    if (atom <= kEmptyAtom) {
+        return;
+    }
+    const int index = (atom - 1) & (kShardCount - 1);
+    const int entry = (atom - 1) >> kShardBits;
+    Shard &shard = shards[index];
+    QMutexLocker locker(&shard.lock);
+    if (entry >= shard.entries.size() || shard.entries[entry].refs == 0) {
+        return;
+    }
+    Entry &item = shard.entries[entry];
+    if (--item.refs > 0) {
+        return;
+    }
+    removeEntry(&shard, entry);
+    usedBytes.fetchAndAddRelaxed(-(item.text.size() + kEntryOverhead));
+    atomCount.fetchAndAddRelaxed(-1);
+    item.text = QByteArray();
+    shard.freeEntries.append(entry);
+}
+
+/*
+ * 获取原子对应的字符串
+ *
+ * @param atom: 原子
+ *
+ * @return QByteArray: 字符串，原子无效时为空
+ */
+QByteArray DBusAtomTable::text(int atom) const
+{
+    if (atom <= kEmptyAtom) {
+        return QByteArray();
+    }
+    const int index = (atom - 1) & (kShardCount - 1);
+    const int entry = (atom - 1) >> kShardBits;
+    const Shard &shard = shards[index];
+    QMutexLocker locker(&shard.lock);
+    if (entry >= shard.entries.size() || shard.entries[entry].refs == 0) {
+        return QByteArray();
+    }
+    return shard.entries[entry].text;
+}
+
+/*
+ * 获取统计信息
+ *
+ * @return DBusAtomTableMetrics: 统计信息
+ */
+DBusAtomTableMetrics DBusAtomTable::metrics() const
+{
+    DBusAtomTableMetrics ret;
+    ret.atoms = atomCount.load();
+    ret.bytes = usedBytes.load();
+    ret.rejected = rejectedCount.load();
+    return ret;
+}
@@ -0,0 +1,141 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_DBUS_PROXY_SRC_FILTER_DBUS_ATOM_TABLE_H
+#define LINGLONG_DBUS_PROXY_SRC_FILTER_DBUS_ATOM_TABLE_H
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QLatin1String>
+#include <QMutex>
+#include <QVector>
+
+// 原子表统计信息
+struct DBusAtomTableMetrics {
+    // 当前原子数
+    int atoms;
+    // 原子文本与表项占用的字节数
+    qint64 bytes;
+    // 超过内存上限未能创建的原子数
+    quint64 rejected;
+};
+
+/*
+ * 进程内共用的字符串原子表
+ *
+ * 把总线名称、路径、interface等报文头字段的原始字节映射为稳定的小整数，判定缓存与授权映射等按原子比较。
+ * 判定缓存在各线程的局部索引中解析原子，转发消息时不查本表，只在创建与淘汰缓存条目时访问。
+ * 表按哈希分片，每片一个互斥锁，多个工作线程同时访问时很少竞争。
+ * 原子带引用计数，由持有者intern与release，引用计数归零时立即释放；内存超过上限时不再创建新原子。
+ * 查找不创建原子，消息中出现的临时字段不会占用表
+ */
+class DBusAtomTable
+{
+public:
+    // 空字符串的原子，不占用表项
+    static const int kEmptyAtom = 0;
+    // 表中不存在或未能创建
+    static const int kNoAtom = -1;
+
+    /*
+     * 获取进程内共用的原子表
+     *
+     * @return DBusAtomTable*: 原子表
+     */
+    static DBusAtomTable *instance();
+
+    /*
+     * 创建原子表，一般使用instance()
+     *
+     * @param limit: 内存上限，字节
+     */
+    explicit DBusAtomTable(qint64 limit);
+
+    /*
+     * 设置内存上限，只影响之后创建的原子
+     *
+     * @param limit: 内存上限，字节
+     */
+    void setLimit(qint64 limit) { maxBytes = limit; }
+
+    /*
+     * 查找字符串对应的原子，不增加引用
+     *
+     * @param data: 字符串视图
+     *
+     * @return int: 原子，不存在时返回kNoAtom
+     */
+    int find(QLatin1String data) const;
+
+    /*
+     * 获取字符串对应的原子并增加一次引用，不存在时创建
+     *
+     * @param data: 字符串视图
+     *
+     * @return int: 原子，超过内存上限时返回kNoAtom
+     */
+    int intern(QLatin1String data);
+
+    /*
+     * 释放一次引用，引用计数归零时删除原子
+     *
+     * @param atom: intern返回的原子
+     */
+    void release(int atom);
+
+    /*
+     * 获取原子对应的字符串
+     *
+     * @param atom: 原子
+     *
+     * @return QByteArray: 字符串，原子无效时为空
+     */
+    QByteArray text(int atom) const;
+
+    /*
+     * 获取统计信息
+     *
+     * @return DBusAtomTableMetrics: 统计信息
+     */
+    DBusAtomTableMetrics metrics() const;
+
+private:
+    Q_DISABLE_COPY(DBusAtomTable)
+
+    // 分片数，原子的低位为分片下标
+    static const int kShardBits = 4;
+    static const int kShardCount = 1 << kShardBits;
+
+    struct Entry {
+        QByteArray text;
+        uint hash;
+        // 引用计数，0为空闲表项
+        int refs;
+    };
+
+    // 一个分片：表项与开放寻址哈希表，哈希表保存表项下标，-1为空槽
+    struct Shard {
+        mutable QMutex lock;
+        QVector<Entry> entries;
+        QVector<int> freeEntries;
+        QVector<int> buckets;
+        int slotMask = 0;
+    };
+
+    // 在分片中查找，返回表项下标或-1，调用方持有分片锁
+    static int findEntry(const Shard &shard, const char *data, int size, uint hash);
+    // 从哈希表中删除表项，后续槽位前移，调用方持有分片锁
+    static void removeEntry(Shard *shard, int entry);
+    // 扩容分片的哈希表，调用方持有分片锁
+    static void rehash(Shard *shard, int slotCount);
+
+    Shard shards[kShardCount];
+    qint64 maxBytes;
+    QAtomicInteger<qint64> usedBytes;
+    QAtomicInt atomCount;
+    QAtomicInteger<quint64> rejectedCount;
+};
+#endif
@@ -11,57 +11,70 @@
 #include <QJsonObject>
 #include <QJsonParseError>
 #include <QJsonValue>
-#include <QRegExp>
+
+DbusFilter::DbusFilter()
+    : policyFields(DBUS_HEADER_FIELDS_NONE)
+    , compiled(false)
+    , ruleGeneration(0)
+{
+}
 
 /*
- * 判断是否为符合规则的表达式
+ * 把一个字段的规则分成按段匹配的规则与其余正则规则，分别编译
  *
- * @param expression: 表达式
- *
- * @return bool: true: 是 false:否
+ * @param rules: 规则列表
+ * @param separator: 段分隔符
+ * @param trie: 输出前缀树
+ * @param matcher: 输出正则匹配器
  */
-bool DbusFilter::isRegularExp(const QString &expression)
+static void compileRules(const QStringList &rules, char separator, QSharedPointer<const DBusNameTrie> *trie,
+                         QSharedPointer<const DBusRuleMatcher> *matcher)
 {
-    return expression.endsWith("*") || expression.endsWith("+") || expression.endsWith("?");
+    QStringList patterns;
+    for (const QString &rule : rules) {
+        if (!DBusNameTrie::isHierarchical(rule, separator)) {
+            patterns.append(rule);
+        }
+    }
+    trie->reset(new DBusNameTrie(rules, separator));
+    matcher->reset(new DBusRuleMatcher(patterns));
 }
 
 /*
- * 判断输入字符串是否匹配指定规则
- *
- * @param src: 输入表达式
- * @param reg: 正则表达式
- *
- * @return bool: true: 是 false:否
+ * 把规则编译成匹配器，之后的匹配只读，可以在多个线程中同时进行
+ * 添加规则后的第一次匹配会自动编译，多线程匹配前需要先调用
  */
-bool DbusFilter::isMatchRegExp(const QString &src, const QString &reg)
+void DbusFilter::compile()
 {
-    const QRegExp regx(reg);
-    return src.contains(regx);
+    compileRules(nameFilter, '.', &nameTrie, &nameMatcher);
+    compileRules(pathFilter, '/', &pathTrie, &pathMatcher);
+    compileRules(interfaceFilter, '.', &interfaceTrie, &interfaceMatcher);
+    policy.reset(new DBusPolicy(policyRules));
+    compiled = true;
 }
 
 /*
- * 判断输入数据是否匹配指定规则列表
+ * 判断dbus消息是否匹配规则列表
+ * dbus名称与路径只含ASCII字符，参数按Latin-1转换后与报文视图按同样方式匹配
  *
- * @param data: 输入表达式
- * @param filterList: 规则列表
+ * @param name: 消息名称
+ * @param path: 消息路径
+ * @param interface: 消息interface
  *
  * @return bool: true: 是 false:否
  */
-bool DbusFilter::isMatchFilter(const QString &data, const QStringList &filterList)
+bool DbusFilter::isMessageMatch(const QString &name, const QString &path, const QString &interface)
 {
-    bool isFound = false;
-    for (const QString &item : filterList) {
-        if (item == data || (isRegularExp(item) && isMatchRegExp(data, item))) {
-            isFound = true;
-            break;
-        }
-    }
-
-    return isFound;
+    const QByteArray nameBytes = name.toLatin1();
+    const QByteArray pathBytes = path.toLatin1();
+    const QByteArray interfaceBytes = interface.toLatin1();
+    return isMessageMatch(QLatin1String(nameBytes.constData(), nameBytes.size()),
+                          QLatin1String(pathBytes.constData(), pathBytes.size()),
+                          QLatin1String(interfaceBytes.constData(), interfaceBytes.size()));
 }
 
 /*
- * 判断dbus消息是否匹配规则列表
+ * 判断dbus消息是否匹配规则列表，参数为报文中字段的视图，用于消息转发热路径
  *
  * @param name: 消息名称
  * @param path: 消息路径
@@ -69,23 +82,63 @@ bool DbusFilter::isMatchFilter(const QString &data, const QStringList &filterLis
  *
  * @return bool: true: 是 false:否
  */
-bool DbusFilter::isMessageMatch(const QString &name, const QString &path, const QString &interface)
+bool DbusFilter::isMessageMatch(QLatin1String name, QLatin1String path, QLatin1String interface)
 {
     if (name.isEmpty() && path.isEmpty() && interface.isEmpty()) {
         return false;
     }
-    if (!name.isEmpty() && !isMatchFilter(name, nameFilter)) {
+    if (!compiled) {
+        compile();
+    }
+    if (!name.isEmpty() && !nameTrie->isMatch(name) && !nameMatcher->isMatch(name)) {
         return false;
     }
-    if (!path.isEmpty() && !isMatchFilter(path, pathFilter)) {
+    if (!path.isEmpty() && !pathTrie->isMatch(path) && !pathMatcher->isMatch(path)) {
         return false;
     }
-    if (!interface.isEmpty() && !isMatchFilter(interface, interfaceFilter)) {
+    if (!interface.isEmpty() && !interfaceTrie->isMatch(interface) && !interfaceMatcher->isMatch(interface)) {
         return false;
     }
     return true;
 }
 
+/*
+ * 判定一条消息：先按策略规则判定，没有匹配的策略规则时，匹配三个名单的消息需要申请授权，其余直接转发
+ *
+ * @param header: 消息报文头，需要包含requiredHeaderFields中的字段
+ *
+ * @return DBusPolicyVerdict: 判定结果
+ */
+DBusPolicyVerdict DbusFilter::evaluate(const DBusHeaderView &header)
+{
+    if (!compiled) {
+        compile();
+    }
+    DBusPolicyVerdict verdict;
+    if (policy->evaluate(header, &verdict)) {
+        return verdict;
+    }
+    verdict.action = isMessageMatch(header.destination(), header.path(), header.interface()) ? DBusPolicyAction::Ask
+                                                                                             : DBusPolicyAction::Allow;
+    return verdict;
+}
+
+/*
+ * 获取匹配规则需要的报文头字段，用于按需解析报文头
+ *
+ * @return quint32: 报文头字段掩码，规则为空时任何消息都不会匹配，返回DBUS_HEADER_FIELDS_NONE
+ */
+quint32 DbusFilter::requiredHeaderFields() const
+{
+    if (nameFilter.isEmpty() && pathFilter.isEmpty() && interfaceFilter.isEmpty()) {
+        return policyFields;
+    }
+    // 字段缺失时跳过该字段的匹配，因此任一列表非空都需要确认三个字段是否存在
+    return policyFields | headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_DESTINATION)
+        | headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_PATH)
+        | headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_INTERFACE);
+}
+
 /*
  * 添加消息名称匹配规则
  *
@@ -97,6 +150,8 @@ void DbusFilter::addNameFilter(const QString &name)
         return;
     }
     nameFilter.append(name);
+    compiled = false;
+    ruleGeneration++;
 }
 
 /*
@@ -110,6 +165,8 @@ void DbusFilter::addPathFilter(const QString &path)
         return;
     }
     pathFilter.append(path);
+    compiled = false;
+    ruleGeneration++;
 }
 
 /*
@@ -123,6 +180,30 @@ void DbusFilter::addInterfaceFilter(const QString &interface)
         return;
     }
     interfaceFilter.append(interface);
+    compiled = false;
+    ruleGeneration++;
+}
+
+/*
+ * 添加策略规则，规则语法见DBusPolicyRule，先添加的规则优先
+ *
+ * @param rule: 策略规则
+ *
+ * @return bool: true:成功 false:规则不合法
+ */
+bool DbusFilter::addRule(const QString &rule)
+{
+    DBusPolicyRule parsed;
+    if (!DBusPolicyRule::parse(rule, &parsed)) {
+        qWarning() << "invalid dbus policy rule:" << rule;
+        return false;
+    }
+    ruleTexts.append(rule);
+    policyRules.append(parsed);
+    policyFields |= parsed.requiredHeaderFields();
+    compiled = false;
+    ruleGeneration++;
+    return true;
 }
 
 /*
@@ -136,6 +217,7 @@ void DbusFilter::dumpConfig(QString &config)
     item["name"] = QJsonArray::fromStringList(nameFilter);
     item["path"] = QJsonArray::fromStringList(pathFilter);
     item["interface"] = QJsonArray::fromStringList(interfaceFilter);
+    item["rule"] = QJsonArray::fromStringList(ruleTexts);
     QJsonObject obj;
     obj["dbuspermission"] = item;
     QJsonDocument doc(obj);
@@ -9,8 +9,15 @@
 
 #include <QDebug>
 #include <QObject>
+#include <QSharedPointer>
 #include <QStringList>
 
+#include "filter/dbus_name_trie.h"
+#include "filter/dbus_policy.h"
+#include "filter/dbus_rule_matcher.h"
+#include "message/dbus_header_view.h"
+#include "message/dbus_message.h"
+
 class DbusFilter : public QObject
 {
     Q_OBJECT
@@ -21,46 +28,78 @@ private:
     QStringList pathFilter;
     QStringList interfaceFilter;
 
+    // 三个字段的规则编译成的匹配器，添加规则后在下一次匹配前重新编译
+    // 按段匹配的规则放入前缀树，其余正则规则仍按原有语义在任意位置查找
+    QSharedPointer<const DBusNameTrie> nameTrie;
+    QSharedPointer<const DBusNameTrie> pathTrie;
+    QSharedPointer<const DBusNameTrie> interfaceTrie;
+    QSharedPointer<const DBusRuleMatcher> nameMatcher;
+    QSharedPointer<const DBusRuleMatcher> pathMatcher;
+    QSharedPointer<const DBusRuleMatcher> interfaceMatcher;
+    // 策略规则，优先于三个名单，编译成判定树
+    QStringList ruleTexts;
+    QVector<DBusPolicyRule> policyRules;
+    QSharedPointer<const DBusPolicy> policy;
+    // 策略规则需要的报文头字段
+    quint32 policyFields;
+    bool compiled;
+    // 规则代数，每次添加规则加一，判定缓存据此失效
+    quint64 ruleGeneration;
+
+public:
+    DbusFilter();
+
     /*
-     * 判断是否为符合规则的表达式
+     * 判断dbus消息是否匹配规则列表
+     * dbus名称与路径只含ASCII字符，参数按Latin-1转换后与报文视图按同样方式匹配
      *
-     * @param expression: 表达式
+     * @param name: 消息名称
+     * @param path: 消息路径
+     * @param interface: 消息interface
      *
      * @return bool: true: 是 false:否
      */
-    bool isRegularExp(const QString &expression);
+    bool isMessageMatch(const QString &name, const QString &path, const QString &interface);
 
     /*
-     * 判断输入字符串是否匹配指定规则
+     * 判断dbus消息是否匹配规则列表，参数为报文中字段的视图，用于消息转发热路径
      *
-     * @param src: 输入表达式
-     * @param reg: 正则表达式
+     * @param name: 消息名称
+     * @param path: 消息路径
+     * @param interface: 消息interface
      *
      * @return bool: true: 是 false:否
      */
-    bool isMatchRegExp(const QString &src, const QString &reg);
+    bool isMessageMatch(QLatin1String name, QLatin1String path, QLatin1String interface);
 
     /*
-     * 判断输入数据是否匹配指定规则列表
+     * 判定一条消息：先按策略规则判定，没有匹配的策略规则时，匹配三个名单的消息需要申请授权，其余直接转发
      *
-     * @param data: 输入表达式
-     * @param filterList: 规则列表
+     * @param header: 消息报文头，需要包含requiredHeaderFields中的字段
      *
-     * @return bool: true: 是 false:否
+     * @return DBusPolicyVerdict: 判定结果
      */
-    bool isMatchFilter(const QString &data, const QStringList &filterList);
+    DBusPolicyVerdict evaluate(const DBusHeaderView &header);
 
-public:
     /*
-     * 判断dbus消息是否匹配规则列表
+     * 获取匹配规则需要的报文头字段，用于按需解析报文头
      *
-     * @param name: 消息名称
-     * @param path: 消息路径
-     * @param interface: 消息interface
+     * @return quint32: 报文头字段掩码，规则为空时任何消息都不会匹配，返回DBUS_HEADER_FIELDS_NONE
+     */
+    quint32 requiredHeaderFields() const;
+
+    /*
+     * 把规则编译成匹配器，之后的匹配只读，可以在多个线程中同时进行
+     * 添加规则后的第一次匹配会自动编译，多线程匹配前需要先调用
+     */
+    void compile();
+
+    /*
+     * 获取规则代数，每次添加规则后变化，缓存判定结果时用于判断规则是否变化
      *
-     * @return bool: true: 是 false:否
+     * @return quint64: 规则代数
      */
-    bool isMessageMatch(const QString &name, const QString &path, const QString &interface);
+    quint64 generation() const { return ruleGeneration; }
 
     /*
      * 添加消息名称匹配规则
@@ -83,6 +122,15 @@ public:
      */
     void addInterfaceFilter(const QString &interface);
 
+    /*
+     * 添加策略规则，规则语法见DBusPolicyRule，先添加的规则优先
+     *
+     * @param rule: 策略规则
+     *
+     * @return bool: true:成功 false:规则不合法
+     */
+    bool addRule(const QString &rule);
+
     /*
      * dump dbus消息过滤规则
      *
@@ -0,0 +1,259 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "dbus_name_trie.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <QHash>
+#include <QVarLengthArray>
+
+#include "filter/dbus_rule_matcher.h"
+
+/*
+ * 编译规则列表，不是分段规则的项被忽略
+ *
+ * @param rules: 规则列表
+ * @param separator: 段分隔符
+ */
+DBusNameTrie::DBusNameTrie(const QStringList &rules, char separator)
+    : separator(separator)
+    , ruleCount(0)
+    , wildcardCount(0)
+    , slotMask(0)
+{
+    Node root = {false, false, -1};
+    nodes.append(root);
+    rehash(16);
+    for (const QString &rule : rules) {
+        if (isHierarchical(rule, separator)) {
+            addRule(rule.toUtf8());
+        }
+    }
+}
+
+/*
+ * 判断规则能否按段匹配：不是正则规则，或者只在以分隔符加*结尾处使用通配
+ *
+ * @param rule: 规则
+ * @param separator: 段分隔符
+ *
+ * @return bool: true: 是 false:否
+ */
+bool DBusNameTrie::isHierarchical(const QString &rule, char separator)
+{
+    if (rule.isEmpty()) {
+        return false;
+    }
+    // 不是正则规则时原本就是整串比较，中间的*段按单段通配匹配
+    if (!DBusRuleMatcher::isPattern(rule)) {
+        return true;
+    }
+    const QByteArray bytes = rule.toUtf8();
+    const int size = bytes.size();
+    if (size < 2 || bytes[size - 1] != '*' || bytes[size - 2] != separator) {
+        return false;
+    }
+    // 其余部分不能含有正则语法，*只能单独成段
+    for (int i = 0; i < size - 2; i++) {
+        const char c = bytes[i];
+        if (c == separator) {
+            continue;
+        }
+        if (c == '*') {
+            const bool segmentStart = i == 0 || bytes[i - 1] == separator;
+            if (!segmentStart || bytes[i + 1] != separator) {
+                return false;
+            }
+            continue;
+        }
+        if (strchr("\\^$.[](){}|+?", c)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 插入一条规则
+void DBusNameTrie::addRule(const QByteArray &rule)
+{
+    const char *data = rule.constData();
+    const int size = rule.size();
+    int node = 0;
+    int begin = 0;
+    while (true) {
+        int end = begin;
+        while (end < size && data[end] != separator) {
+            end++;
+        }
+        const bool last = end == size;
+        const bool star = end - begin == 1 && data[begin] == '*';
+        if (last && star) {
+            nodes[node].subtree = true;
+            break;
+        }
+        if (star) {
+            if (nodes[node].wildcard < 0) {
+                Node child = {false, false, -1};
+                nodes.append(child);
+                nodes[node].wildcard = nodes.size() - 1;
+                wildcardCount++;
+            }
+            node = nodes[node].wildcard;
+        } else {
+            node = addChild(node, data + begin, end - begin);
+        }
+        if (last) {
+            nodes[node].exact = true;
+            break;
+        }
+        begin = end + 1;
+    }
+    ruleCount++;
+}
+
+// 查找或创建parent下内容为segment的子节点
+int DBusNameTrie::addChild(int parent, const char *segment, int size)
+{
+    const int found = findChild(parent, segment, size);
+    if (found >= 0) {
+        return found;
+    }
+    if ((edges.size() + 1) * 2 > buckets.size()) {
+        rehash(buckets.size() * 2);
+    }
+    Node node = {false, false, -1};
+    nodes.append(node);
+    Edge edge = {parent, nodes.size() - 1, segments.size(), size,
+                 qHashBits(segment, static_cast<size_t>(size), static_cast<uint>(parent))};
+    segments.append(segment, size);
+    edges.append(edge);
+    int slot = static_cast<int>(edge.hash) & slotMask;
+    while (buckets[slot] >= 0) {
+        slot = (slot + 1) & slotMask;
+    }
+    buckets[slot] = edges.size() - 1;
+    return edge.child;
+}
+
+// 查找parent下内容为segment的子节点，不存在时返回-1
+int DBusNameTrie::findChild(int parent, const char *segment, int size) const
+{
+    const uint hash = qHashBits(segment, static_cast<size_t>(size), static_cast<uint>(parent));
+    const char *text = segments.constData();
+    int slot = static_cast<int>(hash) & slotMask;
+    for (int index = buckets[slot]; index >= 0; index = buckets[slot]) {
+        const Edge &edge = edges[index];
+        if (edge.hash == hash && edge.parent == parent && edge.size == size
+            && memcmp(text + edge.offset, segment, static_cast<size_t>(size)) == 0) {
+            return edge.child;
+        }
+        slot = (slot + 1) & slotMask;
+    }
+    return -1;
+}
+
+// 扩容子节点哈希表
+void DBusNameTrie::rehash(int slotCount)
+{
+    buckets.fill(-1, slotCount);
+    slotMask = slotCount - 1;
+    for (int i = 0; i < edges.size(); i++) {
+        int slot = static_cast<int>(edges[i].hash) & slotMask;
+        while (buckets[slot] >= 0) {
+            slot = (slot + 1) & slotMask;
+        }
+        buckets[slot] = i;
+    }
+}
+
+// 沿输入的各段匹配，同时跟踪精确分支与单段通配分支，每段每个分支查一次表
+bool DBusNameTrie::matchSegments(const char *data, int size) const
+{
+    if (ruleCount == 0) {
+        return false;
+    }
+    QVarLengthArray<int, 16> buffers[2];
+    QVarLengthArray<int, 16> *active = &buffers[0];
+    QVarLengthArray<int, 16> *next = &buffers[1];
+    active->append(0);
+    int begin = 0;
+    while (true) {
+        int end = begin;
+        while (end < size && data[end] != separator) {
+            end++;
+        }
+        next->clear();
+        for (int node : *active) {
+            // 输入还有剩余的段，是该节点的子树
+            if (nodes[node].subtree) {
+                return true;
+            }
+            const int child = findChild(node, data + begin, end - begin);
+            if (child >= 0) {
+                next->append(child);
+            }
+            if (nodes[node].wildcard >= 0) {
+                next->append(nodes[node].wildcard);
+            }
+        }
+        if (next->isEmpty()) {
+            return false;
+        }
+        std::swap(active, next);
+        if (end == size) {
+            break;
+        }
+        begin = end + 1;
+    }
+    for (int node : *active) {
+        if (nodes[node].exact || nodes[node].subtree) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * 判断输入是否匹配任一规则
+ *
+ * @param data: 输入数据视图
+ *
+ * @return bool: true: 是 false:否
+ */
+bool DBusNameTrie::isMatch(QLatin1String data) const
+{
+    return matchSegments(data.data(), data.size());
+}
+
+/*
+ * 判断输入是否匹配任一规则
+ *
+ * @param data: 输入字符串
+ *
+ * @return bool: true: 是 false:否
+ */
+bool DBusNameTrie::isMatch(const QString &data) const
+{
+    const QByteArray bytes = data.toUtf8();
+    return matchSegments(bytes.constData(), bytes.size());
+}
+
+/*
+ * 获取编译结果统计信息
+ *
+ * @return DBusNameTrieMetrics: 统计信息
+ */
+DBusNameTrieMetrics DBusNameTrie::metrics() const
+{
+    DBusNameTrieMetrics ret;
+    ret.rules = ruleCount;
+    ret.nodes = nodes.size();
+    ret.wildcardNodes = wildcardCount;
+    return ret;
+}
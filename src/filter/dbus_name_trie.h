@@ -0,0 +1,123 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_DBUS_PROXY_SRC_FILTER_DBUS_NAME_TRIE_H
+#define LINGLONG_DBUS_PROXY_SRC_FILTER_DBUS_NAME_TRIE_H
+
+#include <QByteArray>
+#include <QLatin1String>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// 分段前缀树的统计信息
+struct DBusNameTrieMetrics {
+    // 编译进前缀树的规则数
+    int rules;
+    // 节点数，含根节点
+    int nodes;
+    // 单段通配节点数
+    int wildcardNodes;
+};
+
+/*
+ * 按段匹配总线名称、interface与对象路径的前缀树
+ *
+ * 规则按分隔符（名称与interface为.，路径为/）切成段，每段为一个节点：
+ * 普通段精确匹配；中间的*段匹配任意一段；规则以分隔符加*结尾时匹配该节点本身与其下的所有子树，
+ * 如com.deepin.linglong.*匹配com.deepin.linglong与com.deepin.linglong.AppManager，但不匹配com.deepin.linglongX。
+ * 所有节点的子节点放在一个以（父节点，段内容）为键的开放寻址哈希表中，匹配时沿输入的各段走一遍，每段查一次表。
+ * 创建后只读，可以在多个线程中同时匹配
+ */
+class DBusNameTrie
+{
+public:
+    /*
+     * 编译规则列表，不是分段规则的项被忽略
+     *
+     * @param rules: 规则列表
+     * @param separator: 段分隔符
+     */
+    DBusNameTrie(const QStringList &rules, char separator);
+
+    /*
+     * 判断规则能否按段匹配：不是正则规则，或者只在以分隔符加*结尾处使用通配
+     *
+     * @param rule: 规则
+     * @param separator: 段分隔符
+     *
+     * @return bool: true: 是 false:否
+     */
+    static bool isHierarchical(const QString &rule, char separator);
+
+    /*
+     * 判断输入是否匹配任一规则
+     *
+     * @param data: 输入数据视图
+     *
+     * @return bool: true: 是 false:否
+     */
+    bool isMatch(QLatin1String data) const;
+
+    /*
+     * 判断输入是否匹配任一规则
+     *
+     * @param data: 输入字符串
+     *
+     * @return bool: true: 是 false:否
+     */
+    bool isMatch(const QString &data) const;
+
+    /*
+     * 获取编译结果统计信息
+     *
+     * @return DBusNameTrieMetrics: 统计信息
+     */
+    DBusNameTrieMetrics metrics() const;
+
+private:
+    Q_DISABLE_COPY(DBusNameTrie)
+
+    // 插入一条规则
+    void addRule(const QByteArray &rule);
+    // 查找或创建parent下内容为segment的子节点
+    int addChild(int parent, const char *segment, int size);
+    // 查找parent下内容为segment的子节点，不存在时返回-1
+    int findChild(int parent, const char *segment, int size) const;
+    // 扩容子节点哈希表
+    void rehash(int slotCount);
+    // 沿输入的各段匹配
+    bool matchSegments(const char *data, int size) const;
+
+    struct Node {
+        // 规则在此结束
+        bool exact;
+        // 规则以*结尾，匹配此节点与其下所有子树
+        bool subtree;
+        // 单段通配子节点，-1为无
+        int wildcard;
+    };
+
+    // 父节点到子节点的边，段内容保存在segments中
+    struct Edge {
+        int parent;
+        int child;
+        int offset;
+        int size;
+        uint hash;
+    };
+
+    char separator;
+    int ruleCount;
+    int wildcardCount;
+    QVector<Node> nodes;
+    QVector<Edge> edges;
+    QByteArray segments;
+    // 开放寻址哈希表保存edges的下标，-1为空槽
+    QVector<int> buckets;
+    int slotMask;
+};
+#endif
@@ -0,0 +1,382 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "dbus_policy.h"
+
+#include <string.h>
+
+#include "message/dbus_message.h"
+
+// 取值为字符串的规则字段
+struct DBusPolicyStringKey {
+    const char *name;
+    QByteArray DBusPolicyRule::*field;
+};
+
+static const DBusPolicyStringKey kStringKeys[] = {
+    {"sender", &DBusPolicyRule::sender},
+    {"destination", &DBusPolicyRule::destination},
+    {"path", &DBusPolicyRule::path},
+    {"path_namespace", &DBusPolicyRule::pathNamespace},
+    {"interface", &DBusPolicyRule::interface},
+    {"member", &DBusPolicyRule::member},
+    {"arg0", &DBusPolicyRule::arg0},
+    {"arg0namespace", &DBusPolicyRule::arg0Namespace},
+};
+
+static const int kStringKeyCount = static_cast<int>(sizeof(kStringKeys) / sizeof(kStringKeys[0]));
+
+DBusPolicyRule::DBusPolicyRule()
+    : type(0)
+    , action(DBusPolicyAction::Ask)
+{
+}
+
+/*
+ * 解析type字段
+ *
+ * @param value: 字段值
+ *
+ * @return int: MessageType取值，不合法时返回-1
+ */
+static int parseType(const QByteArray &value)
+{
+    if (value == "method_call") {
+        return (int)MessageType::METHOD_CALL;
+    }
+    if (value == "method_return") {
+        return (int)MessageType::METHOD_RETURN;
+    }
+    if (value == "error") {
+        return (int)MessageType::ERROR;
+    }
+    if (value == "signal") {
+        return (int)MessageType::SIGNAL;
+    }
+    return -1;
+}
+
+/*
+ * 解析action字段
+ *
+ * @param value: 字段值
+ * @param action: 输出处理方式
+ *
+ * @return bool: true:成功 false:不合法
+ */
+static bool parseAction(const QByteArray &value, DBusPolicyAction *action)
+{
+    if (value == "allow") {
+        *action = DBusPolicyAction::Allow;
+    } else if (value == "deny") {
+        *action = DBusPolicyAction::Deny;
+    } else if (value == "ask") {
+        *action = DBusPolicyAction::Ask;
+    } else if (value == "drop") {
+        *action = DBusPolicyAction::Drop;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/*
+ * 解析规则
+ *
+ * @param text: 规则文本
+ * @param rule: 输出解析结果
+ *
+ * @return bool: true:成功 false:语法错误、未知字段或字段值不合法
+ */
+bool DBusPolicyRule::parse(const QString &text, DBusPolicyRule *rule)
+{
+    DBusPolicyRule result;
+    const QByteArray bytes = text.toUtf8();
+    const int size = bytes.size();
+    bool hasType = false;
+    bool hasAction = false;
+    int pos = 0;
+    while (pos < size) {
+        const int equal = bytes.indexOf('=', pos);
+        if (equal < 0) {
+            return false;
+        }
+        const QByteArray key = bytes.mid(pos, equal - pos).trimmed();
+        // 与dbus匹配规则相同，单引号内的内容原样保留，引号外的\'表示单引号，逗号分隔各字段
+        QByteArray value("");
+        bool quoted = false;
+        for (pos = equal + 1; pos < size; pos++) {
+            const char c = bytes[pos];
+            if (quoted) {
+                if (c == '\'') {
+                    quoted = false;
+                } else {
+                    value.append(c);
+                }
+            } else if (c == ',') {
+                break;
+            } else if (c == '\'') {
+                quoted = true;
+            } else if (c == '\\' && pos + 1 < size && bytes[pos + 1] == '\'') {
+                value.append('\'');
+                pos++;
+            } else {
+                value.append(c);
+            }
+        }
+        if (quoted) {
+            return false;
+        }
+        pos++;
+
+        if (key == "type") {
+            result.type = parseType(value);
+            if (hasType || result.type < 0) {
+                return false;
+            }
+            hasType = true;
+            continue;
+        }
+        if (key == "action") {
+            if (hasAction || !parseAction(value, &result.action)) {
+                return false;
+            }
+            hasAction = true;
+            continue;
+        }
+        int index = 0;
+        while (index < kStringKeyCount && key != kStringKeys[index].name) {
+            index++;
+        }
+        if (index == kStringKeyCount || !(result.*kStringKeys[index].field).isNull()) {
+            return false;
+        }
+        result.*kStringKeys[index].field = value;
+    }
+    if (!hasAction) {
+        return false;
+    }
+    // path与path_namespace、arg0与arg0namespace不能同时指定
+    if ((!result.path.isNull() && !result.pathNamespace.isNull())
+        || (!result.arg0.isNull() && !result.arg0Namespace.isNull())) {
+        return false;
+    }
+    if ((!result.path.isNull() && !result.path.startsWith('/'))
+        || (!result.pathNamespace.isNull() && !result.pathNamespace.startsWith('/'))) {
+        return false;
+    }
+    *rule = result;
+    return true;
+}
+
+/*
+ * 获取判定这条规则需要的报文头字段
+ *
+ * @return quint32: 报文头字段掩码
+ */
+quint32 DBusPolicyRule::requiredHeaderFields() const
+{
+    // 判定树总是按interface与member查找
+    quint32 fields = headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_INTERFACE)
+        | headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_MEMBER);
+    if (!destination.isNull()) {
+        fields |= headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_DESTINATION);
+    }
+    if (!path.isNull() || !pathNamespace.isNull()) {
+        fields |= headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_PATH);
+    }
+    if (!sender.isNull()) {
+        fields |= headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_SENDER);
+    }
+    // 按签名确认第一个参数是字符串
+    if (!arg0.isNull() || !arg0Namespace.isNull()) {
+        fields |= headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_SIGNATURE);
+    }
+    return fields;
+}
+
+/*
+ * 判断value是否等于命名空间或在其下
+ *
+ * @param value: 输入数据视图
+ * @param space: 命名空间
+ * @param separator: 段分隔符
+ *
+ * @return bool: true: 是 false:否
+ */
+static bool isInNamespace(QLatin1String value, const QByteArray &space, char separator)
+{
+    const int size = space.size();
+    if (value.size() < size || memcmp(value.data(), space.constData(), static_cast<size_t>(size)) != 0) {
+        return false;
+    }
+    // 根路径/的path_namespace匹配所有路径
+    return value.size() == size || space.endsWith(separator) || value.data()[size] == separator;
+}
+
+/*
+ * 编译规则列表
+ *
+ * @param rules: 规则列表，按优先级从高到低排列
+ */
+DBusPolicy::DBusPolicy(const QVector<DBusPolicyRule> &rules)
+    : rules(rules)
+    , roots{0, 0, 0, 0, 0}
+    , headerFields(DBUS_HEADER_FIELDS_NONE)
+{
+    for (int type = (int)MessageType::METHOD_CALL; type <= (int)MessageType::SIGNAL; type++) {
+        QVector<int> candidates;
+        for (int i = 0; i < rules.size(); i++) {
+            if (rules.at(i).type == 0 || rules.at(i).type == type) {
+                candidates.append(i);
+            }
+        }
+        roots[type] = addBranch(candidates, 0);
+    }
+    for (const DBusPolicyRule &rule : rules) {
+        headerFields |= rule.requiredHeaderFields();
+    }
+}
+
+/*
+ * 由候选规则创建一个分支
+ *
+ * @param candidates: 按声明顺序排列的候选规则下标
+ * @param level: 0为interface层，子树为member层分支；1为member层，子树为叶子
+ *
+ * @return int: 分支在branches中的下标
+ */
+int DBusPolicy::addBranch(const QVector<int> &candidates, int level)
+{
+    QByteArray DBusPolicyRule::*field = level == 0 ? &DBusPolicyRule::interface : &DBusPolicyRule::member;
+    // 不限制该字段的规则，以及按字段值分组的其余规则，都保持声明顺序
+    QVector<int> unconstrained;
+    QHash<QLatin1String, QVector<int>> groups;
+    for (int index : candidates) {
+        const QByteArray &value = rules.at(index).*field;
+        if (value.isNull()) {
+            unconstrained.append(index);
+        } else {
+            groups[QLatin1String(value)].append(index);
+        }
+    }
+    Branch branch;
+    branch.any = level == 0 ? addBranch(unconstrained, 1) : leaves.size();
+    if (level != 0) {
+        leaves.append(unconstrained);
+    }
+    for (auto it = groups.constBegin(); it != groups.constEnd(); ++it) {
+        // 合并两个升序的下标列表，得到该字段值下按声明顺序排列的全部候选规则
+        const QVector<int> &group = it.value();
+        QVector<int> merged;
+        merged.reserve(group.size() + unconstrained.size());
+        int i = 0;
+        int j = 0;
+        while (i < group.size() || j < unconstrained.size()) {
+            if (j == unconstrained.size() || (i < group.size() && group.at(i) < unconstrained.at(j))) {
+                merged.append(group.at(i++));
+            } else {
+                merged.append(unconstrained.at(j++));
+            }
+        }
+        if (level == 0) {
+            branch.exact.insert(it.key(), addBranch(merged, 1));
+        } else {
+            branch.exact.insert(it.key(), leaves.size());
+            leaves.append(merged);
+        }
+    }
+    branches.append(branch);
+    return branches.size() - 1;
+}
+
+/*
+ * 检查规则中除类型、interface与member外的字段
+ *
+ * @param rule: 规则
+ * @param header: 消息报文头
+ * @param cacheable: 规则用到缓存键以外的字段时置为false
+ *
+ * @return bool: true:匹配 false:不匹配
+ */
+bool DBusPolicy::matchRule(const DBusPolicyRule &rule, const DBusHeaderView &header, bool *cacheable) const
+{
+    if (!rule.destination.isNull() && header.destination() != QLatin1String(rule.destination)) {
+        return false;
+    }
+    if (!rule.path.isNull() && header.path() != QLatin1String(rule.path)) {
+        return false;
+    }
+    if (!rule.pathNamespace.isNull() && !isInNamespace(header.path(), rule.pathNamespace, '/')) {
+        return false;
+    }
+    if (rule.sender.isNull() && rule.arg0.isNull() && rule.arg0Namespace.isNull()) {
+        return true;
+    }
+    // 以下字段不在判定缓存的键中，结果不能缓存
+    *cacheable = false;
+    if (!rule.sender.isNull() && header.sender() != QLatin1String(rule.sender)) {
+        return false;
+    }
+    if (rule.arg0.isNull() && rule.arg0Namespace.isNull()) {
+        return true;
+    }
+    QLatin1String arg0;
+    switch (header.stringArg0(&arg0)) {
+    case DBusHeaderView::Arg0String:
+        break;
+    case DBusHeaderView::Arg0Absent:
+        return false;
+    case DBusHeaderView::Arg0Pending:
+        // 大消息的body尚未到达，拒绝类规则按匹配处理，避免借大消息绕过
+        return rule.action == DBusPolicyAction::Deny || rule.action == DBusPolicyAction::Drop;
+    }
+    if (!rule.arg0.isNull()) {
+        return arg0 == QLatin1String(rule.arg0);
+    }
+    return isInNamespace(arg0, rule.arg0Namespace, '.');
+}
+
+/*
+ * 判定一条消息，报文头需要包含requiredHeaderFields中的字段
+ *
+ * @param header: 消息报文头
+ * @param verdict: 输出判定结果
+ *
+ * @return bool: true:匹配到规则 false:没有匹配的规则
+ */
+bool DBusPolicy::evaluate(const DBusHeaderView &header, DBusPolicyVerdict *verdict) const
+{
+    verdict->cacheable = true;
+    if (rules.isEmpty() || header.type < (int)MessageType::METHOD_CALL || header.type > (int)MessageType::SIGNAL) {
+        return false;
+    }
+    const Branch &interfaceBranch = branches.at(roots[header.type]);
+    const Branch &memberBranch = branches.at(interfaceBranch.exact.value(header.interface(), interfaceBranch.any));
+    const QVector<int> &leaf = leaves.at(memberBranch.exact.value(header.member(), memberBranch.any));
+    for (int index : leaf) {
+        const DBusPolicyRule &rule = rules.at(index);
+        if (matchRule(rule, header, &verdict->cacheable)) {
+            verdict->action = rule.action;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * 获取编译结果统计信息
+ *
+ * @return DBusPolicyMetrics: 统计信息
+ */
+DBusPolicyMetrics DBusPolicy::metrics() const
+{
+    DBusPolicyMetrics ret = {rules.size(), branches.size(), leaves.size(), 0};
+    for (const QVector<int> &leaf : leaves) {
+        ret.leafRules += leaf.size();
+    }
+    return ret;
+}
@@ -0,0 +1,163 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_DBUS_PROXY_SRC_FILTER_DBUS_POLICY_H
+#define LINGLONG_DBUS_PROXY_SRC_FILTER_DBUS_POLICY_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QLatin1String>
+#include <QString>
+#include <QVector>
+
+#include "message/dbus_header_view.h"
+
+// 规则匹配后对消息的处理
+enum class DBusPolicyAction {
+    // 直接转发，不申请授权
+    Allow,
+    // 拒绝，需要回复的调用回复AccessDenied
+    Deny,
+    // 向用户申请授权
+    Ask,
+    // 丢弃，不回复
+    Drop,
+};
+
+/*
+ * 一条按dbus匹配规则语法书写的策略规则，如
+ * type='method_call',interface='org.freedesktop.DBus.Properties',member='Get',action='allow'
+ *
+ * 支持type、sender、destination、path、path_namespace、interface、member、arg0、arg0namespace与action，
+ * 字段含义与dbus匹配规则相同，action为allow、deny、ask或drop，必须指定。
+ * 未指定的字段不限制，对应的QByteArray为null；指定为空串时只匹配空值
+ */
+struct DBusPolicyRule {
+    DBusPolicyRule();
+
+    /*
+     * 解析规则
+     *
+     * @param text: 规则文本
+     * @param rule: 输出解析结果
+     *
+     * @return bool: true:成功 false:语法错误、未知字段或字段值不合法
+     */
+    static bool parse(const QString &text, DBusPolicyRule *rule);
+
+    /*
+     * 获取判定这条规则需要的报文头字段
+     *
+     * @return quint32: 报文头字段掩码
+     */
+    quint32 requiredHeaderFields() const;
+
+    // 消息类型，按MessageType取值，0为任意类型
+    int type;
+    QByteArray sender;
+    QByteArray destination;
+    QByteArray path;
+    QByteArray pathNamespace;
+    QByteArray interface;
+    QByteArray member;
+    QByteArray arg0;
+    QByteArray arg0Namespace;
+    DBusPolicyAction action;
+};
+
+// 一条消息的策略判定结果
+struct DBusPolicyVerdict {
+    DBusPolicyAction action;
+    // 结果只与类型、destination、path、interface与member有关，可以按这些字段缓存
+    bool cacheable;
+};
+
+// 策略判定树的统计信息
+struct DBusPolicyMetrics {
+    // 规则数
+    int rules;
+    // 分支数，含各消息类型的根
+    int branches;
+    // 叶子数
+    int leaves;
+    // 所有叶子中的规则项之和，即不限制interface或member的规则被复制后的总数
+    int leafRules;
+};
+
+/*
+ * 编译成判定树的策略规则
+ *
+ * 树按消息类型、interface、member三层展开：每种消息类型一个根，根下按interface精确查找节点，
+ * 节点下按member精确查找叶子，找不到时走不限制该字段的分支。不限制某一层的规则会复制到该层的所有分支中，
+ * 因此每个叶子已经按声明顺序列出了类型、interface与member都满足的全部候选规则，
+ * 一条消息只查三次表，再依次检查叶子中规则的其余字段，第一条匹配的规则决定处理方式。
+ * 创建后只读，可以在多个线程中同时判定
+ */
+class DBusPolicy
+{
+public:
+    /*
+     * 编译规则列表
+     *
+     * @param rules: 规则列表，按优先级从高到低排列
+     */
+    explicit DBusPolicy(const QVector<DBusPolicyRule> &rules);
+
+    /*
+     * 判定一条消息，报文头需要包含requiredHeaderFields中的字段
+     *
+     * @param header: 消息报文头
+     * @param verdict: 输出判定结果
+     *
+     * @return bool: true:匹配到规则 false:没有匹配的规则
+     */
+    bool evaluate(const DBusHeaderView &header, DBusPolicyVerdict *verdict) const;
+
+    /*
+     * 获取判定需要的报文头字段，用于按需解析报文头
+     *
+     * @return quint32: 报文头字段掩码，没有规则时返回DBUS_HEADER_FIELDS_NONE
+     */
+    quint32 requiredHeaderFields() const { return headerFields; }
+
+    /*
+     * 获取编译结果统计信息
+     *
+     * @return DBusPolicyMetrics: 统计信息
+     */
+    DBusPolicyMetrics metrics() const;
+
+private:
+    Q_DISABLE_COPY(DBusPolicy)
+
+    // 按interface或member精确查找的分支，键指向rules中的字段，rules创建后不再修改
+    struct Branch {
+        QHash<QLatin1String, int> exact;
+        // 不限制该字段的规则所在的子树
+        int any;
+    };
+
+    /*
+     * 由候选规则创建一个分支
+     *
+     * @param candidates: 按声明顺序排列的候选规则下标
+     * @param level: 0为interface层，子树为member层分支；1为member层，子树为叶子
+     *
+     * @return int: 分支在branches中的下标
+     */
+    int addBranch(const QVector<int> &candidates, int level);
+    // 检查规则中除类型、interface与member外的字段
+    bool matchRule(const DBusPolicyRule &rule, const DBusHeaderView &header, bool *cacheable) const;
+
+    QVector<DBusPolicyRule> rules;
+    // 下标为消息类型，0不使用，值为interface层分支的下标
+    int roots[5];
+    QVector<Branch> branches;
+    // 按声明顺序排列的候选规则下标
+    QVector<QVector<int>> leaves;
+    quint32 headerFields;
+};
+#endif
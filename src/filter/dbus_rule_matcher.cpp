@@ -0,0 +1,725 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "dbus_rule_matcher.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <QHash>
+#include <QPair>
+
+// DFA中表示已匹配的转移
+static const int kAccept = -1;
+// DFA状态数上限，超过后按NFA模拟
+static const int kMaxDfaStates = 4096;
+// DFA转移表的表项数上限，字节等价类多时按此减少状态数上限
+static const int kMaxDfaTransitions = 128 * 1024;
+// 构造DFA时所有状态集合的总大小上限
+static const qint64 kMaxDfaSetEntries = 256 * 1024;
+
+/*
+ * 把QRegExp语法的正则规则编译成Thompson NFA片段
+ *
+ * 支持字面字符、转义的标点、.、字符集、分组、选择与*+?，其余语法（锚点、{n}、\d等字符类简写、
+ * 反向引用、(?:等扩展语法）返回失败，由调用方保留为QRegExp规则
+ */
+class DBusPatternCompiler
+{
+public:
+    explicit DBusPatternCompiler(DBusRuleMatcher *matcher, const QByteArray &pattern)
+        : matcher(matcher)
+        , data(pattern.constData())
+        , size(pattern.size())
+        , pos(0)
+    {
+    }
+
+    // NFA片段：起始状态与待连接的出口，出口编码为状态下标×2+分支
+    struct Fragment {
+        int start;
+        QVector<int> outs;
+    };
+
+    /*
+     * 编译整个规则
+     *
+     * @param fragment: 输出片段
+     *
+     * @return bool: true:成功 false:使用了不支持的语法
+     */
+    bool compile(Fragment *fragment) { return parseAlternation(fragment) && pos == size; }
+
+    // 把片段的所有出口连接到target
+    void patch(const QVector<int> &outs, int target)
+    {
+        for (int out : outs) {
+            DBusRuleMatcher::NfaState &state = matcher->nfa[out >> 1];
+            if (out & 1) {
+                state.out1 = target;
+            } else {
+                state.out = target;
+            }
+        }
+    }
+
+private:
+    int addState(int type, int set)
+    {
+        DBusRuleMatcher::NfaState state = {type, set, -1, -1};
+        matcher->nfa.append(state);
+        return matcher->nfa.size() - 1;
+    }
+
+    bool parseAlternation(Fragment *fragment)
+    {
+        if (!parseConcat(fragment)) {
+            return false;
+        }
+        while (pos < size && data[pos] == '|') {
+            pos++;
+            Fragment right;
+            if (!parseConcat(&right)) {
+                return false;
+            }
+            const int split = addState(DBusRuleMatcher::NfaState::Split, -1);
+            matcher->nfa[split].out = fragment->start;
+            matcher->nfa[split].out1 = right.start;
+            fragment->start = split;
+            fragment->outs += right.outs;
+        }
+        return true;
+    }
+
+    // 空的序列会匹配空串，QRegExp中的写法多为误写，不编译
+    bool parseConcat(Fragment *fragment)
+    {
+        bool empty = true;
+        while (pos < size && data[pos] != '|' && data[pos] != ')') {
+            Fragment next;
+            if (!parseRepeat(&next)) {
+                return false;
+            }
+            if (empty) {
+                *fragment = next;
+                empty = false;
+            } else {
+                patch(fragment->outs, next.start);
+                fragment->outs = next.outs;
+            }
+        }
+        return !empty;
+    }
+
+    bool parseRepeat(Fragment *fragment)
+    {
+        if (!parseAtom(fragment)) {
+            return false;
+        }
+        if (pos >= size || (data[pos] != '*' && data[pos] != '+' && data[pos] != '?')) {
+            return true;
+        }
+        const char op = data[pos++];
+        // 连续的量词在QRegExp中有不同含义，不编译
+        if (pos < size && (data[pos] == '*' || data[pos] == '+' || data[pos] == '?' || data[pos] == '{')) {
+            return false;
+        }
+        const int split = addState(DBusRuleMatcher::NfaState::Split, -1);
+        matcher->nfa[split].out = fragment->start;
+        if (op == '*') {
+            patch(fragment->outs, split);
+            fragment->start = split;
+            fragment->outs = QVector<int>() << (split * 2 + 1);
+        } else if (op == '+') {
+            patch(fragment->outs, split);
+            fragment->outs = QVector<int>() << (split * 2 + 1);
+        } else {
+            fragment->start = split;
+            fragment->outs.append(split * 2 + 1);
+        }
+        return true;
+    }
+
+    bool parseAtom(Fragment *fragment)
+    {
+        const char c = data[pos];
+        // 单个字节与.使用预先建立的字节集合，只有字符集新建集合
+        int set = static_cast<uchar>(c);
+        switch (c) {
+        case '(': {
+            pos++;
+            if (pos < size && data[pos] == '?') {
+                return false;
+            }
+            if (!parseAlternation(fragment) || pos >= size || data[pos] != ')') {
+                return false;
+            }
+            pos++;
+            return true;
+        }
+        case '.':
+            set = DBusRuleMatcher::kAnyByteSet;
+            pos++;
+            break;
+        case '[': {
+            pos++;
+            DBusRuleMatcher::ByteSet bytes;
+            memset(bytes.bits, 0, sizeof(bytes.bits));
+            if (!parseClass(&bytes)) {
+                return false;
+            }
+            matcher->byteSets.append(bytes);
+            set = matcher->byteSets.size() - 1;
+            break;
+        }
+        case '\\': {
+            char literal = 0;
+            if (!parseEscapedChar(&literal)) {
+                return false;
+            }
+            set = static_cast<uchar>(literal);
+            break;
+        }
+        case '*':
+        case '+':
+        case '?':
+        case '{':
+        case '}':
+        case '^':
+        case '$':
+        case ')':
+        case ']':
+            return false;
+        default:
+            pos++;
+            break;
+        }
+        fragment->start = addState(DBusRuleMatcher::NfaState::Byte, set);
+        fragment->outs = QVector<int>() << (fragment->start * 2);
+        return true;
+    }
+
+    // 只支持转义标点，\d、\w、\1等字母数字转义不编译
+    bool parseEscapedChar(char *out)
+    {
+        if (pos + 1 >= size) {
+            return false;
+        }
+        const char c = data[pos + 1];
+        if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+            return false;
+        }
+        *out = c;
+        pos += 2;
+        return true;
+    }
+
+    bool parseClass(DBusRuleMatcher::ByteSet *set)
+    {
+        bool negate = false;
+        if (pos < size && data[pos] == '^') {
+            negate = true;
+            pos++;
+        }
+        bool first = true;
+        while (pos < size && (data[pos] != ']' || first)) {
+            first = false;
+            char low = data[pos];
+            if (low == '[' && pos + 1 < size && (data[pos + 1] == ':' || data[pos + 1] == '=' || data[pos + 1] == '.')) {
+                return false;
+            }
+            if (low == '\\') {
+                if (!parseEscapedChar(&low)) {
+                    return false;
+                }
+            } else {
+                pos++;
+            }
+            char high = low;
+            if (pos + 1 < size && data[pos] == '-' && data[pos + 1] != ']') {
+                pos++;
+                high = data[pos];
+                if (high == '\\') {
+                    if (!parseEscapedChar(&high)) {
+                        return false;
+                    }
+                } else {
+                    pos++;
+                }
+            }
+            if (static_cast<uchar>(low) > static_cast<uchar>(high)) {
+                return false;
+            }
+            for (int b = static_cast<uchar>(low); b <= static_cast<uchar>(high); b++) {
+                set->add(static_cast<uchar>(b));
+            }
+        }
+        if (pos >= size) {
+            return false;
+        }
+        pos++;
+        if (negate) {
+            for (quint32 &bits : set->bits) {
+                bits = ~bits;
+            }
+        }
+        return true;
+    }
+
+    DBusRuleMatcher *matcher;
+    const char *data;
+    int size;
+    int pos;
+};
+
+/*
+ * 编译规则列表
+ *
+ * @param rules: 规则列表
+ */
+DBusRuleMatcher::DBusRuleMatcher(const QStringList &rules)
+    : slotMask(0)
+    , patternCount(0)
+    , matchesEmpty(false)
+    , dfaStates(0)
+{
+    // 0号状态为所有规则共用的接受状态
+    NfaState match = {NfaState::Match, -1, -1, -1};
+    nfa.append(match);
+    // 前256个字节集合为单个字节，之后是任意字节
+    byteSets.resize(kAnyByteSet + 1);
+    for (int b = 0; b < 256; b++) {
+        memset(byteSets[b].bits, 0, sizeof(byteSets[b].bits));
+        byteSets[b].add(static_cast<uchar>(b));
+    }
+    memset(byteSets[kAnyByteSet].bits, 0xff, sizeof(byteSets[kAnyByteSet].bits));
+    for (const QString &rule : rules) {
+        const QByteArray bytes = rule.toUtf8();
+        keys.append(bytes);
+        // 与QRegExp一致，正则规则也匹配与规则完全相同的输入
+        if (isPattern(rule) && !addPattern(bytes)) {
+            regExps.append(QRegExp(rule));
+        }
+    }
+    int slotCount = 16;
+    while (slotCount < keys.size() * 2) {
+        slotCount *= 2;
+    }
+    buckets.fill(-1, slotCount);
+    slotMask = slotCount - 1;
+    for (int i = 0; i < keys.size(); i++) {
+        int slot = static_cast<int>(qHashBits(keys[i].constData(), static_cast<size_t>(keys[i].size()))) & slotMask;
+        while (buckets[slot] >= 0) {
+            slot = (slot + 1) & slotMask;
+        }
+        buckets[slot] = i;
+    }
+    if (patternCount > 0) {
+        buildTrie();
+        buildClosures();
+        if (!buildDfa()) {
+            dfa.clear();
+            dfaStates = 0;
+        }
+    }
+}
+
+/*
+ * 判断规则是否为正则规则
+ *
+ * @param rule: 规则
+ *
+ * @return bool: true: 是 false:否
+ */
+bool DBusRuleMatcher::isPattern(const QString &rule)
+{
+    return rule.endsWith("*") || rule.endsWith("+") || rule.endsWith("?");
+}
+
+/*
+ * 取出规则开头不带量词的单字节原子，这部分按前缀树合并，其余部分由DBusPatternCompiler编译
+ *
+ * @param pattern: 规则
+ * @param sets: 输出前缀中每个原子的字节集合
+ *
+ * @return int: 其余部分在规则中的起始位置
+ */
+static int simplePrefix(const QByteArray &pattern, QVector<int> *sets)
+{
+    // 顶层选择的分支不能共用前缀
+    if (pattern.contains('|')) {
+        return 0;
+    }
+    int pos = 0;
+    while (pos < pattern.size()) {
+        const char c = pattern[pos];
+        int set = static_cast<uchar>(c);
+        int length = 1;
+        if (c == '\\') {
+            if (pos + 1 >= pattern.size() || isalnum(static_cast<uchar>(pattern[pos + 1]))) {
+                break;
+            }
+            set = static_cast<uchar>(pattern[pos + 1]);
+            length = 2;
+        } else if (c == '.') {
+            set = DBusRuleMatcher::kAnyByteSet;
+        } else if (strchr("()[]{}^$*+?", c)) {
+            break;
+        }
+        if (pos + length < pattern.size() && strchr("*+?{", pattern[pos + length])) {
+            break;
+        }
+        sets->append(set);
+        pos += length;
+    }
+    return pos;
+}
+
+// 把正则规则编译成NFA，失败时返回false
+bool DBusRuleMatcher::addPattern(const QByteArray &pattern)
+{
+    // 非ASCII字符在QRegExp中按字符而不是字节匹配
+    for (int i = 0; i < pattern.size(); i++) {
+        if (static_cast<uchar>(pattern[i]) >= 0x80) {
+            return false;
+        }
+    }
+    QVector<int> prefix;
+    const int suffixStart = simplePrefix(pattern, &prefix);
+    int fragmentStart = -1;
+    if (suffixStart < pattern.size()) {
+        const int stateCount = nfa.size();
+        const int setCount = byteSets.size();
+        const QByteArray suffix = pattern.mid(suffixStart);
+        DBusPatternCompiler compiler(this, suffix);
+        DBusPatternCompiler::Fragment fragment;
+        if (!compiler.compile(&fragment)) {
+            nfa.resize(stateCount);
+            byteSets.resize(setCount);
+            return false;
+        }
+        compiler.patch(fragment.outs, 0);
+        fragmentStart = fragment.start;
+    }
+    if (trie.isEmpty()) {
+        trie.append(TrieNode());
+    }
+    int node = 0;
+    for (int set : prefix) {
+        int child = -1;
+        for (const QPair<int, int> &edge : trie[node].children) {
+            if (edge.first == set) {
+                child = edge.second;
+                break;
+            }
+        }
+        if (child < 0) {
+            child = trie.size();
+            trie[node].children.append(qMakePair(set, child));
+            trie.append(TrieNode());
+        }
+        node = child;
+    }
+    if (fragmentStart >= 0) {
+        trie[node].fragments.append(fragmentStart);
+    } else {
+        trie[node].accept = true;
+    }
+    patternCount++;
+    return true;
+}
+
+// 把前缀树展开成NFA状态，每条边为一个字节转移状态，节点的多个后继用分支状态连接
+void DBusRuleMatcher::buildTrie()
+{
+    QVector<int> entries(trie.size(), -1);
+    QVector<QPair<int, int>> edges;
+    for (int i = 0; i < trie.size(); i++) {
+        for (const QPair<int, int> &edge : trie[i].children) {
+            NfaState state = {NfaState::Byte, edge.first, -1, -1};
+            nfa.append(state);
+            edges.append(qMakePair(nfa.size() - 1, edge.second));
+        }
+    }
+    int edge = 0;
+    for (int i = 0; i < trie.size(); i++) {
+        QVector<int> targets;
+        for (int j = 0; j < trie[i].children.size(); j++) {
+            targets.append(edges[edge++].first);
+        }
+        targets += trie[i].fragments;
+        if (trie[i].accept) {
+            targets.append(0);
+        }
+        int entry = targets.isEmpty() ? -1 : targets.last();
+        for (int j = targets.size() - 2; j >= 0; j--) {
+            NfaState split = {NfaState::Split, -1, targets[j], entry};
+            nfa.append(split);
+            entry = nfa.size() - 1;
+        }
+        entries[i] = entry;
+    }
+    for (const QPair<int, int> &pair : edges) {
+        nfa[pair.first].out = entries[pair.second];
+    }
+    starts.append(entries[0]);
+    trie.clear();
+}
+
+// 计算每个NFA状态的空转移闭包、字节等价类与起始集合
+void DBusRuleMatcher::buildClosures()
+{
+    QVector<int> visited(nfa.size(), -1);
+    QVector<int> stack;
+    closureOffsets.resize(nfa.size() + 1);
+    closureAccept.fill(false, nfa.size());
+    for (int i = 0; i < nfa.size(); i++) {
+        closureOffsets[i] = closureStates.size();
+        stack.append(i);
+        while (!stack.isEmpty()) {
+            const int s = stack.takeLast();
+            if (s < 0 || visited[s] == i) {
+                continue;
+            }
+            visited[s] = i;
+            if (nfa[s].type == NfaState::Byte) {
+                closureStates.append(s);
+            } else if (nfa[s].type == NfaState::Match) {
+                closureAccept[i] = true;
+            } else {
+                stack.append(nfa[s].out1);
+                stack.append(nfa[s].out);
+            }
+        }
+        std::sort(closureStates.begin() + closureOffsets[i], closureStates.end());
+    }
+    closureOffsets[nfa.size()] = closureStates.size();
+
+    for (int start : starts) {
+        for (int j = closureOffsets[start]; j < closureOffsets[start + 1]; j++) {
+            startSet.append(closureStates[j]);
+        }
+        matchesEmpty = matchesEmpty || closureAccept[start];
+    }
+    std::sort(startSet.begin(), startSet.end());
+    startSet.erase(std::unique(startSet.begin(), startSet.end()), startSet.end());
+
+    // 按规则中用到的字节集合细分等价类，同一类中的字节在所有状态上的转移相同
+    QVector<bool> used(byteSets.size(), false);
+    for (const NfaState &state : nfa) {
+        if (state.type == NfaState::Byte) {
+            used[state.set] = true;
+        }
+    }
+    memset(classOf, 0, sizeof(classOf));
+    int classCount = 1;
+    for (int i = 0; i < byteSets.size(); i++) {
+        if (!used[i]) {
+            continue;
+        }
+        const ByteSet &set = byteSets[i];
+        QVector<int> split(classCount * 2, -1);
+        int next = 0;
+        for (int b = 0; b < 256; b++) {
+            const int key = classOf[b] * 2 + (set.contains(static_cast<uchar>(b)) ? 1 : 0);
+            if (split[key] < 0) {
+                split[key] = next++;
+            }
+            classOf[b] = static_cast<uchar>(split[key]);
+        }
+        classCount = next;
+    }
+    classBytes.fill(0, classCount);
+    for (int b = 255; b >= 0; b--) {
+        classBytes[classOf[b]] = static_cast<uchar>(b);
+    }
+
+    startSteps.resize(classCount);
+    startAccept.fill(false, classCount);
+    for (int cls = 0; cls < classCount; cls++) {
+        QVector<int> &next = startSteps[cls];
+        startAccept[cls] = advance(startSet, classBytes[cls], &next);
+        std::sort(next.begin(), next.end());
+        next.erase(std::unique(next.begin(), next.end()), next.end());
+    }
+}
+
+/*
+ * 集合中的状态读入一个字节，把转移到的状态的闭包追加到next，不排序去重
+ *
+ * @param set: 当前集合，只包含字节转移状态
+ * @param byte: 输入字节
+ * @param next: 输出下一步状态
+ *
+ * @return bool: true:到达接受状态 false:未到达
+ */
+bool DBusRuleMatcher::advance(const QVector<int> &set, uchar byte, QVector<int> *next) const
+{
+    bool accept = false;
+    for (int s : set) {
+        if (!byteSets[nfa[s].set].contains(byte)) {
+            continue;
+        }
+        const int out = nfa[s].out;
+        accept = accept || closureAccept[out];
+        for (int j = closureOffsets[out]; j < closureOffsets[out + 1]; j++) {
+            next->append(closureStates[j]);
+        }
+    }
+    return accept;
+}
+
+/*
+ * 计算一个NFA状态集合读入一个字节等价类后的集合，每一步都重新加入所有规则的起点
+ *
+ * @param set: 当前集合，只包含字节转移状态
+ * @param cls: 字节等价类
+ * @param next: 输出下一步集合，有序不重复
+ *
+ * @return bool: true:到达接受状态 false:未到达
+ */
+bool DBusRuleMatcher::step(const QVector<int> &set, int cls, QVector<int> *next) const
+{
+    *next = startSteps[cls];
+    const bool accept = advance(set, classBytes[cls], next) || startAccept[cls];
+    std::sort(next->begin(), next->end());
+    next->erase(std::unique(next->begin(), next->end()), next->end());
+    return accept;
+}
+
+// 构造DFA，状态数超过上限时返回false
+bool DBusRuleMatcher::buildDfa()
+{
+    const int classCount = classBytes.size();
+    const int maxStates = qMin(kMaxDfaStates, kMaxDfaTransitions / classCount);
+    // DFA状态为进行中的NFA状态集合，0号状态为没有进行中的匹配
+    QVector<QVector<int>> sets;
+    QHash<QVector<int>, int> index;
+    sets.append(QVector<int>());
+    index.insert(sets[0], 0);
+    qint64 entries = 0;
+    QVector<int> next;
+    for (int i = 0; i < sets.size(); i++) {
+        dfa.resize((i + 1) * classCount);
+        for (int cls = 0; cls < classCount; cls++) {
+            if (step(sets[i], cls, &next)) {
+                dfa[i * classCount + cls] = kAccept;
+                continue;
+            }
+            QHash<QVector<int>, int>::const_iterator it = index.constFind(next);
+            if (it != index.constEnd()) {
+                dfa[i * classCount + cls] = it.value();
+                continue;
+            }
+            if (sets.size() >= maxStates || entries + next.size() > kMaxDfaSetEntries) {
+                return false;
+            }
+            entries += next.size();
+            index.insert(next, sets.size());
+            dfa[i * classCount + cls] = sets.size();
+            sets.append(next);
+        }
+    }
+    dfaStates = sets.size();
+    return true;
+}
+
+// 精确匹配
+bool DBusRuleMatcher::isExactMatch(const char *data, int size) const
+{
+    if (keys.isEmpty()) {
+        return false;
+    }
+    int slot = static_cast<int>(qHashBits(data, static_cast<size_t>(size))) & slotMask;
+    for (int key = buckets[slot]; key >= 0; key = buckets[slot]) {
+        const QByteArray &rule = keys[key];
+        if (rule.size() == size && memcmp(rule.constData(), data, static_cast<size_t>(size)) == 0) {
+            return true;
+        }
+        slot = (slot + 1) & slotMask;
+    }
+    return false;
+}
+
+// 按DFA或NFA查找正则规则
+bool DBusRuleMatcher::isPatternMatch(const char *data, int size) const
+{
+    if (matchesEmpty) {
+        return true;
+    }
+    if (!dfa.isEmpty()) {
+        const int classCount = classBytes.size();
+        const int *table = dfa.constData();
+        int state = 0;
+        for (int i = 0; i < size; i++) {
+            state = table[state * classCount + classOf[static_cast<uchar>(data[i])]];
+            if (state == kAccept) {
+                return true;
+            }
+        }
+    } else if (patternCount > 0) {
+        QVector<int> set;
+        QVector<int> next;
+        for (int i = 0; i < size; i++) {
+            if (step(set, classOf[static_cast<uchar>(data[i])], &next)) {
+                return true;
+            }
+            set.swap(next);
+        }
+    }
+    if (!regExps.isEmpty()) {
+        const QString str = QString::fromUtf8(data, size);
+        for (const QRegExp &regExp : regExps) {
+            if (str.contains(regExp)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/*
+ * 判断输入是否匹配任一规则
+ *
+ * @param data: 输入数据视图
+ *
+ * @return bool: true: 是 false:否
+ */
+bool DBusRuleMatcher::isMatch(QLatin1String data) const
+{
+    return isExactMatch(data.data(), data.size()) || isPatternMatch(data.data(), data.size());
+}
+
+/*
+ * 判断输入是否匹配任一规则
+ *
+ * @param data: 输入字符串
+ *
+ * @return bool: true: 是 false:否
+ */
+bool DBusRuleMatcher::isMatch(const QString &data) const
+{
+    const QByteArray bytes = data.toUtf8();
+    return isExactMatch(bytes.constData(), bytes.size()) || isPatternMatch(bytes.constData(), bytes.size());
+}
+
+/*
+ * 获取编译结果统计信息
+ *
+ * @return DBusRuleMatcherMetrics: 统计信息
+ */
+DBusRuleMatcherMetrics DBusRuleMatcher::metrics() const
+{
+    DBusRuleMatcherMetrics ret;
+    ret.exactRules = keys.size() - patternCount - regExps.size();
+    ret.patternRules = patternCount;
+    ret.regExpRules = regExps.size();
+    ret.dfaStates = dfaStates;
+    ret.byteClasses = classBytes.size();
+    return ret;
+}
@@ -0,0 +1,189 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_DBUS_PROXY_SRC_FILTER_DBUS_RULE_MATCHER_H
+#define LINGLONG_DBUS_PROXY_SRC_FILTER_DBUS_RULE_MATCHER_H
+
+#include <QByteArray>
+#include <QLatin1String>
+#include <QPair>
+#include <QRegExp>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// 编译后的规则统计信息
+struct DBusRuleMatcherMetrics {
+    // 精确匹配的规则数
+    int exactRules;
+    // 编译进自动机的正则规则数
+    int patternRules;
+    // 使用了自动机不支持的语法，仍由QRegExp匹配的规则数
+    int regExpRules;
+    // 自动机状态数，状态过多退回按NFA逐字节模拟时为0
+    int dfaStates;
+    // 输入字节的等价类数
+    int byteClasses;
+};
+
+/*
+ * 一个字段的过滤规则编译成的不可变匹配器
+ *
+ * 与原有语义一致：规则与输入完全相同时匹配；以*、+或?结尾的规则按QRegExp语法在输入的任意位置查找。
+ * 精确规则放入开放寻址哈希表，比较字节不分配内存；正则规则编译成一个合并的Thompson NFA，
+ * 再按输入字节的等价类构造DFA，匹配时每个输入字节查一次转移表，开销只与输入长度有关，与规则数无关。
+ * DFA状态数超过上限时退回按NFA逐字节模拟；使用了锚点、{n}、\d等自动机不支持的语法的规则仍由预编译的QRegExp匹配。
+ * 创建后只读，可以在多个线程中同时匹配
+ */
+class DBusRuleMatcher
+{
+public:
+    // 字节集合中前256项为单个字节，该项为任意字节
+    static const int kAnyByteSet = 256;
+
+    /*
+     * 编译规则列表
+     *
+     * @param rules: 规则列表
+     */
+    explicit DBusRuleMatcher(const QStringList &rules);
+
+    /*
+     * 判断规则是否为正则规则
+     *
+     * @param rule: 规则
+     *
+     * @return bool: true: 是 false:否
+     */
+    static bool isPattern(const QString &rule);
+
+    /*
+     * 判断输入是否匹配任一规则
+     *
+     * @param data: 输入数据视图
+     *
+     * @return bool: true: 是 false:否
+     */
+    bool isMatch(QLatin1String data) const;
+
+    /*
+     * 判断输入是否匹配任一规则
+     *
+     * @param data: 输入字符串
+     *
+     * @return bool: true: 是 false:否
+     */
+    bool isMatch(const QString &data) const;
+
+    /*
+     * 获取编译结果统计信息
+     *
+     * @return DBusRuleMatcherMetrics: 统计信息
+     */
+    DBusRuleMatcherMetrics metrics() const;
+
+private:
+    Q_DISABLE_COPY(DBusRuleMatcher)
+
+    // 精确匹配
+    bool isExactMatch(const char *data, int size) const;
+    // 按DFA或NFA查找正则规则
+    bool isPatternMatch(const char *data, int size) const;
+    // 把正则规则编译成NFA，失败时返回false
+    bool addPattern(const QByteArray &pattern);
+    // 把前缀树展开成NFA状态
+    void buildTrie();
+    // 计算每个NFA状态的空转移闭包、字节等价类与起始集合
+    void buildClosures();
+    // 构造DFA，状态数超过上限时返回false
+    bool buildDfa();
+    /*
+     * 集合中的状态读入一个字节，把转移到的状态的闭包追加到next，不排序去重
+     *
+     * @param set: 当前集合，只包含字节转移状态
+     * @param byte: 输入字节
+     * @param next: 输出下一步状态
+     *
+     * @return bool: true:到达接受状态 false:未到达
+     */
+    bool advance(const QVector<int> &set, uchar byte, QVector<int> *next) const;
+    /*
+     * 计算一个NFA状态集合读入一个字节等价类后的集合，每一步都重新加入所有规则的起点
+     *
+     * @param set: 当前集合，只包含字节转移状态
+     * @param cls: 字节等价类
+     * @param next: 输出下一步集合，有序不重复
+     *
+     * @return bool: true:到达接受状态 false:未到达
+     */
+    bool step(const QVector<int> &set, int cls, QVector<int> *next) const;
+
+    // 256位的字节集合
+    struct ByteSet {
+        quint32 bits[8];
+        bool contains(uchar c) const { return (bits[c >> 5] >> (c & 31)) & 1; }
+        void add(uchar c) { bits[c >> 5] |= 1u << (c & 31); }
+    };
+
+    // Thompson NFA的状态
+    struct NfaState {
+        enum Type { Byte, Split, Match };
+        int type;
+        // 字节转移状态的字节集合在byteSets中的下标
+        int set;
+        int out;
+        int out1;
+    };
+
+    // 规则开头不带量词的单字节原子组成的前缀树，共同前缀只生成一次状态，编译结束后释放
+    struct TrieNode {
+        TrieNode()
+            : accept(false)
+        {
+        }
+        // 按字节集合下标索引的子节点
+        QVector<QPair<int, int>> children;
+        // 前缀之后由DBusPatternCompiler编译的部分的起始状态
+        QVector<int> fragments;
+        // 规则在此结束
+        bool accept;
+    };
+
+    friend class DBusPatternCompiler;
+    QVector<TrieNode> trie;
+
+    // 精确规则，开放寻址哈希表保存keys的下标，-1为空槽
+    QVector<QByteArray> keys;
+    QVector<int> buckets;
+    int slotMask;
+
+    QVector<NfaState> nfa;
+    QVector<ByteSet> byteSets;
+    // 各规则的起始状态
+    QVector<int> starts;
+    int patternCount;
+    // 每个NFA状态的空转移闭包在closureStates中的区间，只包含字节转移状态；闭包含接受状态时closureAccept为true
+    QVector<int> closureOffsets;
+    QVector<int> closureStates;
+    QVector<bool> closureAccept;
+    // 所有规则起点的闭包
+    QVector<int> startSet;
+    // 有规则可以匹配空串时任何输入都匹配
+    bool matchesEmpty;
+    // 字节等价类与每类的代表字节
+    uchar classOf[256];
+    QVector<uchar> classBytes;
+    // 从起点读入一个字节等价类后的集合与是否到达接受状态
+    QVector<QVector<int>> startSteps;
+    QVector<bool> startAccept;
+    // DFA转移表，按状态×等价类排列，kAccept表示已匹配；为空时按NFA模拟
+    QVector<int> dfa;
+    int dfaStates;
+
+    // 不能编译进NFA的规则
+    QVector<QRegExp> regExps;
+};
+#endif
@@ -0,0 +1,254 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "dbus_verdict_cache.h"
+
+#include "filter/dbus_atom_table.h"
+
+/*
+ * 创建键
+ *
+ * @param destination: 消息目标地址
+ * @param path: 消息路径
+ * @param interface: 消息interface
+ * @param member: 消息方法名，过滤规则不需要时为空
+ * @param type: 消息类型，策略规则不区分类型时为0
+ */
+DBusVerdictKey::DBusVerdictKey(QLatin1String destination, QLatin1String path, QLatin1String interface,
+                               QLatin1String member, int type)
+    : fields{destination, path, interface, member}
+    , type(type)
+{
+}
+
+/*
+ * 创建缓存
+ *
+ * @param capacity: 最多缓存的条目数，0为不缓存
+ */
+DBusVerdictCache::DBusVerdictCache(int capacity)
+    : maxEntries(qMax(capacity, 0))
+    , currentGeneration(0)
+    , hand(0)
+{
+    stats = {0, 0, 0, 0, 0, 0};
+}
+
+DBusVerdictCache::~DBusVerdictCache()
+{
+    clear();
+}
+
+// 计算原子组合与消息类型的哈希
+uint DBusVerdictCache::hashAtoms(const int *atoms, int type)
+{
+    uint hash = static_cast<uint>(type);
+    for (int i = 0; i < 4; i++) {
+        hash = hash * 31 + static_cast<uint>(atoms[i]);
+    }
+    return hash ^ (hash >> 16);
+}
+
+// 在局部索引中查找字段的原子，不存在时返回kNoAtom
+int DBusVerdictCache::findAtom(QLatin1String field) const
+{
+    if (field.size() == 0) {
+        return DBusAtomTable::kEmptyAtom;
+    }
+    return atomIndex.value(field, DBusAtomTable::kNoAtom);
+}
+
+// 获取字段的原子并增加一次条目引用，原子表已满时返回kNoAtom
+int DBusVerdictCache::acquireAtom(QLatin1String field)
+{
+    int atom = findAtom(field);
+    if (atom != DBusAtomTable::kNoAtom) {
+        if (atom != DBusAtomTable::kEmptyAtom) {
+            localAtoms[atom].refs++;
+        }
+        return atom;
+    }
+    atom = DBusAtomTable::instance()->intern(field);
+    if (atom == DBusAtomTable::kNoAtom) {
+        return atom;
+    }
+    // 键指向局部字段持有的文本，不指向报文
+    LocalAtom &item = localAtoms[atom];
+    item.text = QByteArray(field.data(), field.size());
+    item.refs = 1;
+    atomIndex.insert(QLatin1String(item.text.constData(), item.text.size()), atom);
+    return atom;
+}
+
+// 释放一次条目引用，没有条目使用时从局部索引中删除
+void DBusVerdictCache::releaseAtom(int atom)
+{
+    QHash<int, LocalAtom>::iterator it = localAtoms.find(atom);
+    if (it == localAtoms.end() || --it->refs > 0) {
+        return;
+    }
+    // 先删除指向文本的键，再释放文本
+    atomIndex.remove(QLatin1String(it->text.constData(), it->text.size()));
+    localAtoms.erase(it);
+    DBusAtomTable::instance()->release(atom);
+}
+
+// 释放条目持有的原子
+void DBusVerdictCache::releaseAtoms(const Entry &entry)
+{
+    for (int atom : entry.atoms) {
+        releaseAtom(atom);
+    }
+}
+
+// 释放所有条目
+void DBusVerdictCache::clear()
+{
+    for (const Entry &entry : entries) {
+        releaseAtoms(entry);
+    }
+    entries.clear();
+    index.clear();
+    hand = 0;
+}
+
+/*
+ * 设置容量并清空缓存
+ *
+ * @param capacity: 最多缓存的条目数，0为不缓存
+ */
+void DBusVerdictCache::setCapacity(int capacity)
+{
+    maxEntries = qMax(capacity, 0);
+    clear();
+}
+
+/*
+ * 同步过滤规则代数，与上次不同时清空缓存
+ *
+ * @param generation: 过滤规则代数
+ */
+void DBusVerdictCache::setGeneration(quint64 generation)
+{
+    if (generation != currentGeneration) {
+        currentGeneration = generation;
+        invalidate();
+    }
+}
+
+/*
+ * 查找判定结果
+ *
+ * @param key: 报文头字段
+ * @param verdict: 输出判定结果
+ *
+ * @return bool: true:命中 false:未命中
+ */
+bool DBusVerdictCache::lookup(const DBusVerdictKey &key, int *verdict)
+{
+    if (entries.isEmpty()) {
+        stats.misses++;
+        return false;
+    }
+    // 在局部索引中查找各字段，任一字段不存在时缓存中一定没有该键
+    int atoms[4];
+    for (int i = 0; i < 4; i++) {
+        atoms[i] = findAtom(key.fields[i]);
+        if (atoms[i] == DBusAtomTable::kNoAtom) {
+            stats.misses++;
+            return false;
+        }
+    }
+    QHash<uint, int>::const_iterator it = index.constFind(hashAtoms(atoms, key.type));
+    if (it == index.constEnd()) {
+        stats.misses++;
+        return false;
+    }
+    Entry &entry = entries[it.value()];
+    bool same = entry.type == key.type;
+    for (int i = 0; i < 4; i++) {
+        same = same && entry.atoms[i] == atoms[i];
+    }
+    if (!same) {
+        stats.misses++;
+        return false;
+    }
+    entry.referenced = true;
+    *verdict = entry.verdict;
+    stats.hits++;
+    return true;
+}
+
+/*
+ * 保存判定结果，容量已满时淘汰一个条目
+ *
+ * @param key: 报文头字段
+ * @param verdict: 判定结果
+ */
+void DBusVerdictCache::insert(const DBusVerdictKey &key, int verdict)
+{
+    if (maxEntries == 0) {
+        return;
+    }
+    // 条目持有各字段原子的引用，原子表已满时不缓存
+    Entry entry = {0, {0, 0, 0, 0}, key.type, verdict, false};
+    for (int i = 0; i < 4; i++) {
+        entry.atoms[i] = acquireAtom(key.fields[i]);
+        if (entry.atoms[i] == DBusAtomTable::kNoAtom) {
+            for (int j = 0; j < i; j++) {
+                releaseAtom(entry.atoms[j]);
+            }
+            return;
+        }
+    }
+    entry.hash = hashAtoms(entry.atoms, entry.type);
+    // 哈希相同的条目直接替换，包括原子不同的冲突条目
+    QHash<uint, int>::const_iterator it = index.constFind(entry.hash);
+    if (it != index.constEnd()) {
+        releaseAtoms(entries[it.value()]);
+        entries[it.value()] = entry;
+        return;
+    }
+    if (entries.size() < maxEntries) {
+        entries.append(entry);
+        index.insert(entry.hash, entries.size() - 1);
+        return;
+    }
+    // 跳过上次扫描后被命中过的条目，清除其标记
+    while (entries[hand].referenced) {
+        entries[hand].referenced = false;
+        hand = (hand + 1) % entries.size();
+    }
+    index.remove(entries[hand].hash);
+    releaseAtoms(entries[hand]);
+    entries[hand] = entry;
+    index.insert(entry.hash, hand);
+    hand = (hand + 1) % entries.size();
+    stats.evictions++;
+}
+
+// 清空缓存，授权结果可能变化时调用
+void DBusVerdictCache::invalidate()
+{
+    if (entries.isEmpty()) {
+        return;
+    }
+    clear();
+    stats.invalidations++;
+}
+
+/*
+ * 获取统计信息
+ *
+ * @return DBusVerdictCacheMetrics: 统计信息
+ */
+DBusVerdictCacheMetrics DBusVerdictCache::metrics() const
+{
+    DBusVerdictCacheMetrics ret = stats;
+    ret.entries = entries.size();
+    ret.atoms = localAtoms.size();
+    return ret;
+}
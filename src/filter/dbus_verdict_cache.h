@@ -0,0 +1,161 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_DBUS_PROXY_SRC_FILTER_DBUS_VERDICT_CACHE_H
+#define LINGLONG_DBUS_PROXY_SRC_FILTER_DBUS_VERDICT_CACHE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QLatin1String>
+#include <QVector>
+
+// 判定缓存统计信息
+struct DBusVerdictCacheMetrics {
+    // 命中次数
+    quint64 hits;
+    // 未命中次数
+    quint64 misses;
+    // 容量已满时淘汰的条目数
+    quint64 evictions;
+    // 规则或授权变化导致的清空次数
+    quint64 invalidations;
+    // 当前条目数
+    int entries;
+    // 局部原子索引中的字段数
+    int atoms;
+};
+
+/*
+ * 判定缓存的键，由消息类型与报文头中destination、path、interface与member的视图组成，不复制数据
+ */
+struct DBusVerdictKey {
+    /*
+     * 创建键
+     *
+     * @param destination: 消息目标地址
+     * @param path: 消息路径
+     * @param interface: 消息interface
+     * @param member: 消息方法名，过滤规则不需要时为空
+     * @param type: 消息类型，策略规则不区分类型时为0
+     */
+    DBusVerdictKey(QLatin1String destination, QLatin1String path, QLatin1String interface, QLatin1String member,
+                   int type = 0);
+
+    QLatin1String fields[4];
+    int type;
+};
+
+/*
+ * 过滤与授权判定结果的缓存
+ *
+ * 沙箱应用反复发送少数几种调用（轮询状态属性、输入法调用等），每种调用的判定只与报文头字段有关。
+ * 缓存以各字段在进程原子表中的原子为键，命中时只比较整数，不转换字符串也不分配内存。
+ * 字段到原子的解析使用本缓存的局部索引，查找时不访问进程原子表，也不加锁；
+ * 局部索引与条目一同持有原子的引用，淘汰时释放。容量满时按CLOCK算法淘汰最近未被命中的条目。
+ * 过滤规则代数变化或调用invalidate时清空。只在创建它的线程中使用
+ */
+class DBusVerdictCache
+{
+public:
+    /*
+     * 创建缓存
+     *
+     * @param capacity: 最多缓存的条目数，0为不缓存
+     */
+    explicit DBusVerdictCache(int capacity);
+    ~DBusVerdictCache();
+
+    /*
+     * 设置容量并清空缓存
+     *
+     * @param capacity: 最多缓存的条目数，0为不缓存
+     */
+    void setCapacity(int capacity);
+
+    int capacity() const { return maxEntries; }
+
+    /*
+     * 同步过滤规则代数，与上次不同时清空缓存
+     *
+     * @param generation: 过滤规则代数
+     */
+    void setGeneration(quint64 generation);
+
+    /*
+     * 查找判定结果
+     *
+     * @param key: 报文头字段
+     * @param verdict: 输出判定结果
+     *
+     * @return bool: true:命中 false:未命中
+     */
+    bool lookup(const DBusVerdictKey &key, int *verdict);
+
+    /*
+     * 保存判定结果，容量已满时淘汰一个条目
+     *
+     * @param key: 报文头字段
+     * @param verdict: 判定结果
+     */
+    void insert(const DBusVerdictKey &key, int verdict);
+
+    // 清空缓存，授权结果可能变化时调用
+    void invalidate();
+
+    /*
+     * 获取统计信息
+     *
+     * @return DBusVerdictCacheMetrics: 统计信息
+     */
+    DBusVerdictCacheMetrics metrics() const;
+
+private:
+    Q_DISABLE_COPY(DBusVerdictCache)
+
+    struct Entry {
+        uint hash;
+        // 持有引用的各字段原子
+        int atoms[4];
+        int type;
+        int verdict;
+        // 上次扫描后被命中过
+        bool referenced;
+    };
+
+    // 局部索引中的一个字段，对进程原子表中的原子持有一次引用
+    struct LocalAtom {
+        QByteArray text;
+        // 使用该字段的条目数
+        int refs;
+    };
+
+    // 计算原子组合与消息类型的哈希
+    static uint hashAtoms(const int *atoms, int type);
+    // 在局部索引中查找字段的原子，不存在时返回kNoAtom
+    int findAtom(QLatin1String field) const;
+    // 获取字段的原子并增加一次条目引用，原子表已满时返回kNoAtom
+    int acquireAtom(QLatin1String field);
+    // 释放一次条目引用，没有条目使用时从局部索引中删除
+    void releaseAtom(int atom);
+    // 释放条目持有的原子
+    void releaseAtoms(const Entry &entry);
+    // 释放所有条目
+    void clear();
+
+    int maxEntries;
+    quint64 currentGeneration;
+    QVector<Entry> entries;
+    // 哈希到entries下标
+    QHash<uint, int> index;
+    // 字段文本到原子，键指向localAtoms中的文本
+    QHash<QLatin1String, int> atomIndex;
+    // 原子到局部字段
+    QHash<int, LocalAtom> localAtoms;
+    // CLOCK算法的指针
+    int hand;
+    DBusVerdictCacheMetrics stats;
+};
+#endif
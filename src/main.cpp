@@ -11,6 +11,7 @@
 
 #include <QCoreApplication>
 #include <QDebug>
+#include <QFile>
 
 #include "filter/dbus_filter.h"
 #include "proxy/dbus_proxy.h"
@@ -20,7 +21,7 @@ int main(int argc, char *argv[])
     QCoreApplication app(argc, argv);
 
     qSetMessagePattern("%{time yyyy-MM-dd hh:mm:ss.zzz} [%{appname}] [%{type}] %{message}");
-    // appId busType socketPath name path interface
+    // appId busType socketPath name path interface [ruleFile]
     if (argc < 7) {
         qCritical() << "dbus proxy param err";
         return -1;
@@ -65,6 +66,23 @@ int main(int argc, char *argv[])
     for (const auto &item : interfaceFilterList) {
         server.filter.addInterfaceFilter(item);
     }
+    // 可选的策略规则文件，每行一条规则，先写的规则优先，#开头的行为注释
+    if (argc > 7) {
+        QFile ruleFile(QString::fromLocal8Bit(argv[7]));
+        if (!ruleFile.open(QIODevice::ReadOnly)) {
+            qCritical() << "dbus proxy rule file err" << ruleFile.errorString();
+            return -1;
+        }
+        for (const QByteArray &line : ruleFile.readAll().split('\n')) {
+            const QString rule = QString::fromUtf8(line).trimmed();
+            if (rule.isEmpty() || rule.startsWith('#')) {
+                continue;
+            }
+            if (!server.filter.addRule(rule)) {
+                return -1;
+            }
+        }
+    }
 
     prctl(PR_SET_PDEATHSIG, SIGKILL);
 
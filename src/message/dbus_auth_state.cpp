@@ -0,0 +1,148 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "dbus_auth_state.h"
+
+#include <string.h>
+
+#include <QDebug>
+
+// 等待回复的客户端命令上限，正常客户端最多同时发送几条
+static const int kMaxPendingCommands = 64;
+
+struct DBusAuthCommandName {
+    const char *name;
+    DBusAuthCommand command;
+};
+
+static const DBusAuthCommandName kClientCommands[] = {
+    {"AUTH", DBusAuthCommand::AUTH},
+    {"CANCEL", DBusAuthCommand::CANCEL},
+    {"BEGIN", DBusAuthCommand::BEGIN},
+    {"DATA", DBusAuthCommand::DATA},
+    {"ERROR", DBusAuthCommand::ERROR},
+    {"NEGOTIATE_UNIX_FD", DBusAuthCommand::NEGOTIATE_UNIX_FD},
+};
+
+static const DBusAuthCommandName kServerCommands[] = {
+    {"OK", DBusAuthCommand::OK},
+    {"REJECTED", DBusAuthCommand::REJECTED},
+    {"DATA", DBusAuthCommand::DATA},
+    {"ERROR", DBusAuthCommand::ERROR},
+    {"AGREE_UNIX_FD", DBusAuthCommand::AGREE_UNIX_FD},
+};
+
+/*
+ * 解析认证报文中的命令，命令与参数之间以空格或制表符分隔，与libdbus一致
+ *
+ * @param line: 报文地址
+ * @param size: 报文长度
+ * @param names: 命令表
+ * @param count: 命令表长度
+ * @param command: 解析结果，未知命令为UNKNOWN
+ *
+ * @return bool: true:成功 false:报文不以"\r\n"结尾
+ */
+static bool parseCommand(const char *line, quint32 size, const DBusAuthCommandName *names, size_t count,
+                         DBusAuthCommand *command)
+{
+    if (size < 2 || line[size - 2] != '\r' || line[size - 1] != '\n') {
+        return false;
+    }
+    quint32 len = 0;
+    while (len < size - 2 && line[len] != ' ' && line[len] != '\t') {
+        len++;
+    }
+    *command = DBusAuthCommand::UNKNOWN;
+    for (size_t i = 0; i < count; i++) {
+        if (strlen(names[i].name) == len && memcmp(names[i].name, line, len) == 0) {
+            *command = names[i].command;
+            break;
+        }
+    }
+    return true;
+}
+
+DBusAuthStateMachine::DBusAuthStateMachine()
+    : nulByteSeen(false)
+    , beginSent(false)
+    , authenticated(false)
+    , unixFdNegotiated(false)
+{
+}
+
+/*
+ * 处理客户端发送的一行认证报文
+ *
+ * @param line: 报文地址，包含行尾的"\r\n"
+ * @param size: 报文长度
+ *
+ * @return bool: true:成功 false:违反认证协议
+ */
+bool DBusAuthStateMachine::handleClientLine(const char *line, quint32 size)
+{
+    if (beginSent) {
+        return false;
+    }
+    // 客户端连接后先发送一个空字节用于传递凭证，dbus-daemon会校验，这里只跳过
+    if (!nulByteSeen) {
+        nulByteSeen = true;
+        if (size > 0 && line[0] == '\0') {
+            line++;
+            size--;
+        }
+    }
+    DBusAuthCommand command;
+    if (!parseCommand(line, size, kClientCommands, sizeof(kClientCommands) / sizeof(kClientCommands[0]),
+                      &command)) {
+        qWarning() << "dbus auth line from client is not terminated by CRLF";
+        return false;
+    }
+    if (command == DBusAuthCommand::BEGIN) {
+        beginSent = true;
+        return true;
+    }
+    if (pendingCommands.size() >= kMaxPendingCommands) {
+        qWarning() << "too many dbus auth commands without reply";
+        return false;
+    }
+    // 未知命令dbus-daemon同样回复ERROR
+    pendingCommands.enqueue(command);
+    return true;
+}
+
+/*
+ * 处理dbus-daemon发送的一行认证报文
+ *
+ * @param line: 报文地址，包含行尾的"\r\n"
+ * @param size: 报文长度
+ *
+ * @return bool: true:成功 false:违反认证协议
+ */
+bool DBusAuthStateMachine::handleServerLine(const char *line, quint32 size)
+{
+    DBusAuthCommand command;
+    if (!parseCommand(line, size, kServerCommands, sizeof(kServerCommands) / sizeof(kServerCommands[0]),
+                      &command)) {
+        qWarning() << "dbus auth line from dbus-daemon is not terminated by CRLF";
+        return false;
+    }
+    // dbus-daemon只回复客户端的命令
+    if (pendingCommands.isEmpty()) {
+        qWarning() << "unexpected dbus auth line from dbus-daemon";
+        return false;
+    }
+    const DBusAuthCommand request = pendingCommands.dequeue();
+    if (command == DBusAuthCommand::OK) {
+        authenticated = true;
+    } else if (command == DBusAuthCommand::REJECTED) {
+        authenticated = false;
+    }
+    if (request == DBusAuthCommand::NEGOTIATE_UNIX_FD) {
+        unixFdNegotiated = command == DBusAuthCommand::AGREE_UNIX_FD;
+    }
+    return true;
+}
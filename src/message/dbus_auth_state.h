@@ -0,0 +1,107 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_DBUS_PROXY_SRC_MESSAGE_DBUS_AUTH_STATE_H
+#define LINGLONG_DBUS_PROXY_SRC_MESSAGE_DBUS_AUTH_STATE_H
+
+#include <QQueue>
+#include <QtGlobal>
+
+// 认证报文的发送方
+enum class DBusAuthPeer {
+    // 沙箱内的dbus客户端
+    Client,
+    // dbus-daemon
+    Server
+};
+
+// 认证阶段的命令 https://dbus.freedesktop.org/doc/dbus-specification.html#auth-protocol
+enum class DBusAuthCommand {
+    UNKNOWN,
+    // 客户端命令
+    AUTH,
+    CANCEL,
+    BEGIN,
+    NEGOTIATE_UNIX_FD,
+    // 服务端命令
+    OK,
+    REJECTED,
+    AGREE_UNIX_FD,
+    // 双方均可发送
+    DATA,
+    ERROR
+};
+
+/*
+ * 单个连接的认证状态机
+ *
+ * 客户端与dbus-daemon两个方向共用一个状态机，按行跟踪认证命令，认证报文本身原样转发。
+ * 客户端除BEGIN外的每条命令dbus-daemon都恰好回复一行，BEGIN没有回复：
+ * 认证未完成时dbus-daemon直接断开连接，否则之后双方都只发送二进制消息。
+ * 因此客户端方向在BEGIN之后立即切换为二进制消息，
+ * dbus-daemon方向在收到BEGIN之前所有命令的回复后切换，切换后不再回到认证阶段
+ */
+class DBusAuthStateMachine
+{
+public:
+    DBusAuthStateMachine();
+
+    /*
+     * 处理客户端发送的一行认证报文
+     *
+     * @param line: 报文地址，包含行尾的"\r\n"
+     * @param size: 报文长度
+     *
+     * @return bool: true:成功 false:违反认证协议
+     */
+    bool handleClientLine(const char *line, quint32 size);
+
+    /*
+     * 处理dbus-daemon发送的一行认证报文
+     *
+     * @param line: 报文地址，包含行尾的"\r\n"
+     * @param size: 报文长度
+     *
+     * @return bool: true:成功 false:违反认证协议
+     */
+    bool handleServerLine(const char *line, quint32 size);
+
+    /*
+     * 指定方向的数据是否已进入二进制消息阶段
+     *
+     * @param peer: 数据发送方
+     *
+     * @return bool: true:二进制阶段 false:认证阶段
+     */
+    bool isBinary(DBusAuthPeer peer) const
+    {
+        return beginSent && (peer == DBusAuthPeer::Client || pendingCommands.isEmpty());
+    }
+
+    /*
+     * dbus-daemon是否已回复OK
+     *
+     * @return bool: true:是 false:否
+     */
+    bool isAuthenticated() const { return authenticated; }
+
+    /*
+     * 双方是否协商支持传递文件描述符
+     *
+     * @return bool: true:是 false:否
+     */
+    bool isUnixFdNegotiated() const { return unixFdNegotiated; }
+
+private:
+    // 等待dbus-daemon回复的客户端命令，按发送顺序排列
+    QQueue<DBusAuthCommand> pendingCommands;
+    // 客户端第一行之前的空字节是否已处理
+    bool nulByteSeen;
+    bool beginSent;
+    bool authenticated;
+    bool unixFdNegotiated;
+};
+#endif
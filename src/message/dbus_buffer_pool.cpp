@@ -0,0 +1,112 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "dbus_buffer_pool.h"
+
+#include <stdlib.h>
+
+#include <QDebug>
+
+/*
+ * 创建缓冲池，不预先申请内存
+ *
+ * @param chunkSize: 块大小，字节
+ * @param capacity: 借出与缓存的块总数上限
+ */
+DBusBufferPool::DBusBufferPool(int chunkSize, int capacity)
+    : size(chunkSize)
+    , maxChunks(capacity)
+    , lent(0)
+    , allocations(0)
+    , reuses(0)
+    , exhausted(0)
+{
+    // 空闲列表的容量预先确定，归还时不分配内存
+    freeList.reserve(capacity);
+}
+
+DBusBufferPool::~DBusBufferPool()
+{
+    if (lent > 0) {
+        qCritical() << "buffer pool released with lent chunks:" << lent;
+    }
+    for (char *chunk : freeList) {
+        free(chunk);
+    }
+}
+
+/*
+ * 借出一块
+ *
+ * @return char*: 块地址，达到容量上限时返回nullptr
+ */
+char *DBusBufferPool::acquire()
+{
+    char *chunk = nullptr;
+    if (!freeList.isEmpty()) {
+        chunk = freeList.takeLast();
+        reuses++;
+    } else if (lent < maxChunks) {
+        chunk = static_cast<char *>(malloc(static_cast<size_t>(size)));
+        if (!chunk) {
+            return nullptr;
+        }
+        allocations++;
+    } else {
+        exhausted++;
+        return nullptr;
+    }
+    lent++;
+    return chunk;
+}
+
+/*
+ * 归还借出的块
+ *
+ * @param chunk: 块地址
+ */
+void DBusBufferPool::release(char *chunk)
+{
+    if (!chunk) {
+        return;
+    }
+    lent--;
+    if (lent + freeList.size() >= maxChunks) {
+        free(chunk);
+        return;
+    }
+    freeList.append(chunk);
+}
+
+/*
+ * 设置容量上限，缓存的空闲块超出上限时立即释放，已借出的块归还时释放
+ *
+ * @param chunks: 借出与缓存的块总数上限
+ */
+void DBusBufferPool::setCapacity(int chunks)
+{
+    maxChunks = qMax(chunks, 0);
+    while (!freeList.isEmpty() && lent + freeList.size() > maxChunks) {
+        free(freeList.takeLast());
+    }
+    freeList.reserve(maxChunks);
+}
+
+/*
+ * 获取统计信息
+ *
+ * @return DBusBufferPoolMetrics: 统计信息
+ */
+DBusBufferPoolMetrics DBusBufferPool::metrics() const
+{
+    DBusBufferPoolMetrics ret;
+    ret.allocations = allocations;
+    ret.reuses = reuses;
+    ret.exhausted = exhausted;
+    ret.lentChunks = lent;
+    ret.freeChunks = freeList.size();
+    return ret;
+}
@@ -0,0 +1,100 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_DBUS_PROXY_SRC_MESSAGE_DBUS_BUFFER_POOL_H
+#define LINGLONG_DBUS_PROXY_SRC_MESSAGE_DBUS_BUFFER_POOL_H
+
+#include <QVector>
+#include <QtGlobal>
+
+// 缓冲池统计信息
+struct DBusBufferPoolMetrics {
+    // 向堆申请内存块的次数
+    quint64 allocations;
+    // 复用空闲块的次数
+    quint64 reuses;
+    // 达到容量上限无法借出的次数
+    quint64 exhausted;
+    // 已借出的块数
+    int lentChunks;
+    // 缓存的空闲块数
+    int freeChunks;
+};
+
+/*
+ * 固定大小接收缓冲块的缓冲池
+ *
+ * 同一线程中的连接共用，消息重组器有数据时借出一块，数据取空后归还，空闲连接不占用接收缓冲区。
+ * 归还的块缓存在空闲列表中按后进先出复用，稳定状态下不再申请内存。
+ * 借出与缓存的块总数不超过容量上限，达到上限后借出失败，调用方自行分配内存。
+ * 不加锁，只能在一个线程中使用
+ */
+class DBusBufferPool
+{
+public:
+    /*
+     * 创建缓冲池，不预先申请内存
+     *
+     * @param chunkSize: 块大小，字节
+     * @param capacity: 借出与缓存的块总数上限
+     */
+    DBusBufferPool(int chunkSize, int capacity);
+    ~DBusBufferPool();
+
+    /*
+     * 借出一块
+     *
+     * @return char*: 块地址，达到容量上限时返回nullptr
+     */
+    char *acquire();
+
+    /*
+     * 归还借出的块
+     *
+     * @param chunk: 块地址
+     */
+    void release(char *chunk);
+
+    /*
+     * 块大小
+     *
+     * @return int: 字节数
+     */
+    int chunkSize() const { return size; }
+
+    /*
+     * 设置容量上限，缓存的空闲块超出上限时立即释放，已借出的块归还时释放
+     *
+     * @param chunks: 借出与缓存的块总数上限
+     */
+    void setCapacity(int chunks);
+
+    /*
+     * 容量上限
+     *
+     * @return int: 块数
+     */
+    int capacity() const { return maxChunks; }
+
+    /*
+     * 获取统计信息
+     *
+     * @return DBusBufferPoolMetrics: 统计信息
+     */
+    DBusBufferPoolMetrics metrics() const;
+
+private:
+    Q_DISABLE_COPY(DBusBufferPool)
+
+    int size;
+    int maxChunks;
+    int lent;
+    QVector<char *> freeList;
+    quint64 allocations;
+    quint64 reuses;
+    quint64 exhausted;
+};
+#endif
@@ -0,0 +1,132 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "dbus_error_reply.h"
+
+#include <string.h>
+
+#include <QtEndian>
+
+// 固定头部中各字段的偏移
+static const int kBodyLengthOffset = 4;
+static const int kSerialOffset = 8;
+static const int kArrayLengthOffset = 12;
+// REPLY_SERIAL字段紧跟固定头部，值位于字段第4个字节之后
+static const int kReplySerialOffset = 16 + 4;
+// 总线名称最大长度
+static const int kMaxBusNameLength = 255;
+
+/*
+ * 追加一个UINT32，小端序
+ *
+ * @param value: 整数值
+ * @param out: 输出缓冲区
+ */
+static void appendUInt32(quint32 value, QByteArray *out)
+{
+    char data[4];
+    qToLittleEndian<quint32>(value, data);
+    out->append(data, 4);
+}
+
+/*
+ * 追加字符串类型字段，包含结尾的空字符
+ *
+ * @param code: 字段编号
+ * @param type: 字段类型，s或g
+ * @param value: 字段值
+ * @param out: 输出缓冲区
+ */
+static void appendStringField(DBusMessageHeaderField code, char type, const char *value, QByteArray *out)
+{
+    const char fieldHeader[4] = {static_cast<char>(code), 1, type, 0};
+    out->append(fieldHeader, 4);
+    const int len = static_cast<int>(strlen(value));
+    if (type == 'g') {
+        out->append(static_cast<char>(len));
+    } else {
+        appendUInt32(static_cast<quint32>(len), out);
+    }
+    out->append(value, len + 1);
+}
+
+DBusErrorReplyTemplate::DBusErrorReplyTemplate(const char *errorName, const char *errorMsg)
+{
+    // 固定头部，body长度在此确定，序列号与报文头数组长度在生成回复时填写
+    const char fixedHeader[16] = {'l', static_cast<char>(MessageType::ERROR), 0x1, 1};
+    prefix.append(fixedHeader, 16);
+    const char replySerialField[8] = {
+        static_cast<char>(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_REPLY_SERIAL), 1, 'u', 0};
+    prefix.append(replySerialField, 8);
+    appendStringField(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_SIGNATURE, 'g', "s", &prefix);
+    prefix.append(QByteArray(static_cast<int>(alignBy8(prefix.size()) - prefix.size()), '\0'));
+    appendStringField(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_ERROR_NAME, 's', errorName, &prefix);
+    fieldsLength = static_cast<quint32>(prefix.size()) - 16;
+    prefix.append(QByteArray(static_cast<int>(alignBy8(prefix.size()) - prefix.size()), '\0'));
+
+    const int msgLen = static_cast<int>(strlen(errorMsg));
+    appendUInt32(static_cast<quint32>(msgLen), &body);
+    body.append(errorMsg, msgLen + 1);
+    qToLittleEndian<quint32>(static_cast<quint32>(body.size()), prefix.data() + kBodyLengthOffset);
+}
+
+/*
+ * 在out末尾追加一条回复request的错误报文
+ *
+ * @param request: 被拒绝的请求报文头
+ * @param serial: 回复报文序列号
+ * @param destination: 回复报文目标地址，为空时不写入DESTINATION字段
+ * @param out: 输出缓冲区，已有数据保持不变
+ *
+ * @return bool: true:成功 false:目标地址超出总线名称长度限制
+ */
+bool DBusErrorReplyTemplate::appendTo(const DBusHeaderView &request, quint32 serial, QLatin1String destination,
+                                      QByteArray *out) const
+{
+    const int destLen = destination.size();
+    if (destLen > kMaxBusNameLength) {
+        return false;
+    }
+    // DESTINATION字段：4字节字段头，4字节长度，字符串及结尾空字符
+    const int destFieldLen = destLen > 0 ? 8 + destLen + 1 : 0;
+    const int destFieldSize = static_cast<int>(alignBy8(static_cast<quint32>(destFieldLen)));
+    const int start = out->size();
+    out->resize(start + prefix.size() + destFieldSize + body.size());
+
+    char *data = out->data() + start;
+    memcpy(data, prefix.constData(), static_cast<size_t>(prefix.size()));
+    qToLittleEndian<quint32>(serial, data + kSerialOffset);
+    qToLittleEndian<quint32>(request.serial, data + kReplySerialOffset);
+    quint32 arrayLength = fieldsLength;
+    char *field = data + prefix.size();
+    if (destLen > 0) {
+        arrayLength = static_cast<quint32>(prefix.size()) - 16 + static_cast<quint32>(destFieldLen);
+        field[0] = static_cast<char>(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_DESTINATION);
+        field[1] = 1;
+        field[2] = 's';
+        field[3] = 0;
+        qToLittleEndian<quint32>(static_cast<quint32>(destLen), field + 4);
+        memcpy(field + 8, destination.data(), static_cast<size_t>(destLen));
+        // 结尾空字符与报文头对齐填充
+        memset(field + 8 + destLen, 0, static_cast<size_t>(destFieldSize - destFieldLen + 1));
+    }
+    qToLittleEndian<quint32>(arrayLength, data + kArrayLengthOffset);
+    memcpy(field + destFieldSize, body.constData(), static_cast<size_t>(body.size()));
+    return true;
+}
+
+/*
+ * 代理拒绝访问时回复客户端的AccessDenied错误
+ *
+ * @return const DBusErrorReplyTemplate &: 错误回复模板
+ */
+const DBusErrorReplyTemplate &accessDeniedReply()
+{
+    static const DBusErrorReplyTemplate reply(
+        "org.freedesktop.DBus.Error.AccessDenied",
+        "org.freedesktop.DBus.Error.AccessDenied, please config permission first!");
+    return reply;
+}
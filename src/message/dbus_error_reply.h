@@ -0,0 +1,62 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_DBUS_PROXY_SRC_MESSAGE_DBUS_ERROR_REPLY_H
+#define LINGLONG_DBUS_PROXY_SRC_MESSAGE_DBUS_ERROR_REPLY_H
+
+#include <QByteArray>
+#include <QLatin1String>
+#include <QtGlobal>
+
+#include "dbus_header_view.h"
+
+/*
+ * 预先编码的dbus错误回复报文
+ *
+ * 错误类型、错误消息以及报文头中的固定部分在构造时按小端序编码一次，
+ * 生成回复时只需填入序列号与目标地址，不经过libdbus，不产生中间对象。
+ * 报文头字段顺序为REPLY_SERIAL、SIGNATURE、ERROR_NAME、DESTINATION，
+ * 与dbus_message_new_error生成的报文等价，标记NO_REPLY_EXPECTED
+ */
+class DBusErrorReplyTemplate
+{
+public:
+    /*
+     * 编码错误回复模板
+     *
+     * @param errorName: 错误类型，如org.freedesktop.DBus.Error.AccessDenied
+     * @param errorMsg: 错误消息，作为body中唯一的字符串参数
+     */
+    DBusErrorReplyTemplate(const char *errorName, const char *errorMsg);
+
+    /*
+     * 在out末尾追加一条回复request的错误报文
+     *
+     * @param request: 被拒绝的请求报文头
+     * @param serial: 回复报文序列号
+     * @param destination: 回复报文目标地址，为空时不写入DESTINATION字段
+     * @param out: 输出缓冲区，已有数据保持不变
+     *
+     * @return bool: true:成功 false:目标地址超出总线名称长度限制
+     */
+    bool appendTo(const DBusHeaderView &request, quint32 serial, QLatin1String destination, QByteArray *out) const;
+
+private:
+    // 固定头部与REPLY_SERIAL、SIGNATURE、ERROR_NAME字段，已按8字节对齐
+    QByteArray prefix;
+    // body，错误消息字符串
+    QByteArray body;
+    // 不含DESTINATION字段及结尾对齐时的报文头数组长度
+    quint32 fieldsLength;
+};
+
+/*
+ * 代理拒绝访问时回复客户端的AccessDenied错误
+ *
+ * @return const DBusErrorReplyTemplate &: 错误回复模板
+ */
+const DBusErrorReplyTemplate &accessDeniedReply();
+#endif
@@ -0,0 +1,370 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "dbus_frame_reader.h"
+
+#include <string.h>
+
+#include <QDebug>
+
+#include "dbus_wire_reader.h"
+
+// 缓冲区初始大小
+static const int kInitialBufferSize = 4096;
+// 缓冲区空闲时超过该大小则释放，避免一条大消息之后长期占用内存
+static const int kShrinkThreshold = 1024 * 1024;
+// 单次读取的数据量，大消息按剩余长度读取
+static const int kReadChunkSize = 1024 * 1024;
+// dbus消息头数组最大长度
+static const quint32 kMaxHeaderFieldsLength = 67108864;
+
+DBusFrameReader::DBusFrameReader()
+    : DBusFrameReader(QSharedPointer<DBusAuthStateMachine>(new DBusAuthStateMachine()), DBusAuthPeer::Client)
+{
+}
+
+DBusFrameReader::DBusFrameReader(const QSharedPointer<DBusAuthStateMachine> &auth, DBusAuthPeer peer)
+    : auth(auth)
+    , peer(peer)
+    , chunk(nullptr)
+    , readPos(0)
+    , writePos(0)
+    , expectSize(0)
+    , cutThroughThreshold(0)
+    , streamSize(0)
+    , streamOffset(0)
+    , streamDiscard(false)
+    , binaryMode(false)
+    , error(false)
+{
+}
+
+DBusFrameReader::~DBusFrameReader()
+{
+    if (chunk) {
+        pool->release(chunk);
+    }
+}
+
+/*
+ * 缓冲区已取空时释放接收缓冲区，借出的块归还缓冲池，在每次分发结束后调用
+ *
+ * 取出的消息视图在调用后失效
+ */
+void DBusFrameReader::releaseBuffer()
+{
+    if (!pool || writePos != readPos) {
+        return;
+    }
+    readPos = writePos = 0;
+    if (chunk) {
+        pool->release(chunk);
+        chunk = nullptr;
+    }
+    // 超过块大小的消息单独分配的内存不保留，下次读取重新从缓冲池借出
+    buffer.clear();
+}
+
+/*
+ * 保证缓冲区尾部至少有size字节可写空间，必要时搬移未取出数据或扩容
+ *
+ * @param size: 需要的空间
+ *
+ * @return char*: 可写地址，失败返回nullptr
+ */
+char *DBusFrameReader::reserve(int size)
+{
+    const int pending = writePos - readPos;
+    if (pending == 0) {
+        readPos = writePos = 0;
+        if (buffer.size() > kShrinkThreshold) {
+            buffer.resize(kInitialBufferSize);
+            buffer.squeeze();
+        }
+    }
+
+    // 正在接收大消息时一次预留整条消息的空间
+    qint64 need = size;
+    if (expectSize > static_cast<quint32>(pending)) {
+        need = qMax<qint64>(need, expectSize - pending);
+    }
+    // 没有接收缓冲区时优先从缓冲池借出，缓冲池用尽时自行分配
+    if (pool && !chunk && buffer.isEmpty() && need <= pool->chunkSize()) {
+        chunk = pool->acquire();
+    }
+    if (capacity() - writePos >= need) {
+        return bufferData() + writePos;
+    }
+
+    // 只搬移尚未取出的不完整数据
+    if (readPos > 0) {
+        memmove(bufferData(), bufferData() + readPos, static_cast<size_t>(pending));
+        readPos = 0;
+        writePos = pending;
+    }
+
+    if (capacity() - writePos < need) {
+        qint64 newSize = qMax<qint64>(qMax(capacity() * 2, kInitialBufferSize), writePos + need);
+        if (writePos + need > DBUS_MAX_MESSAGE_LENGTH + kReadChunkSize) {
+            qCritical() << "dbus frame reader buffer overflow, pending:" << pending << ", need:" << need;
+            return nullptr;
+        }
+        newSize = qMin<qint64>(newSize, DBUS_MAX_MESSAGE_LENGTH + kReadChunkSize);
+        if (chunk) {
+            // 消息超过块大小，转移到单独分配的内存并归还借出的块
+            buffer.resize(static_cast<int>(newSize));
+            memcpy(buffer.data(), chunk, static_cast<size_t>(writePos));
+            pool->release(chunk);
+            chunk = nullptr;
+        } else {
+            buffer.resize(static_cast<int>(newSize));
+        }
+    }
+    return bufferData() + writePos;
+}
+
+/*
+ * 将设备中当前可读的数据全部读入缓冲区
+ *
+ * @param device: 数据来源
+ *
+ * @return qint64: 读取的字节数，出错返回-1
+ */
+qint64 DBusFrameReader::readFrom(QIODevice *device)
+{
+    if (error) {
+        return -1;
+    }
+    const qint64 available = device->bytesAvailable();
+    if (available <= 0) {
+        return 0;
+    }
+    // 其余数据留给调用方下一次读取，保证缓冲区不超过一条最大消息加一个读取块；
+    // 使用缓冲池时最多读到块满，不完整的消息仍能放在块中
+    qint64 limit = kReadChunkSize;
+    if (pool) {
+        limit = qMax<qint64>(pool->chunkSize() - pendingSize(), DBUS_FIXED_HEADER_LENGTH);
+    }
+    if (expectSize > static_cast<quint32>(pendingSize())) {
+        limit = qMax<qint64>(limit, expectSize - pendingSize());
+    }
+    const int size = static_cast<int>(qMin<qint64>(available, limit));
+    char *dst = reserve(size);
+    if (!dst) {
+        error = true;
+        return -1;
+    }
+    const qint64 ret = device->read(dst, size);
+    if (ret > 0) {
+        writePos += static_cast<int>(ret);
+    }
+    return ret;
+}
+
+/*
+ * 向缓冲区追加数据
+ *
+ * @param data: 数据地址
+ * @param size: 数据长度
+ */
+void DBusFrameReader::append(const char *data, int size)
+{
+    if (error || size <= 0) {
+        return;
+    }
+    char *dst = reserve(size);
+    if (!dst) {
+        error = true;
+        return;
+    }
+    memcpy(dst, data, static_cast<size_t>(size));
+    writePos += size;
+}
+
+/*
+ * 计算二进制消息总长度
+ *
+ * @param data: 消息固定头部
+ * @param total: 消息总长度
+ * @param headerLength: 8字节对齐后的报文头长度
+ *
+ * @return bool: true:成功 false:消息头非法
+ */
+bool DBusFrameReader::frameLength(const char *data, quint32 *total, quint32 *headerLength)
+{
+    quint32 bodyLen = 0;
+    quint32 fieldsLen = 0;
+    if (data[0] == 'l') {
+        bodyLen = DBusWireReader<DBusByteOrder::LittleEndian>::readUInt32(data + 4);
+        fieldsLen = DBusWireReader<DBusByteOrder::LittleEndian>::readUInt32(data + 12);
+    } else if (data[0] == 'B') {
+        bodyLen = DBusWireReader<DBusByteOrder::BigEndian>::readUInt32(data + 4);
+        fieldsLen = DBusWireReader<DBusByteOrder::BigEndian>::readUInt32(data + 12);
+    } else {
+        return false;
+    }
+    if (fieldsLen > kMaxHeaderFieldsLength) {
+        return false;
+    }
+    const quint64 headerLen = (DBUS_FIXED_HEADER_LENGTH + fieldsLen + 7) & ~7ULL;
+    const quint64 length = headerLen + bodyLen;
+    if (length > DBUS_MAX_MESSAGE_LENGTH) {
+        return false;
+    }
+    *total = static_cast<quint32>(length);
+    *headerLength = static_cast<quint32>(headerLen);
+    return true;
+}
+
+/*
+ * 在认证阶段取出一行文本
+ *
+ * @param frame: 消息视图
+ *
+ * @return bool: true:取到完整行 false:数据不完整或出错
+ */
+bool DBusFrameReader::nextAuthLine(DBusFrame *frame)
+{
+    const int available = writePos - readPos;
+    if (available <= 0) {
+        return false;
+    }
+    const char *start = bufferData() + readPos;
+    const char *end = static_cast<const char *>(memchr(start, '\n', static_cast<size_t>(available)));
+    if (!end) {
+        if (available > DBUS_MAX_AUTH_LINE_LENGTH) {
+            qCritical() << "dbus auth line too long, size:" << available;
+            error = true;
+        }
+        return false;
+    }
+
+    const int length = static_cast<int>(end - start) + 1;
+    const bool ret = peer == DBusAuthPeer::Client ? auth->handleClientLine(start, static_cast<quint32>(length))
+                                                   : auth->handleServerLine(start, static_cast<quint32>(length));
+    if (!ret) {
+        qCritical() << "dbus auth protocol error";
+        error = true;
+        return false;
+    }
+    frame->data = start;
+    frame->size = static_cast<quint32>(length);
+    frame->isAuth = true;
+    frame->messageSize = frame->size;
+    frame->offset = 0;
+    readPos += length;
+    return true;
+}
+
+/*
+ * 从缓冲区取出下一条完整消息
+ *
+ * @param frame: 消息视图
+ *
+ * @return bool: true:取到完整消息 false:数据不完整或出错
+ */
+bool DBusFrameReader::nextFrame(DBusFrame *frame)
+{
+    if (error) {
+        return false;
+    }
+    if (!binaryMode) {
+        // dbus-daemon方向可能因为客户端发送了BEGIN而切换，每次取消息前都需要确认
+        if (!auth->isBinary(peer)) {
+            return nextAuthLine(frame);
+        }
+        binaryMode = true;
+    }
+
+    // 先输出正在直通转发的大消息，丢弃的部分直接跳过
+    while (streamOffset < streamSize) {
+        if (!nextBodyChunk(frame)) {
+            return false;
+        }
+        if (!streamDiscard) {
+            return true;
+        }
+    }
+
+    const int available = writePos - readPos;
+    if (available < static_cast<int>(DBUS_FIXED_HEADER_LENGTH)) {
+        return false;
+    }
+    const char *start = bufferData() + readPos;
+    quint32 total = 0;
+    quint32 headerLength = 0;
+    if (!frameLength(start, &total, &headerLength)) {
+        qCritical() << "dbus frame reader got an invalid message header";
+        error = true;
+        return false;
+    }
+    frame->data = start;
+    frame->isAuth = false;
+    frame->messageSize = total;
+    frame->offset = 0;
+    if (static_cast<quint32>(available) >= total) {
+        frame->size = total;
+        readPos += static_cast<int>(total);
+        expectSize = 0;
+        return true;
+    }
+    // 大消息在报文头到达后先输出报文头，body随到随出，不等待整条消息
+    if (cutThroughThreshold > 0 && total > cutThroughThreshold) {
+        if (static_cast<quint32>(available) < headerLength) {
+            expectSize = headerLength;
+            return false;
+        }
+        frame->size = headerLength;
+        readPos += static_cast<int>(headerLength);
+        expectSize = 0;
+        streamSize = total;
+        streamOffset = headerLength;
+        streamDiscard = false;
+        return true;
+    }
+    expectSize = total;
+    return false;
+}
+
+/*
+ * 输出正在直通转发的大消息的下一段body
+ *
+ * @param frame: 消息视图
+ *
+ * @return bool: true:取到数据 false:缓冲区中没有该消息的数据
+ */
+bool DBusFrameReader::nextBodyChunk(DBusFrame *frame)
+{
+    const int available = writePos - readPos;
+    if (available <= 0) {
+        return false;
+    }
+    const quint32 size = qMin(static_cast<quint32>(available), streamSize - streamOffset);
+    frame->data = bufferData() + readPos;
+    frame->size = size;
+    frame->isAuth = false;
+    frame->messageSize = streamSize;
+    frame->offset = streamOffset;
+    readPos += static_cast<int>(size);
+    streamOffset += size;
+    if (streamOffset == streamSize) {
+        streamSize = streamOffset = 0;
+    }
+    return true;
+}
+
+/*
+ * 记录调用方已在缓冲区之外转发了直通消息的size字节
+ *
+ * @param size: 字节数，不超过streamRemaining
+ */
+void DBusFrameReader::skipStream(quint32 size)
+{
+    streamOffset += qMin(size, streamRemaining());
+    if (streamOffset == streamSize) {
+        streamSize = streamOffset = 0;
+    }
+}
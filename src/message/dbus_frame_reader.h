@@ -0,0 +1,253 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_DBUS_PROXY_SRC_MESSAGE_DBUS_FRAME_READER_H
+#define LINGLONG_DBUS_PROXY_SRC_MESSAGE_DBUS_FRAME_READER_H
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QSharedPointer>
+#include <QtGlobal>
+
+#include "dbus_auth_state.h"
+#include "dbus_buffer_pool.h"
+
+// dbus消息最大长度 https://dbus.freedesktop.org/doc/dbus-specification.html#message-protocol-messages
+const quint32 DBUS_MAX_MESSAGE_LENGTH = 134217728;
+// dbus消息固定头部长度
+const quint32 DBUS_FIXED_HEADER_LENGTH = 16;
+// 认证阶段单行最大长度
+const int DBUS_MAX_AUTH_LINE_LENGTH = 16384;
+
+/*
+ * 接收缓冲区中一条完整dbus消息(或认证报文)的视图
+ * 数据指向DBusFrameReader内部缓冲区，不做拷贝，仅在下一次向reader写入数据前有效。
+ * 开启直通转发时大消息分段输出：第一段为完整的报文头，之后为按到达顺序切分的body
+ */
+struct DBusFrame {
+    const char *data;
+    quint32 size;
+    // 认证阶段的文本行
+    bool isAuth;
+    // 所属消息的总长度，完整消息时与size相同
+    quint32 messageSize;
+    // 本段在消息中的偏移，为0时本段从消息起始位置开始，包含完整的报文头
+    quint32 offset;
+
+    /*
+     * 是否为完整的消息
+     *
+     * @return bool: true:完整消息 false:大消息中的一段
+     */
+    bool isComplete() const { return offset == 0 && size == messageSize; }
+
+    /*
+     * 将视图包装为QByteArray，不拷贝数据
+     *
+     * @return QByteArray: 指向原缓冲区的字节数组
+     */
+    QByteArray toByteArray() const { return QByteArray::fromRawData(data, static_cast<int>(size)); }
+};
+
+/*
+ * 单个连接的dbus消息流重组器
+ *
+ * 将socket中读取的字节流按dbus协议切分为完整消息，不完整的消息保留在缓冲区中等待后续数据到达。
+ * 认证阶段按行切分并交给认证状态机，状态机确认认证结束后永久切换为二进制消息。
+ * 设置缓冲池后接收缓冲区从缓冲池借出，数据取空后归还；超过块大小的消息仍单独分配内存
+ */
+class DBusFrameReader
+{
+public:
+    /*
+     * 单独使用的重组器，按客户端方向跟踪认证
+     */
+    DBusFrameReader();
+
+    /*
+     * 与同一连接另一方向的重组器共用认证状态机
+     *
+     * @param auth: 连接的认证状态机
+     * @param peer: 本方向数据的发送方
+     */
+    DBusFrameReader(const QSharedPointer<DBusAuthStateMachine> &auth, DBusAuthPeer peer);
+    ~DBusFrameReader();
+
+    /*
+     * 设置接收缓冲区使用的缓冲池，必须在读入数据之前设置
+     *
+     * @param pool: 缓冲池，为空时自行分配内存
+     */
+    void setBufferPool(const QSharedPointer<DBusBufferPool> &pool) { this->pool = pool; }
+
+    /*
+     * 缓冲区已取空时释放接收缓冲区，借出的块归还缓冲池，在每次分发结束后调用
+     *
+     * 取出的消息视图在调用后失效
+     */
+    void releaseBuffer();
+
+    /*
+     * 将设备中当前可读的数据全部读入缓冲区
+     *
+     * @param device: 数据来源
+     *
+     * @return qint64: 读取的字节数，出错返回-1
+     */
+    qint64 readFrom(QIODevice *device);
+
+    /*
+     * 向缓冲区追加数据
+     *
+     * @param data: 数据地址
+     * @param size: 数据长度
+     */
+    void append(const char *data, int size);
+
+    /*
+     * 从缓冲区取出下一条完整消息
+     *
+     * @param frame: 消息视图
+     *
+     * @return bool: true:取到完整消息 false:数据不完整或出错
+     */
+    bool nextFrame(DBusFrame *frame);
+
+    /*
+     * 设置直通转发阈值，超过阈值的消息在报文头到达后即输出报文头，body到达多少输出多少，
+     * 缓冲区只需容纳报文头与一次读取的数据
+     *
+     * @param size: 阈值，字节，0表示总是等待完整消息
+     */
+    void setCutThroughThreshold(quint32 size) { cutThroughThreshold = size; }
+
+    /*
+     * 丢弃刚输出报文头的大消息的剩余部分，之后不再输出该消息的body
+     */
+    void discardMessage() { streamDiscard = true; }
+
+    /*
+     * 缓冲区已取空时，正在直通转发的大消息尚未读入的长度，调用方可以在缓冲区之外直接转发这部分数据
+     *
+     * @return quint32: 字节数，缓冲区中还有数据或没有直通转发的消息时为0
+     */
+    quint32 streamRemaining() const { return pendingSize() == 0 ? streamSize - streamOffset : 0; }
+
+    /*
+     * 记录调用方已在缓冲区之外转发了直通消息的size字节
+     *
+     * @param size: 字节数，不超过streamRemaining
+     */
+    void skipStream(quint32 size);
+
+    /*
+     * 认证阶段双方是否协商了传递文件描述符
+     *
+     * @return bool: true:已协商 false:未协商
+     */
+    bool isUnixFdNegotiated() const { return auth->isUnixFdNegotiated(); }
+
+    /*
+     * 数据流是否违反dbus协议，出错后不再输出消息
+     *
+     * @return bool: true:出错 false:正常
+     */
+    bool hasError() const { return error; }
+
+    /*
+     * 认证是否已结束，之后按二进制消息切分
+     *
+     * @return bool: true:二进制阶段 false:认证阶段
+     */
+    bool isBinaryMode() const { return binaryMode; }
+
+    /*
+     * 跳过认证阶段，用于切分不含认证报文的数据
+     */
+    void startBinaryMode() { binaryMode = true; }
+
+    /*
+     * 缓冲区中尚未取出的字节数
+     *
+     * @return int: 字节数
+     */
+    int pendingSize() const { return writePos - readPos; }
+
+    /*
+     * 缓冲区当前占用的内存大小
+     *
+     * @return int: 字节数
+     */
+    int capacity() const { return chunk ? pool->chunkSize() : buffer.size(); }
+
+private:
+    Q_DISABLE_COPY(DBusFrameReader)
+
+    // 接收缓冲区起始地址
+    char *bufferData() { return chunk ? chunk : buffer.data(); }
+    const char *bufferData() const { return chunk ? chunk : buffer.constData(); }
+
+    /*
+     * 保证缓冲区尾部至少有size字节可写空间，必要时搬移未取出数据或扩容
+     *
+     * @param size: 需要的空间
+     *
+     * @return char*: 可写地址，失败返回nullptr
+     */
+    char *reserve(int size);
+
+    /*
+     * 在认证阶段取出一行文本
+     *
+     * @param frame: 消息视图
+     *
+     * @return bool: true:取到完整行 false:数据不完整或出错
+     */
+    bool nextAuthLine(DBusFrame *frame);
+
+    /*
+     * 计算二进制消息总长度
+     *
+     * @param data: 消息固定头部
+     * @param total: 消息总长度
+     * @param headerLength: 8字节对齐后的报文头长度
+     *
+     * @return bool: true:成功 false:消息头非法
+     */
+    bool frameLength(const char *data, quint32 *total, quint32 *headerLength);
+
+    /*
+     * 输出正在直通转发的大消息的下一段body
+     *
+     * @param frame: 消息视图
+     *
+     * @return bool: true:取到数据 false:缓冲区中没有该消息的数据
+     */
+    bool nextBodyChunk(DBusFrame *frame);
+
+    QSharedPointer<DBusAuthStateMachine> auth;
+    DBusAuthPeer peer;
+    QSharedPointer<DBusBufferPool> pool;
+    // 从缓冲池借出的接收缓冲区，为空时使用buffer
+    char *chunk;
+    QByteArray buffer;
+    // 下一条待取出消息的起始位置
+    int readPos;
+    // 有效数据结束位置
+    int writePos;
+    // 正在接收的不完整消息总长度，用于一次性预留空间
+    quint32 expectSize;
+    quint32 cutThroughThreshold;
+    // 正在直通转发的大消息总长度
+    quint32 streamSize;
+    // 直通转发的大消息中已输出的字节数
+    quint32 streamOffset;
+    // 直通转发的大消息剩余部分是否丢弃
+    bool streamDiscard;
+    bool binaryMode;
+    bool error;
+};
+#endif
@@ -0,0 +1,980 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "dbus_header_view.h"
+
+// dbus名称最大长度
+static const quint32 kMaxNameLength = 255;
+// dbus消息头数组最大长度
+static const quint32 kMaxHeaderFieldsLength = 67108864;
+// dbus消息最大长度
+static const quint64 kMaxMessageLength = 134217728;
+// dbus数组最大长度
+static const quint32 kMaxArrayLength = 67108864;
+// 签名中数组、结构体与字典项各自的最大嵌套层数
+static const int kMaxTypeDepth = 32;
+// 值的最大嵌套层数，包括variant引入的嵌套
+static const int kMaxValueDepth = 64;
+
+static inline bool isNameChar(char c)
+{
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+/*
+ * 校验填充字节是否全部为0
+ *
+ * @param data: 报文地址
+ * @param start: 填充开始地址
+ * @param end: 填充结束地址
+ *
+ * @return bool: true:合法 false:非法
+ */
+static bool isZeroPadding(const char *data, quint32 start, quint32 end)
+{
+    for (quint32 i = start; i < end; i++) {
+        if (data[i] != '\x0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * 校验对象路径，规则与libdbus一致
+ *
+ * @param str: 字符串地址
+ * @param len: 字符串长度
+ *
+ * @return bool: true:合法 false:非法
+ */
+static bool isValidObjectPath(const char *str, quint32 len)
+{
+    if (len == 0 || str[0] != '/') {
+        return false;
+    }
+    if (len == 1) {
+        return true;
+    }
+    if (str[len - 1] == '/') {
+        return false;
+    }
+    for (quint32 i = 1; i < len; i++) {
+        if (str[i] == '/') {
+            if (str[i - 1] == '/') {
+                return false;
+            }
+        } else if (!isNameChar(str[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * 校验interface或错误名称，至少包含两段，每段不能以数字开头
+ *
+ * @param str: 字符串地址
+ * @param len: 字符串长度
+ *
+ * @return bool: true:合法 false:非法
+ */
+static bool isValidInterfaceName(const char *str, quint32 len)
+{
+    if (len == 0 || len > kMaxNameLength) {
+        return false;
+    }
+    bool hasDot = false;
+    bool segmentStart = true;
+    for (quint32 i = 0; i < len; i++) {
+        const char c = str[i];
+        if (c == '.') {
+            if (segmentStart) {
+                return false;
+            }
+            hasDot = true;
+            segmentStart = true;
+        } else if (isNameChar(c) && !(segmentStart && isDigit(c))) {
+            segmentStart = false;
+        } else {
+            return false;
+        }
+    }
+    return hasDot && !segmentStart;
+}
+
+/*
+ * 校验方法或信号名称
+ *
+ * @param str: 字符串地址
+ * @param len: 字符串长度
+ *
+ * @return bool: true:合法 false:非法
+ */
+static bool isValidMemberName(const char *str, quint32 len)
+{
+    if (len == 0 || len > kMaxNameLength || isDigit(str[0])) {
+        return false;
+    }
+    for (quint32 i = 0; i < len; i++) {
+        if (!isNameChar(str[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * 校验总线名称，规则与libdbus一致，唯一名称以":"开头且每段可以数字开头
+ *
+ * @param str: 字符串地址
+ * @param len: 字符串长度
+ *
+ * @return bool: true:合法 false:非法
+ */
+static bool isValidBusName(const char *str, quint32 len)
+{
+    if (len == 0 || len > kMaxNameLength) {
+        return false;
+    }
+    // 唯一名称由dbus-daemon分配，libdbus只要求点号后紧跟名称字符，不要求包含点号
+    if (str[0] == ':') {
+        for (quint32 i = 1; i < len; i++) {
+            if (str[i] == '.') {
+                if (++i == len || !(isNameChar(str[i]) || str[i] == '-')) {
+                    return false;
+                }
+            } else if (!isNameChar(str[i]) && str[i] != '-') {
+                return false;
+            }
+        }
+        return true;
+    }
+    bool hasDot = false;
+    bool segmentStart = true;
+    for (quint32 i = 0; i < len; i++) {
+        const char c = str[i];
+        if (c == '.') {
+            if (segmentStart) {
+                return false;
+            }
+            hasDot = true;
+            segmentStart = true;
+        } else if ((isNameChar(c) || c == '-') && !(segmentStart && isDigit(c))) {
+            segmentStart = false;
+        } else {
+            return false;
+        }
+    }
+    return hasDot && !segmentStart;
+}
+
+/*
+ * 校验对象路径，且不能是dbus-daemon保留的本地路径
+ *
+ * @param str: 字符串地址
+ * @param len: 字符串长度
+ *
+ * @return bool: true:合法 false:非法
+ */
+static bool isAllowedObjectPath(const char *str, quint32 len)
+{
+    return isValidObjectPath(str, len)
+        && QLatin1String(str, static_cast<int>(len)) != QLatin1String("/org/freedesktop/DBus/Local");
+}
+
+/*
+ * 校验interface名称，且不能是dbus-daemon保留的本地interface
+ *
+ * @param str: 字符串地址
+ * @param len: 字符串长度
+ *
+ * @return bool: true:合法 false:非法
+ */
+static bool isAllowedInterfaceName(const char *str, quint32 len)
+{
+    return isValidInterfaceName(str, len)
+        && QLatin1String(str, static_cast<int>(len)) != QLatin1String("org.freedesktop.DBus.Local");
+}
+
+/*
+ * 校验UTF-8字符串，规则与libdbus一致：不允许0字节、过长编码、代理项与超过U+10FFFF的码点
+ *
+ * @param str: 字符串地址
+ * @param len: 字符串长度
+ *
+ * @return bool: true:合法 false:非法
+ */
+static bool isValidUtf8(const char *str, quint32 len)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(str);
+    quint32 i = 0;
+    while (i < len) {
+        const uchar c = p[i];
+        if (c == 0) {
+            return false;
+        }
+        if (c < 0x80) {
+            i++;
+            continue;
+        }
+        quint32 count = 0;
+        quint32 code = 0;
+        quint32 min = 0;
+        if ((c & 0xe0) == 0xc0) {
+            count = 1;
+            code = c & 0x1f;
+            min = 0x80;
+        } else if ((c & 0xf0) == 0xe0) {
+            count = 2;
+            code = c & 0x0f;
+            min = 0x800;
+        } else if ((c & 0xf8) == 0xf0) {
+            count = 3;
+            code = c & 0x07;
+            min = 0x10000;
+        } else {
+            return false;
+        }
+        if (count >= len - i) {
+            return false;
+        }
+        for (quint32 j = 1; j <= count; j++) {
+            if ((p[i + j] & 0xc0) != 0x80) {
+                return false;
+            }
+            code = (code << 6) | (p[i + j] & 0x3f);
+        }
+        if (code < min || code > 0x10ffff || (code & 0xfffff800) == 0xd800) {
+            return false;
+        }
+        i += count + 1;
+    }
+    return true;
+}
+
+static inline bool isBasicType(char c)
+{
+    switch (c) {
+    case 'y':
+    case 'b':
+    case 'n':
+    case 'q':
+    case 'i':
+    case 'u':
+    case 'x':
+    case 't':
+    case 'd':
+    case 'h':
+    case 's':
+    case 'o':
+    case 'g':
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*
+ * 获取类型的对齐字节数，定长基本类型的对齐即其长度
+ *
+ * @param c: 类型编码
+ *
+ * @return quint32: 对齐字节数
+ */
+static quint32 typeAlignment(char c)
+{
+    switch (c) {
+    case 'n':
+    case 'q':
+        return 2;
+    case 'b':
+    case 'i':
+    case 'u':
+    case 'h':
+    case 's':
+    case 'o':
+    case 'a':
+        return 4;
+    case 'x':
+    case 't':
+    case 'd':
+    case '(':
+    case '{':
+        return 8;
+    default:
+        return 1;
+    }
+}
+
+/*
+ * 校验类型签名，规则与libdbus一致，空签名合法
+ *
+ * @param str: 签名地址
+ * @param len: 签名长度
+ *
+ * @return bool: true:合法 false:非法
+ */
+static bool isValidSignature(const char *str, quint32 len)
+{
+    // 各层结构体与字典项中已出现的完整类型数，下标0为最外层
+    int counts[2 * kMaxTypeDepth + 1] = {0};
+    int level = 0;
+    int arrayDepth = 0;
+    int structDepth = 0;
+    int dictDepth = 0;
+    char last = 0;
+    for (quint32 i = 0; i < len; i++) {
+        const char c = str[i];
+        switch (c) {
+        case 'a':
+            if (++arrayDepth > kMaxTypeDepth) {
+                return false;
+            }
+            break;
+        case '(':
+            if (++structDepth > kMaxTypeDepth) {
+                return false;
+            }
+            counts[++level] = 0;
+            break;
+        case ')':
+            if (structDepth == 0 || last == '(') {
+                return false;
+            }
+            structDepth--;
+            level--;
+            break;
+        case '{':
+            if (last != 'a' || ++dictDepth > kMaxTypeDepth) {
+                return false;
+            }
+            counts[++level] = 0;
+            break;
+        case '}':
+            if (dictDepth == 0 || counts[level] != 2) {
+                return false;
+            }
+            dictDepth--;
+            level--;
+            break;
+        default:
+            if (!isBasicType(c) && c != 'v') {
+                return false;
+            }
+            break;
+        }
+        if (c != 'a' && c != '(' && c != '{') {
+            counts[level]++;
+        }
+        // 数组后必须紧跟元素类型
+        if (arrayDepth > 0) {
+            if (c == 'a') {
+                if (i + 1 < len && (str[i + 1] == ')' || str[i + 1] == '}')) {
+                    return false;
+                }
+            } else {
+                arrayDepth = 0;
+            }
+        }
+        // 字典项的键必须是基本类型
+        if (last == '{' && !isBasicType(c)) {
+            return false;
+        }
+        last = c;
+    }
+    return arrayDepth == 0 && structDepth == 0 && dictDepth == 0;
+}
+
+/*
+ * 获取已校验签名中一个完整类型的结束位置
+ *
+ * @param sig: 完整类型的开始地址
+ *
+ * @return const char*: 完整类型之后的地址
+ */
+static const char *nextType(const char *sig)
+{
+    while (*sig == 'a') {
+        sig++;
+    }
+    if (*sig != '(' && *sig != '{') {
+        return sig + 1;
+    }
+    int depth = 0;
+    do {
+        if (*sig == '(' || *sig == '{') {
+            depth++;
+        } else if (*sig == ')' || *sig == '}') {
+            depth--;
+        }
+        sig++;
+    } while (depth > 0);
+    return sig;
+}
+
+// 报文头字段描述
+struct DBusHeaderFieldInfo {
+    // 字段值签名，0表示未知字段
+    char signature;
+    // 字符串类型字段在视图中的位置
+    DBusFieldRef DBusHeaderView::*ref;
+    // UINT32类型字段在视图中的位置
+    quint32 DBusHeaderView::*value;
+    // 字符串内容校验
+    bool (*validate)(const char *str, quint32 len);
+};
+
+// 按字段编号索引的报文头字段表，替代逐个字段的switch与签名比较
+static constexpr DBusHeaderFieldInfo kHeaderFields[] = {
+    {0, nullptr, nullptr, nullptr},
+    {'o', &DBusHeaderView::pathRef, nullptr, isAllowedObjectPath},
+    {'s', &DBusHeaderView::interfaceRef, nullptr, isAllowedInterfaceName},
+    {'s', &DBusHeaderView::memberRef, nullptr, isValidMemberName},
+    {'s', &DBusHeaderView::errorNameRef, nullptr, isValidInterfaceName},
+    {'u', nullptr, &DBusHeaderView::replySerial, nullptr},
+    {'s', &DBusHeaderView::destinationRef, nullptr, isValidBusName},
+    {'s', &DBusHeaderView::senderRef, nullptr, isValidBusName},
+    {'g', &DBusHeaderView::signatureRef, nullptr, isValidSignature},
+    {'u', nullptr, &DBusHeaderView::unixFds, nullptr},
+    // CONTAINER_INSTANCE，代理不使用，只按类型校验
+    {'o', nullptr, nullptr, nullptr},
+};
+static const quint32 kHeaderFieldCount = sizeof(kHeaderFields) / sizeof(kHeaderFields[0]);
+
+/*
+ * 读取header数组中的字符串字段
+ *
+ * @param data: 报文地址
+ * @param offset: 字段值开始地址，读取后指向下一个字段
+ * @param endOffset: header数组结束地址
+ * @param ref: 字段位置
+ *
+ * @return bool: true:成功 false:报文非法
+ */
+template<DBusByteOrder Order>
+static bool readString(const char *data, quint32 *offset, quint32 endOffset, DBusFieldRef *ref)
+{
+    quint32 pos = alignBy4(*offset);
+    if (pos + 4 > endOffset) {
+        return false;
+    }
+    const quint32 len = DBusWireReader<Order>::readUInt32(data + pos);
+    pos += 4;
+    if (len == 0 || len >= endOffset - pos || data[pos + len] != '\x0') {
+        return false;
+    }
+    if (!isZeroPadding(data, *offset, pos - 4)) {
+        return false;
+    }
+    ref->offset = pos;
+    ref->length = len;
+    *offset = pos + len + 1;
+    return true;
+}
+
+/*
+ * 读取header数组中的签名字段
+ *
+ * @param data: 报文地址
+ * @param offset: 字段值开始地址，读取后指向下一个字段
+ * @param endOffset: header数组结束地址
+ * @param ref: 字段位置
+ *
+ * @return bool: true:成功 false:报文非法
+ */
+static bool readSignature(const char *data, quint32 *offset, quint32 endOffset, DBusFieldRef *ref)
+{
+    quint32 pos = *offset;
+    if (pos >= endOffset) {
+        return false;
+    }
+    const quint32 len = static_cast<uchar>(data[pos++]);
+    if (len >= endOffset - pos || data[pos + len] != '\x0') {
+        return false;
+    }
+    ref->offset = pos;
+    ref->length = len;
+    *offset = pos + len + 1;
+    return true;
+}
+
+/*
+ * 读取header数组中的UINT32字段
+ *
+ * @param data: 报文地址
+ * @param offset: 字段值开始地址，读取后指向下一个字段
+ * @param endOffset: header数组结束地址
+ * @param value: 字段值
+ *
+ * @return bool: true:成功 false:报文非法
+ */
+template<DBusByteOrder Order>
+static bool readUInt32Field(const char *data, quint32 *offset, quint32 endOffset, quint32 *value)
+{
+    const quint32 pos = alignBy4(*offset);
+    if (pos + 4 > endOffset || !isZeroPadding(data, *offset, pos)) {
+        return false;
+    }
+    *value = DBusWireReader<Order>::readUInt32(data + pos);
+    *offset = pos + 4;
+    return true;
+}
+
+/*
+ * 跳过不需要解码的字段，只检查字段长度不越界
+ *
+ * @param data: 报文地址
+ * @param signature: 字段值签名
+ * @param offset: 字段值开始地址，跳过后指向下一个字段
+ * @param endOffset: header数组结束地址
+ *
+ * @return bool: true:成功 false:报文非法
+ */
+template<DBusByteOrder Order>
+static bool skipField(const char *data, char signature, quint32 *offset, quint32 endOffset)
+{
+    quint32 pos = *offset;
+    switch (signature) {
+    case 'o':
+    case 's': {
+        pos = alignBy4(pos);
+        if (pos + 4 > endOffset) {
+            return false;
+        }
+        const quint32 len = DBusWireReader<Order>::readUInt32(data + pos);
+        pos += 4;
+        if (len >= endOffset - pos) {
+            return false;
+        }
+        *offset = pos + len + 1;
+        return true;
+    }
+    case 'g': {
+        if (pos >= endOffset) {
+            return false;
+        }
+        const quint32 len = static_cast<uchar>(data[pos++]);
+        if (len >= endOffset - pos) {
+            return false;
+        }
+        *offset = pos + len + 1;
+        return true;
+    }
+    default:
+        pos = alignBy4(pos);
+        if (pos + 4 > endOffset) {
+            return false;
+        }
+        *offset = pos + 4;
+        return true;
+    }
+}
+
+/*
+ * 校验并跳过一个值，规则与libdbus校验消息时一致，用于跳过未知的报文头字段
+ *
+ * @param data: 报文地址
+ * @param type: 值的完整类型，指向已校验的签名
+ * @param offset: 值开始地址，跳过后指向值之后
+ * @param endOffset: header数组结束地址
+ * @param depth: 值的嵌套层数
+ *
+ * @return bool: true:成功 false:报文非法
+ */
+template<DBusByteOrder Order>
+static bool skipValue(const char *data, const char *type, quint32 *offset, quint32 endOffset, int depth)
+{
+    if (depth > kMaxValueDepth) {
+        return false;
+    }
+    const char code = type[0];
+    const quint32 alignment = typeAlignment(code);
+    quint32 pos = (*offset + alignment - 1) & ~(alignment - 1);
+    if (pos >= endOffset || !isZeroPadding(data, *offset, pos)) {
+        return false;
+    }
+    switch (code) {
+    case 's':
+    case 'o': {
+        if (endOffset - pos < 4) {
+            return false;
+        }
+        const quint32 len = DBusWireReader<Order>::readUInt32(data + pos);
+        pos += 4;
+        if (len >= endOffset - pos || data[pos + len] != '\x0') {
+            return false;
+        }
+        if (code == 's' ? !isValidUtf8(data + pos, len) : !isValidObjectPath(data + pos, len)) {
+            return false;
+        }
+        *offset = pos + len + 1;
+        return true;
+    }
+    case 'g':
+    case 'v': {
+        const quint32 len = static_cast<uchar>(data[pos++]);
+        if (len >= endOffset - pos || data[pos + len] != '\x0' || !isValidSignature(data + pos, len)) {
+            return false;
+        }
+        const char *sig = data + pos;
+        pos += len + 1;
+        // variant的签名必须恰好是一个完整类型
+        if (code == 'v'
+            && (len == 0 || nextType(sig) != sig + len
+                || !skipValue<Order>(data, sig, &pos, endOffset, depth + 1))) {
+            return false;
+        }
+        *offset = pos;
+        return true;
+    }
+    case 'a': {
+        if (endOffset - pos < 4) {
+            return false;
+        }
+        const quint32 len = DBusWireReader<Order>::readUInt32(data + pos);
+        pos += 4;
+        // 数组长度不包含长度之后到第一个元素的对齐填充
+        const char *element = type + 1;
+        const quint32 elementAlignment = typeAlignment(element[0]);
+        const quint32 start = (pos + elementAlignment - 1) & ~(elementAlignment - 1);
+        if (start > endOffset || !isZeroPadding(data, pos, start)) {
+            return false;
+        }
+        pos = start;
+        if (len > endOffset - pos || len > kMaxArrayLength) {
+            return false;
+        }
+        const quint32 arrayEnd = pos + len;
+        if (element[0] != 's' && element[0] != 'o' && element[0] != 'g' && isBasicType(element[0])) {
+            // 定长元素之间没有填充，只需校验布尔值
+            if (len % elementAlignment != 0) {
+                return false;
+            }
+            for (; element[0] == 'b' && pos < arrayEnd; pos += 4) {
+                if (DBusWireReader<Order>::readUInt32(data + pos) > 1) {
+                    return false;
+                }
+            }
+            *offset = arrayEnd;
+            return true;
+        }
+        while (pos < arrayEnd) {
+            if (!skipValue<Order>(data, element, &pos, endOffset, depth + 1)) {
+                return false;
+            }
+        }
+        *offset = pos;
+        return pos == arrayEnd;
+    }
+    case '(':
+    case '{': {
+        for (const char *field = type + 1; *field != ')' && *field != '}'; field = nextType(field)) {
+            if (!skipValue<Order>(data, field, &pos, endOffset, depth + 1)) {
+                return false;
+            }
+        }
+        *offset = pos;
+        return true;
+    }
+    default: {
+        // 定长基本类型
+        if (endOffset - pos < alignment) {
+            return false;
+        }
+        if (code == 'b' && DBusWireReader<Order>::readUInt32(data + pos) > 1) {
+            return false;
+        }
+        *offset = pos + alignment;
+        return true;
+    }
+    }
+}
+
+DBusHeaderView::DBusHeaderView()
+    : bigEndian(false)
+    , type(0)
+    , flags(0)
+    , length(0)
+    , serial(0)
+    , headerLength(0)
+    , hasReplySerial(false)
+    , replySerial(0)
+    , unixFds(0)
+    , pathRef {0, 0}
+    , interfaceRef {0, 0}
+    , memberRef {0, 0}
+    , errorNameRef {0, 0}
+    , destinationRef {0, 0}
+    , senderRef {0, 0}
+    , signatureRef {0, 0}
+    , data("")
+    , available(0)
+{
+}
+
+/*
+ * 单次遍历报文头数组，解析dbus消息报文头
+ *
+ * 固定头部总是解析，报文头数组中只解码fields指定的字段，其余字段直接跳过；
+ * 指定字段全部出现后停止遍历，fields为DBUS_HEADER_FIELDS_NONE时不遍历报文头数组。
+ * 只有完整遍历时才校验各消息类型必需的字段，未解码的字段在视图中为空
+ *
+ * @param buffer: 报文地址
+ * @param size: 报文长度
+ * @param fields: 需要解码的字段掩码
+ *
+ * @return bool: true:解析成功 false:失败
+ */
+bool DBusHeaderView::parse(const char *buffer, quint32 size, quint32 fields)
+{
+    return parsePartial(buffer, size, size, fields);
+}
+
+/*
+ * 解析已到达完整报文头但body可能尚未到达的消息，用于大消息边接收边转发
+ *
+ * @param buffer: 报文地址
+ * @param size: 已到达的数据长度，至少包含完整的报文头
+ * @param messageSize: 消息总长度
+ * @param fields: 需要解码的字段掩码
+ *
+ * @return bool: true:解析成功 false:失败
+ */
+bool DBusHeaderView::parsePartial(const char *buffer, quint32 size, quint32 messageSize, quint32 fields)
+{
+    *this = DBusHeaderView();
+    if (size < 16 || size > messageSize) {
+        return false;
+    }
+    // Major protocol version of the sending application.
+    if (buffer[3] != '\x1') {
+        return false;
+    }
+    data = buffer;
+    available = size;
+    // 每条报文只判断一次字节序
+    if (buffer[0] == 'l') {
+        return parseFields<DBusByteOrder::LittleEndian>(size, messageSize, fields);
+    }
+    if (buffer[0] == 'B') {
+        bigEndian = true;
+        return parseFields<DBusByteOrder::BigEndian>(size, messageSize, fields);
+    }
+    return false;
+}
+
+/*
+ * 按字节序特化的报文头解析
+ *
+ * @param size: 已到达的数据长度
+ * @param messageSize: 消息总长度
+ * @param fields: 需要解码的字段掩码
+ *
+ * @return bool: true:解析成功 false:失败
+ */
+template<DBusByteOrder Order>
+bool DBusHeaderView::parseFields(quint32 size, quint32 messageSize, quint32 fields)
+{
+    const char *buffer = data;
+    // Message type 1 2 3 4 分别表示METHOD_CALL METHOD_RETURN ERROR SIGNAL
+    type = static_cast<uchar>(buffer[1]);
+    if (type < (int)MessageType::METHOD_CALL || type > (int)MessageType::SIGNAL) {
+        return false;
+    }
+    // NO_REPLY_EXPECTED  NO_AUTO_START currently receive 0
+    flags = static_cast<uchar>(buffer[2]);
+    length = DBusWireReader<Order>::readUInt32(buffer + 4);
+    serial = DBusWireReader<Order>::readUInt32(buffer + 8);
+    if (serial == 0) {
+        return false;
+    }
+
+    const quint32 arrayLen = DBusWireReader<Order>::readUInt32(buffer + 12);
+    if (arrayLen > kMaxHeaderFieldsLength || arrayLen > size) {
+        return false;
+    }
+    headerLength = alignBy8(16 + arrayLen);
+    // 报文必须恰好由报文头和body组成，body内容不参与解析，报文头必须已完整到达
+    if (headerLength > size || static_cast<quint64>(headerLength) + length != messageSize
+        || messageSize > kMaxMessageLength) {
+        return false;
+    }
+    // 调用方不需要任何字段，例如过滤规则为空时，直接跳过报文头数组
+    fields &= DBUS_HEADER_FIELDS_ALL;
+    if (fields == DBUS_HEADER_FIELDS_NONE) {
+        return true;
+    }
+
+    quint32 offset = 16;
+    const quint32 endOffset = offset + arrayLen;
+    // 已出现的字段，重复字段视为非法报文，避免代理与dbus-daemon对同一报文的理解不一致
+    quint32 seenFields = 0;
+    while (offset < endOffset) {
+        // Structs must be 8 byte aligned
+        const quint32 fieldOffset = alignBy8(offset);
+        if (fieldOffset >= endOffset || !isZeroPadding(buffer, offset, fieldOffset)) {
+            return false;
+        }
+        offset = fieldOffset;
+        const uchar headerType = static_cast<uchar>(buffer[offset++]);
+        // 字段编号0非法；未知字段按协议忽略，只校验并跳过其值，与libdbus一致
+        if (headerType == 0) {
+            return false;
+        }
+        if (headerType >= kHeaderFieldCount) {
+            if (!skipValue<Order>(buffer, "v", &offset, endOffset, 2)) {
+                return false;
+            }
+            continue;
+        }
+        const DBusHeaderFieldInfo &info = kHeaderFields[headerType];
+        const quint32 mask = 1u << headerType;
+        if (seenFields & mask) {
+            return false;
+        }
+        seenFields |= mask;
+        // 字段值的签名只能是单个基本类型，且必须与字段定义一致
+        if (offset + 3 > endOffset || buffer[offset] != '\x1' || buffer[offset + 1] != info.signature
+            || buffer[offset + 2] != '\x0') {
+            return false;
+        }
+        offset += 3;
+
+        // 代理不使用的字段与libdbus一样按类型校验后跳过
+        if (!info.ref && !info.value) {
+            if (!skipValue<Order>(buffer, &info.signature, &offset, endOffset, 3)) {
+                return false;
+            }
+            continue;
+        }
+        // 不需要的字段只跳过，不解码也不校验内容，报文由dbus-daemon完整校验
+        if (!(fields & mask)) {
+            if (!skipField<Order>(buffer, info.signature, &offset, endOffset)) {
+                return false;
+            }
+            continue;
+        }
+        if (info.value) {
+            quint32 *value = &(this->*info.value);
+            if (!readUInt32Field<Order>(buffer, &offset, endOffset, value)) {
+                return false;
+            }
+            // reply serial不能为0
+            if (info.value == &DBusHeaderView::replySerial) {
+                if (*value == 0) {
+                    return false;
+                }
+                hasReplySerial = true;
+            }
+        } else {
+            DBusFieldRef *ref = &(this->*info.ref);
+            const bool ret = info.signature == 'g' ? readSignature(buffer, &offset, endOffset, ref)
+                                                   : readString<Order>(buffer, &offset, endOffset, ref);
+            if (!ret || !info.validate(buffer + ref->offset, ref->length)) {
+                return false;
+            }
+        }
+        // 需要的字段已全部取到，剩余字段不再遍历
+        if (fields != DBUS_HEADER_FIELDS_ALL && (seenFields & fields) == fields) {
+            return true;
+        }
+    }
+    // 报文头数组之后到body之间的填充
+    if (!isZeroPadding(buffer, endOffset, headerLength)) {
+        return false;
+    }
+
+    // 按字段是否出现判断，跳过的字段同样计入
+    const quint32 pathMask = headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_PATH);
+    const quint32 interfaceMask = headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_INTERFACE);
+    const quint32 memberMask = headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_MEMBER);
+    const quint32 errorNameMask = headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_ERROR_NAME);
+    const quint32 replySerialMask = headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_REPLY_SERIAL);
+    quint32 required = 0;
+    switch (type) {
+    case (int)MessageType::METHOD_CALL:
+        required = pathMask | memberMask;
+        break;
+    case (int)MessageType::METHOD_RETURN:
+        required = replySerialMask;
+        break;
+    case (int)MessageType::ERROR:
+        required = errorNameMask | replySerialMask;
+        break;
+    default:
+        required = pathMask | interfaceMask | memberMask;
+        break;
+    }
+    return (seenFields & required) == required;
+}
+
+/*
+ * 读取body中字符串类型的第一个参数，用于按arg0匹配规则，解析时需要包含SIGNATURE字段
+ *
+ * @param arg0: 输出第一个参数，指向原始报文，不分配内存
+ *
+ * @return Arg0State: 读取结果，只有Arg0String时arg0有效
+ */
+DBusHeaderView::Arg0State DBusHeaderView::stringArg0(QLatin1String *arg0) const
+{
+    const QLatin1String sig = signature();
+    if (sig.size() == 0 || sig.data()[0] != 's') {
+        return Arg0Absent;
+    }
+    // 字符串为长度、内容与结尾的0，body从8字节对齐的headerLength开始，长度不需要再对齐
+    const quint64 start = headerLength;
+    const quint64 end = start + length;
+    if (start + 4 > end) {
+        return Arg0Absent;
+    }
+    if (start + 4 > available) {
+        return Arg0Pending;
+    }
+    const quint32 len = bigEndian ? DBusWireReader<DBusByteOrder::BigEndian>::readUInt32(data + start)
+                                  : DBusWireReader<DBusByteOrder::LittleEndian>::readUInt32(data + start);
+    const quint64 stop = start + 4 + len;
+    if (stop + 1 > end) {
+        return Arg0Absent;
+    }
+    if (stop + 1 > available) {
+        return Arg0Pending;
+    }
+    if (data[stop] != '\0') {
+        return Arg0Absent;
+    }
+    *arg0 = QLatin1String(data + start + 4, static_cast<int>(len));
+    return Arg0String;
+}
+
+/*
+ * 转换为包含QString字段的Header结构
+ *
+ * @param header: 输出结果
+ */
+void DBusHeaderView::toHeader(Header *header) const
+{
+    header->bigEndian = bigEndian;
+    header->type = type;
+    header->flags = flags;
+    header->length = length;
+    header->serial = serial;
+    header->path = toString(pathRef);
+    header->interface = toString(interfaceRef);
+    header->member = toString(memberRef);
+    header->errorName = toString(errorNameRef);
+    header->destination = toString(destinationRef);
+    header->sender = toString(senderRef);
+    header->signature = toString(signatureRef);
+    header->hasReplySerial = hasReplySerial;
+    header->replySerial = replySerial;
+    header->unixFds = unixFds;
+}
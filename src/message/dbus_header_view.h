@@ -0,0 +1,150 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_DBUS_PROXY_SRC_MESSAGE_DBUS_HEADER_VIEW_H
+#define LINGLONG_DBUS_PROXY_SRC_MESSAGE_DBUS_HEADER_VIEW_H
+
+#include <QLatin1String>
+#include <QString>
+#include <QtGlobal>
+
+#include "dbus_message.h"
+#include "dbus_wire_reader.h"
+
+// header中字符串类型字段在原始报文中的位置，length为0表示字段不存在
+struct DBusFieldRef {
+    quint32 offset;
+    quint32 length;
+
+    bool isEmpty() const { return length == 0; }
+};
+
+/*
+ * dbus消息报文头视图
+ *
+ * 字符串字段只记录在原始报文中的偏移和长度，不产生任何堆内存分配，
+ * 仅在调用toString时才转换为QString。视图不持有报文数据，报文释放后视图失效
+ */
+class DBusHeaderView
+{
+public:
+    // body中第一个参数的读取结果
+    enum Arg0State {
+        // 第一个参数是字符串
+        Arg0String,
+        // 没有参数、第一个参数不是字符串或内容不合法
+        Arg0Absent,
+        // 第一个参数尚未到达，大消息边接收边转发时出现
+        Arg0Pending,
+    };
+
+    DBusHeaderView();
+
+    /*
+     * 单次遍历报文头数组，解析dbus消息报文头
+     *
+     * 固定头部总是解析，报文头数组中只解码fields指定的字段，其余字段直接跳过；
+     * 指定字段全部出现后停止遍历，fields为DBUS_HEADER_FIELDS_NONE时不遍历报文头数组。
+     * 只有完整遍历时才校验各消息类型必需的字段，未解码的字段在视图中为空
+     *
+     * @param buffer: 报文地址
+     * @param size: 报文长度
+     * @param fields: 需要解码的字段掩码
+     *
+     * @return bool: true:解析成功 false:失败
+     */
+    bool parse(const char *buffer, quint32 size, quint32 fields = DBUS_HEADER_FIELDS_ALL);
+
+    /*
+     * 解析已到达完整报文头但body可能尚未到达的消息，用于大消息边接收边转发
+     *
+     * @param buffer: 报文地址
+     * @param size: 已到达的数据长度，至少包含完整的报文头
+     * @param messageSize: 消息总长度
+     * @param fields: 需要解码的字段掩码
+     *
+     * @return bool: true:解析成功 false:失败
+     */
+    bool parsePartial(const char *buffer, quint32 size, quint32 messageSize,
+                      quint32 fields = DBUS_HEADER_FIELDS_ALL);
+
+    // header字符串字段，指向原始报文，不分配内存
+    QLatin1String path() const { return field(pathRef); }
+    QLatin1String interface() const { return field(interfaceRef); }
+    QLatin1String member() const { return field(memberRef); }
+    QLatin1String errorName() const { return field(errorNameRef); }
+    QLatin1String destination() const { return field(destinationRef); }
+    QLatin1String sender() const { return field(senderRef); }
+    QLatin1String signature() const { return field(signatureRef); }
+
+    /*
+     * 读取body中字符串类型的第一个参数，用于按arg0匹配规则，解析时需要包含SIGNATURE字段
+     *
+     * @param arg0: 输出第一个参数，指向原始报文，不分配内存
+     *
+     * @return Arg0State: 读取结果，只有Arg0String时arg0有效
+     */
+    Arg0State stringArg0(QLatin1String *arg0) const;
+
+    /*
+     * 将字段转换为QString
+     *
+     * @param ref: 字段位置
+     *
+     * @return QString: 字段内容
+     */
+    QString toString(const DBusFieldRef &ref) const { return QString(field(ref)); }
+
+    /*
+     * 转换为包含QString字段的Header结构
+     *
+     * @param header: 输出结果
+     */
+    void toHeader(Header *header) const;
+
+    bool bigEndian;
+    uchar type;
+    uchar flags;
+    // body长度
+    quint32 length;
+    quint32 serial;
+    // 8字节对齐后的报文头长度，即body在报文中的偏移
+    quint32 headerLength;
+    bool hasReplySerial;
+    quint32 replySerial;
+    quint32 unixFds;
+
+    DBusFieldRef pathRef;
+    DBusFieldRef interfaceRef;
+    DBusFieldRef memberRef;
+    DBusFieldRef errorNameRef;
+    DBusFieldRef destinationRef;
+    DBusFieldRef senderRef;
+    DBusFieldRef signatureRef;
+
+private:
+    /*
+     * 按字节序特化的报文头解析
+     *
+     * @param size: 已到达的数据长度
+     * @param messageSize: 消息总长度
+     * @param fields: 需要解码的字段掩码
+     *
+     * @return bool: true:解析成功 false:失败
+     */
+    template<DBusByteOrder Order>
+    bool parseFields(quint32 size, quint32 messageSize, quint32 fields);
+
+    QLatin1String field(const DBusFieldRef &ref) const
+    {
+        return QLatin1String(data + ref.offset, static_cast<int>(ref.length));
+    }
+
+    const char *data;
+    // 已到达的数据长度
+    quint32 available;
+};
+#endif
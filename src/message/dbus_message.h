@@ -52,15 +52,21 @@ enum class DBusMessageHeaderField {
     DBUS_MESSAGE_HEADER_FIELD_NUM_UNIX_FDS
 };
 
+// 报文头字段掩码，按DBusMessageHeaderField编号置位，用于按需解析报文头
+const quint32 DBUS_HEADER_FIELDS_NONE = 0;
+const quint32 DBUS_HEADER_FIELDS_ALL = 0x3FE;
+
 /*
- * 根据大小端将字节数组转化为整形
+ * 获取报文头字段对应的掩码
  *
- * @param arr: 报文字节数组
- * @param isBigEndian: 是否为大端序
+ * @param field: 报文头字段
  *
- * @return int: 转化结果
+ * @return quint32: 字段掩码
  */
-int byteAraryToInt(const QByteArray &arr, bool isBigEndian);
+inline constexpr quint32 headerFieldMask(DBusMessageHeaderField field)
+{
+    return 1u << static_cast<int>(field);
+}
 
 /*
  * 根据偏移量获取8字节对齐结果
@@ -69,7 +75,10 @@ int byteAraryToInt(const QByteArray &arr, bool isBigEndian);
  *
  * @return quint32: 计算结果
  */
-quint32 alignBy8(quint32 offset);
+inline constexpr quint32 alignBy8(quint32 offset)
+{
+    return (offset + 8 - 1) & ~(8u - 1);
+}
 
 /*
  * 根据偏移量获取4字节对齐结果
@@ -78,30 +87,10 @@ quint32 alignBy8(quint32 offset);
  *
  * @return quint32: 计算结果
  */
-quint32 alignBy4(quint32 offset);
-
-/*
- * 从报文中获取指定偏移量的字符数据
- *
- * @param buffer: 报文字节数组
- * @param header: 报文header
- * @param offset: 偏移量开始地址
- * @param endOffset: 偏移量结束地址
- *
- * @return char*: 计算结果
- */
-char *getString(const QByteArray &buffer, Header *header, quint32 *offset, quint32 endOffset);
-
-/*
- * 从报文中获取dbus消息域签名信息
- *
- * @param buffer: 报文字节数组
- * @param offset: 偏移量开始地址
- * @param endOffset: 偏移量结束地址
- *
- * @return char*: 签名结果
- */
-char *getSignature(const QByteArray &buffer, quint32 *offset, quint32 endOffset);
+inline constexpr quint32 alignBy4(quint32 offset)
+{
+    return (offset + 4 - 1) & ~(4u - 1);
+}
 
 /*
  * 从报文中解析dbus消息报文头
@@ -123,6 +112,16 @@ bool parseHeader(const QByteArray &buffer, Header *header);
  */
 bool parseDBusMsg(const QByteArray &byteArray, Header *header);
 
+/*
+ * 使用libdbus完整校验dbus消息，包括body，仅在严格校验模式下使用
+ *
+ * @param data: 报文地址
+ * @param size: 报文长度
+ *
+ * @return bool: true:合法 false:非法
+ */
+bool validateDBusMsg(const char *data, int size);
+
 /*
  * 将报文数组分隔成符合dbus协议标准的dbus消息
  *
@@ -0,0 +1,47 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_DBUS_PROXY_SRC_MESSAGE_DBUS_WIRE_READER_H
+#define LINGLONG_DBUS_PROXY_SRC_MESSAGE_DBUS_WIRE_READER_H
+
+#include <QtEndian>
+#include <QtGlobal>
+
+// dbus报文字节序，由报文第一个字节决定
+enum class DBusByteOrder {
+    LittleEndian,
+    BigEndian
+};
+
+/*
+ * 按字节序在编译期特化的报文读取
+ *
+ * 每条报文只根据第一个字节选择一次特化版本，之后直接从报文地址读取，不再逐个整数判断字节序
+ */
+template<DBusByteOrder Order>
+struct DBusWireReader {
+    /*
+     * 读取UINT32
+     *
+     * @param data: 数据地址，不要求对齐
+     *
+     * @return quint32: 读取结果
+     */
+    static quint32 readUInt32(const char *data);
+};
+
+template<>
+inline quint32 DBusWireReader<DBusByteOrder::LittleEndian>::readUInt32(const char *data)
+{
+    return qFromLittleEndian<quint32>(data);
+}
+
+template<>
+inline quint32 DBusWireReader<DBusByteOrder::BigEndian>::readUInt32(const char *data)
+{
+    return qFromBigEndian<quint32>(data);
+}
+#endif
@@ -0,0 +1,71 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "dbus_daemon_connector.h"
+
+#include <QDebug>
+
+// 首次重试等待时间，毫秒
+static const int kInitialRetryDelay = 10;
+// 重试等待时间上限，毫秒
+static const int kMaxRetryDelay = 500;
+
+DBusDaemonConnector::DBusDaemonConnector(DBusSocket *socket, const QString &daemonPath, int timeout)
+    : QObject(socket)
+    , socket(socket)
+    , daemonPath(daemonPath)
+    , timeout(timeout)
+    , attempt(0)
+    , retryDelay(kInitialRetryDelay)
+    , finished(false)
+{
+    retryTimer.setSingleShot(true);
+    connect(&retryTimer, SIGNAL(timeout()), this, SLOT(connectToDaemon()));
+    connect(socket, SIGNAL(connected()), this, SLOT(onConnected()));
+    connect(socket, SIGNAL(error(QLocalSocket::LocalSocketError)), this,
+            SLOT(onError(QLocalSocket::LocalSocketError)));
+}
+
+/*
+ * 开始连接，立即返回
+ */
+void DBusDaemonConnector::start()
+{
+    elapsed.start();
+    connectToDaemon();
+}
+
+void DBusDaemonConnector::connectToDaemon()
+{
+    attempt++;
+    qDebug() << socket << "connect dbus-daemon, attempt:" << attempt;
+    socket->connectToServer(daemonPath);
+}
+
+void DBusDaemonConnector::onConnected()
+{
+    finished = true;
+    retryTimer.stop();
+    qDebug() << socket << "connected to dbus-daemon after" << elapsed.elapsed() << "ms, attempts:" << attempt;
+}
+
+void DBusDaemonConnector::onError(QLocalSocket::LocalSocketError socketError)
+{
+    // 连接成功后的错误由断开连接流程处理
+    if (finished) {
+        return;
+    }
+    if (elapsed.elapsed() + retryDelay > timeout) {
+        finished = true;
+        qCritical() << socket << "connect dbus-daemon error, msg:" << socket->errorString()
+                    << ", attempts:" << attempt;
+        emit failed();
+        return;
+    }
+    qWarning() << socket << "connect dbus-daemon error:" << socketError << ", retry after" << retryDelay << "ms";
+    retryTimer.start(retryDelay);
+    retryDelay = qMin(retryDelay * 2, kMaxRetryDelay);
+}
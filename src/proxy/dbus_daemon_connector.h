@@ -0,0 +1,68 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_DBUS_PROXY_SRC_PROXY_DBUS_DAEMON_CONNECTOR_H
+#define LINGLONG_DBUS_PROXY_SRC_PROXY_DBUS_DAEMON_CONNECTOR_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+
+#include "proxy/dbus_socket.h"
+
+/*
+ * 异步连接dbus-daemon
+ *
+ * 连接失败后按指数退避重试，超过期限后发出failed信号，整个过程不阻塞事件循环。
+ * 对象作为socket的子对象创建，随socket一起释放
+ */
+class DBusDaemonConnector : public QObject
+{
+    Q_OBJECT
+
+public:
+    /*
+     * 创建连接器
+     *
+     * @param socket: 与dbus-daemon连接的代理客户端，同时作为父对象
+     * @param daemonPath: dbus-daemon地址
+     * @param timeout: 连接期限，毫秒
+     */
+    DBusDaemonConnector(DBusSocket *socket, const QString &daemonPath, int timeout);
+
+    /*
+     * 开始连接，立即返回
+     */
+    void start();
+
+    /*
+     * 已尝试连接的次数
+     *
+     * @return int: 次数
+     */
+    int attempts() const { return attempt; }
+
+signals:
+    // 超过连接期限仍未连接成功
+    void failed();
+
+private slots:
+    void onConnected();
+    void onError(QLocalSocket::LocalSocketError socketError);
+    void connectToDaemon();
+
+private:
+    DBusSocket *socket;
+    QString daemonPath;
+    int timeout;
+    int attempt;
+    // 下次重试的等待时间，毫秒
+    int retryDelay;
+    bool finished;
+    QElapsedTimer elapsed;
+    QTimer retryTimer;
+};
+#endif
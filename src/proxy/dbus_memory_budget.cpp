@@ -0,0 +1,66 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "dbus_memory_budget.h"
+
+/*
+ * 创建内存预算
+ *
+ * @param sessionLimit: 单个会话的上限，字节
+ * @param globalLimit: 所有会话的上限，字节
+ */
+DBusMemoryBudget::DBusMemoryBudget(qint64 sessionLimit, qint64 globalLimit)
+    : perSession(sessionLimit)
+    , global(globalLimit)
+    , used(0)
+    , peak(0)
+    , dropped(0)
+    , disconnected(0)
+{
+}
+
+/*
+ * 设置上限，只对之后的分发生效
+ *
+ * @param sessionLimit: 单个会话的上限，字节
+ * @param globalLimit: 所有会话的上限，字节
+ */
+void DBusMemoryBudget::setLimits(qint64 sessionLimit, qint64 globalLimit)
+{
+    perSession = sessionLimit;
+    global = globalLimit;
+}
+
+/*
+ * 计入会话用量的变化
+ *
+ * @param delta: 变化的字节数，可以为负
+ */
+void DBusMemoryBudget::charge(qint64 delta)
+{
+    if (delta == 0) {
+        return;
+    }
+    const qint64 current = used.fetchAndAddRelaxed(delta) + delta;
+    qint64 last = peak.load();
+    while (current > last && !peak.testAndSetRelaxed(last, current, last)) {
+    }
+}
+
+/*
+ * 获取统计信息
+ *
+ * @return DBusMemoryBudgetMetrics: 统计信息
+ */
+DBusMemoryBudgetMetrics DBusMemoryBudget::metrics() const
+{
+    DBusMemoryBudgetMetrics ret;
+    ret.usedBytes = used.load();
+    ret.peakBytes = peak.load();
+    ret.droppedBroadcasts = dropped.load();
+    ret.disconnects = disconnected.load();
+    return ret;
+}
@@ -0,0 +1,91 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_DBUS_PROXY_SRC_PROXY_DBUS_MEMORY_BUDGET_H
+#define LINGLONG_DBUS_PROXY_SRC_PROXY_DBUS_MEMORY_BUDGET_H
+
+#include <QAtomicInteger>
+#include <QtGlobal>
+
+// 内存预算统计信息
+struct DBusMemoryBudgetMetrics {
+    // 所有会话当前缓存的字节数
+    qint64 usedBytes;
+    // 缓存字节数的历史峰值
+    qint64 peakBytes;
+    // 丢弃的广播信号数
+    quint64 droppedBroadcasts;
+    // 超过会话上限被断开的连接数
+    quint64 disconnects;
+};
+
+/*
+ * 代理缓存数据的内存预算
+ *
+ * 每个会话在分发结束后把接收缓冲区与发送队列占用的字节数变化计入全局用量。
+ * 会话用量超过会话上限时断开连接；全局用量超过全局上限时所有会话丢弃广播信号。
+ * 多线程模式下所有工作线程共用一个预算，用量为原子计数
+ */
+class DBusMemoryBudget
+{
+public:
+    /*
+     * 创建内存预算
+     *
+     * @param sessionLimit: 单个会话的上限，字节
+     * @param globalLimit: 所有会话的上限，字节
+     */
+    DBusMemoryBudget(qint64 sessionLimit, qint64 globalLimit);
+
+    /*
+     * 设置上限，只对之后的分发生效
+     *
+     * @param sessionLimit: 单个会话的上限，字节
+     * @param globalLimit: 所有会话的上限，字节
+     */
+    void setLimits(qint64 sessionLimit, qint64 globalLimit);
+
+    qint64 sessionLimit() const { return perSession; }
+    qint64 globalLimit() const { return global; }
+
+    /*
+     * 计入会话用量的变化
+     *
+     * @param delta: 变化的字节数，可以为负
+     */
+    void charge(qint64 delta);
+
+    /*
+     * 全局用量是否超过上限
+     *
+     * @return bool: true:超过 false:未超过
+     */
+    bool isOverLimit() const { return used.load() > global; }
+
+    // 记录丢弃的广播信号
+    void addDroppedBroadcast() { dropped.fetchAndAddRelaxed(1); }
+
+    // 记录超过会话上限断开的连接
+    void addDisconnect() { disconnected.fetchAndAddRelaxed(1); }
+
+    /*
+     * 获取统计信息
+     *
+     * @return DBusMemoryBudgetMetrics: 统计信息
+     */
+    DBusMemoryBudgetMetrics metrics() const;
+
+private:
+    Q_DISABLE_COPY(DBusMemoryBudget)
+
+    qint64 perSession;
+    qint64 global;
+    QAtomicInteger<qint64> used;
+    QAtomicInteger<qint64> peak;
+    QAtomicInteger<quint64> dropped;
+    QAtomicInteger<quint64> disconnected;
+};
+#endif
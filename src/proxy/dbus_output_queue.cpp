@@ -0,0 +1,232 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "dbus_output_queue.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include <QDebug>
+
+// 批次初始容量，覆盖一次读取中常见的消息条数
+static const int kInitialBatchSize = 256;
+
+/*
+ * 用sendmsg合并发送多段数据，每次调用最多IOV_MAX段，内核缓冲区满时立即返回
+ *
+ * @param fd: socket描述符
+ * @param iov: 数据段
+ * @param count: 数据段数量
+ * @param fds: 附加在第一个字节上的文件描述符，发送后仍由调用方关闭
+ * @param fdCount: 文件描述符数量
+ * @param calls: 累加sendmsg调用次数
+ *
+ * @return qint64: 已发送的字节数，大于0时文件描述符已发送
+ */
+static qint64 sendGathered(int fd, const iovec *iov, int count, const int *fds, int fdCount, quint64 *calls)
+{
+    qint64 sent = 0;
+    while (count > 0) {
+        const int n = qMin(count, IOV_MAX);
+        qint64 expect = 0;
+        for (int i = 0; i < n; i++) {
+            expect += static_cast<qint64>(iov[i].iov_len);
+        }
+        (*calls)++;
+        const qint64 ret = DBusSocket::sendWithFds(fd, iov, n, sent == 0 ? fds : nullptr, sent == 0 ? fdCount : 0);
+        // EAGAIN以及连接错误都交给socket发送缓冲区处理，错误由socket统一上报
+        if (ret < 0) {
+            break;
+        }
+        sent += ret;
+        if (ret < expect) {
+            break;
+        }
+        iov += n;
+        count -= n;
+    }
+    return sent;
+}
+
+DBusOutputQueue::DBusOutputQueue(DBusSocket *socket, qint64 highWatermark, qint64 lowWatermark, QObject *parent)
+    : QObject(parent)
+    , socket(socket)
+    , highWatermark(highWatermark)
+    , lowWatermark(lowWatermark)
+    , full(false)
+    , peakQueuedBytes(0)
+    , totalBytes(0)
+    , pauseCount(0)
+    , frames(0)
+    , sendCalls(0)
+{
+    batch.reserve(kInitialBatchSize);
+    connect(socket, SIGNAL(bytesWritten(qint64)), this, SLOT(onBytesWritten(qint64)));
+}
+
+DBusOutputQueue::~DBusOutputQueue()
+{
+    // 未发送的文件描述符
+    for (int fd : batchFds) {
+        ::close(fd);
+    }
+}
+
+/*
+ * 将一条消息加入当前批次，不拷贝数据
+ *
+ * @param data: 消息地址，在flush之前必须保持有效
+ * @param size: 消息长度
+ * @param fds: 随消息发送的文件描述符，所有权转移给队列，发送后关闭
+ */
+void DBusOutputQueue::enqueue(const char *data, qint64 size, const QVector<int> &fds)
+{
+    if (!fds.isEmpty()) {
+        FdMark mark;
+        mark.index = batch.size();
+        mark.offset = batchFds.size();
+        mark.count = fds.size();
+        fdMarks.append(mark);
+        batchFds += fds;
+    }
+    iovec item;
+    item.iov_base = const_cast<char *>(data);
+    item.iov_len = static_cast<size_t>(size);
+    batch.append(item);
+}
+
+/*
+ * 合并发送当前批次，不阻塞
+ *
+ * @return bool: true:成功 false:socket写入失败
+ */
+bool DBusOutputQueue::flush()
+{
+    if (batch.isEmpty()) {
+        return true;
+    }
+    // socket发送缓冲区中还有数据时直接发送会打乱顺序，只能追加在其后；完成模式下由reactor批量提交
+    bool direct = socket->state() == QLocalSocket::ConnectedState && socket->bytesToWrite() == 0
+        && !socket->isCompletionMode();
+    const int socketFd = static_cast<int>(socket->socketDescriptor());
+    bool ret = true;
+    int mark = 0;
+    int begin = 0;
+    while (begin < batch.size()) {
+        // 文件描述符只能附加在一次sendmsg的第一个字节上，以携带文件描述符的消息为界分组发送
+        const bool hasFds = mark < fdMarks.size() && fdMarks[mark].index == begin;
+        const int next = hasFds ? mark + 1 : mark;
+        const int end = next < fdMarks.size() ? fdMarks[next].index : batch.size();
+        const int *fds = hasFds ? batchFds.constData() + fdMarks[mark].offset : nullptr;
+        const int fdCount = hasFds ? fdMarks[mark].count : 0;
+        qint64 sent = 0;
+        // 直接发送成功时文件描述符已由内核复制，否则随剩余数据交给socket发送缓冲区
+        bool fdsSent = false;
+        if (direct) {
+            sent = sendGathered(socketFd, batch.constData() + begin, end - begin, fds, fdCount, &sendCalls);
+            if (hasFds && sent > 0) {
+                for (int i = 0; i < fdCount; i++) {
+                    ::close(fds[i]);
+                }
+                fdsSent = true;
+            }
+        }
+        for (int i = begin; i < end; i++) {
+            const iovec &item = batch.at(i);
+            const qint64 len = static_cast<qint64>(item.iov_len);
+            totalBytes += len;
+            if (sent >= len) {
+                sent -= len;
+                continue;
+            }
+            direct = false;
+            const bool attach = i == begin && hasFds && !fdsSent;
+            ret = writeBuffered(static_cast<const char *>(item.iov_base) + sent, len - sent, attach ? fds : nullptr,
+                                attach ? fdCount : 0)
+                && ret;
+            sent = 0;
+        }
+        mark = next;
+        begin = end;
+    }
+    frames += static_cast<quint64>(batch.size());
+    batch.resize(0);
+    fdMarks.resize(0);
+    batchFds.resize(0);
+    updateWatermark();
+    return ret;
+}
+
+/*
+ * 先发送当前批次，再追加一条拷贝发送的数据，不阻塞
+ *
+ * @param data: 数据地址，调用返回后即可释放
+ * @param size: 数据长度
+ *
+ * @return bool: true:成功 false:socket写入失败
+ */
+bool DBusOutputQueue::write(const char *data, qint64 size)
+{
+    bool ret = flush();
+    ret = writeBuffered(data, size) && ret;
+    totalBytes += size;
+    frames++;
+    updateWatermark();
+    return ret;
+}
+
+bool DBusOutputQueue::writeBuffered(const char *data, qint64 size, const int *fds, int fdCount)
+{
+    QVector<int> attached;
+    for (int i = 0; i < fdCount; i++) {
+        attached.append(fds[i]);
+    }
+    const qint64 ret = socket->writeWithFds(data, size, attached);
+    if (ret != size) {
+        qCritical() << socket << "write failed, size:" << size << ", ret:" << ret;
+        return false;
+    }
+    return true;
+}
+
+void DBusOutputQueue::updateWatermark()
+{
+    const qint64 queued = socket->bytesToWrite();
+    peakQueuedBytes = qMax(peakQueuedBytes, queued);
+    if (!full && queued >= highWatermark) {
+        full = true;
+        pauseCount++;
+        qDebug() << socket << "output queue reach high watermark, queued:" << queued;
+    }
+}
+
+/*
+ * 获取队列统计信息
+ *
+ * @return DBusOutputQueueMetrics: 统计信息
+ */
+DBusOutputQueueMetrics DBusOutputQueue::metrics() const
+{
+    DBusOutputQueueMetrics ret;
+    ret.queuedBytes = queuedBytes();
+    ret.peakQueuedBytes = peakQueuedBytes;
+    ret.totalBytes = totalBytes;
+    ret.pauseCount = pauseCount;
+    ret.frames = frames;
+    ret.sendCalls = sendCalls;
+    return ret;
+}
+
+void DBusOutputQueue::onBytesWritten(qint64 bytes)
+{
+    Q_UNUSED(bytes);
+    if (full && socket->bytesToWrite() <= lowWatermark) {
+        full = false;
+        qDebug() << socket << "output queue drained, queued:" << socket->bytesToWrite();
+        emit drained();
+    }
+}
@@ -0,0 +1,159 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_DBUS_PROXY_SRC_PROXY_DBUS_OUTPUT_QUEUE_H
+#define LINGLONG_DBUS_PROXY_SRC_PROXY_DBUS_OUTPUT_QUEUE_H
+
+#include <sys/uio.h>
+
+#include <QObject>
+#include <QVector>
+
+#include "proxy/dbus_socket.h"
+
+// 发送队列统计信息
+struct DBusOutputQueueMetrics {
+    // 当前等待发送的字节数
+    qint64 queuedBytes;
+    // 等待发送字节数的历史峰值
+    qint64 peakQueuedBytes;
+    // 已交给socket的字节数
+    qint64 totalBytes;
+    // 超过高水位暂停读取对端的次数
+    quint64 pauseCount;
+    // 已发送的消息数
+    quint64 frames;
+    // 合并发送时调用sendmsg的次数
+    quint64 sendCalls;
+};
+
+/*
+ * 单个方向的非阻塞发送队列
+ *
+ * 同一次读取中切分出的消息先以iovec形式加入批次，不拷贝数据，flush时用一次sendmsg合并发送；
+ * 携带文件描述符的消息从新的一次sendmsg开始发送，文件描述符附加在消息的第一个字节上。
+ * 内核未接收的部分按顺序拷贝进socket自身的发送缓冲区，由事件循环异步发送，不再等待写完成。
+ * 等待发送的数据超过高水位时队列为满，调用方应停止读取对端socket；
+ * 数据发送到低于低水位后发出drained信号，调用方恢复读取；超过高水位一半时为拥塞，调用方可以先丢弃可丢弃的消息。
+ * 单条消息不拆分，队列满时仍接受正在转发的消息，因此占用内存上限为高水位加一次读取的数据
+ */
+class DBusOutputQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    /*
+     * 创建发送队列
+     *
+     * @param socket: 发送数据的socket，不转移所有权
+     * @param highWatermark: 高水位，字节
+     * @param lowWatermark: 低水位，字节
+     * @param parent: 父对象
+     */
+    DBusOutputQueue(DBusSocket *socket, qint64 highWatermark, qint64 lowWatermark, QObject *parent = nullptr);
+    ~DBusOutputQueue() override;
+
+    /*
+     * 将一条消息加入当前批次，不拷贝数据
+     *
+     * @param data: 消息地址，在flush之前必须保持有效
+     * @param size: 消息长度
+     * @param fds: 随消息发送的文件描述符，所有权转移给队列，发送后关闭
+     */
+    void enqueue(const char *data, qint64 size, const QVector<int> &fds = QVector<int>());
+
+    /*
+     * 合并发送当前批次，不阻塞
+     *
+     * @return bool: true:成功 false:socket写入失败
+     */
+    bool flush();
+
+    /*
+     * 先发送当前批次，再追加一条拷贝发送的数据，不阻塞
+     *
+     * @param data: 数据地址，调用返回后即可释放
+     * @param size: 数据长度
+     *
+     * @return bool: true:成功 false:socket写入失败
+     */
+    bool write(const char *data, qint64 size);
+
+    /*
+     * 等待发送的数据是否达到高水位
+     *
+     * @return bool: true:已满，应暂停读取对端 false:未满
+     */
+    bool isFull() const { return full; }
+
+    /*
+     * 等待发送的数据是否达到高水位的一半
+     *
+     * @return bool: true:拥塞，可以丢弃可丢弃的消息 false:未拥塞
+     */
+    bool isCongested() const { return full || queuedBytes() >= highWatermark / 2; }
+
+    /*
+     * 等待发送的字节数
+     *
+     * @return qint64: 字节数
+     */
+    qint64 queuedBytes() const { return socket->bytesToWrite(); }
+
+    /*
+     * 获取队列统计信息
+     *
+     * @return DBusOutputQueueMetrics: 统计信息
+     */
+    DBusOutputQueueMetrics metrics() const;
+
+signals:
+    // 队列从满状态下降到低水位以下
+    void drained();
+
+private slots:
+    void onBytesWritten(qint64 bytes);
+
+private:
+    /*
+     * 拷贝数据到socket发送缓冲区
+     *
+     * @param data: 数据地址
+     * @param size: 数据长度
+     * @param fds: 附加在数据第一个字节上的文件描述符，所有权转移给socket
+     * @param fdCount: 文件描述符数量
+     *
+     * @return bool: true:成功 false:socket写入失败
+     */
+    bool writeBuffered(const char *data, qint64 size, const int *fds = nullptr, int fdCount = 0);
+
+    // 批次中携带文件描述符的消息
+    struct FdMark {
+        // 消息在批次中的下标
+        int index;
+        // 文件描述符在batchFds中的起始位置
+        int offset;
+        int count;
+    };
+
+    // 更新统计信息与水位状态
+    void updateWatermark();
+
+    DBusSocket *socket;
+    qint64 highWatermark;
+    qint64 lowWatermark;
+    bool full;
+    // 等待合并发送的消息
+    QVector<iovec> batch;
+    QVector<FdMark> fdMarks;
+    QVector<int> batchFds;
+    qint64 peakQueuedBytes;
+    qint64 totalBytes;
+    quint64 pauseCount;
+    quint64 frames;
+    quint64 sendCalls;
+};
+#endif
@@ -0,0 +1,144 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "dbus_permission_map.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonParseError>
+
+#include "filter/dbus_atom_table.h"
+
+DBusPermissionMap::DBusPermissionMap()
+    : checked(false)
+{
+}
+
+DBusPermissionMap::~DBusPermissionMap()
+{
+    releaseAtoms(ids);
+}
+
+// 释放映射中的原子
+void DBusPermissionMap::releaseAtoms(const QHash<Key, QString> &map)
+{
+    DBusAtomTable *table = DBusAtomTable::instance();
+    for (auto it = map.constBegin(); it != map.constEnd(); ++it) {
+        for (int atom : it.key().atoms) {
+            table->release(atom);
+        }
+    }
+}
+
+/*
+ * 读取配置文件，建立映射并增加各字段原子的引用
+ *
+ * @param cfgPath: 配置文件路径
+ * @param out: 输出映射，读取失败时为空
+ */
+void DBusPermissionMap::load(const QString &cfgPath, QHash<Key, QString> *out)
+{
+    QFile cfgFile(cfgPath);
+    if (!cfgFile.open(QIODevice::ReadOnly)) {
+        qCritical() << "getPermissionId err" << cfgFile.errorString();
+        return;
+    }
+    QString qValue = cfgFile.readAll();
+    cfgFile.close();
+    QJsonParseError parseJsonErr;
+    QJsonDocument document = QJsonDocument::fromJson(qValue.toUtf8(), &parseJsonErr);
+    if (QJsonParseError::NoError != parseJsonErr.error) {
+        qCritical() << "getPermissionId parse config file err";
+        return;
+    }
+
+    DBusAtomTable *table = DBusAtomTable::instance();
+    QJsonObject dataObject = document.object();
+    for (const auto &key : dataObject.keys()) {
+        auto dbusObject = dataObject.value(key);
+        if (!dbusObject.isArray()) {
+            continue;
+        }
+        QJsonArray dbusArray = dbusObject.toArray();
+        for (int i = 0; i < dbusArray.size(); i++) {
+            QJsonObject item = dbusArray.at(i).toObject();
+            const QByteArray fields[3] = {item.value("name").toString().toUtf8(),
+                                          item.value("path").toString().toUtf8(),
+                                          item.value("ifce").toString().toUtf8()};
+            Key atoms;
+            bool interned = true;
+            for (int j = 0; j < 3; j++) {
+                atoms.atoms[j] = table->intern(QLatin1String(fields[j].constData(), fields[j].size()));
+                interned = interned && atoms.atoms[j] != DBusAtomTable::kNoAtom;
+            }
+            // 与原有按顺序查找一致，同一调用配置了多个权限时使用第一个
+            if (!interned || out->contains(atoms)) {
+                for (int atom : atoms.atoms) {
+                    table->release(atom);
+                }
+                if (!interned) {
+                    qWarning() << "atom table is full, skip permission" << key;
+                }
+                continue;
+            }
+            out->insert(atoms, key);
+        }
+    }
+}
+
+/*
+ * 配置文件修改时间变化时重新加载，与原有映射比较
+ *
+ * @param cfgPath: 配置文件路径
+ *
+ * @return bool: true:映射发生了变化 false:未变化
+ */
+bool DBusPermissionMap::reload(const QString &cfgPath)
+{
+    const QDateTime modified = QFileInfo(cfgPath).lastModified();
+    if (checked && modified == loadedTime) {
+        return false;
+    }
+    checked = true;
+    loadedTime = modified;
+    // 原有映射持有相同字符串的原子，内容相同的配置得到相同的映射
+    QHash<Key, QString> loaded;
+    load(cfgPath, &loaded);
+    QMutexLocker locker(&mutex);
+    if (loaded == ids) {
+        releaseAtoms(loaded);
+        return false;
+    }
+    releaseAtoms(ids);
+    ids.swap(loaded);
+    return true;
+}
+
+/*
+ * 查找dbus调用对应的权限id
+ *
+ * @param name: dbus name
+ * @param path: dbus path
+ * @param ifce: dbus ifce
+ *
+ * @return QString: 权限id，未配置时为空
+ */
+QString DBusPermissionMap::find(QLatin1String name, QLatin1String path, QLatin1String ifce) const
+{
+    QMutexLocker locker(&mutex);
+    const DBusAtomTable *table = DBusAtomTable::instance();
+    Key key = {{table->find(name), table->find(path), table->find(ifce)}};
+    for (int atom : key.atoms) {
+        if (atom == DBusAtomTable::kNoAtom) {
+            return QString();
+        }
+    }
+    return ids.value(key);
+}
@@ -0,0 +1,90 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_DBUS_PROXY_SRC_PROXY_DBUS_PERMISSION_MAP_H
+#define LINGLONG_DBUS_PROXY_SRC_PROXY_DBUS_PERMISSION_MAP_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QLatin1String>
+#include <QMutex>
+#include <QString>
+
+/*
+ * dbus调用到DDE权限id的映射
+ *
+ * 配置文件按权限id列出对应的name、path与interface，加载后按三个字段在进程原子表中的原子建立索引，
+ * 查找时不转换字符串。配置文件修改时间变化时重新加载，内容不变时保留原有映射。
+ * 多线程模式下工作线程共用监听实例的映射，查找与重新加载可以在不同线程中进行
+ */
+class DBusPermissionMap
+{
+public:
+    DBusPermissionMap();
+    ~DBusPermissionMap();
+
+    /*
+     * 配置文件修改时间变化时重新加载，与原有映射比较
+     *
+     * @param cfgPath: 配置文件路径
+     *
+     * @return bool: true:映射发生了变化 false:未变化
+     */
+    bool reload(const QString &cfgPath);
+
+    /*
+     * 查找dbus调用对应的权限id
+     *
+     * @param name: dbus name
+     * @param path: dbus path
+     * @param ifce: dbus ifce
+     *
+     * @return QString: 权限id，未配置时为空
+     */
+    QString find(QLatin1String name, QLatin1String path, QLatin1String ifce) const;
+
+    int size() const
+    {
+        QMutexLocker locker(&mutex);
+        return ids.size();
+    }
+
+private:
+    Q_DISABLE_COPY(DBusPermissionMap)
+
+    // name、path与interface的原子
+    struct Key {
+        int atoms[3];
+        bool operator==(const Key &other) const
+        {
+            return atoms[0] == other.atoms[0] && atoms[1] == other.atoms[1] && atoms[2] == other.atoms[2];
+        }
+        friend uint qHash(const Key &key, uint seed = 0)
+        {
+            return seed ^ (static_cast<uint>(key.atoms[0]) * 31 * 31 + static_cast<uint>(key.atoms[1]) * 31
+                           + static_cast<uint>(key.atoms[2]));
+        }
+    };
+
+    /*
+     * 读取配置文件，建立映射并增加各字段原子的引用
+     *
+     * @param cfgPath: 配置文件路径
+     * @param out: 输出映射，读取失败时为空
+     */
+    static void load(const QString &cfgPath, QHash<Key, QString> *out);
+
+    // 释放映射中的原子
+    static void releaseAtoms(const QHash<Key, QString> &map);
+
+    mutable QMutex mutex;
+    QHash<Key, QString> ids;
+    // 是否已检查过配置文件
+    bool checked;
+    // 上次检查时配置文件的修改时间，文件不存在时为无效时间
+    QDateTime loadedTime;
+};
+#endif
@@ -6,20 +6,72 @@
 
 #include "dbus_proxy.h"
 
+#include <sys/epoll.h>
 #include <unistd.h>
 
 #include <QDBusConnection>
 #include <QDBusInterface>
 #include <QDBusReply>
-#include <QFileInfo>
-#include <QJsonDocument>
-#include <QJsonObject>
-#include <QJsonArray>
+
+// 错误回复输出缓冲区预分配大小，足够容纳一条AccessDenied回复
+static const int kReplyBufferSize = 512;
+// 单个会话缓存数据的默认上限，发送队列高水位为其1/4，低水位为其1/16
+static const qint64 kSessionMemoryLimit = 16 * 1024 * 1024;
+// 所有会话缓存数据的默认上限
+static const qint64 kTotalMemoryLimit = 512 * 1024 * 1024;
+// 每次可读通知最多读取的字节数，超过后回到事件循环，避免一个连接占满事件循环
+static const qint64 kSocketReadBudget = 1024 * 1024;
+// 连接dbus-daemon的默认期限，毫秒
+static const int kDaemonConnectTimeout = 3000;
+// 超过该长度的消息在报文头到达后即过滤转发，body分段直通，不在内存中缓存整条消息
+static const quint32 kCutThroughThreshold = 1024 * 1024;
+// 接收缓冲池的块大小，覆盖绝大多数消息与一次读取的数据
+static const int kBufferChunkSize = 64 * 1024;
+// 接收缓冲池默认容量，块数
+static const int kBufferPoolCapacity = 256;
+// 判定缓存默认容量，条目数
+static const int kVerdictCacheCapacity = 1024;
+// 检查权限配置文件修改时间的间隔，毫秒
+static const int kPermissionReloadInterval = 1000;
+
+/*
+ * 读取数值环境变量，变量未设置时返回默认值
+ *
+ * @param name: 环境变量名
+ * @param defaultValue: 变量未设置时的默认值
+ *
+ * @return qint64: 变量的值
+ */
+static qint64 envInt(const char *name, qint64 defaultValue)
+{
+    const QByteArray value = qgetenv(name);
+    return value.isNull() ? defaultValue : value.toLongLong();
+}
 
 DbusProxy::DbusProxy()
-    : serverProxy(new QLocalServer())
+    : serverProxy(new DBusSocketServer())
+    , bufferPool(new DBusBufferPool(kBufferChunkSize,
+                                    static_cast<int>(envInt("DBUS_PROXY_BUFFER_POOL_CHUNKS", kBufferPoolCapacity))))
+    , memoryBudget(new DBusMemoryBudget(envInt("DBUS_PROXY_SESSION_MEMORY_LIMIT", kSessionMemoryLimit),
+                                        envInt("DBUS_PROXY_MEMORY_LIMIT", kTotalMemoryLimit)))
+    , verdictCache(static_cast<int>(envInt("DBUS_PROXY_VERDICT_CACHE", kVerdictCacheCapacity)))
+    , permissionMap(new DBusPermissionMap())
+    , permissionConfigPath("/usr/share/permission/policy/linglong/dbus_map_config")
+    , strictValidation(!qgetenv("DBUS_PROXY_STRICT_VALIDATION").isNull())
+    , daemonConnectTimeout(kDaemonConnectTimeout)
+    , spliceEnabled(!qgetenv("DBUS_PROXY_SPLICE").isNull())
+    , reactorEnabled(!qgetenv("DBUS_PROXY_REACTOR").isNull())
+    , ioUringEnabled(!qgetenv("DBUS_PROXY_IO_URING").isNull())
+    , workerCount(qMax(static_cast<int>(envInt("DBUS_PROXY_WORKERS", 1)), 1))
+    , workerBalance(LeastLoaded)
+    , nextWorker(0)
+    , activeFilter(&filter)
+    , isWorker(false)
+    , activeSessions(0)
 {
     connect(serverProxy.get(), SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+    connect(&permissionTimer, SIGNAL(timeout()), this, SLOT(reloadPermissions()));
+    replyBuffer.reserve(kReplyBufferSize);
 }
 
 DbusProxy::~DbusProxy()
@@ -27,13 +79,102 @@ DbusProxy::~DbusProxy()
     if (serverProxy) {
         serverProxy->close();
     }
+    // 工作线程退出时在该线程中释放其中的代理实例
+    for (QThread *thread : workerThreads) {
+        thread->quit();
+        thread->wait();
+        delete thread;
+    }
+    // 会话持有两个socket，在reactor之前释放
+    qDeleteAll(sessions);
+    sessions.clear();
+}
+
+/*
+ * 创建reactor并挂到当前线程的事件循环中
+ *
+ * @return bool: true:成功 false:失败，继续使用QSocketNotifier
+ */
+bool DbusProxy::createReactor()
+{
+    reactor.reset(new DBusReactor(ioUringEnabled ? DBusReactor::IoUring : DBusReactor::Epoll));
+    if (!reactor->isValid()) {
+        qWarning() << "create reactor failed, use socket notifiers";
+        return false;
+    }
+    qDebug() << "reactor backend:" << (reactor->backend() == DBusReactor::IoUring ? "io_uring" : "epoll");
+    reactor->attachToEventLoop();
+    return true;
+}
+
+// 创建一个工作线程，复制当前配置，过滤规则共享
+void DbusProxy::startWorker()
+{
+    DbusProxy *worker = new DbusProxy();
+    worker->daemonPath = daemonPath;
+    worker->appId = appId;
+    worker->strictValidation = strictValidation;
+    worker->daemonConnectTimeout = daemonConnectTimeout;
+    worker->spliceEnabled = spliceEnabled;
+    worker->reactorEnabled = reactorEnabled;
+    worker->ioUringEnabled = ioUringEnabled;
+    worker->bufferPool->setCapacity(bufferPool->capacity());
+    worker->memoryBudget = memoryBudget;
+    worker->verdictCache.setCapacity(verdictCache.capacity());
+    worker->permissionMap = permissionMap;
+    worker->activeFilter = activeFilter;
+    worker->isWorker = true;
+    QThread *thread = new QThread();
+    worker->serverProxy->moveToThread(thread);
+    worker->moveToThread(thread);
+    connect(thread, SIGNAL(started()), worker, SLOT(onWorkerStarted()));
+    connect(thread, SIGNAL(finished()), worker, SLOT(deleteLater()));
+    thread->start();
+    workerThreads.append(thread);
+    workers.append(worker);
+}
+
+// 工作线程启动后在该线程中创建reactor
+void DbusProxy::onWorkerStarted()
+{
+    if (reactorEnabled || ioUringEnabled) {
+        createReactor();
+    }
+}
 
-    for (const auto &client : relations.keys()) {
-        if (relations[client]) {
-            delete relations[client];
-            client->close();
+/*
+ * 选择接管新连接的工作线程
+ *
+ * @return DbusProxy*: 工作线程中的代理实例
+ */
+DbusProxy *DbusProxy::pickWorker()
+{
+    int index = nextWorker;
+    if (workerBalance == LeastLoaded) {
+        // 从轮流位置开始查找，连接数相同时仍然轮流分配
+        for (int i = 1; i < workers.size(); i++) {
+            const int candidate = (nextWorker + i) % workers.size();
+            if (workers[candidate]->activeSessions.load() < workers[index]->activeSessions.load()) {
+                index = candidate;
+            }
         }
     }
+    nextWorker = (index + 1) % workers.size();
+    return workers[index];
+}
+
+/*
+ * 获取各工作线程当前处理的连接数
+ *
+ * @return QVector<int>: 按工作线程顺序，未开启多线程时为空
+ */
+QVector<int> DbusProxy::workerLoads() const
+{
+    QVector<int> ret;
+    for (DbusProxy *worker : workers) {
+        ret.append(worker->activeSessions.load());
+    }
+    return ret;
 }
 
 /*
@@ -50,25 +191,40 @@ bool DbusProxy::startListenBoxClient(const QString &socketPath)
         return false;
     }
     QLocalServer::removeServer(socketPath);
+    // 工作线程只读共享过滤规则，在启动工作线程前编译
+    activeFilter->compile();
+    if (workerCount > 1) {
+        // 监听线程只接受连接，描述符移交给工作线程
+        while (workers.size() < workerCount) {
+            startWorker();
+        }
+        serverProxy->setHandoffEnabled(true);
+        qDebug() << "dispatch connections to workers:" << workerCount;
+    } else if ((reactorEnabled || ioUringEnabled) && !reactor && createReactor()) {
+        serverProxy->setReactor(reactor.data());
+    }
     serverProxy->setSocketOptions(QLocalServer::UserAccessOption);
     bool ret = serverProxy->listen(socketPath);
     if (!ret) {
         qCritical() << "listen box dbus client error";
         return false;
     }
+    // 判定缓存命中时不会查找权限id，由监听实例定时检查配置文件
+    reloadPermissions();
+    permissionTimer.start(kPermissionReloadInterval);
     qDebug() << "startListenBoxClient ret:" << ret;
     return ret;
 }
 
 /*
- * 连接dbus-daemon
+ * 异步连接dbus-daemon，立即返回，失败时按退避策略重试直到超过连接期限
  *
  * @param localProxy: 请求与dbus-daemon连接的客户端
  * @param daemonPath: dbus-daemon地址
  *
- * @return bool: true:成功 其它:失败
+ * @return bool: true:已开始连接 其它:失败
  */
-bool DbusProxy::startConnectDbusDaemon(QLocalSocket *localProxy, const QString &daemonPath)
+bool DbusProxy::startConnectDbusDaemon(DBusSocket *localProxy, const QString &daemonPath)
 {
     if (daemonPath.isEmpty()) {
         qCritical() << "daemonPath is empty";
@@ -79,27 +235,80 @@ bool DbusProxy::startConnectDbusDaemon(QLocalSocket *localProxy, const QString &
     connect(localProxy, SIGNAL(disconnected()), this, SLOT(onDisconnectedServer()));
     connect(localProxy, SIGNAL(readyRead()), this, SLOT(onReadyReadServer()));
     qDebug() << "proxy client:" << localProxy << " start connect dbus-daemon...";
-    localProxy->connectToServer(daemonPath);
-    // 等待代理连接dbus-daemon
-    if (!localProxy->waitForConnected(3000)) {
-        qCritical() << "connect dbus-daemon error, msg:" << localProxy->errorString();
-        return false;
-    }
-    qDebug() << "startConnectDbusDaemon done";
+    DBusDaemonConnector *connector = new DBusDaemonConnector(localProxy, daemonPath, daemonConnectTimeout);
+    connect(connector, SIGNAL(failed()), this, SLOT(onConnectDaemonFailed()));
+    connector->start();
     return true;
 }
 
 void DbusProxy::onNewConnection()
 {
-    QLocalSocket *client = serverProxy->nextPendingConnection();
+    if (!workers.isEmpty()) {
+        const qintptr descriptor = serverProxy->nextPendingDescriptor();
+        if (descriptor < 0) {
+            return;
+        }
+        DbusProxy *worker = pickWorker();
+        worker->activeSessions.ref();
+        QMetaObject::invokeMethod(worker, "adoptConnection", Qt::QueuedConnection,
+                                  Q_ARG(int, static_cast<int>(descriptor)));
+        return;
+    }
+    DBusSocket *client = serverProxy->nextPendingSocket();
     qDebug() << "onNewConnection called, client:" << client;
+    if (!client) {
+        return;
+    }
+    setupConnection(client);
+}
+
+/*
+ * 工作线程接管监听线程移交的连接
+ *
+ * @param socketDescriptor: box客户端描述符，所有权转移给工作线程
+ */
+void DbusProxy::adoptConnection(int socketDescriptor)
+{
+    DBusSocket *client = new DBusSocket();
+    client->setReactor(reactor && reactor->isValid() ? reactor.data() : nullptr);
+    if (!client->setSocketDescriptor(socketDescriptor)) {
+        qCritical() << "adopt box client failed, descriptor:" << socketDescriptor;
+        ::close(socketDescriptor);
+        delete client;
+        activeSessions.deref();
+        return;
+    }
+    qDebug() << "worker adopt client:" << client;
+    setupConnection(client);
+}
+
+/*
+ * 为box客户端创建代理客户端与转发状态，开始连接dbus-daemon
+ *
+ * @param client: 新接受的box客户端
+ */
+void DbusProxy::setupConnection(DBusSocket *client)
+{
+    DBusSocket *proxyClient = new DBusSocket();
+    // 新连接由reactor分发时，两个socket的读取事件直接交给会话
+    if (reactor && reactor->isValid()) {
+        proxyClient->setReactor(reactor.data());
+    }
+    const qint64 sessionLimit = memoryBudget->sessionLimit();
+    DBusProxySession *session = new DBusProxySession(this, client, proxyClient, sessionLimit / 4, sessionLimit / 16);
+    sessions.insert(session);
+    session->setMemoryBudget(memoryBudget);
+    session->clientReader.setBufferPool(bufferPool);
+    session->daemonReader.setBufferPool(bufferPool);
     connect(client, SIGNAL(readyRead()), this, SLOT(onReadyReadClient()));
     connect(client, SIGNAL(disconnected()), this, SLOT(onDisconnectedClient()));
-
-    QLocalSocket *proxyClient = new QLocalSocket();
+    // io_uring后端收到的数据已在用户态，不能再从描述符splice
+    if (spliceEnabled && !proxyClient->isCompletionMode()) {
+        session->enableSplice();
+    }
+    // 连接建立前客户端数据留在socket中，连接成功后再读取转发，不阻塞其它连接
     bool ret = startConnectDbusDaemon(proxyClient, daemonPath);
-    relations.insert(client, proxyClient);
-    qDebug() << "onNewConnection create: " << client << "<===>" << proxyClient << " relation, ret:" << ret;
+    qDebug() << "onNewConnection create: " << client << "<===>" << proxyClient << " session, ret:" << ret;
 }
 
 int DbusProxy::requestPermission(const QString &appId, const QString &id)
@@ -131,268 +340,555 @@ int DbusProxy::requestPermission(const QString &appId, const QString &id)
     return ret;
 }
 
-QString DbusProxy::getPermissionId(const QString &name, const QString &path, const QString &ifce)
-{
-    const QString cfgPath = "/usr/share/permission/policy/linglong/dbus_map_config";
-    QFile cfgFile(cfgPath);
-    if (!cfgFile.open(QIODevice::ReadOnly)) {
-        qCritical() << "getPermissionId err" << cfgFile.errorString();
-        return "";
-    }
-    QString qValue = cfgFile.readAll();
-    cfgFile.close();
-    QJsonParseError parseJsonErr;
-    QJsonDocument document = QJsonDocument::fromJson(qValue.toUtf8(), &parseJsonErr);
-    if (QJsonParseError::NoError != parseJsonErr.error) {
-        qCritical() << "getPermissionId parse config file err";
-        return "";
-    }
-
-    QJsonObject dataObject = document.object();
-    // 根据dbus信息查找权限id
-    for (const auto &key : dataObject.keys()) {
-        auto dbusObject = dataObject.value(key);
-        if (dbusObject.isArray()) {
-            QJsonArray dbusArray = dbusObject.toArray();
-            for (int i = 0; i < dbusArray.size(); i++) {
-                QJsonObject item = dbusArray.at(i).toObject();
-                if (name == item.value("name").toString() && path == item.value("path").toString()
-                    && ifce == item.value("ifce").toString()) {
-                    return key;
-                }
-            }
-        }
+QString DbusProxy::getPermissionId(QLatin1String name, QLatin1String path, QLatin1String ifce)
+{
+    const QString id = permissionMap->find(name, path, ifce);
+    if (id.isEmpty()) {
+        qWarning() << "permission id not found "
+                   << QString("name:%1,path:%2,interface:%3").arg(name).arg(path).arg(ifce);
+    }
+    return id;
+}
+
+/*
+ * 判定一条box客户端消息，策略规则与过滤规则得出的结果按报文头字段缓存；
+ * 申请用户授权的结果用户随时可以修改，不缓存，每次重新申请
+ *
+ * @param header: 消息报文头，需要包含过滤规则需要的字段
+ *
+ * @return int: Choice或授权模块返回值，Allow之外都不转发
+ */
+int DbusProxy::judgeMessage(const DBusHeaderView &header)
+{
+    const DBusVerdictKey key(header.destination(), header.path(), header.interface(), header.member(), header.type);
+    int result = Allow;
+    if (verdictCache.lookup(key, &result)) {
+        return result;
+    }
+    // 先按策略规则判定，没有匹配的策略规则时按过滤规则判定 当前实现由白名单改为黑名单
+    const DBusPolicyVerdict verdict = activeFilter->evaluate(header);
+    qDebug() << "dbus msg serial:" << header.serial << ", reply_serial:" << header.replySerial
+             << ", sender:" << header.sender() << ", destination:" << header.destination()
+             << ", header.path:" << header.path() << ", header.interface:" << header.interface()
+             << ", header.member:" << header.member()
+             << ", dbus msg policy action:" << static_cast<int>(verdict.action);
+    if (verdict.action == DBusPolicyAction::Deny) {
+        result = Deny;
+    } else if (verdict.action == DBusPolicyAction::Drop) {
+        result = Drop;
+    } else if (verdict.action == DBusPolicyAction::Ask && !qgetenv("DBUS_PROXY_INTERCEPT").isNull()) {
+        // 未配置权限申请用户授权，授权结果不缓存
+        QString id = getPermissionId(header.destination(), header.path(), header.interface());
+        return requestPermission(appId, id);
     }
-    qWarning() << "permission id not found " << QString("name:%1,path:%2,interface:%3").arg(name).arg(path).arg(ifce);
-    return "";
+    // 依赖arg0等缓存键以外字段的结果不缓存
+    if (verdict.cacheable) {
+        verdictCache.insert(key, result);
+    }
+    return result;
 }
 
 void DbusProxy::onReadyReadClient()
 {
-    // box client socket address
-    QLocalSocket *boxClient = static_cast<QLocalSocket *>(sender());
-    qDebug() << boxClient << "onReadyReadClient called";
-
-    if (boxClient) {
-        // 查找客户端对应的代理
-        QLocalSocket *proxyClient = nullptr;
-        if (relations.contains(boxClient)) {
-            proxyClient = relations[boxClient];
-        } else {
-            qCritical() << "boxClient:" << boxClient << " related proxyClient not found";
-        }
-        // 代理未连接上dbus daemon，尝试重新连接dbus daemon一次
-        if (proxyClient && !connStatus.contains(proxyClient)) {
-            bool ret = startConnectDbusDaemon(proxyClient, daemonPath);
-            qDebug() << proxyClient << " start reconnect dbus-daemon ret:" << ret;
+    DBusProxySession *session = DBusProxySession::fromSocket(static_cast<DBusSocket *>(sender()));
+    if (session) {
+        readClient(session);
+    }
+}
+
+/*
+ * 读取box客户端数据，过滤后转发给dbus-daemon，结束后归还接收缓冲区
+ *
+ * @param session: 会话
+ */
+bool DbusProxy::readClient(DBusProxySession *session)
+{
+    const bool ret = forwardClient(session);
+    // 本次切分出的消息都已交给发送队列，空闲连接不占用接收缓冲区
+    session->clientReader.releaseBuffer();
+    return checkMemoryUsage(session) && ret;
+}
+
+/*
+ * 按读取预算读取box客户端数据并切分过滤转发
+ *
+ * @param session: 会话
+ */
+bool DbusProxy::forwardClient(DBusProxySession *session)
+{
+    DBusSocket *boxClient = session->boxClient;
+    DBusSocket *proxyClient = session->daemonClient;
+    qDebug() << boxClient << "readClient called";
+
+    // 代理尚未连接上dbus daemon，客户端数据暂存在socket读缓冲区中，连接成功后继续读取
+    if (!session->daemonConnected) {
+        qDebug() << proxyClient << " is connecting to dbus-daemon, park client data";
+        return false;
+    }
+    DBusFrameReader *reader = &session->clientReader;
+    DBusOutputQueue *daemonQueue = session->daemonQueue;
+    DBusOutputQueue *clientQueue = session->clientQueue;
+
+    // 只解码过滤规则需要的报文头字段，协商了文件描述符时还需要按UNIX_FDS取出随消息到达的描述符
+    const bool unixFdNegotiated = reader->isUnixFdNegotiated();
+    const quint32 filterFields =
+        activeFilter->requiredHeaderFields()
+        | (unixFdNegotiated ? headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_NUM_UNIX_FDS) : 0);
+    // 严格模式下同样直通转发大消息，否则超过会话内存预算的消息会导致客户端被断开
+    reader->setCutThroughThreshold(kCutThroughThreshold);
+    // 过滤规则变化后缓存的判定结果失效
+    verdictCache.setGeneration(activeFilter->generation());
+    // 客户端在代理处理转发期间又发来了数据不会触发onReadyReadClient回调，超过读取预算后等下一次可读通知
+    qint64 budget = kSocketReadBudget;
+    while (budget > 0 && boxClient->bytesAvailable() > 0) {
+        // dbus-daemon方向发送不及时，或客户端不读取拒绝回复时暂停读取，队列排空后恢复
+        if (daemonQueue->isFull() || clientQueue->isFull()) {
+            qDebug() << boxClient << " output queue is full, pause reading";
+            return false;
         }
+        // dbus 消息会缓存 需要分割成一条一条的，不完整的消息留在重组器中等待后续数据
+        qint64 size = reader->readFrom(boxClient);
+        qDebug() << "Read Data From Client size:" << size;
+        budget -= qMax<qint64>(size, 1);
+        DBusFrame frame;
+        while (reader->nextFrame(&frame)) {
+            // 大消息的后续body，报文头已经过滤，直接转发
+            if (frame.offset > 0) {
+                daemonQueue->enqueue(frame.data, frame.size);
+                continue;
+            }
+            // 报文头字段只记录在报文中的位置，不分配内存
+            DBusHeaderView header;
+            // 随消息传递的文件描述符
+            QVector<int> fds;
+            // 过滤与授权的判定结果，握手信息不拦截
+            int result = Allow;
+            // 认证报文由重组器按行切分并经认证状态机确认，BEGIN之后只有二进制消息，避免被当作认证报文绕过过滤
+            if (!frame.isAuth) {
+                // 默认只解析报文头，body大小不影响过滤开销；严格模式下完整消息再由libdbus完整校验，
+                // 直通转发的大消息body尚未到达，只完整校验报文头的全部字段
+                // 客户端的第一条消息是Hello，尚未发送时还需要识别Hello调用
+                const bool streamed = !frame.isComplete();
+                const quint32 headerFields = strictValidation && streamed
+                    ? DBUS_HEADER_FIELDS_ALL
+                    : filterFields | session->clientHeaderFields();
+                if (!header.parsePartial(frame.data, frame.size, frame.messageSize, headerFields)
+                    || (strictValidation && !streamed && !validateDBusMsg(frame.data, static_cast<int>(frame.size)))) {
+                    // 无法解析的报文不能转发，否则可以绕过过滤规则，与dbus-daemon一样断开连接
+                    qWarning() << "onReadyReadClient parse an abnormal dbus msg, size:" << frame.size
+                               << ", disconnect client:" << boxClient;
+                    daemonQueue->flush();
+                    boxClient->disconnectFromServer();
+                    return false;
+                }
+                // 文件描述符与消息的第一个字节一起到达，按到达顺序取出；未协商或数量不符时无法对应到消息
+                if (header.unixFds > 0
+                    && (!unixFdNegotiated || header.unixFds > static_cast<quint32>(DBusSocket::kMaxFds)
+                        || !boxClient->takeFds(static_cast<int>(header.unixFds), &fds))) {
+                    qWarning() << "client send unexpected unix fds, count:" << header.unixFds
+                               << ", disconnect client:" << boxClient;
+                    daemonQueue->flush();
+                    boxClient->disconnectFromServer();
+                    return false;
+                }
+                session->trackClientMessage(header);
+                // 同样的调用反复出现，判定结果按报文头字段缓存，命中时不匹配规则
+                result = judgeMessage(header);
+            }
 
-        // 客户端在代理处理转发期间又发来了数据不会触发onReadyReadClient回调
-        while (boxClient->bytesAvailable() > 0) {
-            // dbus 消息会缓存 需要分割成一条一条的
-            QByteArray data = boxClient->readAll();
-            qDebug() << "Read Data From Client size:" << data.size();
-            qDebug() << "Read Data From Client:" << data;
-            QList<QByteArray> msgList;
-            // 分割缓存中的dbus消息
-            splitDBusMsg(data, msgList);
-            for (auto item : msgList) {
-                Header header;
-                bool isMatch = false;
-                if (!isDbusAuthMsg(item)) {
-                    if (!parseDBusMsg(item, &header)) {
-                        qWarning() << "onReadyReadClient parse an abnormal dbus msg, msg:" << item
-                                   << ", size:" << item.size();
+            // 记录应用通过dbus访问的宿主机资源
+            if (result != Allow) {
+                // 静默丢弃的消息不回复
+                if (result != Drop && isNeedReply(&header)) {
+                    // 由报文头直接生成错误回复，reply_serial为请求的serial，写入预分配的缓冲区
+                    replyBuffer.resize(0);
+                    if (accessDeniedReply().appendTo(header, header.serial + 1,
+                                                     QLatin1String(session->boxUniqueName), &replyBuffer)) {
+                        clientQueue->write(replyBuffer.constData(), replyBuffer.size());
+                        qDebug() << "reply size:" << replyBuffer.size();
                     } else {
-                        // 判断是否满足过滤规则 当前实现由白名单改为黑名单
-                        isMatch = filter.isMessageMatch(header.destination, header.path, header.interface);
-                        qDebug() << "dbus msg serial:" << header.serial << ", reply_serial:" << header.replySerial
-                                 << ", sender:" << header.sender << ", destination:" << header.destination
-                                 << ", header.path:" << header.path
-                                 << ", header.interface:" << header.interface << ", header.member:" << header.member
-                                 << ", dbus msg match filter ret:" << isMatch;
+                        qCritical() << "create AccessDenied reply failed, destination:" << session->boxUniqueName;
                     }
                 }
-
-                // 握手信息不拦截
-                if (!isDbusAuthMsg(item) && isMatch) {
-                    // 未配置权限申请用户授权
-                    int result = Allow;
-                    if (!qgetenv("DBUS_PROXY_INTERCEPT").isNull()) {
-                        QString id = getPermissionId(header.destination, header.path, header.interface);
-                        result = requestPermission(appId, id);
-                    }
-                    // 记录应用通过dbus访问的宿主机资源
-                    if (result != Allow) {
-                        if (isNeedReply(&header)) {
-                            QByteArray reply = createFakeReplyMsg(
-                                data, header.serial + 1, boxClientAddr, "org.freedesktop.DBus.Error.AccessDenied",
-                                "org.freedesktop.DBus.Error.AccessDenied, please config permission first!");
-                            // 伪造 错误消息格式给客户端
-                            // 将消息发送方 header中的serial 填充到 reply_serial
-                            // 填写消息类型 flags(是否需要回复) 消息body 需要修改消息body长度
-                            // 生成一个惟一的序列号
-                            boxClient->write(reply);
-                            boxClient->waitForBytesWritten(1000);
-                            qDebug() << "reply size:" << reply.size();
-                            qDebug() << reply;
-                        }
-                        return;
-                    }
+                // 拒绝的消息不转发，大消息尚未到达的body同样丢弃，继续处理缓冲区中的后续消息
+                session->stats.deniedMessages++;
+                if (!frame.isComplete()) {
+                    reader->discardMessage();
                 }
-                if (!connStatus.contains(proxyClient)) {
-                    qCritical() << proxyClient << " not connect to dbus-daemon";
-                    return;
+                for (int fd : fds) {
+                    ::close(fd);
                 }
-                proxyClient->write(item);
-                proxyClient->waitForBytesWritten(1000);
-                qDebug() << proxyClient << " send data to dbus-daemon done, msg:" << item << ", size:" << item.size();
-                // Fix 客户端在代理处理转发期间又发来了数据不会触发回调
-                // while (boxClient->bytesAvailable() > 0) {
-                //     QByteArray leftData = boxClient->readAll();
-                //     proxyClient->write(leftData);
-                //     proxyClient->waitForBytesWritten(1000);
-                //     qDebug() << boxClient << " onReadyReadClient data left:" << boxClient->bytesAvailable();
-                // }
+                continue;
             }
+            if (!session->daemonConnected) {
+                qCritical() << proxyClient << " not connect to dbus-daemon";
+                for (int fd : fds) {
+                    ::close(fd);
+                }
+                // 批次中的消息指向接收缓冲区，归还缓冲区前发送
+                daemonQueue->flush();
+                return false;
+            }
+            // 消息留在重组器缓冲区中，本次读取切分出的消息合并发送
+            daemonQueue->enqueue(frame.data, frame.size, fds);
+            if (!frame.isAuth) {
+                session->stats.clientMessages++;
+            }
+            qDebug() << proxyClient << " queue data to dbus-daemon, size:" << frame.size;
+        }
+        // 下次读取可能搬移重组器缓冲区，读取前发送本批消息
+        daemonQueue->flush();
+        // 已读入的数据都已切分为消息时，剩余的文件描述符没有消息声明，直接关闭
+        if (reader->pendingSize() == 0 && boxClient->pendingFdCount() > 0) {
+            QVector<int> orphans;
+            boxClient->takeFds(boxClient->pendingFdCount(), &orphans);
+            qWarning() << boxClient << " send unix fds without message, count:" << orphans.size();
+            for (int fd : orphans) {
+                ::close(fd);
+            }
+        }
+        if (reader->hasError()) {
+            qCritical() << boxClient << " send an invalid dbus stream, disconnect it";
+            boxClient->disconnectFromServer();
+            return false;
         }
     }
+    return budget <= 0;
 }
 
 void DbusProxy::onDisconnectedClient()
 {
-    QLocalSocket *sender = static_cast<QLocalSocket *>(QObject::sender());
+    DBusSocket *sender = static_cast<DBusSocket *>(QObject::sender());
     if (sender) {
         sender->disconnectFromServer();
     }
     qDebug() << "onDisconnectedClient called, sender:" << sender;
-    QLocalSocket *proxyClient = relations[sender];
-    // box 客户端断开连接时，断开代理与dbus daemon的连接
-    if (!proxyClient) {
-        qCritical() << "onDisconnectedClient box client: " << sender << " related proxyClient not found";
+    DBusProxySession *session = DBusProxySession::fromSocket(sender);
+    // 会话可能已经在之前的断开通知中关闭
+    if (!session || !sessions.remove(session)) {
+        qCritical() << "onDisconnectedClient box client: " << sender << " related session not found";
         return;
     }
-    proxyClient->disconnectFromServer();
-    relations.remove(sender);
-    proxyClient->deleteLater();
+    // box 客户端断开连接时，断开代理与dbus daemon的连接
+    session->daemonClient->disconnectFromServer();
+    if (isWorker) {
+        activeSessions.deref();
+    }
+    // 在socket的通知中关闭，延迟释放会话与其持有的socket
+    session->deleteLater();
 }
 
 // dbus-daemon 服务端回调函数
 void DbusProxy::onConnectedServer()
 {
-    QLocalSocket *proxyClient = static_cast<QLocalSocket *>(QObject::sender());
+    DBusSocket *proxyClient = static_cast<DBusSocket *>(QObject::sender());
     qDebug() << proxyClient << " connected to dbus-daemon success";
-    connStatus.insert(proxyClient, true);
+    DBusProxySession *session = DBusProxySession::fromSocket(proxyClient);
+    if (!session) {
+        return;
+    }
+    session->daemonConnected = true;
+    // 转发连接期间客户端发送的认证报文
+    resumeReading(session, session->boxClient);
+}
+
+// 超过期限仍未连接上dbus-daemon，断开对应的客户端
+void DbusProxy::onConnectDaemonFailed()
+{
+    DBusSocket *proxyClient = static_cast<DBusSocket *>(QObject::sender()->parent());
+    DBusProxySession *session = DBusProxySession::fromSocket(proxyClient);
+    if (session) {
+        qCritical() << "connect dbus-daemon timeout, disconnect box client:" << session->boxClient;
+        session->boxClient->disconnectFromServer();
+    }
 }
 
 void DbusProxy::onReadyReadServer()
 {
-    QLocalSocket *daemonClient = static_cast<QLocalSocket *>(QObject::sender());
-    // 查找代理对应的客户端
-    QLocalSocket *boxClient = nullptr;
-    for (const auto &client : relations.keys()) {
-        if (relations[client] == daemonClient) {
-            boxClient = client;
-            break;
-        }
+    DBusProxySession *session = DBusProxySession::fromSocket(static_cast<DBusSocket *>(QObject::sender()));
+    if (session) {
+        readServer(session);
     }
+}
+
+/*
+ * 读取dbus-daemon数据，转发给box客户端，结束后归还接收缓冲区
+ *
+ * @param session: 会话
+ */
+bool DbusProxy::readServer(DBusProxySession *session)
+{
+    const bool ret = forwardServer(session);
+    session->daemonReader.releaseBuffer();
+    return checkMemoryUsage(session) && ret;
+}
 
-    while (daemonClient->bytesAvailable() > 0) {
-        QByteArray receiveDta = daemonClient->readAll();
-        qDebug() << "receive from dbus-daemon, data size:" << receiveDta.size();
-        qDebug() << receiveDta;
-        QList<QByteArray> msgList;
-        // 分割缓存中的dbus消息
-        splitDBusMsg(receiveDta, msgList);
-        for (const auto &item : msgList) {
-            // is a right way to judge?
-            bool isHelloReply = item.contains("NameAcquired");
-            if (isHelloReply) {
-                qDebug() << "parse msg header from dbus-daemon";
-                Header header;
-                if (!parseDBusMsg(item, &header)) {
-                    qWarning() << "onReadyReadServer parse an abnormal dbus msg, msg:" << item
-                               << ", size:" << item.size();
+/*
+ * 按读取预算读取dbus-daemon数据并切分转发
+ *
+ * @param session: 会话
+ */
+bool DbusProxy::forwardServer(DBusProxySession *session)
+{
+    DBusSocket *daemonClient = session->daemonClient;
+    DBusSocket *boxClient = session->boxClient;
+    DBusFrameReader *reader = &session->daemonReader;
+    DBusOutputQueue *clientQueue = session->clientQueue;
+    DBusSpliceRelay *relay = session->spliceRelay.data();
+    const bool unixFdNegotiated = reader->isUnixFdNegotiated();
+
+    qint64 budget = kSocketReadBudget;
+    while (budget > 0) {
+        // 大消息尚未读入用户态的body优先在内核中直通
+        if (relay) {
+            const qint64 moved = spliceServer(session);
+            if (moved < 0) {
+                return false;
+            }
+            if (moved > 0) {
+                budget -= moved;
+                continue;
+            }
+        }
+        if (daemonClient->bytesAvailable() <= 0) {
+            break;
+        }
+        // box客户端读取不及时，暂停读取dbus-daemon，只影响当前连接
+        if (clientQueue->isFull()) {
+            qDebug() << daemonClient << " box client output queue is full, pause reading";
+            return false;
+        }
+        reader->setCutThroughThreshold(kCutThroughThreshold);
+        qint64 size = reader->readFrom(daemonClient);
+        qDebug() << "receive from dbus-daemon, data size:" << size;
+        budget -= qMax<qint64>(size, 1);
+        // box客户端读取不及时或全局内存紧张时，先丢弃广播信号，方法回复与单播消息照常转发
+        const bool shedding = clientQueue->isCongested() || memoryBudget->isOverLimit();
+        DBusFrame frame;
+        while (reader->nextFrame(&frame)) {
+            // 只在等待Hello回复、协商了文件描述符或需要识别广播信号时解析报文头，其余消息直接转发，不扫描内容
+            const quint32 headerFields = session->daemonHeaderFields()
+                | (unixFdNegotiated ? headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_NUM_UNIX_FDS)
+                                    : 0)
+                | (shedding ? headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_DESTINATION) : 0);
+            // 随消息到达的文件描述符，与消息一起转发给客户端
+            QVector<int> fds;
+            if (headerFields != 0 && frame.offset == 0 && !frame.isAuth) {
+                DBusHeaderView header;
+                if (!header.parsePartial(frame.data, frame.size, frame.messageSize, headerFields)) {
+                    qWarning() << "onReadyReadServer parse an abnormal dbus msg, size:" << frame.size;
+                } else if (shedding && frame.isComplete() && header.type == (int)MessageType::SIGNAL
+                           && header.destination().size() == 0) {
+                    // 只丢弃完整的消息，大消息的body可能已在内核中直通
+                    if (header.unixFds > 0 && daemonClient->takeFds(static_cast<int>(header.unixFds), &fds)) {
+                        for (int fd : fds) {
+                            ::close(fd);
+                        }
+                    }
+                    session->stats.droppedBroadcasts++;
+                    memoryBudget->addDroppedBroadcast();
+                    continue;
+                } else {
+                    if (session->trackDaemonMessage(header)) {
+                        qDebug() << boxClient << " unique name:" << session->boxUniqueName;
+                    }
+                    if (header.unixFds > 0 && !daemonClient->takeFds(static_cast<int>(header.unixFds), &fds)) {
+                        qCritical() << daemonClient << " unix fds from dbus-daemon not received, count:"
+                                    << header.unixFds;
+                    }
                 }
-                boxClientAddr = header.destination;
-                qDebug() << "boxClientAddr:" << boxClientAddr;
+            }
+            // 携带文件描述符的大消息body仍走用户态转发
+            if (relay && frame.offset == 0 && !frame.isComplete()) {
+                relay->setMessageAllowed(fds.isEmpty());
             }
             // 将消息转发给客户端
-            if (boxClient) {
-                boxClient->write(item);
-                boxClient->waitForBytesWritten(1000);
-                qDebug() << boxClient << " send data to box dbus client done, msg:" << item << ", size:" << item.size();
-            } else {
-                qCritical() << daemonClient << " related boxClient not found";
+            clientQueue->enqueue(frame.data, frame.size, fds);
+            if (frame.offset == 0 && !frame.isAuth) {
+                session->stats.daemonMessages++;
             }
+            qDebug() << boxClient << " queue data to box dbus client, size:" << frame.size;
+        }
+        clientQueue->flush();
+        if (reader->hasError()) {
+            qCritical() << daemonClient << " receive an invalid dbus stream from dbus-daemon";
+            daemonClient->disconnectFromServer();
+            return false;
         }
     }
+    return budget <= 0;
+}
+
+/*
+ * 把dbus-daemon发来的大消息中尚未读入用户态的body直接splice给box客户端
+ *
+ * @param session: 会话
+ *
+ * @return qint64: 直通转发的字节数，数据丢失已断开连接时为-1
+ */
+qint64 DbusProxy::spliceServer(DBusProxySession *session)
+{
+    DBusSpliceRelay *relay = session->spliceRelay.data();
+    DBusFrameReader *reader = &session->daemonReader;
+    DBusOutputQueue *clientQueue = session->clientQueue;
+    DBusSocket *daemonClient = session->daemonClient;
+    // 重组器缓冲区与box客户端发送队列中的数据都在内核数据之前，两者为空时直通才能保持顺序
+    const quint32 remaining = reader->streamRemaining();
+    if (!relay || remaining == 0 || !relay->isMessageAllowed() || !relay->isValid() || clientQueue->queuedBytes() > 0) {
+        return 0;
+    }
+    QByteArray spill;
+    qint64 lost = 0;
+    const qint64 moved = relay->relay(static_cast<int>(daemonClient->socketDescriptor()),
+                                      static_cast<int>(session->boxClient->socketDescriptor()), remaining, &spill,
+                                      &lost);
+    // 已从dbus-daemon读出的数据丢失，发给box客户端的数据流不再完整，只能断开连接
+    if (lost > 0) {
+        qCritical() << daemonClient << " splice to box client lost data, size:" << lost << ", disconnect it";
+        session->boxClient->disconnectFromServer();
+        return -1;
+    }
+    reader->skipStream(static_cast<quint32>(moved));
+    if (!spill.isEmpty()) {
+        clientQueue->write(spill.constData(), spill.size());
+    }
+    // 数据绕过read读出，恢复可读通知
+    daemonClient->notifyExternalRead();
+    qDebug() << daemonClient << " splice to box client, size:" << moved << ", spill:" << spill.size();
+    return moved;
+}
+
+/*
+ * 分发结束后统计会话缓存的数据，超过内存上限时断开box客户端
+ *
+ * @param session: 会话
+ *
+ * @return bool: true:未超过上限 false:已断开
+ */
+bool DbusProxy::checkMemoryUsage(DBusProxySession *session)
+{
+    const qint64 used = session->updateMemoryUsage();
+    const qint64 limit = memoryBudget->sessionLimit();
+    if (used <= limit && !(memoryBudget->isOverLimit() && used > limit / 2)) {
+        return true;
+    }
+    if (session->boxClient->state() != QLocalSocket::ConnectedState) {
+        return false;
+    }
+    // 暂停读取与丢弃广播信号仍不能限制用量，断开连接释放缓存的数据
+    qWarning() << session->boxClient << " buffered data exceeds memory limit, used:" << used
+               << ", limit:" << limit << ", disconnect it";
+    memoryBudget->addDisconnect();
+    session->boxClient->disconnectFromServer();
+    return false;
 }
 
 // 与dbus-daemon 断开连接
 void DbusProxy::onDisconnectedServer()
 {
-    QLocalSocket *sender = static_cast<QLocalSocket *>(QObject::sender());
+    DBusSocket *sender = static_cast<DBusSocket *>(QObject::sender());
     if (sender) {
         sender->disconnectFromServer();
     }
+    DBusProxySession *session = DBusProxySession::fromSocket(sender);
+    if (session) {
+        // 更新代理与dbus daemon连接状态
+        session->daemonConnected = false;
+        session->boxClient->disconnectFromServer();
+    } else {
+        qCritical() << "onDisconnectedServer " << sender << " related boxClient not found";
+    }
+    qDebug() << "onDisconnectedServer called sender:" << sender;
+}
 
-    QLocalSocket *boxClient = nullptr;
-    for (const auto &client : relations.keys()) {
-        if (relations[client] == sender) {
-            boxClient = client;
-            break;
-        }
+/*
+ * 发送队列排空后恢复读取会话的两端
+ *
+ * @param session: 会话
+ */
+void DbusProxy::resumeSession(DBusProxySession *session)
+{
+    resumeReading(session, session->boxClient);
+    // readClient可能因异常断开连接
+    if (sessions.contains(session)) {
+        resumeReading(session, session->daemonClient);
     }
-    if (boxClient) {
-        boxClient->disconnectFromServer();
+}
+
+/*
+ * 恢复读取暂停的socket，reactor模式下排入下一轮分发，读取预算用完后由reactor继续读取
+ *
+ * @param session: socket所属的会话
+ * @param socket: box客户端或代理客户端
+ */
+void DbusProxy::resumeReading(DBusProxySession *session, DBusSocket *socket)
+{
+    if (reactor && reactor->isValid()) {
+        reactor->schedule(socket, EPOLLIN);
+    } else if (socket == session->boxClient) {
+        readClient(session);
     } else {
-        qCritical() << "onDisconnectedServer " << sender << " related boxClient not found";
+        readServer(session);
     }
+}
 
-    // 更新代理与dbus daemon连接关系
-    if (connStatus.contains(sender)) {
-        connStatus.remove(sender);
+/*
+ * 获取所有连接发送队列的汇总统计信息
+ *
+ * @return DBusOutputQueueMetrics: 峰值为各队列最大值，其余为各队列之和
+ */
+DBusOutputQueueMetrics DbusProxy::outputQueueMetrics() const
+{
+    DBusOutputQueueMetrics ret = {0, 0, 0, 0, 0, 0};
+    for (DBusProxySession *session : sessions) {
+        for (DBusOutputQueue *queue : {session->clientQueue, session->daemonQueue}) {
+            const DBusOutputQueueMetrics item = queue->metrics();
+            ret.queuedBytes += item.queuedBytes;
+            ret.peakQueuedBytes = qMax(ret.peakQueuedBytes, item.peakQueuedBytes);
+            ret.totalBytes += item.totalBytes;
+            ret.pauseCount += item.pauseCount;
+            ret.frames += item.frames;
+            ret.sendCalls += item.sendCalls;
+        }
     }
-    qDebug() << "onDisconnectedServer called sender:" << sender;
+    return ret;
 }
 
-QByteArray DbusProxy::createFakeReplyMsg(const QByteArray &byteMsg, quint32 serial, const QString &dst,
-                                         const QString &errorName, const QString &errorMsg)
+/*
+ * 获取所有连接内核直通转发的汇总统计信息
+ *
+ * @return DBusSpliceMetrics: 各连接之和
+ */
+DBusSpliceMetrics DbusProxy::spliceMetrics() const
 {
-    DBusError dbErr;
-    dbus_error_init(&dbErr);
-    DBusMessage *receiveMsg = dbus_message_demarshal(byteMsg.constData(), byteMsg.size(), &dbErr);
-    if (!receiveMsg) {
-        qCritical() << "dbus_message_demarshal failed";
-        if (dbus_error_is_set(&dbErr)) {
-            qCritical() << "dbus_message_demarshal err msg:" << dbErr.message;
-            dbus_error_free(&dbErr);
+    DBusSpliceMetrics ret = {0, 0, 0};
+    for (DBusProxySession *session : sessions) {
+        if (!session->spliceRelay) {
+            continue;
         }
-        return nullptr;
+        const DBusSpliceMetrics item = session->spliceRelay->metrics();
+        ret.splicedBytes += item.splicedBytes;
+        ret.copiedBytes += item.copiedBytes;
+        ret.spliceCalls += item.spliceCalls;
     }
+    return ret;
+}
 
-    std::string nameString = errorName.toStdString();
-    std::string msgString = errorMsg.toStdString();
-    DBusMessage *reply = dbus_message_new_error(receiveMsg, nameString.c_str(), msgString.c_str());
-    std::string destination = dst.toStdString();
-    auto ret = dbus_message_set_destination(reply, destination.c_str());
-    if (!ret) {
-        // dbus_message_unref(receiveMsg);
-        qCritical() << "createFakeReplyMsg set destination failed";
+// 权限配置文件变化时重新加载，映射变化后清空所有线程的判定缓存，监听后每秒调用一次
+void DbusProxy::reloadPermissions()
+{
+    if (permissionMap->reload(permissionConfigPath)) {
+        qDebug() << "permission config changed:" << permissionConfigPath;
+        invalidateVerdicts();
     }
-    dbus_message_set_serial(reply, serial);
+}
 
-    char *replyAsc;
-    int len = 0;
-    ret = dbus_message_marshal(reply, &replyAsc, &len);
-    if (!ret) {
-        // dbus_message_unref(receiveMsg);
-        qCritical() << "createFakeReplyMsg dbus_message_marshal failed";
-    }
-    QByteArray data(replyAsc, len);
-    dbus_free(replyAsc);
-    dbus_message_unref(receiveMsg);
-    dbus_message_unref(reply);
-    return data;
-}
\ No newline at end of file
+// 清空所有线程的判定缓存，权限配置变化时调用
+void DbusProxy::invalidateVerdicts()
+{
+    verdictCache.invalidate();
+    // 工作线程中的缓存只在该线程中访问，排入其事件循环清空
+    for (DbusProxy *worker : workers) {
+        QMetaObject::invokeMethod(worker, "invalidateVerdicts", Qt::QueuedConnection);
+    }
+}
@@ -9,21 +9,50 @@
 
 #include <dbus/dbus.h>
 
+#include <QAtomicInt>
 #include <QDebug>
 #include <QFile>
-#include <QLocalSocket>
-#include <QLocalServer>
 #include <QObject>
 #include <QScopedPointer>
+#include <QSet>
+#include <QSharedPointer>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
 
 #include "filter/dbus_filter.h"
+#include "filter/dbus_verdict_cache.h"
+#include "message/dbus_buffer_pool.h"
+#include "message/dbus_error_reply.h"
+#include "message/dbus_frame_reader.h"
+#include "message/dbus_header_view.h"
 #include "message/dbus_message.h"
+#include "proxy/dbus_daemon_connector.h"
+#include "proxy/dbus_memory_budget.h"
+#include "proxy/dbus_output_queue.h"
+#include "proxy/dbus_permission_map.h"
+#include "proxy/dbus_proxy_session.h"
+#include "proxy/dbus_reactor.h"
+#include "proxy/dbus_socket.h"
+#include "proxy/dbus_socket_server.h"
+#include "proxy/dbus_splice_relay.h"
 
 class DbusProxy : public QObject
 {
     Q_OBJECT
 
 public:
+    // 授权模块返回值，Drop为策略规则要求静默丢弃，不是授权模块的返回值
+    enum Choice { Allow = 0, Deny, Drop = -2 };
+
+    // 多线程模式下新连接分配给工作线程的方式
+    enum WorkerBalance {
+        // 依次轮流分配
+        RoundRobin,
+        // 分配给当前连接数最少的工作线程，相同时轮流分配
+        LeastLoaded,
+    };
+
     DbusProxy();
     ~DbusProxy();
 
@@ -37,14 +66,14 @@ public:
     bool startListenBoxClient(const QString &socketPath);
 
     /*
-     * 连接dbus-daemon
+     * 异步连接dbus-daemon，立即返回，失败时按退避策略重试直到超过连接期限
      *
      * @param localProxy: 请求与dbus-daemon连接的客户端
      * @param daemonPath: dbus-daemon地址
      *
-     * @return bool: true:成功 其它:失败
+     * @return bool: true:已开始连接 其它:失败
      */
-    bool startConnectDbusDaemon(QLocalSocket *localProxy, const QString &daemonPath);
+    bool startConnectDbusDaemon(DBusSocket *localProxy, const QString &daemonPath);
 
     /*
      * 保存dbus-dameon连接地址
@@ -60,7 +89,183 @@ public:
      */
     void saveAppId(const QString &id) { appId = id; }
 
+    /*
+     * 设置严格校验模式，开启后除报文头外还使用libdbus完整校验客户端消息
+     * 默认关闭，也可通过环境变量DBUS_PROXY_STRICT_VALIDATION开启
+     * 超过直通转发阈值的大消息仍然边接收边转发，不受会话内存预算限制，此时只完整校验报文头的全部字段，
+     * body不经libdbus校验，由dbus-daemon校验
+     *
+     * @param enable: 是否开启
+     */
+    void setStrictValidation(bool enable) { strictValidation = enable; }
+
+    /*
+     * 设置连接dbus-daemon的期限，超过期限仍未连接成功时断开对应的客户端
+     *
+     * @param msec: 期限，毫秒，默认3000
+     */
+    void setDaemonConnectTimeout(int msec) { daemonConnectTimeout = msec; }
+
+    /*
+     * 设置DDE权限配置文件，监听后每秒检查一次修改时间，映射变化时清空所有线程的判定缓存
+     *
+     * @param path: 配置文件路径，默认/usr/share/permission/policy/linglong/dbus_map_config
+     */
+    void setPermissionConfigPath(const QString &path) { permissionConfigPath = path; }
+
+    /*
+     * 设置内核直通模式，开启后dbus-daemon发给box客户端的大消息body通过splice转发，不进入用户态
+     * 默认关闭，也可通过环境变量DBUS_PROXY_SPLICE开启，只对之后建立的连接生效
+     *
+     * @param enable: 是否开启
+     */
+    void setSpliceEnabled(bool enable) { spliceEnabled = enable; }
+
+    /*
+     * 设置reactor模式，开启后连接注册到边沿触发的epoll中，可读时直接调用读取函数，不经过信号槽分发
+     * 默认关闭，也可通过环境变量DBUS_PROXY_REACTOR开启，需要在startListenBoxClient之前设置
+     *
+     * @param enable: 是否开启
+     */
+    void setReactorEnabled(bool enable) { reactorEnabled = enable; }
+
+    /*
+     * 设置reactor使用io_uring，开启后所有连接的接收与发送请求每轮一次系统调用批量提交，隐含开启reactor模式
+     * 内核不支持时回退到epoll；此时数据不经过描述符直接读写，内核直通转发不生效
+     * 默认关闭，也可通过环境变量DBUS_PROXY_IO_URING开启，需要在startListenBoxClient之前设置
+     *
+     * @param enable: 是否开启
+     */
+    void setIoUringEnabled(bool enable) { ioUringEnabled = enable; }
+
+    /*
+     * 设置工作线程数，大于1时当前线程只接受连接，box客户端与对应的dbus-daemon连接整体交给一个工作线程处理
+     * 每个工作线程有独立的事件循环与reactor，过滤规则由所有工作线程只读共享，startListenBoxClient之后不能再修改
+     * 默认为1，在当前线程处理所有连接，也可通过环境变量DBUS_PROXY_WORKERS设置，需要在startListenBoxClient之前设置
+     *
+     * @param count: 工作线程数
+     */
+    void setWorkerCount(int count) { workerCount = count; }
+
+    /*
+     * 设置新连接分配给工作线程的方式，默认LeastLoaded
+     *
+     * @param balance: 分配方式
+     */
+    void setWorkerBalance(WorkerBalance balance) { workerBalance = balance; }
+
+    /*
+     * 设置接收缓冲池容量，同一线程中所有连接的消息重组器从缓冲池借用接收缓冲区，数据取空后归还
+     * 超过容量时连接自行分配内存，多线程模式下每个工作线程一个缓冲池，容量相同
+     * 默认256块，每块64KiB，也可通过环境变量DBUS_PROXY_BUFFER_POOL_CHUNKS设置，需要在startListenBoxClient之前设置
+     *
+     * @param chunks: 块数
+     */
+    void setBufferPoolCapacity(int chunks) { bufferPool->setCapacity(chunks); }
+
+    /*
+     * 获取接收缓冲池统计信息，多线程模式下不包含工作线程中的缓冲池
+     *
+     * @return DBusBufferPoolMetrics: 统计信息
+     */
+    DBusBufferPoolMetrics bufferPoolMetrics() const { return bufferPool->metrics(); }
+
+    /*
+     * 设置缓存数据的内存上限，会话用量为两个接收缓冲区与两个方向发送队列之和
+     * 发送队列超过会话上限的1/4时暂停读取对端，超过1/8时丢弃发给box客户端的广播信号；
+     * 会话用量超过会话上限，或全局用量超过全局上限时用量超过会话上限一半的会话被断开。
+     * 多线程模式下所有工作线程共用全局上限。默认会话16MiB、全局512MiB，
+     * 也可通过环境变量DBUS_PROXY_SESSION_MEMORY_LIMIT与DBUS_PROXY_MEMORY_LIMIT设置，需要在startListenBoxClient之前设置
+     *
+     * @param sessionLimit: 单个会话的上限，字节
+     * @param globalLimit: 所有会话的上限，字节
+     */
+    void setMemoryLimits(qint64 sessionLimit, qint64 globalLimit) { memoryBudget->setLimits(sessionLimit, globalLimit); }
+
+    /*
+     * 获取内存预算统计信息，多线程模式下包含所有工作线程
+     *
+     * @return DBusMemoryBudgetMetrics: 统计信息
+     */
+    DBusMemoryBudgetMetrics memoryMetrics() const { return memoryBudget->metrics(); }
+
+    /*
+     * 获取各工作线程当前处理的连接数
+     *
+     * @return QVector<int>: 按工作线程顺序，未开启多线程时为空
+     */
+    QVector<int> workerLoads() const;
+
+    /*
+     * 获取当前线程中的会话数，多线程模式下不包含工作线程中的会话
+     *
+     * @return int: 会话数
+     */
+    int sessionCount() const { return sessions.size(); }
+
+    /*
+     * 获取所有连接内核直通转发的汇总统计信息，多线程模式下不包含工作线程中的连接
+     *
+     * @return DBusSpliceMetrics: 各连接之和
+     */
+    DBusSpliceMetrics spliceMetrics() const;
+
+    /*
+     * 获取所有连接发送队列的汇总统计信息，多线程模式下不包含工作线程中的连接
+     *
+     * @return DBusOutputQueueMetrics: 峰值为各队列最大值，其余为各队列之和
+     */
+    DBusOutputQueueMetrics outputQueueMetrics() const;
+
+    /*
+     * 设置判定缓存容量，box客户端消息的过滤与授权结果按报文头字段缓存，0为不缓存
+     * 多线程模式下每个工作线程一个缓存，容量相同。默认1024条，
+     * 也可通过环境变量DBUS_PROXY_VERDICT_CACHE设置，需要在startListenBoxClient之前设置
+     *
+     * @param capacity: 条目数
+     */
+    void setVerdictCacheCapacity(int capacity) { verdictCache.setCapacity(capacity); }
+
+    /*
+     * 获取判定缓存统计信息，多线程模式下不包含工作线程中的缓存
+     *
+     * @return DBusVerdictCacheMetrics: 统计信息
+     */
+    DBusVerdictCacheMetrics verdictCacheMetrics() const { return verdictCache.metrics(); }
+
+    /*
+     * 判定一条box客户端消息，策略规则与过滤规则得出的结果按报文头字段缓存；
+     * 申请用户授权的结果用户随时可以修改，不缓存，每次重新申请
+     *
+     * @param header: 消息报文头，需要包含过滤规则需要的字段
+     *
+     * @return int: Choice或授权模块返回值，Allow之外都不转发
+     */
+    int judgeMessage(const DBusHeaderView &header);
+
+public slots:
+    // 清空所有线程的判定缓存，权限配置变化时调用
+    void invalidateVerdicts();
+
+protected:
+    /*
+     * 通过dde权限管理器向用户申请权限
+     *
+     * @param appId: 应用appId
+     * @param id: 申请的应用权限ID
+     *
+     * @return int: 申请结果
+     */
+    virtual int requestPermission(const QString &appId, const QString &id);
+
+protected slots:
+    // 权限配置文件变化时重新加载，映射变化后清空所有线程的判定缓存，监听后每秒调用一次
+    void reloadPermissions();
+
 private:
+    // 会话直接调用读取函数
+    friend class DBusProxySession;
+
     /*
      * 客户端dbus报文是否需要回复
      *
@@ -68,7 +273,7 @@ private:
      *
      * @return bool: true:需要回复 其它:不需要
      */
-    bool isNeedReply(const Header *header)
+    bool isNeedReply(const DBusHeaderView *header)
     {
         if (header->type == (int)MessageType::METHOD_CALL) {
             return (header->flags & 0x1) == 0;
@@ -77,58 +282,108 @@ private:
     }
 
     /*
-     * 客户端dbus报文是否为认证报文
+     * 通过dbus信息获取上报DDE的权限id，映射由监听实例定时重新加载
+     *
+     * @param name: dbus name
+     * @param path: dbus path
+     * @param ifce: dbus ifce
+     *
+     * @return QString: 权限id
+     */
+    QString getPermissionId(QLatin1String name, QLatin1String path, QLatin1String ifce);
+
+    /*
+     * 读取box客户端数据，过滤后转发给dbus-daemon，结束后归还接收缓冲区
      *
-     * @param byteArray: dbus socket报文
+     * @param session: 会话
      *
-     * @return bool: true:是 其它:不是
+     * @return bool: true:本次读取预算用完，可能还有数据 false:已读完或暂停读取
      */
-    bool isDbusAuthMsg(const QByteArray &byteArray)
-    {
-        if (byteArray.size() < 2) {
-            return true;
-        }
-        // buffer[0] 大小端  buffer[1] Message type 1 2 3 4 分别表示METHOD_CALL METHOD_RETURN ERROR SIGNAL
-        if ((byteArray[0] == 'l' || byteArray[0] == 'B') && byteArray[2] < 5) {
-            return false;
-        }
-        return true;
-    }
+    bool readClient(DBusProxySession *session);
 
     /*
-     * 通过dbus信息获取上报DDE的权限id
+     * 按读取预算读取box客户端数据并切分过滤转发
      *
-     * @param name: dbus name
-     * @param path: dbus path
-     * @param ifce: dbus ifce
+     * @param session: 会话
      *
-     * @return QString: 权限id
+     * @return bool: true:本次读取预算用完，可能还有数据 false:已读完或暂停读取
      */
-    QString getPermissionId(const QString &name, const QString &path, const QString &ifce);
+    bool forwardClient(DBusProxySession *session);
 
     /*
-     * 通过dde权限管理器向用户申请权限
+     * 读取dbus-daemon数据，转发给box客户端，结束后归还接收缓冲区
      *
-     * @param appId: 应用appId
-     * @param id: 申请的应用权限ID
+     * @param session: 会话
      *
-     * @return int: 申请结果
+     * @return bool: true:本次读取预算用完，可能还有数据 false:已读完或暂停读取
      */
-    int requestPermission(const QString &appId, const QString &id);
+    bool readServer(DBusProxySession *session);
 
     /*
-     * 创建指定参数的dbus错误消息
+     * 按读取预算读取dbus-daemon数据并切分转发
      *
-     * @param byteMsg: dbus socket报文
-     * @param serial: 报文序列号
-     * @param dst: 报文目标地址
-     * @param errorName: 报文错误类型
-     * @param errorMsg: 报文错误消息
+     * @param session: 会话
      *
-     * @return QByteArray: 报文字节数组
+     * @return bool: true:本次读取预算用完，可能还有数据 false:已读完或暂停读取
      */
-    QByteArray createFakeReplyMsg(const QByteArray &byteMsg, quint32 serial, const QString &dst,
-                                  const QString &errorName, const QString &errorMsg);
+    bool forwardServer(DBusProxySession *session);
+
+    /*
+     * 把dbus-daemon发来的大消息中尚未读入用户态的body直接splice给box客户端
+     *
+     * @param session: 会话
+     *
+     * @return qint64: 直通转发的字节数，数据丢失已断开连接时为-1
+     */
+    qint64 spliceServer(DBusProxySession *session);
+
+    /*
+     * 分发结束后统计会话缓存的数据，超过内存上限时断开box客户端
+     *
+     * @param session: 会话
+     *
+     * @return bool: true:未超过上限 false:已断开
+     */
+    bool checkMemoryUsage(DBusProxySession *session);
+
+    /*
+     * 恢复读取暂停的socket，reactor模式下排入下一轮分发，读取预算用完后由reactor继续读取
+     *
+     * @param session: socket所属的会话
+     * @param socket: box客户端或代理客户端
+     */
+    void resumeReading(DBusProxySession *session, DBusSocket *socket);
+
+    /*
+     * 发送队列排空后恢复读取会话的两端
+     *
+     * @param session: 会话
+     */
+    void resumeSession(DBusProxySession *session);
+
+    /*
+     * 创建reactor并挂到当前线程的事件循环中
+     *
+     * @return bool: true:成功 false:失败，继续使用QSocketNotifier
+     */
+    bool createReactor();
+
+    // 创建一个工作线程，复制当前配置，过滤规则共享
+    void startWorker();
+
+    /*
+     * 选择接管新连接的工作线程
+     *
+     * @return DbusProxy*: 工作线程中的代理实例
+     */
+    DbusProxy *pickWorker();
+
+    /*
+     * 为box客户端创建代理客户端与转发状态，开始连接dbus-daemon
+     *
+     * @param client: 新接受的box客户端
+     */
+    void setupConnection(DBusSocket *client);
 
 public:
     DbusFilter filter;
@@ -141,26 +396,72 @@ private slots:
 
     // dbus-daemon 服务端回调函数
     void onConnectedServer();
+    void onConnectDaemonFailed();
     void onReadyReadServer();
     void onDisconnectedServer();
 
+    // 工作线程启动后在该线程中创建reactor
+    void onWorkerStarted();
+
+    /*
+     * 工作线程接管监听线程移交的连接
+     *
+     * @param socketDescriptor: box客户端描述符，所有权转移给工作线程
+     */
+    void adoptConnection(int socketDescriptor);
+
 private:
+    // reactor模式下分发所有连接的读写事件，需要比所有socket存活更久
+    QScopedPointer<DBusReactor> reactor;
     // dbus-proxy server, wait for dbus client in box to connect
-    QScopedPointer<QLocalServer> serverProxy;
+    QScopedPointer<DBusSocketServer> serverProxy;
 
-    // boxclient & proxy client map
-    QMap<QLocalSocket *, QLocalSocket *> relations;
-    // proxy client connect status map
-    QMap<QLocalSocket *, bool> connStatus;
+    // 所有未断开的会话，socket通过DBusProxySession::fromSocket直接找到会话，这里只用于释放与汇总统计
+    QSet<DBusProxySession *> sessions;
 
-    // 客户端地址
-    QString boxClientAddr;
+    // 错误回复输出缓冲区，预分配后重复使用
+    QByteArray replyBuffer;
+    // 当前线程中所有连接共用的接收缓冲池
+    QSharedPointer<DBusBufferPool> bufferPool;
+    // 缓存数据的内存预算，工作线程共用监听实例的预算
+    QSharedPointer<DBusMemoryBudget> memoryBudget;
+    // 当前线程中所有连接共用的过滤与授权判定缓存
+    DBusVerdictCache verdictCache;
+    // dbus调用到DDE权限id的映射，工作线程共用监听实例的映射
+    QSharedPointer<DBusPermissionMap> permissionMap;
+    // 权限配置文件路径
+    QString permissionConfigPath;
+    // 定时检查权限配置文件，与消息是否命中判定缓存无关
+    QTimer permissionTimer;
 
     // dbus-daemon path
     QString daemonPath;
 
     QString appId;
-    // 授权模块返回值
-    enum Choice { Allow = 0, Deny};
+
+    // 是否使用libdbus完整校验客户端消息
+    bool strictValidation;
+    // 连接dbus-daemon的期限，毫秒
+    int daemonConnectTimeout;
+    // 是否通过splice转发dbus-daemon发来的大消息body
+    bool spliceEnabled;
+    // 是否使用reactor分发读写事件
+    bool reactorEnabled;
+    // reactor是否优先使用io_uring
+    bool ioUringEnabled;
+    // 工作线程数，大于1时开启多线程
+    int workerCount;
+    WorkerBalance workerBalance;
+    // 多线程模式下的工作线程与其中的代理实例，一一对应
+    QVector<QThread *> workerThreads;
+    QVector<DbusProxy *> workers;
+    // 下一个轮流分配的工作线程
+    int nextWorker;
+    // 匹配消息使用的过滤规则，工作线程指向监听实例的filter
+    DbusFilter *activeFilter;
+    // 是否为工作线程中的代理实例
+    bool isWorker;
+    // 工作线程当前处理的连接数，由监听线程增加，工作线程在连接断开时减少
+    QAtomicInt activeSessions;
 };
 #endif
\ No newline at end of file
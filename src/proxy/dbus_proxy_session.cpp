@@ -0,0 +1,182 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "dbus_proxy_session.h"
+
+#include "proxy/dbus_proxy.h"
+
+// 识别客户端Hello调用需要的报文头字段
+static const quint32 kHelloCallFields = headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_DESTINATION)
+    | headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_INTERFACE)
+    | headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_MEMBER);
+// 匹配dbus-daemon对Hello的回复需要的报文头字段
+static const quint32 kHelloReplyFields = headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_REPLY_SERIAL)
+    | headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_DESTINATION);
+
+/*
+ * 创建会话并设置为两个socket的读取者，两个socket由会话持有，随会话释放
+ *
+ * @param proxy: 代理
+ * @param boxClient: box客户端
+ * @param daemonClient: 与dbus-daemon连接的代理客户端
+ * @param highWatermark: 发送队列高水位，字节
+ * @param lowWatermark: 发送队列低水位，字节
+ */
+DBusProxySession::DBusProxySession(DbusProxy *proxy, DBusSocket *boxClient, DBusSocket *daemonClient,
+                                   qint64 highWatermark, qint64 lowWatermark)
+    : proxy(proxy)
+    , boxClient(boxClient)
+    , daemonClient(daemonClient)
+    , auth(new DBusAuthStateMachine())
+    , clientReader(auth, DBusAuthPeer::Client)
+    , daemonReader(auth, DBusAuthPeer::Server)
+    , clientQueue(new DBusOutputQueue(boxClient, highWatermark, lowWatermark, this))
+    , daemonQueue(new DBusOutputQueue(daemonClient, highWatermark, lowWatermark, this))
+    , daemonConnected(false)
+    , helloSent(false)
+    , helloSerial(0)
+    , chargedBytes(0)
+{
+    stats = {0, 0, 0, 0};
+    boxClient->setParent(this);
+    daemonClient->setParent(this);
+    boxClient->setListener(this);
+    daemonClient->setListener(this);
+    // 在事件循环中排队恢复读取，避免在socket的bytesWritten回调中重入读取
+    for (DBusOutputQueue *queue : {clientQueue, daemonQueue}) {
+        connect(queue, SIGNAL(drained()), this, SLOT(onOutputQueueDrained()), Qt::QueuedConnection);
+    }
+}
+
+DBusProxySession::~DBusProxySession()
+{
+    boxClient->setListener(nullptr);
+    daemonClient->setListener(nullptr);
+    if (memoryBudget) {
+        memoryBudget->charge(-chargedBytes);
+    }
+    // 发送队列引用socket，先于socket释放
+    delete clientQueue;
+    delete daemonQueue;
+    delete daemonClient;
+    delete boxClient;
+}
+
+bool DBusProxySession::socketReadable(DBusSocket *socket)
+{
+    if (socket == boxClient) {
+        return proxy->readClient(this);
+    }
+    return proxy->readServer(this);
+}
+
+/*
+ * 开启内核直通，dbus-daemon发给box客户端的大消息body通过splice转发
+ *
+ * @return bool: true:成功 false:创建管道失败
+ */
+bool DBusProxySession::enableSplice()
+{
+    spliceRelay.reset(new DBusSpliceRelay());
+    if (!spliceRelay->isValid()) {
+        spliceRelay.reset();
+        return false;
+    }
+    return true;
+}
+
+/*
+ * 客户端消息还需要解析的报文头字段，第一条消息尚未到达时用于识别Hello调用
+ *
+ * @return quint32: 字段掩码，不需要时为0
+ */
+quint32 DBusProxySession::clientHeaderFields() const
+{
+    return helloSent ? DBUS_HEADER_FIELDS_NONE : kHelloCallFields;
+}
+
+/*
+ * 记录客户端的第一条消息，是Hello调用时记录其serial
+ *
+ * @param header: 按clientHeaderFields解析的报文头
+ */
+void DBusProxySession::trackClientMessage(const DBusHeaderView &header)
+{
+    if (helloSent) {
+        return;
+    }
+    helloSent = true;
+    if (header.type == (int)MessageType::METHOD_CALL && header.member() == QLatin1String("Hello")
+        && header.interface() == QLatin1String("org.freedesktop.DBus")
+        && header.destination() == QLatin1String("org.freedesktop.DBus")) {
+        helloSerial = header.serial;
+    }
+}
+
+/*
+ * dbus-daemon消息还需要解析的报文头字段，等待Hello回复期间用于匹配回复
+ *
+ * @return quint32: 字段掩码，不需要时为0
+ */
+quint32 DBusProxySession::daemonHeaderFields() const
+{
+    return helloSerial != 0 ? kHelloReplyFields : DBUS_HEADER_FIELDS_NONE;
+}
+
+/*
+ * 匹配dbus-daemon对Hello的回复，回复的destination即分配给客户端的唯一名称
+ *
+ * @param header: 按daemonHeaderFields解析的报文头
+ *
+ * @return bool: true:得到了唯一名称 false:不是Hello回复
+ */
+bool DBusProxySession::trackDaemonMessage(const DBusHeaderView &header)
+{
+    if (helloSerial == 0 || header.type != (int)MessageType::METHOD_RETURN || !header.hasReplySerial
+        || header.replySerial != helloSerial) {
+        return false;
+    }
+    const QLatin1String destination = header.destination();
+    boxUniqueName = QByteArray(destination.data(), destination.size());
+    helloSerial = 0;
+    return true;
+}
+
+/*
+ * 获取会话当前缓存的数据
+ *
+ * @return DBusSessionUsage: 接收与发送两部分的字节数
+ */
+DBusSessionUsage DBusProxySession::usage() const
+{
+    DBusSessionUsage ret;
+    ret.inputBytes = clientReader.capacity() + daemonReader.capacity();
+    ret.outputBytes = clientQueue->queuedBytes() + daemonQueue->queuedBytes();
+    return ret;
+}
+
+/*
+ * 重新统计缓存的数据，把与上次统计的差值计入内存预算
+ *
+ * @return qint64: 会话当前缓存的字节数
+ */
+qint64 DBusProxySession::updateMemoryUsage()
+{
+    const DBusSessionUsage current = usage();
+    const qint64 total = current.inputBytes + current.outputBytes;
+    if (memoryBudget) {
+        memoryBudget->charge(total - chargedBytes);
+    }
+    chargedBytes = total;
+    return total;
+}
+
+// 任一方向的发送队列排空后恢复读取两端
+void DBusProxySession::onOutputQueueDrained()
+{
+    updateMemoryUsage();
+    proxy->resumeSession(this);
+}
@@ -0,0 +1,210 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_DBUS_PROXY_SRC_PROXY_DBUS_PROXY_SESSION_H
+#define LINGLONG_DBUS_PROXY_SRC_PROXY_DBUS_PROXY_SESSION_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QScopedPointer>
+#include <QSharedPointer>
+
+#include "message/dbus_auth_state.h"
+#include "message/dbus_frame_reader.h"
+#include "message/dbus_header_view.h"
+#include "proxy/dbus_memory_budget.h"
+#include "proxy/dbus_output_queue.h"
+#include "proxy/dbus_socket.h"
+#include "proxy/dbus_splice_relay.h"
+
+class DbusProxy;
+
+// 会话统计信息
+struct DBusSessionMetrics {
+    // 转发给dbus-daemon的消息数
+    quint64 clientMessages;
+    // 转发给box客户端的消息数
+    quint64 daemonMessages;
+    // 被过滤规则拒绝的消息数
+    quint64 deniedMessages;
+    // box客户端读取不及时时丢弃的广播信号数
+    quint64 droppedBroadcasts;
+};
+
+// 会话当前缓存的数据
+struct DBusSessionUsage {
+    // 两个消息重组器占用的接收缓冲区，字节
+    qint64 inputBytes;
+    // 两个方向发送队列中等待发送的数据，字节
+    qint64 outputBytes;
+};
+
+/*
+ * 一个box客户端与对应代理客户端组成的会话
+ *
+ * 持有两个socket、共用认证状态的两个消息重组器、两个方向的发送队列与内核直通管道，以及与dbus-daemon的连接状态、
+ * box客户端的唯一名称与统计信息。会话是两个socket的读取者，通过fromSocket由socket直接找到所属会话，
+ * 任一方向的读取、恢复与断开都不需要查找连接关系，开销与连接数无关。
+ * reactor模式下可读时直接调用代理的读取函数，不经过信号槽
+ */
+class DBusProxySession : public QObject, public DBusSocketListener
+{
+    Q_OBJECT
+
+public:
+    /*
+     * 创建会话并设置为两个socket的读取者，两个socket由会话持有，随会话释放
+     *
+     * @param proxy: 代理
+     * @param boxClient: box客户端
+     * @param daemonClient: 与dbus-daemon连接的代理客户端
+     * @param highWatermark: 发送队列高水位，字节
+     * @param lowWatermark: 发送队列低水位，字节
+     */
+    DBusProxySession(DbusProxy *proxy, DBusSocket *boxClient, DBusSocket *daemonClient, qint64 highWatermark,
+                     qint64 lowWatermark);
+    ~DBusProxySession() override;
+
+    /*
+     * 获取socket所属的会话
+     *
+     * @param socket: box客户端或代理客户端
+     *
+     * @return DBusProxySession*: 会话，socket不属于任何会话时返回nullptr
+     */
+    static DBusProxySession *fromSocket(DBusSocket *socket)
+    {
+        return socket ? static_cast<DBusProxySession *>(socket->socketListener()) : nullptr;
+    }
+
+    bool socketReadable(DBusSocket *socket) override;
+
+    /*
+     * 开启内核直通，dbus-daemon发给box客户端的大消息body通过splice转发
+     *
+     * @return bool: true:成功 false:创建管道失败
+     */
+    bool enableSplice();
+
+    /*
+     * 获取box客户端
+     *
+     * @return DBusSocket*: box客户端
+     */
+    DBusSocket *boxSocket() const { return boxClient; }
+
+    /*
+     * 获取与dbus-daemon连接的代理客户端
+     *
+     * @return DBusSocket*: 代理客户端
+     */
+    DBusSocket *daemonSocket() const { return daemonClient; }
+
+    /*
+     * 代理客户端是否已连接上dbus-daemon
+     *
+     * @return bool: true:已连接 false:连接中或已断开
+     */
+    bool isDaemonConnected() const { return daemonConnected; }
+
+    /*
+     * dbus-daemon分配给box客户端的唯一名称
+     *
+     * @return QByteArray: 唯一名称，Hello回复到达前为空
+     */
+    QByteArray uniqueName() const { return boxUniqueName; }
+
+    /*
+     * 获取会话统计信息
+     *
+     * @return DBusSessionMetrics: 统计信息
+     */
+    DBusSessionMetrics metrics() const { return stats; }
+
+    /*
+     * 获取会话当前缓存的数据
+     *
+     * @return DBusSessionUsage: 接收与发送两部分的字节数
+     */
+    DBusSessionUsage usage() const;
+
+    /*
+     * 设置会话计入的内存预算，会话释放时从预算中扣除已计入的用量
+     *
+     * @param budget: 内存预算
+     */
+    void setMemoryBudget(const QSharedPointer<DBusMemoryBudget> &budget) { memoryBudget = budget; }
+
+    /*
+     * 重新统计缓存的数据，把与上次统计的差值计入内存预算
+     *
+     * @return qint64: 会话当前缓存的字节数
+     */
+    qint64 updateMemoryUsage();
+
+    /*
+     * 客户端消息还需要解析的报文头字段，第一条消息尚未到达时用于识别Hello调用
+     *
+     * @return quint32: 字段掩码，不需要时为0
+     */
+    quint32 clientHeaderFields() const;
+
+    /*
+     * 记录客户端的第一条消息，是Hello调用时记录其serial
+     *
+     * @param header: 按clientHeaderFields解析的报文头
+     */
+    void trackClientMessage(const DBusHeaderView &header);
+
+    /*
+     * dbus-daemon消息还需要解析的报文头字段，等待Hello回复期间用于匹配回复
+     *
+     * @return quint32: 字段掩码，不需要时为0
+     */
+    quint32 daemonHeaderFields() const;
+
+    /*
+     * 匹配dbus-daemon对Hello的回复，回复的destination即分配给客户端的唯一名称
+     *
+     * @param header: 按daemonHeaderFields解析的报文头
+     *
+     * @return bool: true:得到了唯一名称 false:不是Hello回复
+     */
+    bool trackDaemonMessage(const DBusHeaderView &header);
+
+private slots:
+    // 任一方向的发送队列排空后恢复读取两端
+    void onOutputQueueDrained();
+
+private:
+    Q_DISABLE_COPY(DBusProxySession)
+    friend class DbusProxy;
+
+    DbusProxy *proxy;
+    DBusSocket *boxClient;
+    DBusSocket *daemonClient;
+    // 两个方向共用认证状态机，认证结束后各自切换为二进制消息
+    QSharedPointer<DBusAuthStateMachine> auth;
+    DBusFrameReader clientReader;
+    DBusFrameReader daemonReader;
+    // 发给box客户端与dbus-daemon的发送队列，以会话为父对象
+    DBusOutputQueue *clientQueue;
+    DBusOutputQueue *daemonQueue;
+    // 开启内核直通时的splice管道
+    QScopedPointer<DBusSpliceRelay> spliceRelay;
+    bool daemonConnected;
+    // 是否已收到客户端的第一条消息
+    bool helloSent;
+    // 等待回复的Hello调用serial，收到回复或不是Hello时为0
+    quint32 helloSerial;
+    // dbus-daemon在Hello回复中分配给box客户端的唯一名称
+    QByteArray boxUniqueName;
+    DBusSessionMetrics stats;
+    // 会话计入的内存预算与已计入的字节数
+    QSharedPointer<DBusMemoryBudget> memoryBudget;
+    qint64 chargedBytes;
+};
+#endif
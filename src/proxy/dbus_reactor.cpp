@@ -0,0 +1,608 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "dbus_reactor.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <QDebug>
+#include <QMetaObject>
+#include <QtAlgorithms>
+
+#include "proxy/dbus_socket.h"
+#include "proxy/dbus_uring.h"
+
+// 每次epoll_wait最多取回的事件数，也是每次取出的io_uring完成事件数
+static const int kMaxEvents = 256;
+// io_uring提交队列长度
+static const unsigned kUringEntries = 256;
+// io_uring接收缓冲区数量与大小，数据拷出后立即归还，只需容纳一轮中各连接同时到达的数据
+static const unsigned kUringBufferCount = 64;
+static const unsigned kUringBufferSize = 16 * 1024;
+// 缓存的空闲请求数上限
+static const int kMaxFreeOperations = 256;
+// 释放reactor时等待未完成请求结束的轮数与每轮等待时间，毫秒
+static const int kDrainRounds = 10;
+static const int kDrainTimeout = 10;
+
+// io_uring后端中的一个接收或发送请求，地址作为请求的用户数据
+struct DBusReactor::Operation {
+    Registration *registration;
+    bool receive;
+    // 发送的数据，请求完成前保持引用
+    QByteArray buffer;
+    // 随发送附加的文件描述符
+    QVector<int> fds;
+    iovec iov;
+    msghdr msg;
+    // 控制消息缓冲区，按cmsghdr对齐
+    union {
+        cmsghdr align;
+        char buffer[CMSG_SPACE(sizeof(int) * DBusSocket::kMaxFds)];
+    } control;
+};
+
+static void closeFds(const QVector<int> &fds)
+{
+    for (int item : fds) {
+        ::close(item);
+    }
+}
+
+/*
+ * io_uring后端收到数据，随后以EPOLLIN分发handleEvents
+ *
+ * @param data: 数据地址，调用返回后失效
+ * @param size: 数据长度
+ * @param fds: 随数据到达的文件描述符，所有权转移给处理者
+ * @param fdCount: 文件描述符数量
+ */
+void DBusReactorHandler::handleReceived(const char *data, qint64 size, const int *fds, int fdCount)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(size);
+    for (int i = 0; i < fdCount; i++) {
+        ::close(fds[i]);
+    }
+}
+
+/*
+ * io_uring后端一段发送完成
+ *
+ * @param result: 发送的字节数，出错时为负的errno
+ * @param expected: 提交的字节数
+ */
+void DBusReactorHandler::handleSent(qint64 result, qint64 expected)
+{
+    Q_UNUSED(result);
+    Q_UNUSED(expected);
+}
+
+/*
+ * 创建reactor
+ *
+ * @param preferred: 优先使用的后端，io_uring不可用时使用epoll
+ * @param parent: 父对象
+ */
+DBusReactor::DBusReactor(Backend preferred, QObject *parent)
+    : QObject(parent)
+    , currentBackend(Epoll)
+    , epollFd(-1)
+    , operationCount(0)
+    , dispatching(false)
+    , eventLoopQueued(false)
+{
+    stats = {0, 0, 0, 0};
+    if (preferred == IoUring) {
+        uring.reset(new DBusUring());
+        if (uring->init(kUringEntries, kUringBufferCount, kUringBufferSize)) {
+            currentBackend = IoUring;
+            return;
+        }
+        qWarning() << "io_uring is not available, fall back to epoll";
+        uring.reset();
+    }
+    epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+        qCritical() << "create epoll failed, errno:" << errno;
+    }
+}
+
+DBusReactor::~DBusReactor()
+{
+    notifier.reset();
+    // 内核中的请求仍引用请求中的数据，取消后等待结束，最后一个请求结束的注册项加入removed
+    QVector<Registration *> busy;
+    for (Registration *item : registrations) {
+        item->handler = nullptr;
+        if (uring && item->operations > 0) {
+            uring->prepareCancelFd(item->fd);
+            busy.append(item);
+        } else {
+            delete item;
+        }
+    }
+    registrations.clear();
+    if (uring) {
+        dispatching = true;
+        for (int i = 0; i < kDrainRounds && operationCount > 0; i++) {
+            uring->enter(kDrainTimeout);
+            reapCompletions();
+        }
+        dispatching = false;
+        uring.reset();
+    }
+    for (Registration *item : busy) {
+        if (item->operations > 0) {
+            delete item;
+        }
+    }
+    qDeleteAll(removed);
+    qDeleteAll(freeOperations);
+    if (epollFd >= 0) {
+        ::close(epollFd);
+    }
+}
+
+/*
+ * 注册描述符，同时关注可读、可写与对端关闭事件
+ *
+ * @param fd: 非阻塞描述符
+ * @param handler: 处理者，注销前必须保持有效
+ *
+ * @return bool: true:成功 false:失败
+ */
+bool DBusReactor::add(int fd, DBusReactorHandler *handler)
+{
+    if (!isValid() || fd < 0 || !handler || registrations.contains(handler)) {
+        return false;
+    }
+    Registration *item = new Registration{handler, fd, 0, false, false, 0, nullptr, false};
+    if (uring) {
+        registrations.insert(handler, item);
+        // 接收请求在下一次等待时与其它请求一起提交
+        startReceive(item);
+        scheduleEventLoop();
+        return true;
+    }
+    epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = item;
+    if (::epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        qCritical() << "epoll add fd" << fd << "failed, errno:" << errno;
+        delete item;
+        return false;
+    }
+    registrations.insert(handler, item);
+    return true;
+}
+
+/*
+ * 注销处理者，必须在关闭描述符之前调用，分发过程中调用也是安全的
+ *
+ * @param handler: 处理者
+ */
+void DBusReactor::remove(DBusReactorHandler *handler)
+{
+    Registration *item = registrations.take(handler);
+    if (!item) {
+        return;
+    }
+    readyList.removeAll(item);
+    // 本轮分发列表中可能还有该注册项，置空后跳过，本轮结束后释放
+    item->handler = nullptr;
+    if (uring) {
+        flushList.removeAll(item);
+        receiveList.removeAll(item);
+        if (item->operations > 0) {
+            // 取消请求需要在描述符关闭之前提交，最后一个请求结束时释放注册项
+            uring->prepareCancelFd(item->fd);
+            uring->enter(0);
+            return;
+        }
+    } else {
+        ::epoll_ctl(epollFd, EPOLL_CTL_DEL, item->fd, nullptr);
+    }
+    if (dispatching) {
+        removed.append(item);
+    } else {
+        delete item;
+    }
+}
+
+/*
+ * 把处理者加入就绪列表，在下一轮中以events分发，用于恢复暂停的读取或发送缓冲区中新写入的数据
+ *
+ * @param handler: 已注册的处理者
+ * @param events: 分发的epoll事件
+ */
+void DBusReactor::schedule(DBusReactorHandler *handler, quint32 events)
+{
+    Registration *item = registrations.value(handler);
+    if (!item) {
+        return;
+    }
+    // io_uring后端的发送不依赖可写事件，在本轮结束前提交，与其它连接的请求一起批量提交
+    if (uring && (events & EPOLLOUT)) {
+        events &= ~static_cast<quint32>(EPOLLOUT);
+        if (!item->flushQueued) {
+            item->flushQueued = true;
+            flushList.append(item);
+        }
+    }
+    if (events) {
+        markReady(item, events);
+    }
+    scheduleEventLoop();
+}
+
+void DBusReactor::markReady(Registration *item, quint32 events)
+{
+    item->pending |= events;
+    if (!item->ready) {
+        item->ready = true;
+        readyList.append(item);
+    }
+}
+
+/*
+ * io_uring后端提交一次发送，各段按顺序链接，前一段失败时后续段被取消，每段完成后调用处理者的handleSent
+ *
+ * @param handler: 已注册的处理者
+ * @param buffer: 数据所在缓冲区，发送完成前由reactor持有引用
+ * @param segments: 各段在缓冲区中的位置，文件描述符所有权转移给reactor，发送完成后关闭
+ *
+ * @return bool: true:成功 false:失败
+ */
+bool DBusReactor::submitSend(DBusReactorHandler *handler, const QByteArray &buffer,
+                             const QVector<DBusSendSegment> &segments)
+{
+    Registration *item = registrations.value(handler);
+    bool valid = uring && item && !segments.isEmpty();
+    for (const DBusSendSegment &segment : segments) {
+        valid = valid && segment.size > 0 && segment.offset >= 0 && segment.offset + segment.size <= buffer.size()
+            && segment.fds.size() <= DBusSocket::kMaxFds;
+    }
+    // 链接的请求必须在同一次提交中，提交队列剩余空间不足时先提交已有请求
+    if (!valid || !uring->reserve(static_cast<unsigned>(segments.size()))) {
+        for (const DBusSendSegment &segment : segments) {
+            closeFds(segment.fds);
+        }
+        return false;
+    }
+    for (int i = 0; i < segments.size(); i++) {
+        const DBusSendSegment &segment = segments.at(i);
+        Operation *operation = takeOperation(item);
+        operation->receive = false;
+        operation->buffer = buffer;
+        operation->fds = segment.fds;
+        operation->iov.iov_base = const_cast<char *>(operation->buffer.constData() + segment.offset);
+        operation->iov.iov_len = static_cast<size_t>(segment.size);
+        memset(&operation->msg, 0, sizeof(operation->msg));
+        operation->msg.msg_iov = &operation->iov;
+        operation->msg.msg_iovlen = 1;
+        if (!segment.fds.isEmpty()) {
+            const size_t length = sizeof(int) * static_cast<size_t>(segment.fds.size());
+            operation->msg.msg_control = operation->control.buffer;
+            operation->msg.msg_controllen = CMSG_SPACE(length);
+            cmsghdr *cmsg = CMSG_FIRSTHDR(&operation->msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(length);
+            memcpy(CMSG_DATA(cmsg), segment.fds.constData(), length);
+        }
+        const bool link = i + 1 < segments.size();
+        if (!uring->prepareSend(item->fd, &operation->msg, reinterpret_cast<quint64>(operation), link)) {
+            releaseOperation(operation);
+            for (int j = i + 1; j < segments.size(); j++) {
+                closeFds(segments.at(j).fds);
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * io_uring后端暂停或恢复接收，处理者缓存的数据过多时暂停，数据留在内核中对发送方形成反压
+ *
+ * @param handler: 已注册的处理者
+ * @param enable: true:恢复 false:暂停
+ */
+void DBusReactor::setReceiving(DBusReactorHandler *handler, bool enable)
+{
+    Registration *item = registrations.value(handler);
+    if (!uring || !item || item->receivePaused == !enable) {
+        return;
+    }
+    item->receivePaused = !enable;
+    if (!enable) {
+        // 取消结束后接收请求以ECANCELED结束，在此之前已收到的数据照常交给处理者
+        if (item->receive) {
+            uring->prepareCancelRequest(reinterpret_cast<quint64>(item->receive));
+            scheduleEventLoop();
+        }
+        return;
+    }
+    // 取消尚未结束时由接收请求结束时重新提交
+    if (!item->receive && !receiveList.contains(item)) {
+        receiveList.append(item);
+        scheduleEventLoop();
+    }
+}
+
+void DBusReactor::startReceive(Registration *item)
+{
+    Operation *operation = takeOperation(item);
+    operation->receive = true;
+    // multishot recvmsg只使用地址与控制消息的长度，在每个接收缓冲区开头为其预留空间
+    memset(&operation->msg, 0, sizeof(operation->msg));
+    operation->msg.msg_controllen = sizeof(operation->control.buffer);
+    if (!uring->prepareReceive(item->fd, &operation->msg, reinterpret_cast<quint64>(operation))) {
+        releaseOperation(operation);
+        markReady(item, EPOLLERR);
+        return;
+    }
+    item->receive = operation;
+}
+
+/*
+ * 等待并分发一轮事件，就绪列表不为空时不等待
+ *
+ * @param timeout: 等待时间，毫秒，-1表示一直等待
+ *
+ * @return int: 本轮分发的事件数，出错返回-1
+ */
+int DBusReactor::poll(int timeout)
+{
+    if (!isValid() || dispatching) {
+        return -1;
+    }
+    const int wait = readyList.isEmpty() && flushList.isEmpty() && receiveList.isEmpty() ? timeout : 0;
+    if (uring) {
+        // 上一轮各连接产生的请求与等待合并为一次系统调用
+        if (uring->enter(wait) < 0) {
+            return -1;
+        }
+        stats.wakeups++;
+        dispatching = true;
+        reapCompletions();
+    } else {
+        epoll_event events[kMaxEvents];
+        stats.syscalls++;
+        const int count = ::epoll_wait(epollFd, events, kMaxEvents, wait);
+        if (count < 0 && errno != EINTR) {
+            qCritical() << "epoll wait failed, errno:" << errno;
+            return -1;
+        }
+        stats.wakeups++;
+        for (int i = 0; i < count; i++) {
+            markReady(static_cast<Registration *>(events[i].data.ptr), events[i].events);
+        }
+        dispatching = true;
+    }
+
+    // 本轮只处理当前就绪的描述符，分发过程中新就绪的留到下一轮
+    dispatchList.swap(readyList);
+    int dispatched = 0;
+    for (Registration *item : dispatchList) {
+        if (!item->handler) {
+            continue;
+        }
+        const quint32 pending = item->pending;
+        item->pending = 0;
+        item->ready = false;
+        dispatched++;
+        const bool more = item->handler->handleEvents(pending);
+        // 处理过程中可能已注销
+        if (more && item->handler) {
+            markReady(item, EPOLLIN);
+            stats.deferred++;
+        }
+    }
+    dispatchList.resize(0);
+    if (uring) {
+        // 本轮写入的数据与需要恢复的接收一起提交，发送过程中可能追加新的注册项
+        for (int i = 0; i < flushList.size(); i++) {
+            Registration *item = flushList.at(i);
+            item->flushQueued = false;
+            if (item->handler) {
+                item->handler->handleEvents(EPOLLOUT);
+            }
+        }
+        flushList.resize(0);
+        for (Registration *item : receiveList) {
+            if (item->handler && !item->receive && !item->receivePaused) {
+                startReceive(item);
+            }
+        }
+        receiveList.resize(0);
+    }
+    dispatching = false;
+    qDeleteAll(removed);
+    removed.resize(0);
+    stats.dispatches += static_cast<quint64>(dispatched);
+    // 挂在Qt事件循环中时只在有完成事件时唤醒，本轮产生的请求需要立即提交
+    if (uring && notifier && uring->pendingSubmissions() > 0) {
+        uring->enter(0);
+    }
+    return dispatched;
+}
+
+void DBusReactor::reapCompletions()
+{
+    DBusUringCompletion completions[kMaxEvents];
+    unsigned count = 0;
+    do {
+        count = uring->reap(completions, kMaxEvents);
+        for (unsigned i = 0; i < count; i++) {
+            const DBusUringCompletion &completion = completions[i];
+            // 取消请求自身的完成事件
+            if (completion.userData == 0) {
+                continue;
+            }
+            Operation *operation = reinterpret_cast<Operation *>(completion.userData);
+            if (operation->receive) {
+                completeReceive(operation, completion);
+            } else {
+                completeSend(operation, completion);
+            }
+        }
+    } while (count == static_cast<unsigned>(kMaxEvents));
+}
+
+void DBusReactor::completeReceive(Operation *operation, const DBusUringCompletion &completion)
+{
+    Registration *item = operation->registration;
+    quint32 events = 0;
+    const int bufferId = completion.bufferId();
+    if (bufferId >= 0) {
+        DBusUringMessage message;
+        if (uring->parseReceived(&operation->msg, completion, &message)) {
+            int fds[DBusSocket::kMaxFds];
+            int fdCount = 0;
+            for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message.control); cmsg;
+                 cmsg = CMSG_NXTHDR(&message.control, cmsg)) {
+                if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+                    continue;
+                }
+                const int count = static_cast<int>((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+                for (int i = 0; i < count && fdCount < DBusSocket::kMaxFds; i++) {
+                    memcpy(&fds[fdCount++], CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                }
+            }
+            if (message.truncated) {
+                qCritical() << "io_uring received message truncated, fd:" << item->fd;
+            }
+            if (item->handler && (message.payloadSize > 0 || fdCount > 0)) {
+                item->handler->handleReceived(message.payload, message.payloadSize, fds, fdCount);
+            } else {
+                for (int i = 0; i < fdCount; i++) {
+                    ::close(fds[i]);
+                }
+            }
+            // 流式socket收到0字节表示对端已关闭写端
+            events |= message.payloadSize > 0 ? EPOLLIN : EPOLLRDHUP;
+        } else {
+            events |= EPOLLERR;
+        }
+        uring->recycleBuffer(bufferId);
+    } else if (completion.result < 0 && completion.result != -ENOBUFS && completion.result != -ECANCELED) {
+        events |= EPOLLERR;
+    }
+    if (!completion.hasMore()) {
+        item->receive = nullptr;
+        // 接收缓冲区用完或内核结束了multishot请求，连接正常且未暂停时本轮结束前重新提交
+        if (item->handler && !item->receivePaused && !(events & (EPOLLERR | EPOLLRDHUP))) {
+            receiveList.append(item);
+        }
+    }
+    if (events && item->handler) {
+        markReady(item, events);
+    }
+    if (!completion.hasMore()) {
+        releaseOperation(operation);
+    }
+}
+
+void DBusReactor::completeSend(Operation *operation, const DBusUringCompletion &completion)
+{
+    DBusReactorHandler *handler = operation->registration->handler;
+    const qint64 expected = static_cast<qint64>(operation->iov.iov_len);
+    // 先释放数据引用，处理者可以直接复用发送缓冲区
+    operation->buffer = QByteArray();
+    if (handler) {
+        handler->handleSent(completion.result, expected);
+    }
+    releaseOperation(operation);
+}
+
+DBusReactor::Operation *DBusReactor::takeOperation(Registration *item)
+{
+    Operation *operation = nullptr;
+    if (freeOperations.isEmpty()) {
+        operation = new Operation();
+    } else {
+        operation = freeOperations.takeLast();
+    }
+    operation->registration = item;
+    item->operations++;
+    operationCount++;
+    return operation;
+}
+
+void DBusReactor::releaseOperation(Operation *operation)
+{
+    Registration *item = operation->registration;
+    closeFds(operation->fds);
+    operation->fds.resize(0);
+    operation->buffer = QByteArray();
+    operation->registration = nullptr;
+    if (freeOperations.size() < kMaxFreeOperations) {
+        freeOperations.append(operation);
+    } else {
+        delete operation;
+    }
+    operationCount--;
+    if (--item->operations == 0 && !item->handler) {
+        if (dispatching) {
+            removed.append(item);
+        } else {
+            delete item;
+        }
+    }
+}
+
+/*
+ * 挂到当前线程的Qt事件循环中，epoll描述符可读时分发一轮事件
+ */
+void DBusReactor::attachToEventLoop()
+{
+    if (!isValid() || notifier) {
+        return;
+    }
+    // io_uring描述符在完成队列不为空时可读
+    notifier.reset(new QSocketNotifier(uring ? uring->descriptor() : epollFd, QSocketNotifier::Read));
+    connect(notifier.data(), SIGNAL(activated(int)), this, SLOT(onActivated()));
+}
+
+/*
+ * 获取统计信息
+ *
+ * @return DBusReactorMetrics: 统计信息
+ */
+DBusReactorMetrics DBusReactor::metrics() const
+{
+    DBusReactorMetrics ret = stats;
+    if (uring) {
+        ret.syscalls += uring->enterCount();
+    }
+    return ret;
+}
+
+void DBusReactor::onActivated()
+{
+    eventLoopQueued = false;
+    poll(0);
+    // 还有用完预算的连接时排队继续分发，让其它Qt事件有机会处理
+    if (!readyList.isEmpty() || !flushList.isEmpty() || !receiveList.isEmpty()) {
+        scheduleEventLoop();
+    }
+}
+
+void DBusReactor::scheduleEventLoop()
+{
+    if (!notifier || eventLoopQueued) {
+        return;
+    }
+    eventLoopQueued = true;
+    QMetaObject::invokeMethod(this, "onActivated", Qt::QueuedConnection);
+}
@@ -0,0 +1,286 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_DBUS_PROXY_SRC_PROXY_DBUS_REACTOR_H
+#define LINGLONG_DBUS_PROXY_SRC_PROXY_DBUS_REACTOR_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QObject>
+#include <QScopedPointer>
+#include <QSocketNotifier>
+#include <QVector>
+
+class DBusUring;
+struct DBusUringCompletion;
+
+// reactor统计信息
+struct DBusReactorMetrics {
+    // epoll_wait返回的次数
+    quint64 wakeups;
+    // 分发给处理者的事件次数
+    quint64 dispatches;
+    // 读取预算用完后推迟到下一轮继续处理的次数
+    quint64 deferred;
+    // reactor自身的系统调用次数，epoll_wait或io_uring_enter
+    quint64 syscalls;
+};
+
+// io_uring后端一次发送中的一段，文件描述符附加在该段的第一个字节上
+struct DBusSendSegment {
+    qint64 offset;
+    qint64 size;
+    QVector<int> fds;
+};
+
+/*
+ * 注册到reactor中的描述符处理者
+ */
+class DBusReactorHandler
+{
+public:
+    virtual ~DBusReactorHandler() {}
+
+    /*
+     * 描述符就绪，边沿触发，处理者需要读到没有数据或用完本轮读取预算
+     *
+     * @param events: 就绪的epoll事件
+     *
+     * @return bool: true:读取预算用完仍有数据，下一轮继续处理 false:本轮已处理完
+     */
+    virtual bool handleEvents(quint32 events) = 0;
+
+    /*
+     * io_uring后端收到数据，随后以EPOLLIN分发handleEvents
+     *
+     * @param data: 数据地址，调用返回后失效
+     * @param size: 数据长度
+     * @param fds: 随数据到达的文件描述符，所有权转移给处理者
+     * @param fdCount: 文件描述符数量
+     */
+    virtual void handleReceived(const char *data, qint64 size, const int *fds, int fdCount);
+
+    /*
+     * io_uring后端一段发送完成
+     *
+     * @param result: 发送的字节数，出错时为负的errno
+     * @param expected: 提交的字节数
+     */
+    virtual void handleSent(qint64 result, qint64 expected);
+};
+
+/*
+ * 事件分发
+ *
+ * 描述符就绪后直接调用对应的处理者，不经过信号槽与sender查找。每轮先收集内核事件，再依次分发就绪列表；
+ * 处理者用完读取预算时排到就绪列表末尾，下一轮继续处理，保证多个连接之间轮流读取。
+ * 可以由poll在独立循环中驱动，也可以通过attachToEventLoop挂到Qt事件循环中。
+ *
+ * 默认使用边沿触发epoll。选择io_uring时每个描述符提交一个multishot recvmsg，数据由内核写入共享的接收缓冲区，
+ * 发送以链接的sendmsg提交；所有连接本轮产生的请求在下一次等待时一次系统调用批量提交。
+ * 内核不支持io_uring时回退到epoll
+ */
+class DBusReactor : public QObject
+{
+    Q_OBJECT
+
+public:
+    // 读写事件的来源
+    enum Backend {
+        // 边沿触发epoll，就绪后由处理者自己读写
+        Epoll,
+        // io_uring，由reactor批量提交接收与发送请求
+        IoUring,
+    };
+
+    /*
+     * 创建reactor
+     *
+     * @param preferred: 优先使用的后端，io_uring不可用时使用epoll
+     * @param parent: 父对象
+     */
+    explicit DBusReactor(Backend preferred = Epoll, QObject *parent = nullptr);
+    ~DBusReactor() override;
+
+    /*
+     * 后端是否创建成功
+     *
+     * @return bool: true:可用 false:不可用
+     */
+    bool isValid() const { return epollFd >= 0 || uring; }
+
+    /*
+     * 实际使用的后端
+     *
+     * @return Backend: 后端
+     */
+    Backend backend() const { return currentBackend; }
+
+    /*
+     * 注册描述符，同时关注可读、可写与对端关闭事件
+     *
+     * @param fd: 非阻塞描述符
+     * @param handler: 处理者，注销前必须保持有效
+     *
+     * @return bool: true:成功 false:失败
+     */
+    bool add(int fd, DBusReactorHandler *handler);
+
+    /*
+     * 注销处理者，必须在关闭描述符之前调用，分发过程中调用也是安全的
+     *
+     * @param handler: 处理者
+     */
+    void remove(DBusReactorHandler *handler);
+
+    /*
+     * 把处理者加入就绪列表，在下一轮中以events分发，用于恢复暂停的读取或发送缓冲区中新写入的数据
+     *
+     * @param handler: 已注册的处理者
+     * @param events: 分发的epoll事件
+     */
+    void schedule(DBusReactorHandler *handler, quint32 events);
+
+    /*
+     * io_uring后端提交一次发送，各段按顺序链接，前一段失败时后续段被取消，每段完成后调用处理者的handleSent
+     *
+     * @param handler: 已注册的处理者
+     * @param buffer: 数据所在缓冲区，发送完成前由reactor持有引用
+     * @param segments: 各段在缓冲区中的位置，文件描述符所有权转移给reactor，发送完成后关闭
+     *
+     * @return bool: true:成功 false:失败
+     */
+    bool submitSend(DBusReactorHandler *handler, const QByteArray &buffer, const QVector<DBusSendSegment> &segments);
+
+    /*
+     * io_uring后端暂停或恢复接收，处理者缓存的数据过多时暂停，数据留在内核中对发送方形成反压
+     *
+     * @param handler: 已注册的处理者
+     * @param enable: true:恢复 false:暂停
+     */
+    void setReceiving(DBusReactorHandler *handler, bool enable);
+
+    /*
+     * 等待并分发一轮事件，就绪列表不为空时不等待
+     *
+     * @param timeout: 等待时间，毫秒，-1表示一直等待
+     *
+     * @return int: 本轮分发的事件数，出错返回-1
+     */
+    int poll(int timeout);
+
+    /*
+     * 挂到当前线程的Qt事件循环中，epoll描述符可读时分发一轮事件
+     */
+    void attachToEventLoop();
+
+    /*
+     * 获取统计信息
+     *
+     * @return DBusReactorMetrics: 统计信息
+     */
+    DBusReactorMetrics metrics() const;
+
+private slots:
+    void onActivated();
+
+private:
+    struct Operation;
+
+    // 一个已注册的描述符
+    struct Registration {
+        DBusReactorHandler *handler;
+        int fd;
+        // 等待分发的事件
+        quint32 pending;
+        // 是否已在就绪列表中
+        bool ready;
+        // io_uring后端：是否已在发送列表中
+        bool flushQueued;
+        // io_uring后端：未完成的请求数，为0后才能释放
+        int operations;
+        // io_uring后端：未结束的接收请求
+        Operation *receive;
+        // io_uring后端：处理者暂停了接收
+        bool receivePaused;
+    };
+
+    /*
+     * 把注册项加入就绪列表
+     *
+     * @param item: 注册项
+     * @param events: 等待分发的事件
+     */
+    void markReady(Registration *item, quint32 events);
+
+    // 在Qt事件循环中排队分发下一轮
+    void scheduleEventLoop();
+
+    /*
+     * 提交io_uring接收请求，失败时以EPOLLERR分发
+     *
+     * @param item: 注册项
+     */
+    void startReceive(Registration *item);
+
+    // 取出并处理所有io_uring完成事件
+    void reapCompletions();
+
+    /*
+     * 处理接收请求的完成事件
+     *
+     * @param operation: 接收请求
+     * @param completion: 完成事件
+     */
+    void completeReceive(Operation *operation, const DBusUringCompletion &completion);
+
+    /*
+     * 处理发送请求的完成事件
+     *
+     * @param operation: 发送请求
+     * @param completion: 完成事件
+     */
+    void completeSend(Operation *operation, const DBusUringCompletion &completion);
+
+    /*
+     * 取一个空闲的请求
+     *
+     * @param item: 所属注册项
+     *
+     * @return Operation*: 请求
+     */
+    Operation *takeOperation(Registration *item);
+
+    /*
+     * 请求结束，关闭未发送的文件描述符，所属注册项已注销且没有其它请求时释放
+     *
+     * @param operation: 请求
+     */
+    void releaseOperation(Operation *operation);
+
+    Backend currentBackend;
+    int epollFd;
+    QScopedPointer<DBusUring> uring;
+    QScopedPointer<QSocketNotifier> notifier;
+    QHash<DBusReactorHandler *, Registration *> registrations;
+    // 就绪列表，分发时与dispatchList交换，避免每轮分配内存
+    QVector<Registration *> readyList;
+    QVector<Registration *> dispatchList;
+    // 分发过程中注销的注册项，本轮结束后释放
+    QVector<Registration *> removed;
+    // io_uring后端：本轮结束前需要提交发送的注册项
+    QVector<Registration *> flushList;
+    // io_uring后端：本轮结束前需要重新提交接收的注册项
+    QVector<Registration *> receiveList;
+    // io_uring后端：已结束的请求，重复使用
+    QVector<Operation *> freeOperations;
+    // io_uring后端：未完成的请求数
+    int operationCount;
+    bool dispatching;
+    bool eventLoopQueued;
+    DBusReactorMetrics stats;
+};
+#endif
@@ -0,0 +1,743 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "dbus_socket.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <QDebug>
+#include <QFile>
+
+const int DBusSocket::kMaxFds;
+
+// 发送缓冲区前部已发送的数据超过该大小时搬移剩余数据
+static const int kCompactThreshold = 64 * 1024;
+// 完成模式下缓存的未读数据超过该大小时暂停接收，读取到低于低水位后恢复
+static const qint64 kReceiveHighWatermark = 1024 * 1024;
+static const qint64 kReceiveLowWatermark = 256 * 1024;
+// 完成模式下一次提交最多链接的发送段数，每段以携带文件描述符的消息开始
+static const int kMaxLinkedSends = 16;
+
+// 控制消息缓冲区，按cmsghdr对齐
+union DBusFdControl {
+    cmsghdr align;
+    char buffer[CMSG_SPACE(sizeof(int) * DBusSocket::kMaxFds)];
+};
+
+static void closeFds(const QVector<int> &fds)
+{
+    for (int item : fds) {
+        ::close(item);
+    }
+}
+
+DBusSocket::DBusSocket(QObject *parent)
+    : QIODevice(parent)
+    , fd(-1)
+    , reactor(nullptr)
+    , listener(nullptr)
+    , peerHungUp(false)
+    , socketState(QLocalSocket::UnconnectedState)
+    , socketError(QLocalSocket::UnknownSocketError)
+    , readNotified(false)
+    , writeOffset(0)
+    , readOffset(0)
+    , receivedTotal(0)
+    , readTotal(0)
+    , receivePaused(false)
+    , inflightBytes(0)
+{
+}
+
+DBusSocket::~DBusSocket()
+{
+    readNotifier.reset();
+    writeNotifier.reset();
+    if (fd >= 0) {
+        if (reactor) {
+            reactor->remove(this);
+        }
+        ::close(fd);
+    }
+    closeFds(receivedFds.toVector());
+    for (const PendingFds &item : pendingFds) {
+        closeFds(item.fds);
+    }
+    for (const PendingFds &item : bufferedFds) {
+        closeFds(item.fds);
+    }
+}
+
+/*
+ * 连接本地socket，立即返回，结果通过connected或error信号通知
+ *
+ * @param name: socket路径
+ */
+void DBusSocket::connectToServer(const QString &name)
+{
+    if (socketState != QLocalSocket::UnconnectedState) {
+        qWarning() << this << "connectToServer called while socket is in use";
+        return;
+    }
+    const QByteArray path = QFile::encodeName(name);
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.isEmpty() || path.size() >= static_cast<int>(sizeof(addr.sun_path))) {
+        setSocketError(QLocalSocket::ServerNotFoundError, QStringLiteral("invalid socket path: ") + name);
+        return;
+    }
+    memcpy(addr.sun_path, path.constData(), static_cast<size_t>(path.size()));
+
+    const int socketFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (socketFd < 0) {
+        setSocketError(QLocalSocket::SocketResourceError, QString::fromLocal8Bit(strerror(errno)));
+        return;
+    }
+    // 本地socket的connect不会返回EINPROGRESS，监听队列满时返回EAGAIN，由调用方重试
+    int ret = 0;
+    do {
+        ret = ::connect(socketFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    } while (ret < 0 && errno == EINTR);
+    if (ret != 0) {
+        const int err = errno;
+        ::close(socketFd);
+        QLocalSocket::LocalSocketError type = QLocalSocket::UnknownSocketError;
+        if (err == ENOENT) {
+            type = QLocalSocket::ServerNotFoundError;
+        } else if (err == ECONNREFUSED || err == EAGAIN) {
+            type = QLocalSocket::ConnectionRefusedError;
+        } else if (err == EACCES || err == EPERM) {
+            type = QLocalSocket::SocketAccessError;
+        }
+        setSocketError(type, QString::fromLocal8Bit(strerror(err)));
+        return;
+    }
+    fd = socketFd;
+    socketState = QLocalSocket::ConnectedState;
+    QIODevice::open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+    startNotifiers();
+    emit connected();
+}
+
+/*
+ * 接管已连接的socket描述符
+ *
+ * @param socketDescriptor: socket描述符，成功后由该对象关闭
+ *
+ * @return bool: true:成功 false:失败
+ */
+bool DBusSocket::setSocketDescriptor(qintptr socketDescriptor)
+{
+    const int socketFd = static_cast<int>(socketDescriptor);
+    if (socketState != QLocalSocket::UnconnectedState || socketFd < 0) {
+        return false;
+    }
+    const int flags = ::fcntl(socketFd, F_GETFL);
+    if (flags < 0 || ::fcntl(socketFd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        qWarning() << "set socket descriptor" << socketFd << "non-blocking failed, errno:" << errno;
+        return false;
+    }
+    ::fcntl(socketFd, F_SETFD, FD_CLOEXEC);
+    fd = socketFd;
+    socketState = QLocalSocket::ConnectedState;
+    QIODevice::open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+    startNotifiers();
+    return true;
+}
+
+void DBusSocket::startNotifiers()
+{
+    if (reactor) {
+        if (reactor->add(fd, this)) {
+            return;
+        }
+        qWarning() << this << "register to reactor failed, fall back to socket notifiers";
+        reactor = nullptr;
+    }
+    readNotifier.reset(new QSocketNotifier(fd, QSocketNotifier::Read));
+    connect(readNotifier.data(), SIGNAL(activated(int)), this, SLOT(onReadActivated()));
+    writeNotifier.reset(new QSocketNotifier(fd, QSocketNotifier::Write));
+    writeNotifier->setEnabled(false);
+    connect(writeNotifier.data(), SIGNAL(activated(int)), this, SLOT(onWriteActivated()));
+}
+
+/*
+ * 发送完缓冲区中的数据后断开连接
+ */
+void DBusSocket::disconnectFromServer()
+{
+    if (socketState == QLocalSocket::UnconnectedState || socketState == QLocalSocket::ClosingState) {
+        return;
+    }
+    if (bytesToWrite() > 0) {
+        // 剩余数据发送完后在flushWriteBuffer中关闭
+        socketState = QLocalSocket::ClosingState;
+        if (readNotifier) {
+            readNotifier->setEnabled(false);
+        }
+        return;
+    }
+    closeSocket();
+}
+
+/*
+ * 立即断开连接，丢弃未发送的数据
+ */
+void DBusSocket::abort()
+{
+    closeSocket();
+}
+
+void DBusSocket::close()
+{
+    disconnectFromServer();
+}
+
+void DBusSocket::closeSocket()
+{
+    const bool wasConnected =
+        socketState == QLocalSocket::ConnectedState || socketState == QLocalSocket::ClosingState;
+    // 可能在通知回调中关闭，通知对象延迟释放
+    for (QSocketNotifier *notifier : {readNotifier.take(), writeNotifier.take()}) {
+        if (notifier) {
+            notifier->setEnabled(false);
+            notifier->deleteLater();
+        }
+    }
+    if (fd >= 0) {
+        if (reactor) {
+            reactor->remove(this);
+        }
+        ::close(fd);
+        fd = -1;
+    }
+    peerHungUp = false;
+    QVector<int> fds;
+    takeFds(receivedFds.size(), &fds);
+    closeFds(fds);
+    while (!pendingFds.isEmpty()) {
+        closeFds(pendingFds.dequeue().fds);
+    }
+    writeBuffer.clear();
+    writeOffset = 0;
+    readBuffer.clear();
+    readOffset = 0;
+    while (!bufferedFds.isEmpty()) {
+        closeFds(bufferedFds.dequeue().fds);
+    }
+    receivedTotal = 0;
+    readTotal = 0;
+    receivePaused = false;
+    // 已提交的数据由reactor持有引用直到请求结束
+    inflightBuffer.clear();
+    inflightBytes = 0;
+    readNotified = false;
+    socketState = QLocalSocket::UnconnectedState;
+    if (isOpen()) {
+        QIODevice::close();
+    }
+    if (wasConnected) {
+        emit disconnected();
+    }
+}
+
+void DBusSocket::setSocketError(QLocalSocket::LocalSocketError error, const QString &message)
+{
+    socketError = error;
+    setErrorString(message);
+    emit this->error(error);
+}
+
+qint64 DBusSocket::bytesAvailable() const
+{
+    if (isCompletionMode()) {
+        return readBuffer.size() - readOffset + QIODevice::bytesAvailable();
+    }
+    int available = 0;
+    if (fd < 0 || ::ioctl(fd, FIONREAD, &available) != 0) {
+        available = 0;
+    }
+    return available + QIODevice::bytesAvailable();
+}
+
+/*
+ * 按到达顺序取出文件描述符，所有权转移给调用方
+ *
+ * @param count: 数量
+ * @param fds: 输出文件描述符
+ *
+ * @return bool: true:成功 false:已收到的文件描述符不足，不取出
+ */
+bool DBusSocket::takeFds(int count, QVector<int> *fds)
+{
+    if (count < 0 || count > receivedFds.size()) {
+        return false;
+    }
+    fds->reserve(fds->size() + count);
+    for (int i = 0; i < count; i++) {
+        fds->append(receivedFds.dequeue());
+    }
+    return true;
+}
+
+/*
+ * 调用方绕过read直接从描述符读取数据(如splice)后调用，恢复可读通知
+ */
+void DBusSocket::notifyExternalRead()
+{
+    readNotified = false;
+    if (readNotifier && socketState == QLocalSocket::ConnectedState) {
+        readNotifier->setEnabled(true);
+    }
+}
+
+qint64 DBusSocket::readData(char *data, qint64 maxSize)
+{
+    if (fd < 0) {
+        return -1;
+    }
+    if (isCompletionMode()) {
+        const qint64 size = qMin(maxSize, readBuffer.size() - readOffset);
+        memcpy(data, readBuffer.constData() + readOffset, static_cast<size_t>(size));
+        readOffset += size;
+        readTotal += size;
+        while (!bufferedFds.isEmpty() && bufferedFds.head().position < readTotal) {
+            for (int item : bufferedFds.dequeue().fds) {
+                receivedFds.enqueue(item);
+            }
+        }
+        if (readOffset == readBuffer.size()) {
+            readBuffer.resize(0);
+            readOffset = 0;
+        }
+        if (receivePaused && readBuffer.size() - readOffset < kReceiveLowWatermark) {
+            receivePaused = false;
+            reactor->setReceiving(this, true);
+        }
+        if (peerHungUp) {
+            reactor->schedule(this, EPOLLRDHUP);
+        }
+        return size;
+    }
+    notifyExternalRead();
+    iovec iov;
+    iov.iov_base = data;
+    iov.iov_len = static_cast<size_t>(maxSize);
+    DBusFdControl control;
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+    ssize_t ret = 0;
+    do {
+        ret = ::recvmsg(fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        // 连接错误由可读通知统一处理
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        const size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; i++) {
+            int item = -1;
+            memcpy(&item, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            receivedFds.enqueue(item);
+        }
+    }
+    if (msg.msg_flags & MSG_CTRUNC) {
+        qCritical() << this << "received file descriptors truncated";
+    }
+    // 对端关闭后不会再有边沿事件，读取后由reactor再检查一次是否已读完
+    if (reactor && peerHungUp) {
+        reactor->schedule(this, EPOLLRDHUP);
+    }
+    return ret;
+}
+
+qint64 DBusSocket::writeData(const char *data, qint64 size)
+{
+    return writeWithFds(data, size, QVector<int>());
+}
+
+/*
+ * 发送数据，文件描述符随数据的第一个字节发送，不阻塞
+ *
+ * @param data: 数据地址，调用返回后即可释放
+ * @param size: 数据长度
+ * @param fds: 文件描述符，所有权转移给该对象，发送后关闭
+ *
+ * @return qint64: 写入的字节数，失败返回-1
+ */
+qint64 DBusSocket::writeWithFds(const char *data, qint64 size, const QVector<int> &fds)
+{
+    if (socketState != QLocalSocket::ConnectedState || size <= 0 || fds.size() > kMaxFds) {
+        closeFds(fds);
+        setErrorString(QStringLiteral("socket is not writable"));
+        return -1;
+    }
+    if (!fds.isEmpty()) {
+        PendingFds item;
+        item.position = writeBuffer.size();
+        item.fds = fds;
+        pendingFds.enqueue(item);
+    }
+    const bool wasEmpty = bytesToWrite() == 0;
+    writeBuffer.append(data, static_cast<int>(size));
+    if (writeNotifier) {
+        writeNotifier->setEnabled(true);
+    } else if (reactor && wasEmpty) {
+        // 边沿触发下内核缓冲区一直可写时不会再有可写事件，由reactor在下一轮发送
+        reactor->schedule(this, EPOLLOUT);
+    }
+    return size;
+}
+
+/*
+ * 发送一次数据，文件描述符附加在第一个字节上，不阻塞
+ *
+ * @param socketDescriptor: socket描述符
+ * @param iov: 数据段
+ * @param count: 数据段数量
+ * @param fds: 文件描述符，发送成功后仍由调用方关闭
+ * @param fdCount: 文件描述符数量
+ *
+ * @return qint64: 发送的字节数，失败返回-1并保留errno
+ */
+qint64 DBusSocket::sendWithFds(int socketDescriptor, const iovec *iov, int count, const int *fds, int fdCount)
+{
+    if (fdCount > kMaxFds) {
+        errno = EINVAL;
+        return -1;
+    }
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = const_cast<iovec *>(iov);
+    msg.msg_iovlen = static_cast<size_t>(count);
+    DBusFdControl control;
+    if (fdCount > 0) {
+        const size_t length = sizeof(int) * static_cast<size_t>(fdCount);
+        msg.msg_control = control.buffer;
+        msg.msg_controllen = CMSG_SPACE(length);
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(length);
+        memcpy(CMSG_DATA(cmsg), fds, length);
+    }
+    ssize_t ret = 0;
+    do {
+        ret = ::sendmsg(socketDescriptor, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+/*
+ * 发送缓冲区中的数据，直到内核缓冲区满
+ *
+ * @return qint64: 发送的字节数，出错返回-1
+ */
+qint64 DBusSocket::flushWriteBuffer()
+{
+    if (isCompletionMode()) {
+        return submitWriteBuffer();
+    }
+    qint64 written = 0;
+    while (fd >= 0 && writeOffset < writeBuffer.size()) {
+        // 文件描述符只能附加在一次发送的第一个字节上，按附加位置分段发送
+        qint64 size = writeBuffer.size() - writeOffset;
+        const PendingFds *attach = nullptr;
+        if (!pendingFds.isEmpty()) {
+            if (pendingFds.head().position == writeOffset) {
+                attach = &pendingFds.head();
+                if (pendingFds.size() > 1) {
+                    size = qMin(size, pendingFds.at(1).position - writeOffset);
+                }
+            } else {
+                size = qMin(size, pendingFds.head().position - writeOffset);
+            }
+        }
+        iovec iov;
+        iov.iov_base = const_cast<char *>(writeBuffer.constData() + writeOffset);
+        iov.iov_len = static_cast<size_t>(size);
+        const qint64 ret = sendWithFds(fd, &iov, 1, attach ? attach->fds.constData() : nullptr,
+                                       attach ? attach->fds.size() : 0);
+        if (ret < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            setSocketError(QLocalSocket::PeerClosedError, QString::fromLocal8Bit(strerror(errno)));
+            closeSocket();
+            return -1;
+        }
+        if (attach) {
+            closeFds(pendingFds.dequeue().fds);
+        }
+        writeOffset += ret;
+        written += ret;
+    }
+    if (writeOffset == writeBuffer.size()) {
+        writeBuffer.clear();
+        writeOffset = 0;
+    } else if (writeOffset >= kCompactThreshold) {
+        writeBuffer.remove(0, static_cast<int>(writeOffset));
+        for (PendingFds &item : pendingFds) {
+            item.position -= writeOffset;
+        }
+        writeOffset = 0;
+    }
+    if (writeNotifier) {
+        writeNotifier->setEnabled(bytesToWrite() > 0);
+    }
+    if (written > 0) {
+        emit bytesWritten(written);
+    }
+    if (socketState == QLocalSocket::ClosingState && bytesToWrite() == 0) {
+        closeSocket();
+    }
+    return written;
+}
+
+bool DBusSocket::waitForBytesWritten(int msecs)
+{
+    if (fd < 0 || bytesToWrite() == 0) {
+        return false;
+    }
+    // 完成模式下由reactor提交并等待发送完成
+    if (isCompletionMode()) {
+        const qint64 before = bytesToWrite();
+        reactor->poll(msecs);
+        return bytesToWrite() < before;
+    }
+    pollfd item = {fd, POLLOUT, 0};
+    if (::poll(&item, 1, msecs) <= 0) {
+        return false;
+    }
+    return flushWriteBuffer() > 0;
+}
+
+bool DBusSocket::waitForReadyRead(int msecs)
+{
+    if (fd < 0) {
+        return false;
+    }
+    // 完成模式下数据由reactor收到后分发，没有读取者时发出readyRead
+    if (isCompletionMode()) {
+        reactor->poll(msecs);
+        return bytesAvailable() > 0;
+    }
+    pollfd item = {fd, POLLIN, 0};
+    if (::poll(&item, 1, msecs) <= 0) {
+        return false;
+    }
+    if (bytesAvailable() > 0) {
+        readNotified = true;
+        emit readyRead();
+        return true;
+    }
+    onReadActivated();
+    return false;
+}
+
+/*
+ * 可读但没有数据时检查对端是否已关闭，已关闭则关闭socket
+ *
+ * @return bool: true:已关闭 false:连接正常
+ */
+bool DBusSocket::checkPeerClosed()
+{
+    char c = 0;
+    const ssize_t ret = ::recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (ret == 0) {
+        setSocketError(QLocalSocket::PeerClosedError, QStringLiteral("remote closed"));
+        closeSocket();
+        return true;
+    }
+    if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        setSocketError(QLocalSocket::PeerClosedError, QString::fromLocal8Bit(strerror(errno)));
+        closeSocket();
+        return true;
+    }
+    return false;
+}
+
+/*
+ * reactor分发的读写事件
+ *
+ * @param events: 就绪的epoll事件
+ *
+ * @return bool: true:读取预算用完仍有数据 false:本轮已处理完
+ */
+bool DBusSocket::handleEvents(quint32 events)
+{
+    if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        peerHungUp = true;
+    }
+    if ((events & EPOLLOUT) && bytesToWrite() > 0) {
+        flushWriteBuffer();
+    }
+    if (fd < 0 || !(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+        return false;
+    }
+    if (bytesAvailable() == 0) {
+        // 完成模式下只有接收结束或出错时才需要检查，对端已关闭时读不到数据，否则连接出错
+        if (!isCompletionMode()) {
+            checkPeerClosed();
+        } else if (peerHungUp && !checkPeerClosed()) {
+            setSocketError(QLocalSocket::PeerClosedError, QStringLiteral("receive failed"));
+            closeSocket();
+        }
+        return false;
+    }
+    if (listener) {
+        return listener->socketReadable(this);
+    }
+    emit readyRead();
+    return false;
+}
+
+/*
+ * 完成模式下reactor收到的数据，追加到读缓存，缓存过多时暂停接收
+ *
+ * @param data: 数据地址
+ * @param size: 数据长度
+ * @param fds: 随数据到达的文件描述符
+ * @param fdCount: 文件描述符数量
+ */
+void DBusSocket::handleReceived(const char *data, qint64 size, const int *fds, int fdCount)
+{
+    if (fdCount > 0) {
+        PendingFds item;
+        item.position = receivedTotal;
+        for (int i = 0; i < fdCount; i++) {
+            item.fds.append(fds[i]);
+        }
+        bufferedFds.enqueue(item);
+    }
+    receivedTotal += size;
+    if (readOffset >= kCompactThreshold) {
+        readBuffer.remove(0, static_cast<int>(readOffset));
+        readOffset = 0;
+    }
+    readBuffer.append(data, static_cast<int>(size));
+    if (!receivePaused && readBuffer.size() - readOffset >= kReceiveHighWatermark) {
+        receivePaused = true;
+        reactor->setReceiving(this, false);
+    }
+}
+
+/*
+ * 完成模式下一段发送完成，全部完成后提交期间新写入的数据
+ *
+ * @param result: 发送的字节数，出错时为负的errno
+ * @param expected: 提交的字节数
+ */
+void DBusSocket::handleSent(qint64 result, qint64 expected)
+{
+    if (fd < 0) {
+        return;
+    }
+    // 链接的发送带MSG_WAITALL，只有出错时才会少于提交的字节数
+    if (result != expected) {
+        setSocketError(QLocalSocket::PeerClosedError,
+                       result < 0 ? QString::fromLocal8Bit(strerror(static_cast<int>(-result)))
+                                  : QStringLiteral("short write"));
+        closeSocket();
+        return;
+    }
+    inflightBytes -= result;
+    if (inflightBytes == 0) {
+        inflightBuffer.resize(0);
+        if (submitWriteBuffer() < 0) {
+            return;
+        }
+    }
+    emit bytesWritten(result);
+    if (socketState == QLocalSocket::ClosingState && bytesToWrite() == 0) {
+        closeSocket();
+    }
+}
+
+/*
+ * 完成模式下把发送缓冲区整体提交给reactor，上一次提交完成前不提交
+ *
+ * @return qint64: 提交的字节数，出错返回-1
+ */
+qint64 DBusSocket::submitWriteBuffer()
+{
+    if (fd < 0 || inflightBytes > 0 || writeBuffer.size() == writeOffset) {
+        return 0;
+    }
+    // 完成模式下不会部分发送，writeOffset始终为0，文件描述符的位置直接对应缓冲区位置
+    inflightBuffer.swap(writeBuffer);
+    writeBuffer.resize(0);
+    const qint64 size = inflightBuffer.size();
+    QVector<DBusSendSegment> segments;
+    qint64 begin = 0;
+    while (begin < size && segments.size() < kMaxLinkedSends) {
+        DBusSendSegment segment;
+        segment.offset = begin;
+        if (!pendingFds.isEmpty() && pendingFds.head().position == begin) {
+            segment.fds = pendingFds.dequeue().fds;
+        }
+        const qint64 end = pendingFds.isEmpty() ? size : pendingFds.head().position;
+        segment.size = end - begin;
+        segments.append(segment);
+        begin = end;
+    }
+    // 超过一次链接的段数时剩余数据留到本次发送完成后提交
+    if (begin < size) {
+        writeBuffer.append(inflightBuffer.constData() + begin, static_cast<int>(size - begin));
+        inflightBuffer.truncate(static_cast<int>(begin));
+        for (PendingFds &item : pendingFds) {
+            item.position -= begin;
+        }
+    }
+    if (!reactor->submitSend(this, inflightBuffer, segments)) {
+        setSocketError(QLocalSocket::SocketResourceError, QStringLiteral("submit send failed"));
+        closeSocket();
+        return -1;
+    }
+    inflightBytes = begin;
+    return begin;
+}
+
+void DBusSocket::onReadActivated()
+{
+    if (fd < 0) {
+        return;
+    }
+    if (bytesAvailable() == 0) {
+        // 可读但没有数据，说明对端已关闭或连接出错
+        checkPeerClosed();
+        return;
+    }
+    // 上次通知后调用方没有读取，说明暂停了读取，关闭通知直到下一次读取
+    if (readNotified) {
+        readNotifier->setEnabled(false);
+        return;
+    }
+    readNotified = true;
+    emit readyRead();
+}
+
+void DBusSocket::onWriteActivated()
+{
+    flushWriteBuffer();
+}
@@ -0,0 +1,267 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_DBUS_PROXY_SRC_PROXY_DBUS_SOCKET_H
+#define LINGLONG_DBUS_PROXY_SRC_PROXY_DBUS_SOCKET_H
+
+#include <sys/uio.h>
+
+#include <QIODevice>
+#include <QLocalSocket>
+#include <QQueue>
+#include <QScopedPointer>
+#include <QSocketNotifier>
+#include <QVector>
+
+#include "proxy/dbus_reactor.h"
+
+class DBusSocket;
+
+/*
+ * socket的读取者，reactor模式下可读时直接调用
+ */
+class DBusSocketListener
+{
+public:
+    virtual ~DBusSocketListener() {}
+
+    /*
+     * socket可读时由reactor直接调用，不经过readyRead信号
+     *
+     * @param socket: 可读的socket
+     *
+     * @return bool: true:读取预算用完仍有数据 false:已读完或暂停读取
+     */
+    virtual bool socketReadable(DBusSocket *socket) = 0;
+};
+
+/*
+ * 直接操作描述符的本地socket，支持传递文件描述符
+ *
+ * QLocalSocket使用read读取数据，随消息传递的文件描述符(SCM_RIGHTS)会被内核丢弃。
+ * 该类使用recvmsg读取，收到的文件描述符按到达顺序排队，由调用方按消息报文头的UNIX_FDS字段取出；
+ * 发送时文件描述符附加在对应数据的第一个字节上。状态、错误与信号和QLocalSocket保持一致。
+ * 读取不经过用户态缓冲区，直接读入调用方缓冲区；收到可读通知后调用方没有读取时暂停通知，
+ * 数据留在内核中由内核对发送方形成反压，调用方再次读取后恢复。
+ * 设置reactor后不再创建QSocketNotifier，描述符注册到reactor中，可读时直接调用listener。
+ * reactor使用io_uring时为完成模式：收到的数据由reactor交给socket缓存，读取时从缓存拷贝；
+ * 写入的数据在本轮结束前整体提交给reactor发送，发送完成前不修改，新写入的数据等本次发送完成后再提交
+ */
+class DBusSocket : public QIODevice, public DBusReactorHandler
+{
+    Q_OBJECT
+
+public:
+    explicit DBusSocket(QObject *parent = nullptr);
+    ~DBusSocket() override;
+
+    /*
+     * 连接本地socket，立即返回，结果通过connected或error信号通知
+     *
+     * @param name: socket路径
+     */
+    void connectToServer(const QString &name);
+
+    /*
+     * 接管已连接的socket描述符
+     *
+     * @param socketDescriptor: socket描述符，成功后由该对象关闭
+     *
+     * @return bool: true:成功 false:失败
+     */
+    bool setSocketDescriptor(qintptr socketDescriptor);
+
+    /*
+     * 由reactor分发读写事件，必须在连接之前设置
+     *
+     * @param reactor: reactor，需要比socket存活更久
+     */
+    void setReactor(DBusReactor *reactor) { this->reactor = reactor; }
+
+    /*
+     * 设置读取者，reactor模式下可读时直接调用，未设置时发出readyRead信号；也作为socket所属对象的反向指针
+     *
+     * @param listener: 读取者，为nullptr时取消
+     */
+    void setListener(DBusSocketListener *listener) { this->listener = listener; }
+
+    /*
+     * 获取读取者
+     *
+     * @return DBusSocketListener*: 读取者，未设置时返回nullptr
+     */
+    DBusSocketListener *socketListener() const { return listener; }
+
+    bool handleEvents(quint32 events) override;
+    void handleReceived(const char *data, qint64 size, const int *fds, int fdCount) override;
+    void handleSent(qint64 result, qint64 expected) override;
+
+    /*
+     * 是否为完成模式，此时数据不在描述符中，不能绕过socket直接读写描述符
+     *
+     * @return bool: true:reactor使用io_uring false:直接读写描述符
+     */
+    bool isCompletionMode() const { return reactor && reactor->backend() == DBusReactor::IoUring; }
+
+    /*
+     * 发送完缓冲区中的数据后断开连接
+     */
+    void disconnectFromServer();
+
+    /*
+     * 立即断开连接，丢弃未发送的数据
+     */
+    void abort();
+
+    void close() override;
+
+    QLocalSocket::LocalSocketState state() const { return socketState; }
+    QLocalSocket::LocalSocketError error() const { return socketError; }
+    qintptr socketDescriptor() const { return fd; }
+
+    bool isSequential() const override { return true; }
+    qint64 bytesAvailable() const override;
+    qint64 bytesToWrite() const override { return writeBuffer.size() - writeOffset + inflightBytes; }
+    bool waitForBytesWritten(int msecs = 30000) override;
+    bool waitForReadyRead(int msecs = 30000) override;
+
+    /*
+     * 已收到尚未取出的文件描述符数量
+     *
+     * @return int: 数量
+     */
+    int pendingFdCount() const { return receivedFds.size(); }
+
+    /*
+     * 按到达顺序取出文件描述符，所有权转移给调用方
+     *
+     * @param count: 数量
+     * @param fds: 输出文件描述符
+     *
+     * @return bool: true:成功 false:已收到的文件描述符不足，不取出
+     */
+    bool takeFds(int count, QVector<int> *fds);
+
+    /*
+     * 发送数据，文件描述符随数据的第一个字节发送，不阻塞
+     *
+     * @param data: 数据地址，调用返回后即可释放
+     * @param size: 数据长度
+     * @param fds: 文件描述符，所有权转移给该对象，发送后关闭
+     *
+     * @return qint64: 写入的字节数，失败返回-1
+     */
+    qint64 writeWithFds(const char *data, qint64 size, const QVector<int> &fds);
+
+    /*
+     * 调用方绕过read直接从描述符读取数据(如splice)后调用，恢复可读通知
+     */
+    void notifyExternalRead();
+
+    /*
+     * 发送一次数据，文件描述符附加在第一个字节上，不阻塞
+     *
+     * @param socketDescriptor: socket描述符
+     * @param iov: 数据段
+     * @param count: 数据段数量
+     * @param fds: 文件描述符，发送成功后仍由调用方关闭
+     * @param fdCount: 文件描述符数量
+     *
+     * @return qint64: 发送的字节数，失败返回-1并保留errno
+     */
+    static qint64 sendWithFds(int socketDescriptor, const iovec *iov, int count, const int *fds, int fdCount);
+
+    // 一次发送或一条消息最多携带的文件描述符数量，与内核SCM_MAX_FD一致
+    static const int kMaxFds = 253;
+
+signals:
+    void connected();
+    void disconnected();
+    void error(QLocalSocket::LocalSocketError socketError);
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 size) override;
+
+private slots:
+    void onReadActivated();
+    void onWriteActivated();
+
+private:
+    // 附加在发送缓冲区某个位置上的文件描述符
+    struct PendingFds {
+        // 在发送缓冲区中的位置
+        qint64 position;
+        QVector<int> fds;
+    };
+
+    // 连接建立后创建读写通知
+    void startNotifiers();
+
+    /*
+     * 发送缓冲区中的数据，直到内核缓冲区满
+     *
+     * @return qint64: 发送的字节数，出错返回-1
+     */
+    qint64 flushWriteBuffer();
+
+    /*
+     * 完成模式下把发送缓冲区整体提交给reactor，上一次提交完成前不提交
+     *
+     * @return qint64: 提交的字节数，出错返回-1
+     */
+    qint64 submitWriteBuffer();
+
+    /*
+     * 记录错误并发出error信号
+     *
+     * @param error: 错误类型
+     * @param message: 错误描述
+     */
+    void setSocketError(QLocalSocket::LocalSocketError error, const QString &message);
+
+    // 关闭描述符并丢弃未发送的数据，连接过时发出disconnected信号
+    void closeSocket();
+
+    /*
+     * 可读但没有数据时检查对端是否已关闭，已关闭则关闭socket
+     *
+     * @return bool: true:已关闭 false:连接正常
+     */
+    bool checkPeerClosed();
+
+    int fd;
+    DBusReactor *reactor;
+    DBusSocketListener *listener;
+    // reactor报告过对端关闭写端，读完剩余数据后关闭
+    bool peerHungUp;
+    QLocalSocket::LocalSocketState socketState;
+    QLocalSocket::LocalSocketError socketError;
+    QScopedPointer<QSocketNotifier> readNotifier;
+    QScopedPointer<QSocketNotifier> writeNotifier;
+    // 已发出readyRead且调用方尚未读取
+    bool readNotified;
+    // 已收到尚未取出的文件描述符
+    QQueue<int> receivedFds;
+    // 发送缓冲区，writeOffset之前的数据已发送
+    QByteArray writeBuffer;
+    qint64 writeOffset;
+    QQueue<PendingFds> pendingFds;
+    // 完成模式：已收到尚未读取的数据，readOffset之前的数据已读取
+    QByteArray readBuffer;
+    qint64 readOffset;
+    // 完成模式：随读缓存中的数据到达的文件描述符，位置为在接收数据流中的偏移，
+    // 读到该位置时才放入receivedFds，与直接recvmsg时取出文件描述符的时机一致
+    QQueue<PendingFds> bufferedFds;
+    qint64 receivedTotal;
+    qint64 readTotal;
+    // 完成模式：缓存数据过多，已暂停接收
+    bool receivePaused;
+    // 完成模式：已提交给reactor尚未完成的数据
+    QByteArray inflightBuffer;
+    qint64 inflightBytes;
+};
+#endif
@@ -0,0 +1,65 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "dbus_socket_server.h"
+
+#include <unistd.h>
+
+#include <QDebug>
+
+DBusSocketServer::DBusSocketServer(QObject *parent)
+    : QLocalServer(parent)
+    , reactor(nullptr)
+    , handoffEnabled(false)
+{
+}
+
+DBusSocketServer::~DBusSocketServer()
+{
+    // 未被取走的描述符由server关闭
+    while (!pendingDescriptors.isEmpty()) {
+        ::close(static_cast<int>(pendingDescriptors.dequeue()));
+    }
+}
+
+/*
+ * 取出一个新连接，对象以server为父对象
+ *
+ * @return DBusSocket*: 新连接，没有时返回nullptr
+ */
+DBusSocket *DBusSocketServer::nextPendingSocket()
+{
+    return pendingSockets.isEmpty() ? nullptr : pendingSockets.dequeue();
+}
+
+/*
+ * 开启描述符移交时取出一个新连接的描述符，所有权转移给调用方
+ *
+ * @return qintptr: 描述符，没有时返回-1
+ */
+qintptr DBusSocketServer::nextPendingDescriptor()
+{
+    return pendingDescriptors.isEmpty() ? -1 : pendingDescriptors.dequeue();
+}
+
+void DBusSocketServer::incomingConnection(quintptr socketDescriptor)
+{
+    if (handoffEnabled) {
+        pendingDescriptors.enqueue(static_cast<qintptr>(socketDescriptor));
+        emit newConnection();
+        return;
+    }
+    DBusSocket *socket = new DBusSocket(this);
+    socket->setReactor(reactor);
+    if (!socket->setSocketDescriptor(static_cast<qintptr>(socketDescriptor))) {
+        qCritical() << "accept box client failed, descriptor:" << socketDescriptor;
+        ::close(static_cast<int>(socketDescriptor));
+        delete socket;
+        return;
+    }
+    pendingSockets.enqueue(socket);
+    emit newConnection();
+}
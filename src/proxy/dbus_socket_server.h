@@ -0,0 +1,66 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_DBUS_PROXY_SRC_PROXY_DBUS_SOCKET_SERVER_H
+#define LINGLONG_DBUS_PROXY_SRC_PROXY_DBUS_SOCKET_SERVER_H
+
+#include <QLocalServer>
+#include <QQueue>
+
+#include "proxy/dbus_socket.h"
+
+/*
+ * 监听box客户端连接，新连接以DBusSocket接管，以便传递文件描述符
+ *
+ * 监听、权限选项等沿用QLocalServer，新连接通过nextPendingSocket取出，nextPendingConnection始终为空；
+ * 开启描述符移交时不创建socket，新连接的描述符通过nextPendingDescriptor取出，交给其它线程接管
+ */
+class DBusSocketServer : public QLocalServer
+{
+    Q_OBJECT
+
+public:
+    explicit DBusSocketServer(QObject *parent = nullptr);
+    ~DBusSocketServer() override;
+
+    /*
+     * 取出一个新连接，对象以server为父对象
+     *
+     * @return DBusSocket*: 新连接，没有时返回nullptr
+     */
+    DBusSocket *nextPendingSocket();
+
+    /*
+     * 新连接由reactor分发读写事件
+     *
+     * @param reactor: reactor，为nullptr时使用QSocketNotifier
+     */
+    void setReactor(DBusReactor *reactor) { this->reactor = reactor; }
+
+    /*
+     * 新连接只保存描述符，不在当前线程创建socket
+     *
+     * @param enable: 是否开启
+     */
+    void setHandoffEnabled(bool enable) { handoffEnabled = enable; }
+
+    /*
+     * 开启描述符移交时取出一个新连接的描述符，所有权转移给调用方
+     *
+     * @return qintptr: 描述符，没有时返回-1
+     */
+    qintptr nextPendingDescriptor();
+
+protected:
+    void incomingConnection(quintptr socketDescriptor) override;
+
+private:
+    QQueue<DBusSocket *> pendingSockets;
+    QQueue<qintptr> pendingDescriptors;
+    DBusReactor *reactor;
+    bool handoffEnabled;
+};
+#endif
@@ -0,0 +1,134 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "dbus_splice_relay.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <QDebug>
+
+// 期望的管道容量，超过系统限制时保持默认容量
+static const int kPipeSize = 1024 * 1024;
+
+DBusSpliceRelay::DBusSpliceRelay()
+    : pipeSize(0)
+    , messageAllowed(false)
+{
+    stats = {0, 0, 0};
+    if (::pipe2(pipeFds, O_NONBLOCK | O_CLOEXEC) != 0) {
+        qWarning() << "create splice pipe failed, errno:" << errno;
+        pipeFds[0] = pipeFds[1] = -1;
+        return;
+    }
+    ::fcntl(pipeFds[1], F_SETPIPE_SZ, kPipeSize);
+    pipeSize = ::fcntl(pipeFds[1], F_GETPIPE_SZ);
+    if (pipeSize <= 0) {
+        closePipe();
+    }
+}
+
+DBusSpliceRelay::~DBusSpliceRelay()
+{
+    closePipe();
+}
+
+void DBusSpliceRelay::closePipe()
+{
+    if (pipeFds[0] >= 0) {
+        ::close(pipeFds[0]);
+        ::close(pipeFds[1]);
+        pipeFds[0] = pipeFds[1] = -1;
+    }
+}
+
+/*
+ * 从源socket搬运最多size字节到目标socket，不阻塞
+ *
+ * @param sourceFd: 源socket描述符
+ * @param destFd: 目标socket描述符
+ * @param size: 最多搬运的字节数
+ * @param spill: 追加已从源读出但目标暂时写不下的数据，调用方需在其他数据之前发送
+ * @param lost: 输出已从源读出、但既未写入目标也未取回到spill的字节数，不为0时数据流已不完整，调用方需断开连接
+ *
+ * @return qint64: 从源读出的字节数，包括spill中的数据与丢失的数据
+ */
+qint64 DBusSpliceRelay::relay(int sourceFd, int destFd, qint64 size, QByteArray *spill, qint64 *lost)
+{
+    qint64 moved = 0;
+    *lost = 0;
+    while (isValid() && moved < size) {
+        stats.spliceCalls++;
+        const ssize_t in = ::splice(sourceFd, nullptr, pipeFds[1], nullptr,
+                                    static_cast<size_t>(qMin(size - moved, pipeSize)),
+                                    SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (in < 0 && errno == EINTR) {
+            continue;
+        }
+        if (in < 0 && (errno == EINVAL || errno == ENOSYS)) {
+            qWarning() << "splice not supported on socket, fallback to copy, errno:" << errno;
+            closePipe();
+            break;
+        }
+        // 源socket暂无数据、已关闭或出错，都交给Qt处理
+        if (in <= 0) {
+            break;
+        }
+        moved += in;
+
+        qint64 inPipe = in;
+        while (inPipe > 0) {
+            stats.spliceCalls++;
+            const ssize_t out = ::splice(pipeFds[0], nullptr, destFd, nullptr, static_cast<size_t>(inPipe),
+                                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (out > 0) {
+                inPipe -= out;
+                stats.splicedBytes += static_cast<quint64>(out);
+            } else if (out < 0 && errno == EINTR) {
+                continue;
+            } else {
+                break;
+            }
+        }
+        // 目标socket写不下或出错，剩余数据交给调用方按顺序发送，写入错误由Qt统一上报
+        if (inPipe > 0) {
+            *lost = drainPipe(inPipe, spill);
+            break;
+        }
+    }
+    return moved;
+}
+
+/*
+ * 把管道中的size字节取回到spill，读取失败时关闭管道
+ *
+ * @param size: 字节数
+ * @param spill: 输出缓冲区
+ *
+ * @return qint64: 未能取回的字节数
+ */
+qint64 DBusSpliceRelay::drainPipe(qint64 size, QByteArray *spill)
+{
+    const int offset = spill->size();
+    spill->resize(offset + static_cast<int>(size));
+    qint64 done = 0;
+    while (done < size) {
+        const ssize_t ret = ::read(pipeFds[0], spill->data() + offset + done, static_cast<size_t>(size - done));
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            qCritical() << "drain splice pipe failed, errno:" << errno << ", lost:" << size - done;
+            spill->resize(offset + static_cast<int>(done));
+            closePipe();
+            break;
+        }
+        done += ret;
+    }
+    stats.copiedBytes += static_cast<quint64>(done);
+    return size - done;
+}
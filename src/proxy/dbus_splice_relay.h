@@ -0,0 +1,92 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_DBUS_PROXY_SRC_PROXY_DBUS_SPLICE_RELAY_H
+#define LINGLONG_DBUS_PROXY_SRC_PROXY_DBUS_SPLICE_RELAY_H
+
+#include <QByteArray>
+
+// 内核直通转发统计信息
+struct DBusSpliceMetrics {
+    // 在内核中直接送达目标的字节数
+    quint64 splicedBytes;
+    // 目标暂时写不下，从管道取回用户态的字节数
+    quint64 copiedBytes;
+    // splice系统调用次数
+    quint64 spliceCalls;
+};
+
+/*
+ * 通过管道在两个socket之间搬运数据，数据不进入用户态
+ *
+ * 用于转发不需要检查内容的消息body：源socket的数据splice进管道，再从管道splice到目标socket。
+ * 目标socket写不下时，已经进入管道的数据取回到调用方缓冲区，保证每次调用返回时管道为空，
+ * 调用方按原有路径发送即可保持顺序。内核不支持对该类socket使用splice时自动停用，调用方回退到拷贝转发
+ */
+class DBusSpliceRelay
+{
+public:
+    DBusSpliceRelay();
+    ~DBusSpliceRelay();
+
+    /*
+     * 是否可用，管道创建失败或内核不支持时为false
+     *
+     * @return bool: true:可用 false:不可用
+     */
+    bool isValid() const { return pipeFds[0] >= 0; }
+
+    /*
+     * 从源socket搬运最多size字节到目标socket，不阻塞
+     *
+     * @param sourceFd: 源socket描述符
+     * @param destFd: 目标socket描述符
+     * @param size: 最多搬运的字节数
+     * @param spill: 追加已从源读出但目标暂时写不下的数据，调用方需在其他数据之前发送
+     * @param lost: 输出已从源读出、但既未写入目标也未取回到spill的字节数，不为0时数据流已不完整，调用方需断开连接
+     *
+     * @return qint64: 从源读出的字节数，包括spill中的数据与丢失的数据
+     */
+    qint64 relay(int sourceFd, int destFd, qint64 size, QByteArray *spill, qint64 *lost);
+
+    /*
+     * 当前消息的body是否允许内核直通，携带文件描述符等需要用户态处理的消息不允许
+     *
+     * @param allowed: true:允许 false:不允许
+     */
+    void setMessageAllowed(bool allowed) { messageAllowed = allowed; }
+    bool isMessageAllowed() const { return messageAllowed; }
+
+    /*
+     * 获取统计信息
+     *
+     * @return DBusSpliceMetrics: 统计信息
+     */
+    DBusSpliceMetrics metrics() const { return stats; }
+
+private:
+    Q_DISABLE_COPY(DBusSpliceRelay)
+
+    /*
+     * 把管道中的size字节取回到spill，读取失败时关闭管道
+     *
+     * @param size: 字节数
+     * @param spill: 输出缓冲区
+     *
+     * @return qint64: 未能取回的字节数
+     */
+    qint64 drainPipe(qint64 size, QByteArray *spill);
+
+    // 关闭管道，停用内核直通
+    void closePipe();
+
+    int pipeFds[2];
+    // 管道容量，每次splice不超过该长度
+    qint64 pipeSize;
+    bool messageAllowed;
+    DBusSpliceMetrics stats;
+};
+#endif
@@ -0,0 +1,609 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "dbus_uring.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <QDebug>
+
+// 需要multishot recvmsg、接收缓冲区环、按描述符取消与带超时的等待，对应内核6.0
+#if defined(IORING_RECV_MULTISHOT) && defined(IORING_ASYNC_CANCEL_FD) && defined(IORING_ENTER_EXT_ARG)    \
+    && defined(__NR_io_uring_setup)
+#define DBUS_URING_SUPPORTED 1
+#endif
+
+// 初始化时探测使用的用户数据，不会与调用方的用户数据冲突
+static const quint64 kProbeUserData = 1;
+// 探测时等待完成事件的时间，毫秒
+static const int kProbeTimeout = 100;
+
+bool DBusUringCompletion::hasMore() const
+{
+#ifdef DBUS_URING_SUPPORTED
+    return flags & IORING_CQE_F_MORE;
+#else
+    return false;
+#endif
+}
+
+int DBusUringCompletion::bufferId() const
+{
+#ifdef DBUS_URING_SUPPORTED
+    return (flags & IORING_CQE_F_BUFFER) ? static_cast<int>(flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+#else
+    return -1;
+#endif
+}
+
+DBusUring::DBusUring()
+    : ringFd(-1)
+    , sqRing(MAP_FAILED)
+    , sqRingSize(0)
+    , cqRing(MAP_FAILED)
+    , cqRingSize(0)
+    , sqeMemory(MAP_FAILED)
+    , sqeMemorySize(0)
+    , sqHead(nullptr)
+    , sqTail(nullptr)
+    , sqMask(0)
+    , sqEntries(0)
+    , sqeTail(0)
+    , cqHead(nullptr)
+    , cqTail(nullptr)
+    , cqMask(0)
+    , cqes(nullptr)
+    , bufferRing(MAP_FAILED)
+    , bufferRingSize(0)
+    , bufferMemory(nullptr)
+    , bufferMemorySize(0)
+    , bufferCount(0)
+    , bufferSize(0)
+    , bufferTail(0)
+    , bufferRegistered(false)
+    , enterCalls(0)
+{
+}
+
+DBusUring::~DBusUring()
+{
+    release();
+}
+
+void DBusUring::release()
+{
+    // 先关闭io_uring，内核取消所有请求后再释放接收缓冲区
+    if (ringFd >= 0) {
+        ::close(ringFd);
+        ringFd = -1;
+    }
+    if (sqeMemory != MAP_FAILED) {
+        ::munmap(sqeMemory, sqeMemorySize);
+        sqeMemory = MAP_FAILED;
+    }
+    if (cqRing != MAP_FAILED && cqRing != sqRing) {
+        ::munmap(cqRing, cqRingSize);
+    }
+    cqRing = MAP_FAILED;
+    if (sqRing != MAP_FAILED) {
+        ::munmap(sqRing, sqRingSize);
+        sqRing = MAP_FAILED;
+    }
+    if (bufferRing != MAP_FAILED) {
+        ::munmap(bufferRing, bufferRingSize);
+        bufferRing = MAP_FAILED;
+    }
+    if (bufferMemory) {
+        ::munmap(bufferMemory, bufferMemorySize);
+        bufferMemory = nullptr;
+    }
+    bufferRegistered = false;
+}
+
+/*
+ * 创建io_uring并注册接收缓冲区
+ *
+ * @param entries: 提交队列长度，完成队列为其4倍
+ * @param bufferCount: 接收缓冲区数量，必须是2的幂
+ * @param bufferSize: 每个接收缓冲区的大小
+ *
+ * @return bool: true:成功 false:内核不支持或资源不足
+ */
+bool DBusUring::init(unsigned entries, unsigned bufferCount, unsigned bufferSize)
+{
+#ifdef DBUS_URING_SUPPORTED
+    if (ringFd >= 0 || bufferCount == 0 || (bufferCount & (bufferCount - 1)) != 0 || bufferCount > 32768) {
+        return false;
+    }
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // 完成队列更长，连接多时一轮产生的完成事件不溢出
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;
+    ringFd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (ringFd < 0) {
+        qWarning() << "io_uring setup failed, errno:" << errno;
+        return false;
+    }
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP)) {
+        qWarning() << "io_uring features not supported:" << params.features;
+        release();
+        return false;
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sqRingSize = qMax(sqRingSize, cqRingSize);
+        cqRingSize = sqRingSize;
+    }
+    sqRing = ::mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+                    IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        release();
+        return false;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cqRing = sqRing;
+    } else {
+        cqRing = ::mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+                        IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) {
+            release();
+            return false;
+        }
+    }
+    sqeMemorySize = params.sq_entries * sizeof(io_uring_sqe);
+    sqeMemory = ::mmap(nullptr, sqeMemorySize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+                       IORING_OFF_SQES);
+    if (sqeMemory == MAP_FAILED) {
+        release();
+        return false;
+    }
+    char *sq = static_cast<char *>(sqRing);
+    char *cq = static_cast<char *>(cqRing);
+    sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqEntries = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_entries);
+    sqeTail = *sqTail;
+    // 提交项与提交队列位置一一对应，之后不再修改
+    unsigned *array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    for (unsigned i = 0; i < sqEntries; i++) {
+        array[i] = i;
+    }
+    cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = cq + params.cq_off.cqes;
+
+    // 接收缓冲区环与缓冲区，由内核在接收时选择
+    this->bufferCount = bufferCount;
+    this->bufferSize = bufferSize;
+    bufferRingSize = bufferCount * sizeof(io_uring_buf);
+    bufferRing = ::mmap(nullptr, bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    bufferMemorySize = static_cast<size_t>(bufferCount) * bufferSize;
+    void *memory = ::mmap(nullptr, bufferMemorySize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    bufferMemory = memory == MAP_FAILED ? nullptr : static_cast<char *>(memory);
+    if (bufferRing == MAP_FAILED || !bufferMemory) {
+        release();
+        return false;
+    }
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<quint64>(bufferRing);
+    reg.ring_entries = bufferCount;
+    reg.bgid = 0;
+    if (::syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        qWarning() << "io_uring register buffer ring failed, errno:" << errno;
+        release();
+        return false;
+    }
+    bufferRegistered = true;
+    bufferTail = 0;
+    for (unsigned i = 0; i < bufferCount; i++) {
+        recycleBuffer(static_cast<int>(i));
+    }
+    if (!probe()) {
+        qWarning() << "io_uring multishot recvmsg not supported";
+        release();
+        return false;
+    }
+    return true;
+#else
+    Q_UNUSED(entries);
+    Q_UNUSED(bufferCount);
+    Q_UNUSED(bufferSize);
+    return false;
+#endif
+}
+
+/*
+ * 确认内核支持multishot recvmsg、接收缓冲区与按描述符取消
+ *
+ * @return bool: true:支持 false:不支持
+ */
+bool DBusUring::probe()
+{
+#ifdef DBUS_URING_SUPPORTED
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) != 0) {
+        return false;
+    }
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    bool received = false;
+    bool finished = false;
+    if (prepareReceive(fds[0], &msg, kProbeUserData) && enter(0) >= 0 && ::write(fds[1], "p", 1) == 1) {
+        DBusUringCompletion completion;
+        for (int i = 0; i < 2 && !received; i++) {
+            enter(kProbeTimeout);
+            while (reap(&completion, 1) == 1) {
+                DBusUringMessage message;
+                if (completion.userData == kProbeUserData && completion.bufferId() >= 0) {
+                    received = completion.hasMore() && parseReceived(&msg, completion, &message)
+                        && message.payloadSize == 1;
+                    recycleBuffer(completion.bufferId());
+                }
+            }
+        }
+    }
+    // 取消后multishot请求以不带IORING_CQE_F_MORE的完成事件结束，之后才能关闭描述符
+    if (prepareCancelFd(fds[0]) && enter(0) >= 0) {
+        DBusUringCompletion completion;
+        for (int i = 0; i < 2 && !finished; i++) {
+            enter(kProbeTimeout);
+            while (reap(&completion, 1) == 1) {
+                if (completion.userData == kProbeUserData) {
+                    if (completion.bufferId() >= 0) {
+                        recycleBuffer(completion.bufferId());
+                    }
+                    finished = !completion.hasMore();
+                }
+            }
+        }
+    }
+    ::close(fds[0]);
+    ::close(fds[1]);
+    return received && finished;
+#else
+    return false;
+#endif
+}
+
+void *DBusUring::nextSqe()
+{
+#ifdef DBUS_URING_SUPPORTED
+    if (ringFd < 0) {
+        return nullptr;
+    }
+    if (sqeTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+        // 提交队列已满，先提交已有请求
+        if (enter(0) < 0 || sqeTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+            qCritical() << "io_uring submission queue is full";
+            return nullptr;
+        }
+    }
+    io_uring_sqe *sqe = static_cast<io_uring_sqe *>(sqeMemory) + (sqeTail & sqMask);
+    sqeTail++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+#else
+    return nullptr;
+#endif
+}
+
+/*
+ * 添加multishot recvmsg请求，每次收到数据产生一个完成事件，数据写入内核选择的接收缓冲区
+ *
+ * @param fd: socket描述符
+ * @param msg: 只使用msg_namelen与msg_controllen，请求结束前必须保持有效
+ * @param userData: 用户数据，不能为0
+ *
+ * @return bool: true:成功 false:提交队列已满且提交失败
+ */
+bool DBusUring::prepareReceive(int fd, const msghdr *msg, quint64 userData)
+{
+#ifdef DBUS_URING_SUPPORTED
+    io_uring_sqe *sqe = static_cast<io_uring_sqe *>(nextSqe());
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<quint64>(msg);
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->msg_flags = MSG_CMSG_CLOEXEC;
+    sqe->user_data = userData;
+    return true;
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(msg);
+    Q_UNUSED(userData);
+    return false;
+#endif
+}
+
+/*
+ * 添加sendmsg请求，MSG_WAITALL保证整段发送完成或出错
+ *
+ * @param fd: socket描述符
+ * @param msg: 数据与控制消息，请求完成前必须保持有效
+ * @param userData: 用户数据，不能为0
+ * @param link: 是否与下一个请求链接，前一个请求失败时后续请求被取消
+ *
+ * @return bool: true:成功 false:提交队列已满且提交失败
+ */
+bool DBusUring::prepareSend(int fd, const msghdr *msg, quint64 userData, bool link)
+{
+#ifdef DBUS_URING_SUPPORTED
+    io_uring_sqe *sqe = static_cast<io_uring_sqe *>(nextSqe());
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<quint64>(msg);
+    sqe->len = 1;
+    // 链接的请求只有完整发送才算成功，部分发送时断开链接，后续请求被取消，不会乱序
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    sqe->flags = link ? IOSQE_IO_LINK : 0;
+    sqe->user_data = userData;
+    return true;
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(msg);
+    Q_UNUSED(userData);
+    Q_UNUSED(link);
+    return false;
+#endif
+}
+
+/*
+ * 添加取消请求，取消描述符上所有未完成的请求，完成事件的用户数据为0
+ *
+ * @param fd: 描述符，提交前不能关闭
+ *
+ * @return bool: true:成功 false:提交队列已满且提交失败
+ */
+bool DBusUring::prepareCancelFd(int fd)
+{
+#ifdef DBUS_URING_SUPPORTED
+    io_uring_sqe *sqe = static_cast<io_uring_sqe *>(nextSqe());
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = 0;
+    return true;
+#else
+    Q_UNUSED(fd);
+    return false;
+#endif
+}
+
+/*
+ * 添加取消请求，取消用户数据为target的请求，完成事件的用户数据为0
+ *
+ * @param target: 要取消的请求的用户数据
+ *
+ * @return bool: true:成功 false:提交队列已满且提交失败
+ */
+bool DBusUring::prepareCancelRequest(quint64 target)
+{
+#ifdef DBUS_URING_SUPPORTED
+    io_uring_sqe *sqe = static_cast<io_uring_sqe *>(nextSqe());
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = 0;
+    return true;
+#else
+    Q_UNUSED(target);
+    return false;
+#endif
+}
+
+/*
+ * 保证提交队列至少还能容纳count个请求，空间不足时先提交已有请求，用于链接的请求不跨越两次提交
+ *
+ * @param count: 请求数
+ *
+ * @return bool: true:成功 false:超过提交队列长度或提交失败
+ */
+bool DBusUring::reserve(unsigned count)
+{
+    if (ringFd < 0 || count > sqEntries) {
+        return false;
+    }
+    if (sqEntries - pendingSubmissions() >= count) {
+        return true;
+    }
+    return enter(0) >= 0 && sqEntries - pendingSubmissions() >= count;
+}
+
+unsigned DBusUring::publishSubmissions()
+{
+    if (ringFd < 0) {
+        return 0;
+    }
+    __atomic_store_n(sqTail, sqeTail, __ATOMIC_RELEASE);
+    return sqeTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * 尚未提交给内核的请求数
+ *
+ * @return unsigned: 请求数
+ */
+unsigned DBusUring::pendingSubmissions() const
+{
+    return ringFd < 0 ? 0 : sqeTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * 提交队列中的请求，按需等待完成事件
+ *
+ * @param timeout: 已有完成事件或为0时不等待，-1表示一直等待，毫秒
+ *
+ * @return int: 提交的请求数，出错返回-1
+ */
+int DBusUring::enter(int timeout)
+{
+#ifdef DBUS_URING_SUPPORTED
+    if (ringFd < 0) {
+        return -1;
+    }
+    const unsigned submit = publishSubmissions();
+    // 完成队列中已有事件时不需要等待
+    const bool wait = timeout != 0 && *cqHead == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    if (submit == 0 && !wait) {
+        return 0;
+    }
+    unsigned flags = 0;
+    io_uring_getevents_arg arg;
+    __kernel_timespec ts;
+    memset(&arg, 0, sizeof(arg));
+    if (wait) {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        if (timeout > 0) {
+            ts.tv_sec = timeout / 1000;
+            ts.tv_nsec = static_cast<long long>(timeout % 1000) * 1000000;
+            arg.ts = reinterpret_cast<quint64>(&ts);
+        }
+    }
+    enterCalls++;
+    const long ret = ::syscall(__NR_io_uring_enter, ringFd, submit, wait ? 1 : 0, flags, wait ? &arg : nullptr,
+                               wait ? sizeof(arg) : 0);
+    if (ret < 0) {
+        // 超时、被信号打断或内核暂时无法接收更多请求时由下一次调用继续提交
+        if (errno == ETIME || errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+            return 0;
+        }
+        qCritical() << "io_uring enter failed, errno:" << errno;
+        return -1;
+    }
+    return static_cast<int>(ret);
+#else
+    Q_UNUSED(timeout);
+    return -1;
+#endif
+}
+
+/*
+ * 取出完成事件，不需要系统调用
+ *
+ * @param completions: 输出完成事件
+ * @param max: 最多取出的数量
+ *
+ * @return unsigned: 取出的数量
+ */
+unsigned DBusUring::reap(DBusUringCompletion *completions, unsigned max)
+{
+#ifdef DBUS_URING_SUPPORTED
+    if (ringFd < 0) {
+        return 0;
+    }
+    unsigned head = *cqHead;
+    const unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    unsigned count = 0;
+    for (; head != tail && count < max; head++, count++) {
+        const io_uring_cqe &cqe = static_cast<const io_uring_cqe *>(cqes)[head & cqMask];
+        completions[count].userData = cqe.user_data;
+        completions[count].result = cqe.res;
+        completions[count].flags = cqe.flags;
+    }
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    return count;
+#else
+    Q_UNUSED(completions);
+    Q_UNUSED(max);
+    return 0;
+#endif
+}
+
+/*
+ * 解析multishot recvmsg完成事件对应的接收缓冲区
+ *
+ * @param msg: 提交请求时的msghdr
+ * @param completion: 完成事件，必须使用了接收缓冲区
+ * @param out: 输出数据与控制消息
+ *
+ * @return bool: true:成功 false:缓冲区内容不完整
+ */
+bool DBusUring::parseReceived(const msghdr *msg, const DBusUringCompletion &completion, DBusUringMessage *out) const
+{
+#ifdef DBUS_URING_SUPPORTED
+    const int id = completion.bufferId();
+    if (id < 0 || static_cast<unsigned>(id) >= bufferCount || completion.result < 0) {
+        return false;
+    }
+    // 缓冲区依次为io_uring_recvmsg_out、地址、控制消息与数据，地址与控制消息按请求中的长度预留
+    const char *buffer = bufferMemory + static_cast<size_t>(id) * bufferSize;
+    const size_t reserved = sizeof(io_uring_recvmsg_out) + msg->msg_namelen + msg->msg_controllen;
+    if (static_cast<size_t>(completion.result) < reserved) {
+        return false;
+    }
+    io_uring_recvmsg_out header;
+    memcpy(&header, buffer, sizeof(header));
+    if (header.payloadlen > completion.result - reserved || header.controllen > msg->msg_controllen) {
+        return false;
+    }
+    out->payload = buffer + reserved;
+    out->payloadSize = header.payloadlen;
+    memset(&out->control, 0, sizeof(out->control));
+    out->control.msg_control =
+        const_cast<char *>(buffer + sizeof(io_uring_recvmsg_out) + msg->msg_namelen);
+    out->control.msg_controllen = header.controllen;
+    out->truncated = header.flags & (MSG_CTRUNC | MSG_TRUNC);
+    return true;
+#else
+    Q_UNUSED(msg);
+    Q_UNUSED(completion);
+    Q_UNUSED(out);
+    return false;
+#endif
+}
+
+/*
+ * 归还接收缓冲区
+ *
+ * @param bufferId: 缓冲区编号
+ */
+void DBusUring::recycleBuffer(int bufferId)
+{
+#ifdef DBUS_URING_SUPPORTED
+    if (!bufferRegistered || bufferId < 0 || static_cast<unsigned>(bufferId) >= bufferCount) {
+        return;
+    }
+    io_uring_buf *bufs = static_cast<io_uring_buf *>(bufferRing);
+    io_uring_buf &item = bufs[bufferTail & (bufferCount - 1)];
+    item.addr = reinterpret_cast<quint64>(bufferMemory + static_cast<size_t>(bufferId) * bufferSize);
+    item.len = bufferSize;
+    item.bid = static_cast<quint16>(bufferId);
+    bufferTail++;
+    // 环的tail与第一项的resv字段重叠
+    unsigned short *tail =
+        reinterpret_cast<unsigned short *>(static_cast<char *>(bufferRing) + offsetof(io_uring_buf, resv));
+    __atomic_store_n(tail, bufferTail, __ATOMIC_RELEASE);
+#else
+    Q_UNUSED(bufferId);
+#endif
+}
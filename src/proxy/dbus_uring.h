@@ -0,0 +1,231 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_DBUS_PROXY_SRC_PROXY_DBUS_URING_H
+#define LINGLONG_DBUS_PROXY_SRC_PROXY_DBUS_URING_H
+
+#include <sys/socket.h>
+
+#include <QtGlobal>
+
+// 一个完成事件
+struct DBusUringCompletion {
+    // 提交时的用户数据
+    quint64 userData;
+    // 操作结果，出错时为负的errno
+    qint32 result;
+    // IORING_CQE_F_*标志
+    quint32 flags;
+
+    /*
+     * multishot请求是否还会产生后续完成事件
+     *
+     * @return bool: true:请求仍然有效 false:请求已结束
+     */
+    bool hasMore() const;
+
+    /*
+     * 内核为该次接收选择的缓冲区
+     *
+     * @return int: 缓冲区编号，没有使用缓冲区时返回-1
+     */
+    int bufferId() const;
+};
+
+// multishot recvmsg收到的一段数据，指向接收缓冲区，归还缓冲区后失效
+struct DBusUringMessage {
+    const char *payload;
+    quint32 payloadSize;
+    // 只设置了msg_control与msg_controllen，可用CMSG_FIRSTHDR遍历控制消息
+    msghdr control;
+    // 控制消息或数据被截断
+    bool truncated;
+};
+
+/*
+ * io_uring提交队列与完成队列的封装，直接使用系统调用，不依赖liburing
+ *
+ * 请求写入与内核共享的提交队列，enter时一次系统调用批量提交并按需等待；完成事件直接从共享内存读取，
+ * 不需要系统调用。同时注册一组由内核选择的接收缓冲区(provided buffer ring)，multishot接收时内核从中取用，
+ * 调用方处理完后归还。初始化时实际执行一次multishot recvmsg与按描述符取消，
+ * 内核或头文件不支持时isValid为false，调用方回退到epoll
+ */
+class DBusUring
+{
+public:
+    DBusUring();
+    ~DBusUring();
+
+    /*
+     * 创建io_uring并注册接收缓冲区
+     *
+     * @param entries: 提交队列长度，完成队列为其4倍
+     * @param bufferCount: 接收缓冲区数量，必须是2的幂
+     * @param bufferSize: 每个接收缓冲区的大小
+     *
+     * @return bool: true:成功 false:内核不支持或资源不足
+     */
+    bool init(unsigned entries, unsigned bufferCount, unsigned bufferSize);
+
+    /*
+     * 是否可用
+     *
+     * @return bool: true:可用 false:不可用
+     */
+    bool isValid() const { return ringFd >= 0; }
+
+    /*
+     * io_uring描述符，有完成事件时可读，可以交给事件循环等待
+     *
+     * @return int: 描述符
+     */
+    int descriptor() const { return ringFd; }
+
+    /*
+     * 添加multishot recvmsg请求，每次收到数据产生一个完成事件，数据写入内核选择的接收缓冲区
+     *
+     * @param fd: socket描述符
+     * @param msg: 只使用msg_namelen与msg_controllen，请求结束前必须保持有效
+     * @param userData: 用户数据，不能为0
+     *
+     * @return bool: true:成功 false:提交队列已满且提交失败
+     */
+    bool prepareReceive(int fd, const msghdr *msg, quint64 userData);
+
+    /*
+     * 添加sendmsg请求，MSG_WAITALL保证整段发送完成或出错
+     *
+     * @param fd: socket描述符
+     * @param msg: 数据与控制消息，请求完成前必须保持有效
+     * @param userData: 用户数据，不能为0
+     * @param link: 是否与下一个请求链接，前一个请求失败时后续请求被取消
+     *
+     * @return bool: true:成功 false:提交队列已满且提交失败
+     */
+    bool prepareSend(int fd, const msghdr *msg, quint64 userData, bool link);
+
+    /*
+     * 添加取消请求，取消描述符上所有未完成的请求，完成事件的用户数据为0
+     *
+     * @param fd: 描述符，提交前不能关闭
+     *
+     * @return bool: true:成功 false:提交队列已满且提交失败
+     */
+    bool prepareCancelFd(int fd);
+
+    /*
+     * 添加取消请求，取消用户数据为target的请求，完成事件的用户数据为0
+     *
+     * @param target: 要取消的请求的用户数据
+     *
+     * @return bool: true:成功 false:提交队列已满且提交失败
+     */
+    bool prepareCancelRequest(quint64 target);
+
+    /*
+     * 保证提交队列至少还能容纳count个请求，空间不足时先提交已有请求，用于链接的请求不跨越两次提交
+     *
+     * @param count: 请求数
+     *
+     * @return bool: true:成功 false:超过提交队列长度或提交失败
+     */
+    bool reserve(unsigned count);
+
+    /*
+     * 提交队列中的请求，按需等待完成事件
+     *
+     * @param timeout: 已有完成事件或为0时不等待，-1表示一直等待，毫秒
+     *
+     * @return int: 提交的请求数，出错返回-1
+     */
+    int enter(int timeout);
+
+    /*
+     * 尚未提交给内核的请求数
+     *
+     * @return unsigned: 请求数
+     */
+    unsigned pendingSubmissions() const;
+
+    /*
+     * 取出完成事件，不需要系统调用
+     *
+     * @param completions: 输出完成事件
+     * @param max: 最多取出的数量
+     *
+     * @return unsigned: 取出的数量
+     */
+    unsigned reap(DBusUringCompletion *completions, unsigned max);
+
+    /*
+     * 解析multishot recvmsg完成事件对应的接收缓冲区
+     *
+     * @param msg: 提交请求时的msghdr
+     * @param completion: 完成事件，必须使用了接收缓冲区
+     * @param out: 输出数据与控制消息
+     *
+     * @return bool: true:成功 false:缓冲区内容不完整
+     */
+    bool parseReceived(const msghdr *msg, const DBusUringCompletion &completion, DBusUringMessage *out) const;
+
+    /*
+     * 归还接收缓冲区
+     *
+     * @param bufferId: 缓冲区编号
+     */
+    void recycleBuffer(int bufferId);
+
+    /*
+     * io_uring_enter系统调用次数
+     *
+     * @return quint64: 次数
+     */
+    quint64 enterCount() const { return enterCalls; }
+
+private:
+    Q_DISABLE_COPY(DBusUring)
+
+    // 取一个空闲的提交项，提交队列满时先提交已有请求
+    void *nextSqe();
+
+    // 把本地写入的提交项发布给内核，返回尚未提交的数量
+    unsigned publishSubmissions();
+
+    // 确认内核支持multishot recvmsg、接收缓冲区与按描述符取消
+    bool probe();
+
+    // 释放所有资源
+    void release();
+
+    int ringFd;
+    void *sqRing;
+    size_t sqRingSize;
+    void *cqRing;
+    size_t cqRingSize;
+    void *sqeMemory;
+    size_t sqeMemorySize;
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned sqMask;
+    unsigned sqEntries;
+    // 本地已填写的提交项位置，publishSubmissions时发布给内核
+    unsigned sqeTail;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned cqMask;
+    void *cqes;
+    // 接收缓冲区环与缓冲区内存
+    void *bufferRing;
+    size_t bufferRingSize;
+    char *bufferMemory;
+    size_t bufferMemorySize;
+    unsigned bufferCount;
+    unsigned bufferSize;
+    unsigned short bufferTail;
+    bool bufferRegistered;
+    quint64 enterCalls;
+};
+#endif
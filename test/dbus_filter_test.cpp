@@ -8,7 +8,37 @@
 
 #include <QDebug>
 
+#include "filter/dbus_atom_table.h"
 #include "filter/dbus_filter.h"
+#include "filter/dbus_name_trie.h"
+#include "filter/dbus_policy.h"
+#include "filter/dbus_rule_matcher.h"
+#include "filter/dbus_verdict_cache.h"
+
+namespace {
+/*
+ * 使用libdbus生成消息并解析报文头
+ *
+ * @param msg: 消息，调用后释放
+ * @param arg0: 字符串类型的第一个参数，为nullptr时不添加参数
+ * @param header: 输出报文头，指向data
+ * @param data: 输出报文
+ */
+void parseMessage(DBusMessage *msg, const char *arg0, DBusHeaderView *header, QByteArray *data)
+{
+    if (arg0) {
+        dbus_message_append_args(msg, DBUS_TYPE_STRING, &arg0, DBUS_TYPE_INVALID);
+    }
+    dbus_message_set_serial(msg, 1);
+    char *buffer = nullptr;
+    int len = 0;
+    dbus_message_marshal(msg, &buffer, &len);
+    *data = QByteArray(buffer, len);
+    dbus_free(buffer);
+    dbus_message_unref(msg);
+    ASSERT_EQ(header->parse(data->constData(), static_cast<quint32>(data->size())), true);
+}
+} // namespace
 
 TEST(filter, filter01)
 {
@@ -65,4 +95,335 @@ TEST(filter, dump01)
     QString config = "";
     filter.dumpConfig(config);
     EXPECT_EQ(config.isEmpty(), false);
-}
\ No newline at end of file
+}
+TEST(filter, filter03)
+{
+    // 报文字段视图与QString参数的匹配结果一致
+    DbusFilter filter;
+    filter.addNameFilter("com.deepin.linglong.*");
+    filter.addNameFilter("org.freedesktop.portal.Desktop");
+    filter.addPathFilter("/com/deepin/linglong/*");
+    filter.addPathFilter("/org/freedesktop/portal/desktop");
+
+    bool ret = filter.isMessageMatch(QLatin1String("com.deepin.linglong.AppManager"),
+                                     QLatin1String("/com/deepin/linglong/PackageManager"), QLatin1String(""));
+    EXPECT_EQ(ret, true);
+    ret = filter.isMessageMatch(QLatin1String("org.freedesktop.portal.Desktop"),
+                                QLatin1String("/org/freedesktop/portal/desktop"), QLatin1String(""));
+    EXPECT_EQ(ret, true);
+    ret = filter.isMessageMatch(QLatin1String("com.deepin.test.AppManager"), QLatin1String("/com/deepin/test"),
+                                QLatin1String(""));
+    EXPECT_EQ(ret, false);
+}
+
+TEST(filter, filter04)
+{
+    // 规则为空时不需要解析报文头字段
+    DbusFilter filter;
+    EXPECT_EQ(filter.requiredHeaderFields(), DBUS_HEADER_FIELDS_NONE);
+    filter.addPathFilter("/com/deepin/linglong/*");
+    const quint32 fields = filter.requiredHeaderFields();
+    EXPECT_NE(fields & headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_DESTINATION), 0u);
+    EXPECT_NE(fields & headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_PATH), 0u);
+    EXPECT_NE(fields & headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_INTERFACE), 0u);
+    EXPECT_EQ(fields & headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_SENDER), 0u);
+}
+
+TEST(filter, filter05)
+{
+    // 编译后的匹配结果与逐条QRegExp查找一致
+    const QStringList rules = {"com.deepin.linglong.*",   "org.freedesktop.portal.Desktop", "/org/(gnome|kde)/.+",
+                               "com.[a-c]+x?",            "^org.test.End$*",                "org.test\\d*",
+                               "com.deepin.linglong.App"};
+    const QStringList inputs = {"com.deepin.linglong.AppManager",
+                                "com.deepin.linglong",
+                                "org.freedesktop.portal.Desktop",
+                                "org.freedesktop.portal.Desktop2",
+                                "/org/kde/KWin",
+                                "/org/gnome/",
+                                "com.b",
+                                "com.d",
+                                "org.test.End",
+                                "org.test.Ends",
+                                "org.test1",
+                                "com.deepin.linglong.App",
+                                ""};
+    const DBusRuleMatcher matcher(rules);
+    for (const QString &input : inputs) {
+        bool expected = false;
+        for (const QString &rule : rules) {
+            if (rule == input || (DBusRuleMatcher::isPattern(rule) && input.contains(QRegExp(rule)))) {
+                expected = true;
+                break;
+            }
+        }
+        EXPECT_EQ(matcher.isMatch(input), expected) << input.toStdString();
+        const QByteArray latin = input.toLatin1();
+        EXPECT_EQ(matcher.isMatch(QLatin1String(latin.constData(), latin.size())), expected) << input.toStdString();
+    }
+    const DBusRuleMatcherMetrics metrics = matcher.metrics();
+    EXPECT_EQ(metrics.exactRules, 2);
+    EXPECT_EQ(metrics.patternRules, 3);
+    EXPECT_EQ(metrics.regExpRules, 2);
+    EXPECT_GT(metrics.dfaStates, 0);
+}
+
+TEST(filter, filter06)
+{
+    // 以分隔符加*结尾的规则按段匹配子树，不再在任意位置查找
+    DbusFilter filter;
+    filter.addNameFilter("com.deepin.linglong.*");
+    filter.addPathFilter("/com/deepin/linglong/*");
+    filter.addPathFilter("/org/freedesktop/*/desktop");
+
+    EXPECT_EQ(filter.isMessageMatch("com.deepin.linglong", "", ""), true);
+    EXPECT_EQ(filter.isMessageMatch("com.deepin.linglong.AppManager", "", ""), true);
+    EXPECT_EQ(filter.isMessageMatch("xcom.deepin.linglongX", "", ""), false);
+    EXPECT_EQ(filter.isMessageMatch("com.deepin.linglongX", "", ""), false);
+    EXPECT_EQ(filter.isMessageMatch("", "/com/deepin/linglong/PackageManager", ""), true);
+    EXPECT_EQ(filter.isMessageMatch("", "/com/deepin/linglongX", ""), false);
+    EXPECT_EQ(filter.isMessageMatch("", "/org/freedesktop/portal/desktop", ""), true);
+    EXPECT_EQ(filter.isMessageMatch("", "/org/freedesktop/portal/a/desktop", ""), false);
+    EXPECT_EQ(filter.isMessageMatch(QLatin1String("xcom.deepin.linglongX"), QLatin1String(""), QLatin1String("")),
+              false);
+}
+
+TEST(filter, filter07)
+{
+    // 不能按段匹配的正则规则不进入前缀树
+    EXPECT_EQ(DBusNameTrie::isHierarchical("com.deepin.linglong.*", '.'), true);
+    EXPECT_EQ(DBusNameTrie::isHierarchical("com.deepin.*.Manager", '.'), true);
+    EXPECT_EQ(DBusNameTrie::isHierarchical("org.freedesktop.portal.Desktop*", '.'), false);
+    EXPECT_EQ(DBusNameTrie::isHierarchical("com.[a-c]+.*", '.'), false);
+    EXPECT_EQ(DBusNameTrie::isHierarchical("/com/deepin.linglong/*", '/'), false);
+
+    const QStringList rules = {"com.deepin.linglong.*", "org.kde.*.Manager", "org.freedesktop.portal.Desktop*"};
+    const DBusNameTrie trie(rules, '.');
+    EXPECT_EQ(trie.isMatch(QString("org.kde.KWin.Manager")), true);
+    EXPECT_EQ(trie.isMatch(QString("org.kde.KWin.Window.Manager")), false);
+    EXPECT_EQ(trie.isMatch(QString("org.freedesktop.portal.Desktop")), false);
+    const DBusNameTrieMetrics metrics = trie.metrics();
+    EXPECT_EQ(metrics.rules, 2);
+    EXPECT_EQ(metrics.wildcardNodes, 1);
+}
+
+TEST(filter, filter08)
+{
+    // 判定缓存按报文头字段命中，规则代数变化时清空，容量满时淘汰未被命中的条目
+    DbusFilter filter;
+    filter.addNameFilter("com.deepin.linglong.*");
+    DBusVerdictCache cache(2);
+    cache.setGeneration(filter.generation());
+
+    const DBusVerdictKey key(QLatin1String("com.deepin.linglong.AppManager"),
+                             QLatin1String("/com/deepin/linglong/PackageManager"),
+                             QLatin1String("com.deepin.linglong.PackageManager"), QLatin1String("Status"));
+    int verdict = -1;
+    EXPECT_EQ(cache.lookup(key, &verdict), false);
+    cache.insert(key, 1);
+    EXPECT_EQ(cache.lookup(key, &verdict), true);
+    EXPECT_EQ(verdict, 1);
+    // 字段边界不同的键不命中
+    const DBusVerdictKey shifted(QLatin1String("com.deepin.linglong.AppManager"),
+                                 QLatin1String("/com/deepin/linglong/PackageManagercom.deepin.linglong"),
+                                 QLatin1String(".PackageManager"), QLatin1String("Status"));
+    EXPECT_EQ(cache.lookup(shifted, &verdict), false);
+
+    const DBusVerdictKey other1(QLatin1String("org.freedesktop.Notifications"), QLatin1String(""),
+                                QLatin1String(""), QLatin1String(""));
+    const DBusVerdictKey other2(QLatin1String("org.freedesktop.portal.Desktop"), QLatin1String(""),
+                                QLatin1String(""), QLatin1String(""));
+    cache.insert(other1, 0);
+    cache.insert(other2, 0);
+    EXPECT_EQ(cache.lookup(key, &verdict), true);
+    EXPECT_EQ(cache.lookup(other1, &verdict) || cache.lookup(other2, &verdict), true);
+    EXPECT_EQ(cache.metrics().entries, 2);
+    EXPECT_EQ(cache.metrics().evictions, 1u);
+
+    filter.addPathFilter("/org/freedesktop/portal/desktop");
+    cache.setGeneration(filter.generation());
+    EXPECT_EQ(cache.lookup(key, &verdict), false);
+    const DBusVerdictCacheMetrics metrics = cache.metrics();
+    EXPECT_EQ(metrics.entries, 0);
+    EXPECT_EQ(metrics.invalidations, 1u);
+    EXPECT_GT(metrics.hits, 0u);
+}
+
+TEST(filter, filter09)
+{
+    // 原子按引用计数保留，引用归零后删除，超过内存上限时不再创建
+    DBusAtomTable table(1024);
+    const QLatin1String name("com.deepin.linglong.AppManager");
+    EXPECT_EQ(table.find(name), DBusAtomTable::kNoAtom);
+    EXPECT_EQ(table.intern(QLatin1String("")), DBusAtomTable::kEmptyAtom);
+
+    const int atom = table.intern(name);
+    EXPECT_GT(atom, DBusAtomTable::kEmptyAtom);
+    EXPECT_EQ(table.intern(name), atom);
+    EXPECT_EQ(table.find(name), atom);
+    EXPECT_EQ(table.text(atom), QByteArray("com.deepin.linglong.AppManager"));
+    table.release(atom);
+    EXPECT_EQ(table.find(name), atom);
+    table.release(atom);
+    EXPECT_EQ(table.find(name), DBusAtomTable::kNoAtom);
+    EXPECT_EQ(table.metrics().atoms, 0);
+    EXPECT_EQ(table.metrics().bytes, 0);
+
+    QVector<int> atoms;
+    for (int i = 0; i < 100; i++) {
+        const QByteArray text = QString("org.freedesktop.Name%1").arg(i).toLatin1();
+        const int item = table.intern(QLatin1String(text.constData(), text.size()));
+        if (item != DBusAtomTable::kNoAtom) {
+            atoms.append(item);
+        }
+    }
+    EXPECT_LT(atoms.size(), 100);
+    EXPECT_GT(table.metrics().rejected, 0u);
+    EXPECT_LE(table.metrics().bytes, 1024);
+    for (int item : atoms) {
+        table.release(item);
+    }
+    EXPECT_EQ(table.metrics().atoms, 0);
+}
+
+TEST(filter, filter10)
+{
+    // 策略规则按声明顺序优先于三个名单，没有匹配的策略规则时匹配名单的消息申请授权
+    DbusFilter filter;
+    filter.addNameFilter("org.freedesktop.*");
+    filter.addPathFilter("/org/freedesktop/*");
+    filter.addInterfaceFilter("org.freedesktop.*");
+    const quint64 generation = filter.generation();
+    EXPECT_EQ(filter.addRule("type='method_call',interface='org.freedesktop.DBus.Properties',member='Get',"
+                             "action='allow'"),
+              true);
+    EXPECT_EQ(filter.addRule("interface='org.freedesktop.Notifications',member='Notify',action='ask'"), true);
+    EXPECT_EQ(filter.addRule("type='method_call',destination='org.freedesktop.portal.Desktop',"
+                             "path_namespace='/org/freedesktop/portal',arg0namespace='org.freedesktop.host',"
+                             "action='deny'"),
+              true);
+    EXPECT_EQ(filter.addRule("interface='com.deepin.daemon.Audio',action='drop'"), true);
+    EXPECT_NE(filter.generation(), generation);
+    EXPECT_NE(filter.requiredHeaderFields()
+                  & headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_SIGNATURE),
+              0u);
+
+    DBusHeaderView header;
+    QByteArray data;
+    parseMessage(dbus_message_new_method_call("org.freedesktop.UPower", "/org/freedesktop/UPower",
+                                              "org.freedesktop.DBus.Properties", "Get"),
+                 "org.freedesktop.UPower", &header, &data);
+    DBusPolicyVerdict verdict = filter.evaluate(header);
+    EXPECT_EQ(verdict.action, DBusPolicyAction::Allow);
+    EXPECT_EQ(verdict.cacheable, true);
+    parseMessage(dbus_message_new_method_call("org.freedesktop.UPower", "/org/freedesktop/UPower",
+                                              "org.freedesktop.DBus.Properties", "Set"),
+                 nullptr, &header, &data);
+    EXPECT_EQ(filter.evaluate(header).action, DBusPolicyAction::Ask);
+    parseMessage(dbus_message_new_signal("/org/freedesktop/UPower", "org.freedesktop.DBus.Properties", "Get"),
+                 nullptr, &header, &data);
+    EXPECT_EQ(filter.evaluate(header).action, DBusPolicyAction::Ask);
+
+    parseMessage(dbus_message_new_method_call("org.freedesktop.Notifications", "/org/freedesktop/Notifications",
+                                              "org.freedesktop.Notifications", "Notify"),
+                 "demo", &header, &data);
+    EXPECT_EQ(filter.evaluate(header).action, DBusPolicyAction::Ask);
+
+    // arg0不在判定缓存的键中，检查过arg0的结果不能缓存
+    parseMessage(dbus_message_new_method_call("org.freedesktop.portal.Desktop", "/org/freedesktop/portal/desktop",
+                                              "org.freedesktop.portal.Documents", "Add"),
+                 "org.freedesktop.host.Files", &header, &data);
+    verdict = filter.evaluate(header);
+    EXPECT_EQ(verdict.action, DBusPolicyAction::Deny);
+    EXPECT_EQ(verdict.cacheable, false);
+    parseMessage(dbus_message_new_method_call("org.freedesktop.portal.Desktop", "/org/freedesktop/portal/desktop",
+                                              "org.freedesktop.portal.Documents", "Add"),
+                 "org.freedesktop.hostile", &header, &data);
+    verdict = filter.evaluate(header);
+    EXPECT_EQ(verdict.action, DBusPolicyAction::Ask);
+    EXPECT_EQ(verdict.cacheable, false);
+    parseMessage(dbus_message_new_method_call("org.freedesktop.portal.Desktop", "/org/freedesktop/portals",
+                                              "org.freedesktop.portal.Documents", "Add"),
+                 "org.freedesktop.host", &header, &data);
+    verdict = filter.evaluate(header);
+    EXPECT_EQ(verdict.action, DBusPolicyAction::Ask);
+    EXPECT_EQ(verdict.cacheable, true);
+
+    parseMessage(dbus_message_new_method_call("com.deepin.daemon.Audio", "/com/deepin/daemon/Audio",
+                                              "com.deepin.daemon.Audio", "SetPort"),
+                 nullptr, &header, &data);
+    EXPECT_EQ(filter.evaluate(header).action, DBusPolicyAction::Drop);
+    parseMessage(dbus_message_new_method_call("com.deepin.daemon.Audio", "/com/deepin/daemon/Audio",
+                                              "com.deepin.daemon.Display", "SetPort"),
+                 nullptr, &header, &data);
+    EXPECT_EQ(filter.evaluate(header).action, DBusPolicyAction::Allow);
+
+    // 规则语法与dbus匹配规则相同，必须指定action
+    DBusPolicyRule rule;
+    EXPECT_EQ(DBusPolicyRule::parse("arg0=it\\'s,action=deny", &rule), true);
+    EXPECT_EQ(rule.arg0, QByteArray("it's"));
+    EXPECT_EQ(rule.action, DBusPolicyAction::Deny);
+    EXPECT_EQ(rule.member.isNull(), true);
+    EXPECT_EQ(DBusPolicyRule::parse("interface='org.freedesktop.Notifications'", &rule), false);
+    EXPECT_EQ(DBusPolicyRule::parse("eavesdrop='true',action='allow'", &rule), false);
+    EXPECT_EQ(DBusPolicyRule::parse("type='bogus',action='allow'", &rule), false);
+    EXPECT_EQ(DBusPolicyRule::parse("path='org',action='allow'", &rule), false);
+    EXPECT_EQ(DBusPolicyRule::parse("path='/org',path_namespace='/org',action='allow'", &rule), false);
+    EXPECT_EQ(DBusPolicyRule::parse("member='Get,action='allow'", &rule), false);
+    EXPECT_EQ(filter.addRule("member='Get',action='maybe'"), false);
+
+    // 不限制interface或member的规则复制到各分支中
+    QVector<DBusPolicyRule> rules;
+    for (const QString &text : {QString("interface='a.b',member='C',action='allow'"),
+                                QString("interface='a.b',action='deny'"), QString("member='C',action='ask'")}) {
+        ASSERT_EQ(DBusPolicyRule::parse(text, &rule), true);
+        rules.append(rule);
+    }
+    DBusPolicy policy(rules);
+    const DBusPolicyMetrics metrics = policy.metrics();
+    EXPECT_EQ(metrics.rules, 3);
+    EXPECT_EQ(metrics.branches, 4 * 3);
+    EXPECT_EQ(metrics.leaves, 4 * 4);
+    EXPECT_EQ(metrics.leafRules, 4 * 5);
+
+    // 策略规则区分消息类型，判定缓存的键包含类型
+    DBusVerdictCache cache(4);
+    const DBusVerdictKey call(QLatin1String(""), QLatin1String("/a"), QLatin1String("a.b"), QLatin1String("C"),
+                              (int)MessageType::METHOD_CALL);
+    const DBusVerdictKey signal(QLatin1String(""), QLatin1String("/a"), QLatin1String("a.b"), QLatin1String("C"),
+                                (int)MessageType::SIGNAL);
+    int result = -1;
+    cache.insert(call, 0);
+    EXPECT_EQ(cache.lookup(signal, &result), false);
+    EXPECT_EQ(cache.lookup(call, &result), true);
+}
+
+TEST(filter, filter11)
+{
+    // 判定缓存在局部索引中解析原子，相同字段只保留一份，清空后归还进程原子表中的引用
+    DBusAtomTable *table = DBusAtomTable::instance();
+    const int before = table->metrics().atoms;
+    DBusVerdictCache cache(4);
+    const QLatin1String name("org.deepin.linglong.Demo");
+    const QLatin1String path("/org/deepin/linglong/Demo");
+    {
+        // 键的字段指向报文，插入后报文被覆盖不影响缓存
+        QByteArray packet("StatusRefresh");
+        cache.insert(DBusVerdictKey(name, path, name, QLatin1String(packet.constData(), 6)), 0);
+        cache.insert(DBusVerdictKey(name, path, name, QLatin1String(packet.constData() + 6, 7)), 1);
+        memset(packet.data(), 'x', static_cast<size_t>(packet.size()));
+    }
+    EXPECT_EQ(cache.metrics().atoms, 4);
+    EXPECT_EQ(table->metrics().atoms, before + 4);
+
+    int verdict = -1;
+    EXPECT_EQ(cache.lookup(DBusVerdictKey(name, path, name, QLatin1String("Refresh")), &verdict), true);
+    EXPECT_EQ(verdict, 1);
+    EXPECT_EQ(cache.lookup(DBusVerdictKey(name, path, name, QLatin1String("Status")), &verdict), true);
+    EXPECT_EQ(verdict, 0);
+    EXPECT_EQ(cache.lookup(DBusVerdictKey(name, path, name, QLatin1String("xxxxxx")), &verdict), false);
+
+    cache.invalidate();
+    EXPECT_EQ(cache.metrics().atoms, 0);
+    EXPECT_EQ(table->metrics().atoms, before);
+}
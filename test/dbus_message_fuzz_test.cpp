@@ -0,0 +1,422 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <dbus/dbus.h>
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include <QByteArray>
+#include <QtEndian>
+
+#include "message/dbus_header_view.h"
+
+// 对比原生报文头解析与libdbus的解析结果：原生解析接受的报文libdbus也必须接受且字段一致，
+// libdbus接受的报文原生解析也必须接受
+namespace {
+
+const char *const kPaths[] = {"/", "/org/freedesktop/DBus", "/com/deepin/linglong/PackageManager", "/a/b_c/D1"};
+const char *const kBusNames[] = {"org.freedesktop.DBus", ":1.42", "com.deepin.linglong.AppManager",
+                                 "org.gtk-vfs.Daemon", ":1.5475"};
+const char *const kInterfaces[] = {"org.freedesktop.DBus", "com.deepin.linglong.PackageManager",
+                                   "org.freedesktop.portal.FileChooser", "a.b"};
+const char *const kMembers[] = {"Hello", "Status", "NameAcquired", "_private1"};
+const char *const kErrorNames[] = {"org.freedesktop.DBus.Error.AccessDenied",
+                                   "org.freedesktop.DBus.Error.UnknownMethod"};
+
+template<size_t N>
+const char *pick(std::mt19937 &rng, const char *const (&items)[N])
+{
+    return items[rng() % N];
+}
+
+QByteArray marshal(DBusMessage *msg)
+{
+    char *buffer = nullptr;
+    int len = 0;
+    dbus_message_marshal(msg, &buffer, &len);
+    QByteArray ret(buffer, len);
+    dbus_free(buffer);
+    return ret;
+}
+
+// 使用libdbus随机生成一条合法的dbus消息
+QByteArray randomMessage(std::mt19937 &rng)
+{
+    const int type = 1 + static_cast<int>(rng() % 4);
+    DBusMessage *msg = dbus_message_new(type);
+    switch (type) {
+    case DBUS_MESSAGE_TYPE_METHOD_CALL:
+        dbus_message_set_path(msg, pick(rng, kPaths));
+        dbus_message_set_member(msg, pick(rng, kMembers));
+        if (rng() % 2) {
+            dbus_message_set_interface(msg, pick(rng, kInterfaces));
+        }
+        if (rng() % 2) {
+            dbus_message_set_destination(msg, pick(rng, kBusNames));
+        }
+        break;
+    case DBUS_MESSAGE_TYPE_METHOD_RETURN:
+        dbus_message_set_reply_serial(msg, 1 + rng() % 1000);
+        dbus_message_set_destination(msg, pick(rng, kBusNames));
+        break;
+    case DBUS_MESSAGE_TYPE_ERROR:
+        dbus_message_set_error_name(msg, pick(rng, kErrorNames));
+        dbus_message_set_reply_serial(msg, 1 + rng() % 1000);
+        break;
+    default:
+        dbus_message_set_path(msg, pick(rng, kPaths));
+        dbus_message_set_interface(msg, pick(rng, kInterfaces));
+        dbus_message_set_member(msg, pick(rng, kMembers));
+        break;
+    }
+    if (rng() % 2) {
+        dbus_message_set_sender(msg, pick(rng, kBusNames));
+    }
+
+    const int argCount = static_cast<int>(rng() % 3);
+    for (int i = 0; i < argCount; i++) {
+        if (rng() % 2) {
+            const char *str = pick(rng, kMembers);
+            dbus_message_append_args(msg, DBUS_TYPE_STRING, &str, DBUS_TYPE_INVALID);
+        } else {
+            QByteArray bytes(static_cast<int>(rng() % 4096), 'x');
+            const char *data = bytes.constData();
+            dbus_message_append_args(msg, DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE, &data, bytes.size(), DBUS_TYPE_INVALID);
+        }
+    }
+    dbus_message_set_serial(msg, 1 + rng() % 100000);
+    QByteArray ret = marshal(msg);
+    dbus_message_unref(msg);
+    return ret;
+}
+
+bool sameField(QLatin1String view, const char *expect)
+{
+    if (!expect || !*expect) {
+        return view.isEmpty();
+    }
+    return view == QLatin1String(expect);
+}
+
+// 比较原生解析与libdbus解析的报文头，返回是否一致
+::testing::AssertionResult sameHeader(const DBusHeaderView &header, DBusMessage *msg)
+{
+    if (header.type != dbus_message_get_type(msg) || header.serial != dbus_message_get_serial(msg)
+        || (header.hasReplySerial ? header.replySerial : 0) != dbus_message_get_reply_serial(msg)
+        || !sameField(header.path(), dbus_message_get_path(msg))
+        || !sameField(header.interface(), dbus_message_get_interface(msg))
+        || !sameField(header.member(), dbus_message_get_member(msg))
+        || !sameField(header.errorName(), dbus_message_get_error_name(msg))
+        || !sameField(header.destination(), dbus_message_get_destination(msg))
+        || !sameField(header.sender(), dbus_message_get_sender(msg))
+        || !sameField(header.signature(), dbus_message_get_signature(msg))) {
+        return ::testing::AssertionFailure() << "header mismatch, serial:" << header.serial;
+    }
+    return ::testing::AssertionSuccess();
+}
+
+DBusMessage *demarshal(const QByteArray &data)
+{
+    DBusError dbErr;
+    dbus_error_init(&dbErr);
+    DBusMessage *msg = dbus_message_demarshal(data.constData(), data.size(), &dbErr);
+    if (dbus_error_is_set(&dbErr)) {
+        dbus_error_free(&dbErr);
+    }
+    return msg;
+}
+
+// 协议允许未知的消息类型，代理无法按类型过滤，原生解析有意拒绝，不参与反向比较
+bool isKnownType(const QByteArray &data)
+{
+    return data.size() > 1 && data[1] >= DBUS_MESSAGE_TYPE_METHOD_CALL && data[1] <= DBUS_MESSAGE_TYPE_SIGNAL;
+}
+
+// 生成一个随机的完整类型签名，depth限制容器嵌套层数
+QByteArray randomType(std::mt19937 &rng, int depth)
+{
+    const char basics[] = "ybnutsogv";
+    const int kind = static_cast<int>(rng() % (depth > 0 ? 12 : 9));
+    switch (kind) {
+    case 9:
+        return "a" + randomType(rng, depth - 1);
+    case 10: {
+        QByteArray ret = "(";
+        const int count = 1 + static_cast<int>(rng() % 3);
+        for (int i = 0; i < count; i++) {
+            ret += randomType(rng, depth - 1);
+        }
+        return ret + ")";
+    }
+    case 11:
+        return "a{" + QByteArray(1, basics[rng() % 8]) + randomType(rng, depth - 1) + "}";
+    default:
+        return QByteArray(1, basics[kind]);
+    }
+}
+
+// 获取签名中一个完整类型之后的位置
+const char *skipType(const char *sig)
+{
+    int depth = 0;
+    do {
+        if (*sig == '(' || *sig == '{') {
+            depth++;
+        } else if (*sig == ')' || *sig == '}') {
+            depth--;
+        }
+    } while (*sig++ == 'a' || depth > 0);
+    return sig;
+}
+
+// 按签名向容器中追加一个随机值，type指向签名中的一个完整类型，追加后指向下一个类型
+void appendRandomValue(std::mt19937 &rng, DBusMessageIter *iter, const char **type)
+{
+    const char code = **type;
+    const char *next = skipType(*type);
+    const QByteArray inner(*type + 1, static_cast<int>(next - *type - 1));
+    *type = next;
+    switch (code) {
+    case 'a': {
+        DBusMessageIter array;
+        dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, inner.constData(), &array);
+        const int count = static_cast<int>(rng() % 3);
+        for (int i = 0; i < count; i++) {
+            const char *element = inner.constData();
+            appendRandomValue(rng, &array, &element);
+        }
+        dbus_message_iter_close_container(iter, &array);
+        break;
+    }
+    case '(':
+    case '{': {
+        // inner包含结尾的括号
+        DBusMessageIter item;
+        dbus_message_iter_open_container(iter, code == '(' ? DBUS_TYPE_STRUCT : DBUS_TYPE_DICT_ENTRY, nullptr, &item);
+        const char *field = inner.constData();
+        while (*field != ')' && *field != '}') {
+            appendRandomValue(rng, &item, &field);
+        }
+        dbus_message_iter_close_container(iter, &item);
+        break;
+    }
+    case 'v': {
+        const QByteArray contained = randomType(rng, 1);
+        DBusMessageIter variant;
+        dbus_message_iter_open_container(iter, DBUS_TYPE_VARIANT, contained.constData(), &variant);
+        const char *value = contained.constData();
+        appendRandomValue(rng, &variant, &value);
+        dbus_message_iter_close_container(iter, &variant);
+        break;
+    }
+    case 's': {
+        // 包含多字节字符的字符串
+        const char *const strings[] = {"", "org.deepin.linglong", "\xe4\xb8\xad\xe6\x96\x87", "\xf0\x9f\x98\x80x"};
+        const char *value = strings[rng() % 4];
+        dbus_message_iter_append_basic(iter, DBUS_TYPE_STRING, &value);
+        break;
+    }
+    case 'o': {
+        const char *value = pick(rng, kPaths);
+        dbus_message_iter_append_basic(iter, DBUS_TYPE_OBJECT_PATH, &value);
+        break;
+    }
+    case 'g': {
+        const char *const signatures[] = {"", "a{sv}", "(iu)ay", "v"};
+        const char *value = signatures[rng() % 4];
+        dbus_message_iter_append_basic(iter, DBUS_TYPE_SIGNATURE, &value);
+        break;
+    }
+    default: {
+        // 定长类型，布尔值只能为0或1
+        dbus_uint64_t value = (static_cast<dbus_uint64_t>(rng()) << 32) | rng();
+        if (code == 'b') {
+            value = 0;
+            *reinterpret_cast<dbus_bool_t *>(&value) = rng() % 2;
+        }
+        dbus_message_iter_append_basic(iter, code, &value);
+        break;
+    }
+    }
+}
+
+/*
+ * 在合法消息的报文头数组末尾追加一个未知字段，值由libdbus编码
+ *
+ * 以(yv)为签名的body与报文头数组中的一项编码相同，直接拼接到报文头数组之后
+ *
+ * @param rng: 随机数
+ * @param origin: 原消息，小端字节序
+ *
+ * @return QByteArray: 新消息
+ */
+QByteArray appendUnknownField(std::mt19937 &rng, const QByteArray &origin)
+{
+    DBusMessage *field = dbus_message_new_signal("/a", "a.b", "c");
+    DBusMessageIter iter;
+    dbus_message_iter_init_append(field, &iter);
+    const unsigned char code = static_cast<unsigned char>(DBUS_HEADER_FIELD_LAST + 1 + rng() % 200);
+    dbus_message_iter_append_basic(&iter, DBUS_TYPE_BYTE, &code);
+    const QByteArray type = "v";
+    const char *value = type.constData();
+    appendRandomValue(rng, &iter, &value);
+    dbus_message_set_serial(field, 1);
+    const QByteArray encoded = marshal(field);
+    dbus_message_unref(field);
+    DBusHeaderView fieldHeader;
+    fieldHeader.parse(encoded.constData(), encoded.size());
+    const QByteArray entry = encoded.mid(static_cast<int>(fieldHeader.headerLength));
+
+    DBusHeaderView header;
+    header.parse(origin.constData(), origin.size());
+    const quint32 arrayLen = qFromLittleEndian<quint32>(origin.constData() + 12);
+    QByteArray array = origin.mid(16, static_cast<int>(alignBy8(arrayLen)));
+    array += entry;
+    QByteArray ret = origin.left(16);
+    const quint32 newLen = static_cast<quint32>(array.size());
+    qToLittleEndian(newLen, reinterpret_cast<uchar *>(ret.data() + 12));
+    ret += array;
+    ret.append(QByteArray(static_cast<int>(alignBy8(16 + newLen) - (16 + newLen)), '\x0'));
+    ret += origin.mid(static_cast<int>(header.headerLength));
+    return ret;
+}
+
+} // namespace
+
+TEST(dbusmsgFuzz, validMessages)
+{
+    std::mt19937 rng(20221017);
+    for (int i = 0; i < 2000; i++) {
+        const QByteArray data = randomMessage(rng);
+        DBusHeaderView header;
+        ASSERT_TRUE(header.parse(data.constData(), data.size())) << data.toHex().constData();
+        DBusMessage *msg = demarshal(data);
+        ASSERT_NE(msg, nullptr);
+        EXPECT_TRUE(sameHeader(header, msg)) << data.toHex().constData();
+        dbus_message_unref(msg);
+
+        // 按需解析的字段与完整解析一致
+        const quint32 fields = headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_DESTINATION)
+            | headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_PATH)
+            | headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_INTERFACE);
+        DBusHeaderView lazyHeader;
+        ASSERT_TRUE(lazyHeader.parse(data.constData(), data.size(), fields)) << data.toHex().constData();
+        EXPECT_TRUE(lazyHeader.destination() == header.destination());
+        EXPECT_TRUE(lazyHeader.path() == header.path());
+        EXPECT_TRUE(lazyHeader.interface() == header.interface());
+        EXPECT_EQ(lazyHeader.headerLength, header.headerLength);
+    }
+}
+
+TEST(dbusmsgFuzz, mutatedHeaders)
+{
+    std::mt19937 rng(1017);
+    for (int i = 0; i < 20000; i++) {
+        const QByteArray origin = randomMessage(rng);
+        DBusHeaderView originHeader;
+        ASSERT_TRUE(originHeader.parse(origin.constData(), origin.size()));
+
+        // 只修改报文头，body保持不变
+        QByteArray data = origin;
+        const int count = 1 + static_cast<int>(rng() % 4);
+        for (int j = 0; j < count; j++) {
+            const int pos = static_cast<int>(rng() % originHeader.headerLength);
+            data[pos] = static_cast<char>(rng() % 2 ? rng() : data[pos] ^ (1 << (rng() % 8)));
+        }
+
+        DBusHeaderView header;
+        const bool accepted = header.parse(data.constData(), data.size());
+        DBusMessage *msg = demarshal(data);
+        if (msg && isKnownType(data)) {
+            EXPECT_TRUE(accepted) << "native parser rejected a message accepted by libdbus: "
+                                  << data.toHex().constData();
+        }
+        // body长度与签名未变时body仍然合法，libdbus必须同样接受；携带文件描述符的报文libdbus无法单独解析
+        if (accepted && header.length == originHeader.length && header.signature() == originHeader.signature()
+            && header.unixFds == 0) {
+            ASSERT_NE(msg, nullptr) << "native parser accepted a message rejected by libdbus: "
+                                    << data.toHex().constData();
+            EXPECT_TRUE(sameHeader(header, msg)) << data.toHex().constData();
+        }
+        if (msg) {
+            dbus_message_unref(msg);
+        }
+    }
+}
+
+TEST(dbusmsgFuzz, randomFrames)
+{
+    std::mt19937 rng(17);
+    for (int i = 0; i < 20000; i++) {
+        // 固定头部合法，报文头数组随机填充
+        const quint32 arrayLen = rng() % 256;
+        QByteArray data(static_cast<int>(alignBy8(16 + arrayLen)), '\x0');
+        data[0] = rng() % 2 ? 'l' : 'B';
+        data[1] = static_cast<char>(rng() % 5);
+        data[2] = static_cast<char>(rng() % 4);
+        data[3] = '\x1';
+        data[8] = static_cast<char>(1 + rng() % 255);
+        data[11] = static_cast<char>(1 + rng() % 255);
+        if (data[0] == 'l') {
+            data[12] = static_cast<char>(arrayLen);
+        } else {
+            data[15] = static_cast<char>(arrayLen);
+        }
+        for (quint32 j = 16; j < 16 + arrayLen; j++) {
+            // 偏向合法的字段编码、签名和字符串内容
+            const quint32 r = rng() % 8;
+            data[j] = static_cast<char>(r < 2 ? rng() % 10 : (r < 4 ? "osugl\x01/."[rng() % 8] : rng()));
+        }
+
+        DBusHeaderView header;
+        const bool accepted = header.parse(data.constData(), data.size());
+        DBusMessage *msg = demarshal(data);
+        if (msg && isKnownType(data)) {
+            EXPECT_TRUE(accepted) << "native parser rejected a message accepted by libdbus: "
+                                  << data.toHex().constData();
+        }
+        if (accepted && header.signature().isEmpty() && header.unixFds == 0) {
+            ASSERT_NE(msg, nullptr) << "native parser accepted a message rejected by libdbus: "
+                                    << data.toHex().constData();
+            EXPECT_TRUE(sameHeader(header, msg)) << data.toHex().constData();
+        }
+        if (msg) {
+            dbus_message_unref(msg);
+        }
+    }
+}
+
+TEST(dbusmsgFuzz, unknownFields)
+{
+    // 协议要求忽略未知的报文头字段，原生解析与libdbus一样跳过其值；变异后两者的判断仍然一致
+    std::mt19937 rng(20231017);
+    for (int i = 0; i < 5000; i++) {
+        const QByteArray origin = randomMessage(rng);
+        const QByteArray data = appendUnknownField(rng, origin);
+        DBusHeaderView header;
+        ASSERT_TRUE(header.parse(data.constData(), data.size())) << data.toHex().constData();
+        DBusMessage *msg = demarshal(data);
+        ASSERT_NE(msg, nullptr) << data.toHex().constData();
+        EXPECT_TRUE(sameHeader(header, msg)) << data.toHex().constData();
+        dbus_message_unref(msg);
+
+        // 只变异报文头数组中的未知字段
+        const quint32 fieldStart = alignBy8(16 + qFromLittleEndian<quint32>(origin.constData() + 12)) + 1;
+        QByteArray mutated = data;
+        const int count = 1 + static_cast<int>(rng() % 3);
+        for (int j = 0; j < count; j++) {
+            const int pos = static_cast<int>(fieldStart + rng() % (header.headerLength - fieldStart));
+            mutated[pos] = static_cast<char>(rng() % 2 ? rng() : mutated[pos] ^ (1 << (rng() % 8)));
+        }
+        const bool accepted = header.parse(mutated.constData(), mutated.size());
+        msg = demarshal(mutated);
+        EXPECT_EQ(accepted, msg != nullptr) << mutated.toHex().constData();
+        if (msg) {
+            dbus_message_unref(msg);
+        }
+    }
+}
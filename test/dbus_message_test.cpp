@@ -8,6 +8,11 @@
 
 #include <QDebug>
 
+#include "message/dbus_auth_state.h"
+#include "message/dbus_buffer_pool.h"
+#include "message/dbus_error_reply.h"
+#include "message/dbus_frame_reader.h"
+#include "message/dbus_header_view.h"
 #include "message/dbus_message.h"
 
 TEST(dbusmsg, message01)
@@ -125,4 +130,418 @@ TEST(dbusmsg, message07)
     EXPECT_EQ(ret, true);
     bool isMemberOk = (header.member == "Hello");
     EXPECT_EQ(isMemberOk, true);
-}
\ No newline at end of file
+}
+TEST(dbusmsg, frameReader01)
+{
+    // 一条消息分多次到达时，收齐之前不输出
+    QByteArray byteArray(
+        "l\x01\x00\x01\x00\x00\x00\x00\x01\x00\x00\x00n\x00\x00\x00\x01\x01o\x00\x15\x00\x00\x00/org/freedesktop/DBus\x00\x00\x00\x06\x01s\x00\x14\x00\x00\x00org.freedesktop.DBus\x00\x00\x00\x00\x02\x01s\x00\x14\x00\x00\x00org.freedesktop.DBus\x00\x00\x00\x00\x03\x01s\x00\x05\x00\x00\x00Hello\x00\x00\x00",
+        128);
+    DBusFrameReader reader;
+    DBusFrame frame;
+    reader.append("BEGIN\r\n", 7);
+    EXPECT_EQ(reader.nextFrame(&frame), true);
+    EXPECT_EQ(frame.isAuth, true);
+    for (int i = 0; i < byteArray.size() - 1; i++) {
+        reader.append(byteArray.constData() + i, 1);
+        EXPECT_EQ(reader.nextFrame(&frame), false);
+    }
+    reader.append(byteArray.constData() + byteArray.size() - 1, 1);
+    EXPECT_EQ(reader.nextFrame(&frame), true);
+    EXPECT_EQ(frame.isAuth, false);
+    EXPECT_EQ(frame.toByteArray(), byteArray);
+    EXPECT_EQ(reader.pendingSize(), 0);
+}
+
+TEST(dbusmsg, frameReader02)
+{
+    // 认证报文与第一条消息在同一次读取中到达
+    QByteArray hello(
+        "l\x01\x00\x01\x00\x00\x00\x00\x01\x00\x00\x00n\x00\x00\x00\x01\x01o\x00\x15\x00\x00\x00/org/freedesktop/DBus\x00\x00\x00\x06\x01s\x00\x14\x00\x00\x00org.freedesktop.DBus\x00\x00\x00\x00\x02\x01s\x00\x14\x00\x00\x00org.freedesktop.DBus\x00\x00\x00\x00\x03\x01s\x00\x05\x00\x00\x00Hello\x00\x00\x00",
+        128);
+    QByteArray auth("\x00"
+                    "AUTH EXTERNAL 31303030\r\n",
+                    25);
+    QByteArray byteArray = auth + QByteArray("BEGIN\r\n") + hello + hello.left(20);
+    DBusFrameReader reader;
+    reader.append(byteArray.constData(), byteArray.size());
+    QList<QByteArray> out;
+    DBusFrame frame;
+    while (reader.nextFrame(&frame)) {
+        out.push_back(frame.toByteArray());
+    }
+    EXPECT_EQ(out.size(), 3);
+    EXPECT_EQ(out[0], auth);
+    EXPECT_EQ(out[1], QByteArray("BEGIN\r\n"));
+    EXPECT_EQ(out[2], hello);
+    EXPECT_EQ(reader.isBinaryMode(), true);
+    EXPECT_EQ(reader.pendingSize(), 20);
+    EXPECT_EQ(reader.hasError(), false);
+}
+
+TEST(dbusmsg, frameReader03)
+{
+    // 非法的字节序标志
+    QByteArray byteArray("x\x01\x00\x01\x00\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00", 16);
+    DBusFrameReader reader;
+    reader.append("BEGIN\r\n", 7);
+    reader.append(byteArray.constData(), byteArray.size());
+    DBusFrame frame;
+    EXPECT_EQ(reader.nextFrame(&frame), true);
+    EXPECT_EQ(reader.nextFrame(&frame), false);
+    EXPECT_EQ(reader.hasError(), true);
+}
+
+TEST(dbusmsg, headerView01)
+{
+    QByteArray byteArray(
+        "l\x01\x00\x01\x14\x00\x00\x00\x02\x00\x00\x00\x9F\x00\x00\x00\x01\x01o\x00#\x00\x00\x00/com/deepin/linglong/PackageManager\x00\x00\x00\x00\x00\x02\x01s\x00\"\x00\x00\x00"
+        "com.deepin.linglong.PackageManager\x00\x00\x00\x00\x00\x00\x03\x01s\x00\x04\x00\x00\x00test\x00\x00\x00\x00\x06\x01s\x00\x1E\x00\x00\x00"
+        "com.deepin.linglong.AppManager\x00\x00\b\x01g\x00\x01s\x00\x00\x0F\x00\x00\x00org.deepin.demo\x00",
+        196);
+    DBusHeaderView header;
+    bool ret = header.parse(byteArray.constData(), byteArray.size());
+    EXPECT_EQ(ret, true);
+    EXPECT_EQ(header.serial, 2u);
+    EXPECT_EQ(header.headerLength, 176u);
+    EXPECT_EQ(header.length, 20u);
+    EXPECT_EQ(header.path() == QLatin1String("/com/deepin/linglong/PackageManager"), true);
+    EXPECT_EQ(header.interface() == QLatin1String("com.deepin.linglong.PackageManager"), true);
+    EXPECT_EQ(header.member() == QLatin1String("test"), true);
+    EXPECT_EQ(header.destination() == QLatin1String("com.deepin.linglong.AppManager"), true);
+    EXPECT_EQ(header.signature() == QLatin1String("s"), true);
+    EXPECT_EQ(header.sender().isEmpty(), true);
+    EXPECT_EQ(header.toString(header.memberRef), QString("test"));
+}
+
+TEST(dbusmsg, headerView02)
+{
+    // 报文头数组长度超出报文长度
+    QByteArray byteArray(
+        "l\x01\x00\x01\x00\x00\x00\x00\x01\x00\x00\x00n\x00\x00\x00\x01\x01o\x00\x15\x00\x00\x00/org/freedesktop/DBus\x00\x00\x00\x06\x01s\x00\x14\x00\x00\x00org.freedesktop.DBus\x00\x00\x00\x00\x02\x01s\x00\x14\x00\x00\x00org.freedesktop.DBus\x00\x00\x00\x00\x03\x01s\x00\x05\x00\x00\x00Hello\x00\x00\x00",
+        128);
+    DBusHeaderView header;
+    EXPECT_EQ(header.parse(byteArray.constData(), byteArray.size()), true);
+    EXPECT_EQ(header.parse(byteArray.constData(), 100), false);
+    byteArray[12] = '\xFF';
+    EXPECT_EQ(header.parse(byteArray.constData(), byteArray.size()), false);
+}
+
+TEST(dbusmsg, headerView03)
+{
+    // 只解码需要的字段
+    QByteArray byteArray(
+        "l\x01\x00\x01\x00\x00\x00\x00\x01\x00\x00\x00n\x00\x00\x00\x01\x01o\x00\x15\x00\x00\x00/org/freedesktop/DBus\x00\x00\x00\x06\x01s\x00\x14\x00\x00\x00org.freedesktop.DBus\x00\x00\x00\x00\x02\x01s\x00\x14\x00\x00\x00org.freedesktop.DBus\x00\x00\x00\x00\x03\x01s\x00\x05\x00\x00\x00Hello\x00\x00\x00",
+        128);
+    DBusHeaderView header;
+    bool ret = header.parse(byteArray.constData(), byteArray.size(),
+                            headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_DESTINATION));
+    EXPECT_EQ(ret, true);
+    EXPECT_EQ(header.destination() == QLatin1String("org.freedesktop.DBus"), true);
+    EXPECT_EQ(header.path().isEmpty(), true);
+    EXPECT_EQ(header.member().isEmpty(), true);
+
+    // 不需要任何字段时只解析固定头部
+    ret = header.parse(byteArray.constData(), byteArray.size(), DBUS_HEADER_FIELDS_NONE);
+    EXPECT_EQ(ret, true);
+    EXPECT_EQ(header.serial, 1u);
+    EXPECT_EQ(header.headerLength, 128u);
+    EXPECT_EQ(header.destination().isEmpty(), true);
+    EXPECT_EQ(header.parse(byteArray.constData(), 100, DBUS_HEADER_FIELDS_NONE), false);
+
+    // 跳过的字段长度越界同样视为非法报文
+    byteArray[20] = '\x7F';
+    ret = header.parse(byteArray.constData(), byteArray.size(),
+                       headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_DESTINATION));
+    EXPECT_EQ(ret, false);
+}
+
+TEST(dbusmsg, headerView04)
+{
+    // 大端序报文
+    QByteArray byteArray(
+        "B\x01\x00\x01\x00\x00\x00\x00\x00\x00\x00\x01\x00\x00\x00n\x01\x01o\x00\x00\x00\x00\x15/org/freedesktop/DBus\x00\x00\x00\x06\x01s\x00\x00\x00\x00\x14org.freedesktop.DBus\x00\x00\x00\x00\x02\x01s\x00\x00\x00\x00\x14org.freedesktop.DBus\x00\x00\x00\x00\x03\x01s\x00\x00\x00\x00\x05Hello\x00\x00\x00",
+        128);
+    DBusHeaderView header;
+    bool ret = header.parse(byteArray.constData(), byteArray.size());
+    EXPECT_EQ(ret, true);
+    EXPECT_EQ(header.bigEndian, true);
+    EXPECT_EQ(header.serial, 1u);
+    EXPECT_EQ(header.headerLength, 128u);
+    EXPECT_EQ(header.path() == QLatin1String("/org/freedesktop/DBus"), true);
+    EXPECT_EQ(header.destination() == QLatin1String("org.freedesktop.DBus"), true);
+    EXPECT_EQ(header.member() == QLatin1String("Hello"), true);
+
+    // 字段值签名与字段定义不一致
+    byteArray[18] = 's';
+    EXPECT_EQ(header.parse(byteArray.constData(), byteArray.size()), false);
+}
+
+TEST(dbusmsg, authState01)
+{
+    // 客户端连续发送AUTH、NEGOTIATE_UNIX_FD、BEGIN，dbus-daemon方向收到全部回复后才切换
+    DBusAuthStateMachine auth;
+    EXPECT_EQ(auth.handleClientLine("\x00" "AUTH EXTERNAL 31303030\r\n", 25), true);
+    EXPECT_EQ(auth.handleClientLine("NEGOTIATE_UNIX_FD\r\n", 19), true);
+    EXPECT_EQ(auth.handleClientLine("BEGIN\r\n", 7), true);
+    EXPECT_EQ(auth.isBinary(DBusAuthPeer::Client), true);
+    EXPECT_EQ(auth.isBinary(DBusAuthPeer::Server), false);
+    EXPECT_EQ(auth.handleServerLine("OK 1234deadbeef\r\n", 17), true);
+    EXPECT_EQ(auth.isAuthenticated(), true);
+    EXPECT_EQ(auth.isBinary(DBusAuthPeer::Server), false);
+    EXPECT_EQ(auth.handleServerLine("AGREE_UNIX_FD\r\n", 15), true);
+    EXPECT_EQ(auth.isUnixFdNegotiated(), true);
+    EXPECT_EQ(auth.isBinary(DBusAuthPeer::Server), true);
+}
+
+TEST(dbusmsg, authState02)
+{
+    // 违反认证协议
+    DBusAuthStateMachine auth;
+    EXPECT_EQ(auth.handleServerLine("OK 1234deadbeef\r\n", 17), false);
+    EXPECT_EQ(auth.handleClientLine("AUTH EXTERNAL\n", 14), false);
+    EXPECT_EQ(auth.handleClientLine("AUTH\r\n", 6), true);
+    EXPECT_EQ(auth.handleServerLine("REJECTED EXTERNAL\r\n", 19), true);
+    EXPECT_EQ(auth.isAuthenticated(), false);
+    // BEGIN之后不能再发送认证命令
+    EXPECT_EQ(auth.handleClientLine("BEGINX\r\n", 8), true);
+    EXPECT_EQ(auth.isBinary(DBusAuthPeer::Client), false);
+    EXPECT_EQ(auth.handleClientLine("BEGIN\r\n", 7), true);
+    EXPECT_EQ(auth.handleClientLine("DATA\r\n", 6), false);
+}
+
+TEST(dbusmsg, frameReader04)
+{
+    QByteArray hello(
+        "l\x01\x00\x01\x00\x00\x00\x00\x01\x00\x00\x00n\x00\x00\x00\x01\x01o\x00\x15\x00\x00\x00/org/freedesktop/DBus\x00\x00\x00\x06\x01s\x00\x14\x00\x00\x00org.freedesktop.DBus\x00\x00\x00\x00\x02\x01s\x00\x14\x00\x00\x00org.freedesktop.DBus\x00\x00\x00\x00\x03\x01s\x00\x05\x00\x00\x00Hello\x00\x00\x00",
+        128);
+    QByteArray authLine("\x00"
+                        "AUTH EXTERNAL 31303030\r\n",
+                        25);
+    DBusFrame frame;
+
+    // BEGIN之前以"l"开头的数据仍按认证报文处理
+    DBusFrameReader reader;
+    reader.append(authLine.constData(), authLine.size());
+    reader.append(hello.constData(), hello.size());
+    EXPECT_EQ(reader.nextFrame(&frame), true);
+    EXPECT_EQ(frame.isAuth, true);
+    EXPECT_EQ(reader.nextFrame(&frame), false);
+    EXPECT_EQ(reader.isBinaryMode(), false);
+    EXPECT_EQ(reader.hasError(), false);
+
+    // 两个方向共用认证状态机，客户端在dbus-daemon回复OK前已发送BEGIN
+    QSharedPointer<DBusAuthStateMachine> auth(new DBusAuthStateMachine());
+    DBusFrameReader clientReader(auth, DBusAuthPeer::Client);
+    DBusFrameReader serverReader(auth, DBusAuthPeer::Server);
+    QByteArray clientData = authLine + QByteArray("BEGIN\r\n") + hello;
+    clientReader.append(clientData.constData(), clientData.size());
+    int count = 0;
+    while (clientReader.nextFrame(&frame)) {
+        count++;
+    }
+    EXPECT_EQ(count, 3);
+    EXPECT_EQ(frame.isAuth, false);
+
+    // dbus-daemon的OK与第一条二进制消息在同一次读取中到达
+    QByteArray serverData = QByteArray("OK 1234deadbeef\r\n") + hello;
+    serverReader.append(serverData.constData(), serverData.size());
+    EXPECT_EQ(serverReader.nextFrame(&frame), true);
+    EXPECT_EQ(frame.isAuth, true);
+    EXPECT_EQ(serverReader.nextFrame(&frame), true);
+    EXPECT_EQ(frame.isAuth, false);
+    EXPECT_EQ(frame.toByteArray(), hello);
+    EXPECT_EQ(serverReader.isBinaryMode(), true);
+}
+
+TEST(dbusmsg, errorReply01)
+{
+    QByteArray hello(
+        "l\x01\x00\x01\x00\x00\x00\x00\x01\x00\x00\x00n\x00\x00\x00\x01\x01o\x00\x15\x00\x00\x00/org/freedesktop/DBus\x00\x00\x00\x06\x01s\x00\x14\x00\x00\x00org.freedesktop.DBus\x00\x00\x00\x00\x02\x01s\x00\x14\x00\x00\x00org.freedesktop.DBus\x00\x00\x00\x00\x03\x01s\x00\x05\x00\x00\x00Hello\x00\x00\x00",
+        128);
+    DBusHeaderView request;
+    EXPECT_EQ(request.parse(hello.constData(), hello.size()), true);
+
+    // 追加在已有数据之后，生成的报文可被libdbus解析
+    QByteArray out("pending");
+    EXPECT_EQ(accessDeniedReply().appendTo(request, 9, QLatin1String(":1.585"), &out), true);
+    EXPECT_EQ(out.startsWith("pending"), true);
+    const QByteArray reply = out.mid(7);
+    DBusError err;
+    dbus_error_init(&err);
+    DBusMessage *msg = dbus_message_demarshal(reply.constData(), reply.size(), &err);
+    ASSERT_NE(msg, nullptr);
+    EXPECT_EQ(dbus_message_get_type(msg), DBUS_MESSAGE_TYPE_ERROR);
+    EXPECT_EQ(QString(dbus_message_get_error_name(msg)), QString("org.freedesktop.DBus.Error.AccessDenied"));
+    EXPECT_EQ(QString(dbus_message_get_destination(msg)), QString(":1.585"));
+    EXPECT_EQ(dbus_message_get_serial(msg), 9u);
+    EXPECT_EQ(dbus_message_get_reply_serial(msg), 1u);
+    EXPECT_EQ(dbus_message_get_no_reply(msg), TRUE);
+    const char *text = nullptr;
+    EXPECT_EQ(dbus_message_get_args(msg, &err, DBUS_TYPE_STRING, &text, DBUS_TYPE_INVALID), TRUE);
+    EXPECT_EQ(QString(text), QString("org.freedesktop.DBus.Error.AccessDenied, please config permission first!"));
+    dbus_message_unref(msg);
+
+    // 未获取到客户端地址时不写入DESTINATION字段
+    out.clear();
+    EXPECT_EQ(accessDeniedReply().appendTo(request, 2, QLatin1String(""), &out), true);
+    DBusHeaderView header;
+    EXPECT_EQ(header.parse(out.constData(), out.size()), true);
+    EXPECT_EQ(header.type, static_cast<uchar>(MessageType::ERROR));
+    EXPECT_EQ(header.replySerial, 1u);
+    EXPECT_EQ(header.destination().isEmpty(), true);
+    EXPECT_EQ(validateDBusMsg(out.constData(), out.size()), true);
+
+    EXPECT_EQ(accessDeniedReply().appendTo(request, 3, QLatin1String(QByteArray(256, 'a').constData()), &out),
+              false);
+}
+
+TEST(dbusmsg, frameReader05)
+{
+    // 报文头长度176，body长度20
+    QByteArray call(
+        "l\x01\x00\x01\x14\x00\x00\x00\x02\x00\x00\x00\x9F\x00\x00\x00\x01\x01o\x00#\x00\x00\x00/com/deepin/linglong/PackageManager\x00\x00\x00\x00\x00\x02\x01s\x00\"\x00\x00\x00"
+        "com.deepin.linglong.PackageManager\x00\x00\x00\x00\x00\x00\x03\x01s\x00\x04\x00\x00\x00test\x00\x00\x00\x00\x06\x01s\x00\x1E\x00\x00\x00"
+        "com.deepin.linglong.AppManager\x00\x00\b\x01g\x00\x01s\x00\x00\x0F\x00\x00\x00org.deepin.demo\x00",
+        196);
+    DBusFrameReader reader;
+    reader.startBinaryMode();
+    reader.setCutThroughThreshold(100);
+    DBusFrame frame;
+
+    // 报文头未完整到达时不输出
+    reader.append(call.constData(), 170);
+    EXPECT_EQ(reader.nextFrame(&frame), false);
+    // 报文头到达后立即输出，body随到随出
+    reader.append(call.constData() + 170, 10);
+    EXPECT_EQ(reader.nextFrame(&frame), true);
+    EXPECT_EQ(frame.offset, 0u);
+    EXPECT_EQ(frame.size, 176u);
+    EXPECT_EQ(frame.messageSize, 196u);
+    EXPECT_EQ(frame.isComplete(), false);
+    DBusHeaderView header;
+    EXPECT_EQ(header.parsePartial(frame.data, frame.size, frame.messageSize), true);
+    EXPECT_EQ(header.member() == QLatin1String("test"), true);
+    EXPECT_EQ(header.parse(frame.data, frame.size), false);
+    QByteArray forwarded = frame.toByteArray();
+    EXPECT_EQ(reader.nextFrame(&frame), true);
+    EXPECT_EQ(frame.offset, 176u);
+    EXPECT_EQ(frame.size, 4u);
+    forwarded.append(frame.toByteArray());
+    EXPECT_EQ(reader.nextFrame(&frame), false);
+    reader.append(call.constData() + 180, 16);
+    EXPECT_EQ(reader.nextFrame(&frame), true);
+    EXPECT_EQ(frame.offset, 180u);
+    forwarded.append(frame.toByteArray());
+    EXPECT_EQ(forwarded, call);
+
+    // 丢弃被拒绝的大消息，后续消息不受影响
+    reader.append(call.constData(), 180);
+    EXPECT_EQ(reader.nextFrame(&frame), true);
+    EXPECT_EQ(frame.isComplete(), false);
+    reader.discardMessage();
+    EXPECT_EQ(reader.nextFrame(&frame), false);
+    reader.append(call.constData() + 180, 16);
+    reader.append(call.constData(), call.size());
+    EXPECT_EQ(reader.nextFrame(&frame), true);
+    EXPECT_EQ(frame.isComplete(), true);
+    EXPECT_EQ(frame.toByteArray(), call);
+    EXPECT_EQ(reader.pendingSize(), 0);
+    EXPECT_EQ(reader.hasError(), false);
+}
+
+TEST(dbusmsg, bufferPool01)
+{
+    // 报文头长度176，body长度20
+    QByteArray call(
+        "l\x01\x00\x01\x14\x00\x00\x00\x02\x00\x00\x00\x9F\x00\x00\x00\x01\x01o\x00#\x00\x00\x00/com/deepin/linglong/PackageManager\x00\x00\x00\x00\x00\x02\x01s\x00\"\x00\x00\x00"
+        "com.deepin.linglong.PackageManager\x00\x00\x00\x00\x00\x00\x03\x01s\x00\x04\x00\x00\x00test\x00\x00\x00\x00\x06\x01s\x00\x1E\x00\x00\x00"
+        "com.deepin.linglong.AppManager\x00\x00\b\x01g\x00\x01s\x00\x00\x0F\x00\x00\x00org.deepin.demo\x00",
+        196);
+    QSharedPointer<DBusBufferPool> pool(new DBusBufferPool(256, 2));
+    DBusFrameReader first;
+    DBusFrameReader second;
+    DBusFrameReader third;
+    for (DBusFrameReader *reader : {&first, &second, &third}) {
+        reader->setBufferPool(pool);
+        reader->startBinaryMode();
+    }
+    DBusFrame frame;
+
+    // 有数据时借出一块，数据取空后归还，下次读取复用同一块
+    first.append(call.constData(), call.size());
+    EXPECT_EQ(pool->metrics().lentChunks, 1);
+    EXPECT_EQ(first.nextFrame(&frame), true);
+    EXPECT_EQ(frame.toByteArray(), call);
+    first.releaseBuffer();
+    EXPECT_EQ(pool->metrics().lentChunks, 0);
+    EXPECT_EQ(pool->metrics().freeChunks, 1);
+    first.append(call.constData(), call.size());
+    EXPECT_EQ(pool->metrics().allocations, 1u);
+    EXPECT_EQ(pool->metrics().reuses, 1u);
+
+    // 不完整的消息保留在块中，不归还
+    second.append(call.constData(), 100);
+    second.releaseBuffer();
+    EXPECT_EQ(pool->metrics().lentChunks, 2);
+
+    // 达到容量上限后自行分配内存
+    third.append(call.constData(), call.size());
+    EXPECT_EQ(pool->metrics().exhausted, 1u);
+    EXPECT_EQ(third.nextFrame(&frame), true);
+    EXPECT_EQ(frame.toByteArray(), call);
+
+    // 超过块大小的消息转移到单独分配的内存，借出的块立即归还
+    second.append(call.constData() + 100, call.size() - 100);
+    second.append(call.constData(), call.size());
+    second.append(call.constData(), call.size());
+    EXPECT_EQ(pool->metrics().lentChunks, 1);
+    EXPECT_GT(second.capacity(), 256);
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(second.nextFrame(&frame), true);
+        EXPECT_EQ(frame.toByteArray(), call);
+    }
+    second.releaseBuffer();
+    EXPECT_EQ(second.capacity(), 0);
+
+    // 缩小容量时释放多余的空闲块
+    first.nextFrame(&frame);
+    first.releaseBuffer();
+    pool->setCapacity(0);
+    EXPECT_EQ(pool->metrics().freeChunks, 0);
+    EXPECT_EQ(pool->metrics().lentChunks, 0);
+}
+
+TEST(dbusmsg, headerView05)
+{
+    // 读取字符串类型的第一个参数，body尚未到达时无法判断
+    QByteArray byteArray(
+        "l\x01\x00\x01\x14\x00\x00\x00\x02\x00\x00\x00\x9F\x00\x00\x00\x01\x01o\x00#\x00\x00\x00/com/deepin/linglong/PackageManager\x00\x00\x00\x00\x00\x02\x01s\x00\"\x00\x00\x00"
+        "com.deepin.linglong.PackageManager\x00\x00\x00\x00\x00\x00\x03\x01s\x00\x04\x00\x00\x00test\x00\x00\x00\x00\x06\x01s\x00\x1E\x00\x00\x00"
+        "com.deepin.linglong.AppManager\x00\x00\b\x01g\x00\x01s\x00\x00\x0F\x00\x00\x00org.deepin.demo\x00",
+        196);
+    DBusHeaderView header;
+    QLatin1String arg0("");
+    EXPECT_EQ(header.parse(byteArray.constData(), byteArray.size()), true);
+    EXPECT_EQ(header.stringArg0(&arg0), DBusHeaderView::Arg0String);
+    EXPECT_EQ(arg0 == QLatin1String("org.deepin.demo"), true);
+
+    EXPECT_EQ(header.parsePartial(byteArray.constData(), 176, byteArray.size()), true);
+    EXPECT_EQ(header.stringArg0(&arg0), DBusHeaderView::Arg0Pending);
+    EXPECT_EQ(header.parsePartial(byteArray.constData(), 195, byteArray.size()), true);
+    EXPECT_EQ(header.stringArg0(&arg0), DBusHeaderView::Arg0Pending);
+
+    // 没有解析签名字段
+    EXPECT_EQ(header.parse(byteArray.constData(), byteArray.size(),
+                           headerFieldMask(DBusMessageHeaderField::DBUS_MESSAGE_HEADER_FIELD_MEMBER)),
+              true);
+    EXPECT_EQ(header.stringArg0(&arg0), DBusHeaderView::Arg0Absent);
+
+    // 字符串长度超出body或缺少结尾的0
+    byteArray[176] = '\x10';
+    EXPECT_EQ(header.parse(byteArray.constData(), byteArray.size()), true);
+    EXPECT_EQ(header.stringArg0(&arg0), DBusHeaderView::Arg0Absent);
+    byteArray[176] = '\x0E';
+    EXPECT_EQ(header.parse(byteArray.constData(), byteArray.size()), true);
+    EXPECT_EQ(header.stringArg0(&arg0), DBusHeaderView::Arg0Absent);
+}
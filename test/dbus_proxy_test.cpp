@@ -6,10 +6,30 @@
 
 #include <gtest/gtest.h>
 
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <thread>
+
+#include <QCoreApplication>
+#include <QDateTime>
 #include <QDebug>
 #include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QPointer>
 
+#include "proxy/dbus_output_queue.h"
+#include "proxy/dbus_permission_map.h"
 #include "proxy/dbus_proxy.h"
+#include "proxy/dbus_proxy_session.h"
+#include "proxy/dbus_reactor.h"
+#include "proxy/dbus_splice_relay.h"
 
 TEST(dbusProxy, proxy01)
 {
@@ -17,7 +37,7 @@ TEST(dbusProxy, proxy01)
     DbusProxy server;
     server.saveDbusDaemonPath(daemonPath);
 
-    QLocalSocket *proxyClient = new QLocalSocket();
+    DBusSocket *proxyClient = new DBusSocket();
     bool ret = server.startConnectDbusDaemon(proxyClient, daemonPath);
     delete proxyClient;
     EXPECT_EQ(ret, true);
@@ -28,3 +48,889 @@ TEST(dbusProxy, proxy01)
     ret = server.startListenBoxClient(socketPath);
     EXPECT_EQ(ret, true);
 }
+
+TEST(dbusProxy, outputQueue01)
+{
+    const QString socketPath = QDir::currentPath() + "/output_queue_socket";
+    QLocalServer::removeServer(socketPath);
+    QLocalServer server;
+    EXPECT_EQ(server.listen(socketPath), true);
+    DBusSocket sender;
+    sender.connectToServer(socketPath);
+    EXPECT_EQ(sender.state(), QLocalSocket::ConnectedState);
+    EXPECT_EQ(server.waitForNewConnection(1000), true);
+    QLocalSocket *receiver = server.nextPendingConnection();
+    ASSERT_NE(receiver, nullptr);
+
+    DBusOutputQueue queue(&sender, 64 * 1024, 16 * 1024);
+    int drainedCount = 0;
+    QObject::connect(&queue, &DBusOutputQueue::drained, [&drainedCount]() { drainedCount++; });
+
+    // 对端未读取时写入不阻塞，超过高水位后队列为满
+    const QByteArray data(256 * 1024, 'x');
+    EXPECT_EQ(queue.write(data.constData(), data.size()), true);
+    EXPECT_EQ(queue.isFull(), true);
+    EXPECT_EQ(queue.metrics().pauseCount, 1u);
+    EXPECT_EQ(queue.metrics().peakQueuedBytes, data.size());
+
+    // 对端读取后队列排空
+    qint64 received = 0;
+    for (int i = 0; i < 1000 && received < data.size(); i++) {
+        sender.waitForBytesWritten(10);
+        if (receiver->waitForReadyRead(10)) {
+            received += receiver->readAll().size();
+        }
+    }
+    EXPECT_EQ(received, data.size());
+    EXPECT_EQ(queue.isFull(), false);
+    EXPECT_EQ(queue.queuedBytes(), 0);
+    EXPECT_EQ(queue.metrics().totalBytes, data.size());
+    EXPECT_EQ(drainedCount, 1);
+}
+
+TEST(dbusProxy, proxy02)
+{
+    // dbus-daemon不可用时连接立即返回，不阻塞事件循环
+    DbusProxy server;
+    server.setDaemonConnectTimeout(100);
+    DBusSocket *proxyClient = new DBusSocket();
+    QElapsedTimer timer;
+    timer.start();
+    bool ret = server.startConnectDbusDaemon(proxyClient, QDir::currentPath() + "/not_exist_bus");
+    EXPECT_EQ(ret, true);
+    EXPECT_LT(timer.elapsed(), 100);
+    EXPECT_NE(proxyClient->state(), QLocalSocket::ConnectedState);
+    delete proxyClient;
+
+    EXPECT_EQ(server.startConnectDbusDaemon(nullptr, ""), false);
+}
+
+TEST(dbusProxy, splice01)
+{
+    DBusSpliceRelay relay;
+    ASSERT_EQ(relay.isValid(), true);
+    int source[2];
+    int dest[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, source), 0);
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, dest), 0);
+
+    // 只有固定头部的小端method call，body为64KiB
+    const quint32 bodySize = 64 * 1024;
+    QByteArray msg(16, '\0');
+    msg[0] = 'l';
+    msg[1] = 1;
+    msg[3] = 1;
+    qToLittleEndian<quint32>(bodySize, reinterpret_cast<uchar *>(msg.data() + 4));
+    qToLittleEndian<quint32>(1, reinterpret_cast<uchar *>(msg.data() + 8));
+    QByteArray body(static_cast<int>(bodySize), '\0');
+    for (int i = 0; i < body.size(); i++) {
+        body[i] = static_cast<char>(i * 7);
+    }
+    msg.append(body);
+    ASSERT_EQ(::write(source[0], msg.constData(), static_cast<size_t>(msg.size())), msg.size());
+
+    // 读入报文头后，body在缓冲区之外直接转发
+    DBusFrameReader reader;
+    reader.startBinaryMode();
+    reader.setCutThroughThreshold(1024);
+    char head[16];
+    ASSERT_EQ(::read(source[1], head, sizeof(head)), 16);
+    reader.append(head, sizeof(head));
+    DBusFrame frame;
+    ASSERT_EQ(reader.nextFrame(&frame), true);
+    EXPECT_EQ(frame.isComplete(), false);
+    EXPECT_EQ(reader.streamRemaining(), bodySize);
+
+    QByteArray spill;
+    qint64 lost = -1;
+    const qint64 moved = relay.relay(source[1], dest[0], reader.streamRemaining(), &spill, &lost);
+    EXPECT_EQ(moved, bodySize);
+    EXPECT_EQ(lost, 0);
+    reader.skipStream(static_cast<quint32>(moved));
+    EXPECT_EQ(reader.streamRemaining(), 0u);
+    EXPECT_EQ(reader.nextFrame(&frame), false);
+
+    // 目标写不下的部分取回到spill，两者按顺序拼接后与原body一致
+    QByteArray received(static_cast<int>(bodySize), '\0');
+    qint64 size = 0;
+    while (size < bodySize) {
+        const ssize_t ret = ::read(dest[1], received.data() + size, static_cast<size_t>(bodySize - size));
+        if (ret <= 0) {
+            break;
+        }
+        size += ret;
+    }
+    EXPECT_EQ(static_cast<quint64>(size), relay.metrics().splicedBytes);
+    EXPECT_EQ(static_cast<quint64>(spill.size()), relay.metrics().copiedBytes);
+    received.resize(static_cast<int>(size));
+    EXPECT_EQ(received + spill, body);
+
+    for (int fd : {source[0], source[1], dest[0], dest[1]}) {
+        ::close(fd);
+    }
+}
+
+TEST(dbusProxy, unixFd01)
+{
+    int pair[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, pair), 0);
+    DBusSocket sender;
+    DBusSocket receiver;
+    ASSERT_EQ(sender.setSocketDescriptor(pair[0]), true);
+    ASSERT_EQ(receiver.setSocketDescriptor(pair[1]), true);
+
+    // 第二条消息携带文件描述符，合并发送时文件描述符附加在该消息的第一个字节上
+    const int memFd = memfd_create("dbus-proxy-test", 0);
+    ASSERT_GE(memFd, 0);
+    ASSERT_EQ(::write(memFd, "linglong", 8), 8);
+    const QByteArray first(100, 'a');
+    const QByteArray second(200, 'b');
+    DBusOutputQueue queue(&sender, 64 * 1024, 16 * 1024);
+    queue.enqueue(first.constData(), first.size());
+    queue.enqueue(second.constData(), second.size(), QVector<int>() << memFd);
+    EXPECT_EQ(queue.flush(), true);
+
+    // 文件描述符随第二条消息的数据到达，按到达顺序取出
+    QByteArray received;
+    char buf[1024];
+    for (int i = 0; i < 100 && received.size() < first.size() + second.size(); i++) {
+        receiver.waitForReadyRead(10);
+        const qint64 ret = receiver.read(buf, sizeof(buf));
+        if (ret > 0) {
+            received.append(buf, static_cast<int>(ret));
+        }
+    }
+    EXPECT_EQ(received, first + second);
+    ASSERT_EQ(receiver.pendingFdCount(), 1);
+    QVector<int> fds;
+    EXPECT_EQ(receiver.takeFds(2, &fds), false);
+    ASSERT_EQ(receiver.takeFds(1, &fds), true);
+    ASSERT_EQ(fds.size(), 1);
+    char content[8];
+    EXPECT_EQ(::pread(fds[0], content, sizeof(content), 0), 8);
+    EXPECT_EQ(QByteArray(content, sizeof(content)), QByteArray("linglong"));
+    ::close(fds[0]);
+}
+
+namespace {
+// 每次只读取一块数据的读取者，用于验证读取预算用完后由reactor在下一轮继续分发
+class ChunkListener : public DBusSocketListener
+{
+public:
+    bool socketReadable(DBusSocket *socket) override
+    {
+        calls++;
+        char buf[1024];
+        const qint64 ret = socket->read(buf, sizeof(buf));
+        if (ret > 0) {
+            received.append(buf, static_cast<int>(ret));
+        }
+        return socket->bytesAvailable() > 0;
+    }
+
+    int calls = 0;
+    QByteArray received;
+};
+} // namespace
+
+TEST(dbusProxy, reactor01)
+{
+    DBusReactor reactor;
+    ASSERT_EQ(reactor.isValid(), true);
+    int pair[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, pair), 0);
+    DBusSocket sender;
+    DBusSocket receiver;
+    sender.setReactor(&reactor);
+    receiver.setReactor(&reactor);
+    ASSERT_EQ(sender.setSocketDescriptor(pair[0]), true);
+    ASSERT_EQ(receiver.setSocketDescriptor(pair[1]), true);
+    ChunkListener listener;
+    receiver.setListener(&listener);
+
+    // 写入的数据由reactor在下一轮发送，读取者每轮只读1KiB，其余推迟到后续轮次
+    const QByteArray data(4096, 'x');
+    EXPECT_EQ(sender.write(data.constData(), data.size()), data.size());
+    EXPECT_EQ(sender.bytesToWrite(), data.size());
+    for (int i = 0; i < 10 && listener.received.size() < data.size(); i++) {
+        reactor.poll(100);
+    }
+    EXPECT_EQ(sender.bytesToWrite(), 0);
+    EXPECT_EQ(listener.received, data);
+    EXPECT_EQ(listener.calls, 4);
+    EXPECT_GE(reactor.metrics().deferred, 3u);
+
+    // 对端关闭后读完剩余数据再关闭socket
+    sender.abort();
+    for (int i = 0; i < 10 && receiver.state() != QLocalSocket::UnconnectedState; i++) {
+        reactor.poll(100);
+    }
+    EXPECT_EQ(receiver.state(), QLocalSocket::UnconnectedState);
+}
+
+namespace {
+// 读完所有数据的读取者，记录读到第一个文件描述符时已收到的字节数
+class DrainListener : public DBusSocketListener
+{
+public:
+    bool socketReadable(DBusSocket *socket) override
+    {
+        char buf[64 * 1024];
+        qint64 ret = 0;
+        while ((ret = socket->read(buf, sizeof(buf))) > 0) {
+            received.append(buf, static_cast<int>(ret));
+            if (fdOffset < 0 && socket->pendingFdCount() > 0) {
+                fdOffset = received.size();
+            }
+        }
+        return false;
+    }
+
+    int fdOffset = -1;
+    QByteArray received;
+};
+} // namespace
+
+TEST(dbusProxy, uring01)
+{
+    // 内核不支持io_uring时回退到epoll，两种后端行为一致
+    DBusReactor reactor(DBusReactor::IoUring);
+    ASSERT_EQ(reactor.isValid(), true);
+    int pair[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, pair), 0);
+    DBusSocket sender;
+    DBusSocket receiver;
+    sender.setReactor(&reactor);
+    receiver.setReactor(&reactor);
+    ASSERT_EQ(sender.setSocketDescriptor(pair[0]), true);
+    ASSERT_EQ(receiver.setSocketDescriptor(pair[1]), true);
+    DrainListener listener;
+    receiver.setListener(&listener);
+
+    // 文件描述符随第二段数据到达，超过接收高水位的数据暂停接收后继续读完
+    const int memFd = memfd_create("dbus-proxy-test", 0);
+    ASSERT_GE(memFd, 0);
+    ASSERT_EQ(::write(memFd, "linglong", 8), 8);
+    const QByteArray first(100, 'a');
+    const QByteArray second(200, 'b');
+    const QByteArray bulk(4 * 1024 * 1024, 'c');
+    EXPECT_EQ(sender.write(first.constData(), first.size()), first.size());
+    EXPECT_EQ(sender.writeWithFds(second.constData(), second.size(), QVector<int>() << memFd), second.size());
+    EXPECT_EQ(sender.write(bulk.constData(), bulk.size()), bulk.size());
+    const int total = first.size() + second.size() + bulk.size();
+    for (int i = 0; i < 1000 && listener.received.size() < total; i++) {
+        reactor.poll(100);
+    }
+    EXPECT_EQ(sender.bytesToWrite(), 0);
+    EXPECT_EQ(listener.received, first + second + bulk);
+    EXPECT_GT(listener.fdOffset, first.size());
+    ASSERT_EQ(receiver.pendingFdCount(), 1);
+    QVector<int> fds;
+    ASSERT_EQ(receiver.takeFds(1, &fds), true);
+    char content[8];
+    EXPECT_EQ(::pread(fds[0], content, sizeof(content), 0), 8);
+    EXPECT_EQ(QByteArray(content, sizeof(content)), QByteArray("linglong"));
+    ::close(fds[0]);
+
+    // 对端关闭后关闭socket
+    sender.abort();
+    for (int i = 0; i < 10 && receiver.state() != QLocalSocket::UnconnectedState; i++) {
+        reactor.poll(100);
+    }
+    EXPECT_EQ(receiver.state(), QLocalSocket::UnconnectedState);
+}
+
+TEST(dbusProxy, worker01)
+{
+    // 监听线程接受连接需要事件循环
+    static int argc = 1;
+    static char name[] = "dbus-proxy-test";
+    static char *argv[] = {name, nullptr};
+    if (!QCoreApplication::instance()) {
+        new QCoreApplication(argc, argv);
+    }
+    DbusProxy server;
+    server.saveDbusDaemonPath(QDir::currentPath() + "/not_exist_bus");
+    server.setDaemonConnectTimeout(200);
+    server.setWorkerCount(2);
+    server.setWorkerBalance(DbusProxy::RoundRobin);
+    const QString socketPath = QDir::currentPath() + "/worker_socket";
+    ASSERT_EQ(server.startListenBoxClient(socketPath), true);
+    EXPECT_EQ(server.workerLoads(), QVector<int>() << 0 << 0);
+
+    // 三个客户端轮流分配给两个工作线程
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath.toLocal8Bit().constData(), sizeof(addr.sun_path) - 1);
+    QVector<int> clients;
+    for (int i = 0; i < 3; i++) {
+        const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)), 0);
+        clients.append(fd);
+    }
+    QElapsedTimer timer;
+    timer.start();
+    while (timer.elapsed() < 1000 && server.workerLoads() != (QVector<int>() << 2 << 1)) {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+    }
+    EXPECT_EQ(server.workerLoads(), QVector<int>() << 2 << 1);
+
+    // dbus-daemon不可用，超过连接期限后工作线程断开各自的客户端
+    while (timer.elapsed() < 5000 && server.workerLoads() != (QVector<int>() << 0 << 0)) {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+    }
+    EXPECT_EQ(server.workerLoads(), QVector<int>() << 0 << 0);
+    for (int fd : clients) {
+        char c;
+        EXPECT_EQ(::recv(fd, &c, 1, MSG_DONTWAIT), 0);
+        ::close(fd);
+    }
+}
+
+TEST(dbusProxy, session01)
+{
+    // 会话是两个socket的读取者，由socket直接找到所属会话，两个socket随会话释放
+    DbusProxy proxy;
+    QPointer<DBusSocket> boxClient(new DBusSocket());
+    QPointer<DBusSocket> daemonClient(new DBusSocket());
+    DBusProxySession *session = new DBusProxySession(&proxy, boxClient, daemonClient, 1024, 512);
+    EXPECT_EQ(DBusProxySession::fromSocket(boxClient), session);
+    EXPECT_EQ(DBusProxySession::fromSocket(daemonClient), session);
+    EXPECT_EQ(session->boxSocket(), boxClient.data());
+    EXPECT_EQ(session->daemonSocket(), daemonClient.data());
+    EXPECT_EQ(session->isDaemonConnected(), false);
+    EXPECT_EQ(session->uniqueName().isEmpty(), true);
+    EXPECT_EQ(session->metrics().clientMessages, 0u);
+    delete session;
+    EXPECT_EQ(boxClient.isNull(), true);
+    EXPECT_EQ(daemonClient.isNull(), true);
+
+    // dbus-daemon不可用，超过连接期限后断开客户端并释放会话
+    static int argc = 1;
+    static char name[] = "dbus-proxy-test";
+    static char *argv[] = {name, nullptr};
+    if (!QCoreApplication::instance()) {
+        new QCoreApplication(argc, argv);
+    }
+    DbusProxy server;
+    server.saveDbusDaemonPath(QDir::currentPath() + "/not_exist_bus");
+    server.setDaemonConnectTimeout(200);
+    const QString socketPath = QDir::currentPath() + "/session_socket";
+    ASSERT_EQ(server.startListenBoxClient(socketPath), true);
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath.toLocal8Bit().constData(), sizeof(addr.sun_path) - 1);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)), 0);
+    QElapsedTimer timer;
+    timer.start();
+    while (timer.elapsed() < 1000 && server.sessionCount() != 1) {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+    }
+    EXPECT_EQ(server.sessionCount(), 1);
+    while (timer.elapsed() < 5000 && server.sessionCount() != 0) {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+    }
+    EXPECT_EQ(server.sessionCount(), 0);
+    char c;
+    EXPECT_EQ(::recv(fd, &c, 1, MSG_DONTWAIT), 0);
+    ::close(fd);
+}
+
+namespace {
+/*
+ * 使用libdbus生成消息并解析报文头
+ *
+ * @param msg: 消息，调用后释放
+ * @param serial: 消息serial
+ * @param header: 输出报文头，指向data
+ * @param data: 输出报文
+ */
+void parseMessage(DBusMessage *msg, quint32 serial, DBusHeaderView *header, QByteArray *data)
+{
+    dbus_message_set_serial(msg, serial);
+    char *buffer = nullptr;
+    int len = 0;
+    dbus_message_marshal(msg, &buffer, &len);
+    *data = QByteArray(buffer, len);
+    dbus_free(buffer);
+    dbus_message_unref(msg);
+    ASSERT_EQ(header->parse(data->constData(), static_cast<quint32>(data->size())), true);
+}
+
+DBusMessage *helloReply(quint32 replySerial, const char *uniqueName)
+{
+    DBusMessage *msg = dbus_message_new(DBUS_MESSAGE_TYPE_METHOD_RETURN);
+    dbus_message_set_reply_serial(msg, replySerial);
+    dbus_message_set_destination(msg, uniqueName);
+    return msg;
+}
+} // namespace
+
+TEST(dbusProxy, session02)
+{
+    // 每个会话由各自Hello调用的回复得到唯一名称，与其它会话收到的消息无关
+    DbusProxy proxy;
+    DBusProxySession first(&proxy, new DBusSocket(), new DBusSocket(), 1024, 512);
+    DBusProxySession second(&proxy, new DBusSocket(), new DBusSocket(), 1024, 512);
+    DBusHeaderView header;
+    QByteArray data;
+    EXPECT_NE(first.clientHeaderFields(), DBUS_HEADER_FIELDS_NONE);
+    EXPECT_EQ(first.daemonHeaderFields(), DBUS_HEADER_FIELDS_NONE);
+    parseMessage(dbus_message_new_method_call("org.freedesktop.DBus", "/org/freedesktop/DBus",
+                                              "org.freedesktop.DBus", "Hello"),
+                 1, &header, &data);
+    first.trackClientMessage(header);
+    second.trackClientMessage(header);
+    EXPECT_EQ(first.clientHeaderFields(), DBUS_HEADER_FIELDS_NONE);
+    EXPECT_NE(first.daemonHeaderFields(), DBUS_HEADER_FIELDS_NONE);
+
+    // 其它消息与serial不同的回复不会改变唯一名称
+    DBusMessage *signal =
+        dbus_message_new_signal("/org/freedesktop/DBus", "org.freedesktop.DBus", "NameAcquired");
+    dbus_message_set_destination(signal, ":1.99");
+    parseMessage(signal, 2, &header, &data);
+    EXPECT_EQ(first.trackDaemonMessage(header), false);
+    parseMessage(helloReply(2, ":1.98"), 3, &header, &data);
+    EXPECT_EQ(first.trackDaemonMessage(header), false);
+    EXPECT_EQ(first.uniqueName().isEmpty(), true);
+
+    parseMessage(helloReply(1, ":1.10"), 4, &header, &data);
+    EXPECT_EQ(first.trackDaemonMessage(header), true);
+    parseMessage(helloReply(1, ":1.11"), 5, &header, &data);
+    EXPECT_EQ(second.trackDaemonMessage(header), true);
+    EXPECT_EQ(first.uniqueName(), QByteArray(":1.10"));
+    EXPECT_EQ(second.uniqueName(), QByteArray(":1.11"));
+    // 得到唯一名称后不再解析dbus-daemon消息
+    EXPECT_EQ(first.daemonHeaderFields(), DBUS_HEADER_FIELDS_NONE);
+    EXPECT_EQ(first.trackDaemonMessage(header), false);
+    EXPECT_EQ(first.uniqueName(), QByteArray(":1.10"));
+
+    // 第一条消息不是Hello时不跟踪
+    DBusProxySession third(&proxy, new DBusSocket(), new DBusSocket(), 1024, 512);
+    parseMessage(dbus_message_new_method_call("org.deepin.linglong.demo", "/org/deepin/linglong/demo",
+                                              "org.deepin.linglong.demo", "Hello"),
+                 1, &header, &data);
+    third.trackClientMessage(header);
+    EXPECT_EQ(third.clientHeaderFields(), DBUS_HEADER_FIELDS_NONE);
+    EXPECT_EQ(third.daemonHeaderFields(), DBUS_HEADER_FIELDS_NONE);
+}
+
+namespace {
+/*
+ * 获取当前进程的常驻内存
+ *
+ * @return qint64: 字节数
+ */
+qint64 residentBytes()
+{
+    QFile statm("/proc/self/statm");
+    if (!statm.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    const QList<QByteArray> fields = statm.readAll().split(' ');
+    return fields.size() > 1 ? fields[1].toLongLong() * sysconf(_SC_PAGESIZE) : 0;
+}
+
+/*
+ * 模拟dbus-daemon，完成认证后向唯一的连接持续发送广播信号
+ *
+ * @param listenFd: 监听描述符
+ * @param signal: 广播信号
+ * @param total: 发送的总字节数
+ * @param sent: 输出已发送的字节数
+ */
+void floodSignals(int listenFd, const QByteArray &signal, qint64 total, std::atomic<qint64> *sent)
+{
+    pollfd item = {listenFd, POLLIN, 0};
+    if (::poll(&item, 1, 5000) <= 0) {
+        return;
+    }
+    const int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+    QByteArray auth;
+    char c = 0;
+    while (!auth.endsWith("BEGIN\r\n") && ::read(fd, &c, 1) == 1) {
+        auth.append(c);
+        if (auth.endsWith("\r\n") && auth.contains("AUTH")) {
+            const char reply[] = "OK 0123456789abcdef0123456789abcdef\r\n";
+            ::write(fd, reply, sizeof(reply) - 1);
+            auth.clear();
+        }
+    }
+    // 代理暂停读取时等待，超过期限后停止发送
+    QElapsedTimer timer;
+    timer.start();
+    qint64 offset = 0;
+    while (sent->load() < total && timer.elapsed() < 20000) {
+        item = {fd, POLLOUT, 0};
+        if (::poll(&item, 1, 10) <= 0) {
+            continue;
+        }
+        const ssize_t ret = ::send(fd, signal.constData() + offset, static_cast<size_t>(signal.size() - offset),
+                                   MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (ret < 0) {
+            if (errno == EAGAIN) {
+                continue;
+            }
+            break;
+        }
+        offset = (offset + ret) % signal.size();
+        sent->fetch_add(ret);
+    }
+    ::close(fd);
+}
+} // namespace
+
+TEST(dbusProxy, memory01)
+{
+    static int argc = 1;
+    static char name[] = "dbus-proxy-test";
+    static char *argv[] = {name, nullptr};
+    if (!QCoreApplication::instance()) {
+        new QCoreApplication(argc, argv);
+    }
+    // 4KiB的广播信号
+    DBusMessage *msg = dbus_message_new_signal("/org/deepin/linglong/demo", "org.deepin.linglong.demo", "Changed");
+    const QByteArray payload(4096, 'x');
+    const char *arg = payload.constData();
+    dbus_message_append_args(msg, DBUS_TYPE_STRING, &arg, DBUS_TYPE_INVALID);
+    DBusHeaderView header;
+    QByteArray signal;
+    parseMessage(msg, 1, &header, &signal);
+
+    const QString daemonPath = QDir::currentPath() + "/memory_bus";
+    ::unlink(daemonPath.toLocal8Bit().constData());
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, daemonPath.toLocal8Bit().constData(), sizeof(addr.sun_path) - 1);
+    const int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ASSERT_EQ(bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)), 0);
+    ASSERT_EQ(listen(listenFd, 1), 0);
+
+    // 会话上限1MiB，发往box客户端的队列超过128KiB后丢弃广播信号
+    DbusProxy server;
+    server.saveDbusDaemonPath(daemonPath);
+    server.setMemoryLimits(1024 * 1024, 64 * 1024 * 1024);
+    const QString socketPath = QDir::currentPath() + "/memory_socket";
+    ASSERT_EQ(server.startListenBoxClient(socketPath), true);
+    const qint64 total = 64 * 1024 * 1024;
+    std::atomic<qint64> sent(0);
+    std::thread daemon([&]() { floodSignals(listenFd, signal, total, &sent); });
+
+    // 客户端完成认证后不再读取
+    strncpy(addr.sun_path, socketPath.toLocal8Bit().constData(), sizeof(addr.sun_path) - 1);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)), 0);
+    const char auth[] = "\0AUTH EXTERNAL 30\r\n";
+    ASSERT_EQ(::write(fd, auth, sizeof(auth) - 1), static_cast<ssize_t>(sizeof(auth) - 1));
+    QByteArray line;
+    QElapsedTimer timer;
+    timer.start();
+    char c = 0;
+    while (timer.elapsed() < 5000 && !line.endsWith("\r\n")) {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+        while (::recv(fd, &c, 1, MSG_DONTWAIT) == 1) {
+            line.append(c);
+            if (c == '\n') {
+                break;
+            }
+        }
+    }
+    ASSERT_EQ(line.startsWith("OK"), true);
+    const char begin[] = "BEGIN\r\n";
+    ASSERT_EQ(::write(fd, begin, sizeof(begin) - 1), static_cast<ssize_t>(sizeof(begin) - 1));
+
+    // 发送量远超会话上限，代理的常驻内存与缓存的数据保持有界，连接不被断开
+    const qint64 before = residentBytes();
+    while (timer.elapsed() < 30000 && sent.load() < total) {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+    }
+    daemon.join();
+    QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+    EXPECT_GE(sent.load(), total);
+    EXPECT_LT(residentBytes() - before, 16 * 1024 * 1024);
+    const DBusMemoryBudgetMetrics metrics = server.memoryMetrics();
+    EXPECT_GT(metrics.droppedBroadcasts, 0u);
+    EXPECT_LE(metrics.peakBytes, 1024 * 1024);
+    EXPECT_EQ(metrics.disconnects, 0u);
+    ::close(fd);
+    ::close(listenFd);
+}
+
+namespace {
+/*
+ * 模拟dbus-daemon，完成认证后只接收数据
+ *
+ * @param listenFd: 监听描述符
+ * @param total: 需要接收的总字节数
+ * @param received: 输出已接收的字节数
+ */
+void drainMessages(int listenFd, qint64 total, std::atomic<qint64> *received)
+{
+    pollfd item = {listenFd, POLLIN, 0};
+    if (::poll(&item, 1, 5000) <= 0) {
+        return;
+    }
+    const int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+    QByteArray auth;
+    char c = 0;
+    while (!auth.endsWith("BEGIN\r\n") && ::read(fd, &c, 1) == 1) {
+        auth.append(c);
+        if (auth.endsWith("\r\n") && auth.contains("AUTH")) {
+            const char reply[] = "OK 0123456789abcdef0123456789abcdef\r\n";
+            ::write(fd, reply, sizeof(reply) - 1);
+            auth.clear();
+        }
+    }
+    QElapsedTimer timer;
+    timer.start();
+    char buffer[64 * 1024];
+    while (received->load() < total && timer.elapsed() < 20000) {
+        item = {fd, POLLIN, 0};
+        if (::poll(&item, 1, 10) <= 0) {
+            continue;
+        }
+        const ssize_t ret = ::recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (ret <= 0) {
+            if (ret < 0 && errno == EAGAIN) {
+                continue;
+            }
+            break;
+        }
+        received->fetch_add(ret);
+    }
+    ::close(fd);
+}
+} // namespace
+
+TEST(dbusProxy, strict01)
+{
+    static int argc = 1;
+    static char name[] = "dbus-proxy-test";
+    static char *argv[] = {name, nullptr};
+    if (!QCoreApplication::instance()) {
+        new QCoreApplication(argc, argv);
+    }
+    // 4MiB的方法调用，超过会话内存上限
+    DBusMessage *msg = dbus_message_new_method_call("org.deepin.linglong.demo", "/org/deepin/linglong/demo",
+                                                    "org.deepin.linglong.demo", "Upload");
+    const QByteArray payload(4 * 1024 * 1024, 'x');
+    const char *arg = payload.constData();
+    dbus_message_append_args(msg, DBUS_TYPE_STRING, &arg, DBUS_TYPE_INVALID);
+    DBusHeaderView header;
+    QByteArray call;
+    parseMessage(msg, 1, &header, &call);
+
+    const QString daemonPath = QDir::currentPath() + "/strict_bus";
+    ::unlink(daemonPath.toLocal8Bit().constData());
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, daemonPath.toLocal8Bit().constData(), sizeof(addr.sun_path) - 1);
+    const int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ASSERT_EQ(bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)), 0);
+    ASSERT_EQ(listen(listenFd, 1), 0);
+
+    // 严格模式下大消息同样直通转发，不受会话内存上限限制
+    DbusProxy server;
+    server.saveDbusDaemonPath(daemonPath);
+    server.setStrictValidation(true);
+    server.setMemoryLimits(1024 * 1024, 64 * 1024 * 1024);
+    const QString socketPath = QDir::currentPath() + "/strict_socket";
+    ASSERT_EQ(server.startListenBoxClient(socketPath), true);
+    std::atomic<qint64> received(0);
+    std::thread daemon([&]() { drainMessages(listenFd, call.size(), &received); });
+
+    strncpy(addr.sun_path, socketPath.toLocal8Bit().constData(), sizeof(addr.sun_path) - 1);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)), 0);
+    const char auth[] = "\0AUTH EXTERNAL 30\r\n";
+    ASSERT_EQ(::write(fd, auth, sizeof(auth) - 1), static_cast<ssize_t>(sizeof(auth) - 1));
+    QByteArray line;
+    QElapsedTimer timer;
+    timer.start();
+    char c = 0;
+    while (timer.elapsed() < 5000 && !line.endsWith("\r\n")) {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+        while (::recv(fd, &c, 1, MSG_DONTWAIT) == 1) {
+            line.append(c);
+            if (c == '\n') {
+                break;
+            }
+        }
+    }
+    ASSERT_EQ(line.startsWith("OK"), true);
+    const char begin[] = "BEGIN\r\n";
+    ASSERT_EQ(::write(fd, begin, sizeof(begin) - 1), static_cast<ssize_t>(sizeof(begin) - 1));
+
+    // 客户端持续发送，代理读取速度受限于dbus-daemon方向
+    qint64 offset = 0;
+    while (timer.elapsed() < 30000 && received.load() < call.size()) {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+        if (offset < call.size()) {
+            const ssize_t ret = ::send(fd, call.constData() + offset, static_cast<size_t>(call.size() - offset),
+                                       MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (ret > 0) {
+                offset += ret;
+            }
+        }
+    }
+    daemon.join();
+    EXPECT_EQ(received.load(), static_cast<qint64>(call.size()));
+    EXPECT_EQ(server.memoryMetrics().disconnects, 0u);
+    EXPECT_EQ(server.sessionCount(), 1);
+    ::close(fd);
+    ::close(listenFd);
+}
+
+TEST(dbusProxy, permission01)
+{
+    // 权限映射按原子查找，配置文件不变时不重新加载，删除后映射清空
+    const QString cfgPath = QDir::currentPath() + "/permission_map_config";
+    QFile cfgFile(cfgPath);
+    ASSERT_EQ(cfgFile.open(QIODevice::WriteOnly | QIODevice::Truncate), true);
+    cfgFile.write("{\"screenshot\": [{\"name\": \"com.deepin.Screenshot\", \"path\": \"/com/deepin/Screenshot\", "
+                  "\"ifce\": \"com.deepin.Screenshot\"}], \"calendar\": [{\"name\": \"com.deepin.Calendar\", "
+                  "\"path\": \"/com/deepin/Calendar\", \"ifce\": \"com.deepin.Calendar\"}]}");
+    cfgFile.close();
+
+    DBusPermissionMap map;
+    EXPECT_EQ(map.reload(cfgPath), true);
+    EXPECT_EQ(map.size(), 2);
+    EXPECT_EQ(map.reload(cfgPath), false);
+    EXPECT_EQ(map.find(QLatin1String("com.deepin.Calendar"), QLatin1String("/com/deepin/Calendar"),
+                       QLatin1String("com.deepin.Calendar")),
+              QString("calendar"));
+    EXPECT_EQ(map.find(QLatin1String("com.deepin.Calendar"), QLatin1String("/com/deepin/Screenshot"),
+                       QLatin1String("com.deepin.Calendar"))
+                  .isEmpty(),
+              true);
+
+    // 修改时间变化但内容不变时映射不变，内容变化时重新建立映射
+    ASSERT_EQ(cfgFile.open(QIODevice::WriteOnly | QIODevice::Truncate), true);
+    cfgFile.write("{\"calendar\": [{\"name\": \"com.deepin.Calendar\", \"path\": \"/com/deepin/Calendar\", "
+                  "\"ifce\": \"com.deepin.Calendar\"}], \"screenshot\": [{\"name\": \"com.deepin.Screenshot\", "
+                  "\"path\": \"/com/deepin/Screenshot\", \"ifce\": \"com.deepin.Screenshot\"}]}");
+    cfgFile.setFileTime(QDateTime::currentDateTime().addSecs(10), QFileDevice::FileModificationTime);
+    cfgFile.close();
+    EXPECT_EQ(map.reload(cfgPath), false);
+    EXPECT_EQ(map.size(), 2);
+    ASSERT_EQ(cfgFile.open(QIODevice::WriteOnly | QIODevice::Truncate), true);
+    cfgFile.write("{\"calendar\": [{\"name\": \"com.deepin.Calendar\", \"path\": \"/com/deepin/Calendar\", "
+                  "\"ifce\": \"com.deepin.Calendar\"}]}");
+    cfgFile.setFileTime(QDateTime::currentDateTime().addSecs(20), QFileDevice::FileModificationTime);
+    cfgFile.close();
+    EXPECT_EQ(map.reload(cfgPath), true);
+    EXPECT_EQ(map.size(), 1);
+    EXPECT_EQ(map.find(QLatin1String("com.deepin.Screenshot"), QLatin1String("/com/deepin/Screenshot"),
+                       QLatin1String("com.deepin.Screenshot"))
+                  .isEmpty(),
+              true);
+
+    QFile::remove(cfgPath);
+    EXPECT_EQ(map.reload(cfgPath), true);
+    EXPECT_EQ(map.size(), 0);
+    EXPECT_EQ(map.reload(cfgPath), false);
+    EXPECT_EQ(map.find(QLatin1String("com.deepin.Calendar"), QLatin1String("/com/deepin/Calendar"),
+                       QLatin1String("com.deepin.Calendar"))
+                  .isEmpty(),
+              true);
+}
+
+namespace {
+// 授权结果由测试指定的代理
+class FakePermissionProxy : public DbusProxy
+{
+public:
+    using DbusProxy::reloadPermissions;
+
+    int choice = DbusProxy::Allow;
+    int requests = 0;
+
+protected:
+    int requestPermission(const QString &appId, const QString &id) override
+    {
+        Q_UNUSED(appId);
+        Q_UNUSED(id);
+        requests++;
+        return choice;
+    }
+};
+} // namespace
+
+TEST(dbusProxy, permission02)
+{
+    // 申请授权的结果不缓存，用户修改授权后下一条消息得到新的判定结果
+    qputenv("DBUS_PROXY_INTERCEPT", "1");
+    FakePermissionProxy proxy;
+    proxy.filter.addNameFilter("com.deepin.Screenshot");
+    proxy.filter.addPathFilter("/com/deepin/Screenshot");
+    proxy.filter.addInterfaceFilter("com.deepin.Screenshot");
+    DBusHeaderView header;
+    QByteArray data;
+    parseMessage(dbus_message_new_method_call("com.deepin.Screenshot", "/com/deepin/Screenshot",
+                                              "com.deepin.Screenshot", "Take"),
+                 1, &header, &data);
+    EXPECT_EQ(proxy.judgeMessage(header), DbusProxy::Allow);
+    proxy.choice = DbusProxy::Deny;
+    EXPECT_EQ(proxy.judgeMessage(header), DbusProxy::Deny);
+    proxy.choice = DbusProxy::Allow;
+    EXPECT_EQ(proxy.judgeMessage(header), DbusProxy::Allow);
+    EXPECT_EQ(proxy.requests, 3);
+
+    // 不在名单中的调用由过滤规则直接放行，结果缓存
+    parseMessage(dbus_message_new_method_call("org.deepin.linglong.demo", "/org/deepin/linglong/demo",
+                                              "org.deepin.linglong.demo", "Take"),
+                 2, &header, &data);
+    EXPECT_EQ(proxy.judgeMessage(header), DbusProxy::Allow);
+    EXPECT_EQ(proxy.judgeMessage(header), DbusProxy::Allow);
+    EXPECT_EQ(proxy.requests, 3);
+    EXPECT_EQ(proxy.verdictCacheMetrics().hits, 1u);
+    EXPECT_EQ(proxy.verdictCacheMetrics().entries, 1);
+    qunsetenv("DBUS_PROXY_INTERCEPT");
+}
+
+TEST(dbusProxy, permission03)
+{
+    // 权限配置文件由监听实例定时检查，与消息是否命中判定缓存无关，映射变化后清空判定缓存
+    const QString cfgPath = QDir::currentPath() + "/permission_proxy_config";
+    QFile cfgFile(cfgPath);
+    ASSERT_EQ(cfgFile.open(QIODevice::WriteOnly | QIODevice::Truncate), true);
+    cfgFile.write("{\"screenshot\": [{\"name\": \"com.deepin.Screenshot\", \"path\": \"/com/deepin/Screenshot\", "
+                  "\"ifce\": \"com.deepin.Screenshot\"}]}");
+    cfgFile.close();
+    FakePermissionProxy proxy;
+    proxy.setPermissionConfigPath(cfgPath);
+    proxy.reloadPermissions();
+    DBusHeaderView header;
+    QByteArray data;
+    parseMessage(dbus_message_new_method_call("org.deepin.linglong.demo", "/org/deepin/linglong/demo",
+                                              "org.deepin.linglong.demo", "Take"),
+                 1, &header, &data);
+    EXPECT_EQ(proxy.judgeMessage(header), DbusProxy::Allow);
+    EXPECT_EQ(proxy.verdictCacheMetrics().entries, 1);
+
+    // 修改时间变化但内容不变时不清空
+    ASSERT_EQ(cfgFile.open(QIODevice::ReadWrite), true);
+    cfgFile.setFileTime(QDateTime::currentDateTime().addSecs(10), QFileDevice::FileModificationTime);
+    cfgFile.close();
+    proxy.reloadPermissions();
+    EXPECT_EQ(proxy.verdictCacheMetrics().entries, 1);
+
+    ASSERT_EQ(cfgFile.open(QIODevice::WriteOnly | QIODevice::Truncate), true);
+    cfgFile.write("{\"calendar\": [{\"name\": \"com.deepin.Calendar\", \"path\": \"/com/deepin/Calendar\", "
+                  "\"ifce\": \"com.deepin.Calendar\"}]}");
+    cfgFile.setFileTime(QDateTime::currentDateTime().addSecs(20), QFileDevice::FileModificationTime);
+    cfgFile.close();
+    proxy.reloadPermissions();
+    EXPECT_EQ(proxy.verdictCacheMetrics().entries, 0);
+    EXPECT_EQ(proxy.verdictCacheMetrics().invalidations, 1u);
+    QFile::remove(cfgPath);
+}